@@ -7,9 +7,16 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/statvfs.h>
 #include <db.h>
+#include "utils/bloom.h"
+#include "utils/cancel.h"
 #include "utils/memory.h"
+#include "utils/metrics.h"
 #include "utils/path.h"
 #include "utils/print.h"
 #include "dbmgr.h"
@@ -18,8 +25,220 @@
 
 static DB *g_db = NULL;
 
+/**
+ * Space usage (see mdbfs_backend_berkeleydb_get_space) is kept for this long,
+ * so that polling it (e.g. by `df`) does not hit the database every time.
+ */
+#define MDBFS_BERKELEYDB_SPACE_TTL_MS 1000
+
+static uint32_t        g_space_page_size = 0;
+static int64_t         g_space_total_pages = 0;  ///< Pages, plus room to grow
+static int64_t         g_space_free_pages = 0;   ///< Free pages, plus room to grow
+static int             g_space_valid = 0;
+static struct timespec g_space_taken;
+static pthread_mutex_t g_space_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Memory for the Bloom filter of keys, in bytes, or 0 for none; see
+ * mdbfs_backend_berkeleydb_set_bloom_memory.
+ */
+static int64_t g_bloom_memory = 0;
+
+/**
+ * A Bloom filter of the keys, so that looking up keys which do not exist does
+ * not probe the database. It is built by a background thread from a scan of
+ * the database, kept up with records created through us, and built again once
+ * most of its keys have been removed.
+ */
+static struct mdbfs_bloom *g_bloom = NULL;
+static int                 g_bloom_ready = 0; ///< Whether every key has been added
+static int                 g_bloom_stale = 0; ///< Whether the filter is to be built (again)
+static int                 g_bloom_builder_running = 0;
+static pthread_t           g_bloom_builder;
+static pthread_mutex_t     g_bloom_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t      g_bloom_cond = PTHREAD_COND_INITIALIZER;
+
 /********** Private APIs **********/
 
+/**
+ * Count a lookup answered by the Bloom filter, and update its false positive
+ * rate: keys the filter could not rule out but which do not exist, out of all
+ * keys which do not exist.
+ *
+ * @param false_positive [in] Whether the key has been looked up in vain.
+ */
+static void bloom_count(int false_positive)
+{
+  struct mdbfs_metric *negatives = mdbfs_metric_get("berkeleydb_bloom_negatives");
+  struct mdbfs_metric *false_positives = mdbfs_metric_get("berkeleydb_bloom_false_positives");
+
+  mdbfs_metric_add(false_positive ? false_positives : negatives, 1);
+
+  int64_t fp = mdbfs_metric_value(false_positives);
+  int64_t all = fp + mdbfs_metric_value(negatives);
+  mdbfs_metric_set(mdbfs_metric_get("berkeleydb_bloom_false_positive_ppm"), all ? fp * 1000000 / all : 0);
+}
+
+/**
+ * Ask the Bloom filter whether a key may exist.
+ *
+ * @param key [in] The key.
+ * @return 0 if the key surely does not exist, 1 if it may, or -1 if there is
+ *         no filter to ask.
+ */
+static int bloom_check(const char *key)
+{
+  int ret = -1;
+
+  pthread_mutex_lock(&g_bloom_lock);
+  if (g_bloom && g_bloom_ready)
+    ret = mdbfs_bloom_may_contain(g_bloom, key, strlen(key));
+  pthread_mutex_unlock(&g_bloom_lock);
+
+  if (ret == 0)
+    bloom_count(0);
+
+  return ret;
+}
+
+/**
+ * Keep the Bloom filter up with a key created or removed through us.
+ *
+ * @param key     [in] The key.
+ * @param removed [in] Whether the key has been removed, rather than created.
+ */
+static void bloom_update(const char *key, int removed)
+{
+  pthread_mutex_lock(&g_bloom_lock);
+
+  if (g_bloom && !removed) {
+    mdbfs_bloom_add(g_bloom, key, strlen(key));
+  } else if (g_bloom) {
+    mdbfs_bloom_remove(g_bloom);
+    if (mdbfs_bloom_is_stale(g_bloom)) {
+      g_bloom_stale = 1;
+      pthread_cond_signal(&g_bloom_cond);
+    }
+  }
+
+  pthread_mutex_unlock(&g_bloom_lock);
+}
+
+/**
+ * Build the Bloom filter from a scan of the database. Runs on the Bloom filter
+ * builder.
+ */
+static void bloom_build(void)
+{
+  DBTYPE type = DB_UNKNOWN;
+  void *stat = NULL;
+  DBC *cursor = NULL;
+  DBT key = {0};
+  DBT value = {0};
+  int64_t nkeys = 0;
+  int64_t n = 0;
+  int r = 0;
+
+  /* Keys of record numbers are not stored as they are named; only B-trees
+   * and hashes get a filter
+   */
+  r = g_db->get_type(g_db, &type);
+  if (r != 0 || (type != DB_BTREE && type != DB_HASH)) {
+    mdbfs_debug("berkeleydb: bloom_build: no filter for this access method");
+    return;
+  }
+
+  /* Tune the filter for the number of keys last counted, if ever */
+  if (g_db->stat(g_db, NULL, &stat, DB_FAST_STAT) == 0)
+    nkeys = type == DB_BTREE ? ((DB_BTREE_STAT *)stat)->bt_nkeys : ((DB_HASH_STAT *)stat)->hash_nkeys;
+  free(stat);
+
+  /* The filter takes keys created from now on, while it is being filled */
+  struct mdbfs_bloom *bloom = mdbfs_bloom_new(g_bloom_memory, nkeys);
+
+  pthread_mutex_lock(&g_bloom_lock);
+  struct mdbfs_bloom *old = g_bloom;
+  g_bloom = bloom;
+  g_bloom_ready = 0;
+  pthread_mutex_unlock(&g_bloom_lock);
+
+  mdbfs_bloom_free(old);
+  mdbfs_metric_set(mdbfs_metric_get("berkeleydb_bloom_bytes"), mdbfs_bloom_size(bloom));
+
+  r = g_db->cursor(g_db, NULL, &cursor, 0);
+  if (r != 0) {
+    mdbfs_error("berkeleydb: bloom_build: %s", db_strerror(r));
+    return;
+  }
+
+  mdbfs_debug("berkeleydb: bloom_build: adding every key");
+
+  for (;;) {
+    memset(&key, 0, sizeof(DBT));
+    memset(&value, 0, sizeof(DBT));
+
+    /* Only keys are wanted; a partial get of no bytes skips the values */
+    value.flags = DB_DBT_PARTIAL;
+
+    r = cursor->get(cursor, &key, &value, DB_NEXT);
+    if (r != 0)
+      break;
+
+    pthread_mutex_lock(&g_bloom_lock);
+    mdbfs_bloom_add(bloom, key.data, key.size);
+    pthread_mutex_unlock(&g_bloom_lock);
+
+    /* Closing the database, or building again, gives up this build */
+    if (++n % 4096 == 0 && (!__atomic_load_n(&g_bloom_builder_running, __ATOMIC_RELAXED) ||
+                            __atomic_load_n(&g_bloom_stale, __ATOMIC_RELAXED)))
+      break;
+  }
+
+  cursor->close(cursor);
+
+  if (r != DB_NOTFOUND) {
+    mdbfs_debug("berkeleydb: bloom_build: given up after %lld keys", (long long)n);
+    return;
+  }
+
+  pthread_mutex_lock(&g_bloom_lock);
+  g_bloom_ready = 1;
+  pthread_mutex_unlock(&g_bloom_lock);
+
+  mdbfs_debug("berkeleydb: bloom_build: added %lld keys", (long long)n);
+}
+
+/**
+ * Body of the Bloom filter builder, a background thread building the filter
+ * whenever it is to be built.
+ */
+static void *bloom_builder(void *data)
+{
+  (void)data;
+
+  pthread_mutex_lock(&g_bloom_lock);
+
+  for (;;) {
+    while (g_bloom_builder_running && !g_bloom_stale)
+      pthread_cond_wait(&g_bloom_cond, &g_bloom_lock);
+
+    if (!g_bloom_builder_running)
+      break;
+
+    g_bloom_stale = 0;
+    pthread_mutex_unlock(&g_bloom_lock);
+
+    bloom_build();
+
+    pthread_mutex_lock(&g_bloom_lock);
+  }
+
+  pthread_mutex_unlock(&g_bloom_lock);
+  return NULL;
+}
+
+/********** Public APIs **********/
+
 int mdbfs_backend_berkeleydb_open_database_from_file(const char *path)
 {
   int r = 0;
@@ -50,6 +269,17 @@ int mdbfs_backend_berkeleydb_open_database_from_file(const char *path)
     return 0;
   }
 
+  if (g_bloom_memory > 0) {
+    pthread_mutex_lock(&g_bloom_lock);
+    g_bloom_builder_running = 1;
+    g_bloom_stale = 1;
+    if (pthread_create(&g_bloom_builder, NULL, bloom_builder, NULL) != 0) {
+      mdbfs_warning("berkeleydb: open: cannot start the Bloom filter builder; every key will be looked up");
+      g_bloom_builder_running = 0;
+    }
+    pthread_mutex_unlock(&g_bloom_lock);
+  }
+
   return 1;
 }
 
@@ -62,6 +292,23 @@ void mdbfs_backend_berkeleydb_close_database(void)
 
   mdbfs_info("closing berkeley db database");
 
+  /* Stop the Bloom filter builder, which may be using the handle */
+  pthread_mutex_lock(&g_bloom_lock);
+  int bloom_builder_running = g_bloom_builder_running;
+  g_bloom_builder_running = 0;
+  pthread_cond_signal(&g_bloom_cond);
+  pthread_mutex_unlock(&g_bloom_lock);
+
+  if (bloom_builder_running)
+    pthread_join(g_bloom_builder, NULL);
+
+  pthread_mutex_lock(&g_bloom_lock);
+  mdbfs_bloom_free(g_bloom);
+  g_bloom = NULL;
+  g_bloom_ready = 0;
+  g_bloom_stale = 0;
+  pthread_mutex_unlock(&g_bloom_lock);
+
   int r = g_db->close(g_db, 0);
   if (r != 0) {
     mdbfs_warning("berkeleydb: close: %s", db_strerror(r));
@@ -69,6 +316,7 @@ void mdbfs_backend_berkeleydb_close_database(void)
   }
 
   g_db = NULL;
+  g_space_valid = 0;
 }
 
 char *mdbfs_backend_berkeleydb_get_database_name(void)
@@ -109,6 +357,10 @@ char **mdbfs_backend_berkeleydb_get_record_keys(void)
   mdbfs_debug("iterating the whole database");
 
   for (;;) {
+    /* Give up with the request, if it is (see utils/cancel.h) */
+    if (mdbfs_cancel_check())
+      break;
+
     /* Clear DBTs */
     memset(&key, 0, sizeof(DBT));
     memset(&value, 0, sizeof(DBT));
@@ -135,6 +387,15 @@ char **mdbfs_backend_berkeleydb_get_record_keys(void)
   /* "The DBcursor->get() method will return DB_NOTFOUND if DB_NEXT is set and
    * the cursor isalready on the last record in the database."
    */
+  if (r == 0) {
+    mdbfs_debug("berkeleydb: get_record_keys: iteration given up");
+    for (int i = 0; i < ret_length; i++) {
+      mdbfs_free(ret[i]);
+    }
+    mdbfs_free(ret);
+    goto quit;
+  }
+
   if (r != DB_NOTFOUND) {
     mdbfs_error("berkeleydb: get_record_keys: error during iteration: %s", db_strerror(r));
     for (int i = 0; i < ret_length; i++) {
@@ -161,6 +422,72 @@ quit:
   return ret;
 }
 
+int mdbfs_backend_berkeleydb_walk_record_keys(mdbfs_backend_berkeleydb_key_walker walker, void *data)
+{
+  DBC *cursor = NULL;
+  DBT key = {0};
+  DBT value = {0};
+  int ret = 0;
+  int r = 0;
+
+  if (!walker) {
+    mdbfs_warning("berkeleydb: walk_record_keys: walker is missing, this is unexpected. returning");
+    return 0;
+  }
+
+  r = g_db->cursor(g_db, NULL, &cursor, 0);
+  if (r != 0) {
+    mdbfs_error("berkeleydb: walk_record_keys: %s", db_strerror(r));
+    return 0;
+  }
+
+  mdbfs_debug("berkeleydb: walking keys of the whole database");
+
+  for (;;) {
+    /* Give up with the request, if it is (see utils/cancel.h) */
+    if (mdbfs_cancel_check())
+      break;
+
+    memset(&key, 0, sizeof(DBT));
+    memset(&value, 0, sizeof(DBT));
+
+    /* Only keys are wanted; a partial get of no bytes skips the values */
+    value.flags = DB_DBT_PARTIAL;
+
+    r = cursor->get(cursor, &key, &value, DB_NEXT);
+    if (r != 0)
+      break;
+
+    if (walker(key.data, key.size, data) != 0) {
+      r = DB_NOTFOUND;
+      break;
+    }
+  }
+
+  if (r == 0) {
+    mdbfs_debug("berkeleydb: walk_record_keys: iteration given up");
+    goto quit;
+  }
+
+  if (r != DB_NOTFOUND) {
+    mdbfs_error("berkeleydb: walk_record_keys: error during iteration: %s", db_strerror(r));
+    goto quit;
+  }
+
+  ret = 1;
+
+  mdbfs_debug("berkeleydb: done walking keys of the whole database");
+
+quit:
+  r = cursor->close(cursor);
+  if (r != 0) {
+    mdbfs_warning("berkeleydb: walk_record_keys: cannot close cursor: %s", db_strerror(r));
+    mdbfs_warning("berkeleydb: walk_record_keys: *leaking memory*");
+  }
+
+  return ret;
+}
+
 uint8_t *mdbfs_backend_berkeleydb_get_record_value(size_t *value_length, const char *key)
 {
   DBT dbt_key = {0};
@@ -169,6 +496,11 @@ uint8_t *mdbfs_backend_berkeleydb_get_record_value(size_t *value_length, const c
   size_t ret_length = 0;
   int r = 0;
 
+  /* Keys ruled out by the Bloom filter are not looked up at all */
+  int maybe = bloom_check(key);
+  if (!maybe)
+    return NULL;
+
   mdbfs_debug("berkeleydb: get_record_value: querying database");
 
   /* Prepare DBTs */
@@ -183,6 +515,9 @@ uint8_t *mdbfs_backend_berkeleydb_get_record_value(size_t *value_length, const c
 
   r = g_db->get(g_db, NULL, &dbt_key, &dbt_value, 0);
   if (r != 0) {
+    if (r == DB_NOTFOUND && maybe > 0)
+      bloom_count(1);
+
     mdbfs_error("berkeleydb: get_record_value: %s", db_strerror(r));
     return NULL;
   }
@@ -196,6 +531,161 @@ uint8_t *mdbfs_backend_berkeleydb_get_record_value(size_t *value_length, const c
   return ret;
 }
 
+int64_t mdbfs_backend_berkeleydb_get_record_length(const char *key)
+{
+  DBT dbt_key = {0};
+  DBT dbt_value = {0};
+  int r = 0;
+
+  int maybe = bloom_check(key);
+  if (!maybe)
+    return -1;
+
+  mdbfs_debug("berkeleydb: get_record_length: querying database");
+
+  dbt_key.data = (void *)key;
+  dbt_key.size = strlen(key);
+  dbt_key.flags = DB_DBT_READONLY;
+
+  /* A user buffer of no room makes Berkeley DB tell the size of the record
+   * without copying it anywhere.
+   */
+  dbt_value.flags = DB_DBT_USERMEM;
+  dbt_value.ulen = 0;
+
+  r = g_db->get(g_db, NULL, &dbt_key, &dbt_value, 0);
+  if (r != 0 && r != DB_BUFFER_SMALL) {
+    if (r == DB_NOTFOUND && maybe > 0)
+      bloom_count(1);
+
+    mdbfs_debug("berkeleydb: get_record_length: %s", db_strerror(r));
+    return -1;
+  }
+
+  return dbt_value.size;
+}
+
+uint32_t mdbfs_backend_berkeleydb_get_page_size(void)
+{
+  uint32_t page_size = 0;
+
+  /* The page size is kept in the handle since open; nothing is read */
+  int r = g_db->get_pagesize(g_db, &page_size);
+  if (r != 0) {
+    mdbfs_error("berkeleydb: get_page_size: %s", db_strerror(r));
+    return 0;
+  }
+
+  return page_size;
+}
+
+const char *mdbfs_backend_berkeleydb_get_access_method(void)
+{
+  DBTYPE type = DB_UNKNOWN;
+
+  int r = g_db->get_type(g_db, &type);
+  if (r != 0) {
+    mdbfs_error("berkeleydb: get_access_method: %s", db_strerror(r));
+    return NULL;
+  }
+
+  switch (type) {
+    case DB_BTREE:
+      return "btree";
+    case DB_HASH:
+      return "hash";
+    case DB_RECNO:
+      return "recno";
+    case DB_QUEUE:
+      return "queue";
+    default:
+      return "unknown";
+  }
+}
+
+int mdbfs_backend_berkeleydb_get_space(uint32_t *page_size, int64_t *total_pages, int64_t *free_pages)
+{
+  DBTYPE type = DB_UNKNOWN;
+  void *stat = NULL;
+  struct timespec now;
+  int ret = 0;
+  int r = 0;
+
+  pthread_mutex_lock(&g_space_lock);
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  if (g_space_valid &&
+      (now.tv_sec - g_space_taken.tv_sec) * 1000 + (now.tv_nsec - g_space_taken.tv_nsec) / 1000000 < MDBFS_BERKELEYDB_SPACE_TTL_MS)
+    goto reply;
+
+  mdbfs_debug("berkeleydb: get_space: querying page statistics");
+
+  r = g_db->get_type(g_db, &type);
+  if (r != 0) {
+    mdbfs_error("berkeleydb: get_space: %s", db_strerror(r));
+    goto quit;
+  }
+
+  /* A fast stat reads the metadata page only, instead of walking the tree */
+  r = g_db->stat(g_db, NULL, &stat, DB_FAST_STAT);
+  if (r != 0) {
+    mdbfs_error("berkeleydb: get_space: %s", db_strerror(r));
+    goto quit;
+  }
+
+  switch (type) {
+    case DB_BTREE:
+    case DB_RECNO:
+      g_space_page_size   = ((DB_BTREE_STAT *)stat)->bt_pagesize;
+      g_space_total_pages = ((DB_BTREE_STAT *)stat)->bt_pagecnt;
+      g_space_free_pages  = ((DB_BTREE_STAT *)stat)->bt_free;
+      break;
+    case DB_HASH:
+      g_space_page_size   = ((DB_HASH_STAT *)stat)->hash_pagesize;
+      g_space_total_pages = ((DB_HASH_STAT *)stat)->hash_pagecnt;
+      g_space_free_pages  = ((DB_HASH_STAT *)stat)->hash_free;
+      break;
+    case DB_QUEUE:
+      g_space_page_size   = ((DB_QUEUE_STAT *)stat)->qs_pagesize;
+      g_space_total_pages = ((DB_QUEUE_STAT *)stat)->qs_pages;
+      g_space_free_pages  = ((DB_QUEUE_STAT *)stat)->qs_pgfree;
+      break;
+    default:
+      mdbfs_warning("berkeleydb: get_space: unknown access method");
+      goto quit;
+  }
+
+  /* The database grows into the file system it lives on, so what that has
+   * left counts as free too
+   */
+  const char *filename = NULL;
+  const char *dbname = NULL;
+  struct statvfs host = {0};
+
+  if (g_db->get_dbname(g_db, &filename, &dbname) == 0 && filename && g_space_page_size > 0 &&
+      statvfs(filename, &host) == 0) {
+    int64_t room = (int64_t)host.f_bavail * host.f_frsize / g_space_page_size;
+    g_space_total_pages += room;
+    g_space_free_pages  += room;
+  }
+
+  g_space_taken = now;
+  g_space_valid = 1;
+
+reply:
+  *page_size   = g_space_page_size;
+  *total_pages = g_space_total_pages;
+  *free_pages  = g_space_free_pages;
+  ret = 1;
+
+quit:
+  pthread_mutex_unlock(&g_space_lock);
+
+  /* "The statistical information is stored in memory allocated by malloc" */
+  free(stat);
+  return ret;
+}
+
 int mdbfs_backend_berkeleydb_set_record_value(const char *key, const uint8_t *value, const size_t value_length)
 {
   DBT dbt_key = {0};
@@ -218,11 +708,57 @@ int mdbfs_backend_berkeleydb_set_record_value(const char *key, const uint8_t *va
     return 0;
   }
 
+  bloom_update(key, 0);
+
   mdbfs_debug("berkeleydb: set_record_value: done setting new %s", key);
 
   return 1;
 }
 
+int64_t mdbfs_backend_berkeleydb_copy_record(const char *key_from, const char *key_to)
+{
+  DBT dbt_key_from = {0};
+  DBT dbt_key_to = {0};
+  DBT dbt_value = {0};
+  int64_t ret = -1;
+  int r = 0;
+
+  mdbfs_debug("berkeleydb: copy_record: copying %s to %s", key_from, key_to);
+
+  /* Prepare DBTs */
+  dbt_key_from.data = (void *)key_from;
+  dbt_key_from.size = strlen(key_from);
+  dbt_key_from.flags = DB_DBT_READONLY;
+
+  dbt_key_to.data = (void *)key_to;
+  dbt_key_to.size = strlen(key_to);
+  dbt_key_to.flags = DB_DBT_READONLY;
+
+  dbt_value.flags = DB_DBT_MALLOC;
+
+  r = g_db->get(g_db, NULL, &dbt_key_from, &dbt_value, 0);
+  if (r != 0) {
+    mdbfs_error("berkeleydb: copy_record: failed to get the record copied from: %s", db_strerror(r));
+    goto quit;
+  }
+
+  r = g_db->put(g_db, NULL, &dbt_key_to, &dbt_value, 0);
+  if (r != 0) {
+    mdbfs_error("berkeleydb: copy_record: failed to set the record copied to: %s", db_strerror(r));
+    goto quit;
+  }
+
+  bloom_update(key_to, 0);
+
+  ret = dbt_value.size;
+
+  mdbfs_debug("berkeleydb: copy_record: copied %lld bytes from %s to %s", (long long)ret, key_from, key_to);
+
+quit:
+  mdbfs_free(dbt_value.data);
+  return ret;
+}
+
 int mdbfs_backend_berkeleydb_rename_record(const char *key_old, const char *key_new)
 {
   DBT dbt_key_old = {0};
@@ -252,15 +788,7 @@ int mdbfs_backend_berkeleydb_rename_record(const char *key_old, const char *key_
     goto quit;
   }
 
-  /* Remove it */
-  r = g_db->del(g_db, NULL, &dbt_key_old, 0);
-  if (r != 0) {
-    mdbfs_error("berkeleydb: rename_record: failed to delete the old record: %s", db_strerror(r));
-    ret = 0;
-    goto quit;
-  }
-
-  /* Then put it back using the new key */
+  /* Put it under the new key, so that the record is not lost if this fails */
   r = g_db->put(g_db, NULL, &dbt_key_new, &dbt_value, 0);
   if (r != 0) {
     mdbfs_error("berkeleydb: rename_record: failed to set the new record: %s", db_strerror(r));
@@ -268,6 +796,20 @@ int mdbfs_backend_berkeleydb_rename_record(const char *key_old, const char *key_
     goto quit;
   }
 
+  bloom_update(key_new, 0);
+
+  /* Then remove the old one */
+  if (strcmp(key_old, key_new) != 0) {
+    r = g_db->del(g_db, NULL, &dbt_key_old, 0);
+    if (r != 0) {
+      mdbfs_error("berkeleydb: rename_record: failed to delete the old record: %s", db_strerror(r));
+      ret = 0;
+      goto quit;
+    }
+
+    bloom_update(key_old, 1);
+  }
+
   /* Done */
   ret = 1;
 
@@ -299,6 +841,8 @@ int mdbfs_backend_berkeleydb_create_record(const char *key_new)
     return 0;
   }
 
+  bloom_update(key_new, 0);
+
   mdbfs_debug("berkeleydb: create_record: created (empty) record %s", key_new);
 
   return 1;
@@ -322,7 +866,14 @@ int mdbfs_backend_berkeleydb_remove_record(const char *key)
     return 0;
   }
 
+  bloom_update(key, 1);
+
   mdbfs_debug("berkeleydb: remove_record: removed record %s", key);
 
   return 1;
 }
+
+void mdbfs_backend_berkeleydb_set_bloom_memory(int64_t size)
+{
+  g_bloom_memory = size > 0 ? size : 0;
+}
@@ -8,22 +8,42 @@
 #ifndef MDBFS_BACKENDS_BERKELEYDB_DBMGR_H
 #define MDBFS_BACKENDS_BERKELEYDB_DBMGR_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 /* TODO: Documentation */
 
+/**
+ * Callback receiving keys one by one, see
+ * mdbfs_backend_berkeleydb_walk_record_keys.
+ *
+ * @param key        [in] The key, which may not terminate with NUL.
+ * @param key_length [in] Length of the key.
+ * @param data       [in] User data given to the walk.
+ * @return 0 to continue walking, non-zero to stop.
+ */
+typedef int (*mdbfs_backend_berkeleydb_key_walker)(const char *key, size_t key_length, void *data);
+
 int mdbfs_backend_berkeleydb_open_database_from_file(const char *path);
 void mdbfs_backend_berkeleydb_close_database(void);
 
 char *mdbfs_backend_berkeleydb_get_database_name(void);
 
 char **mdbfs_backend_berkeleydb_get_record_keys(void);
+int mdbfs_backend_berkeleydb_walk_record_keys(mdbfs_backend_berkeleydb_key_walker walker, void *data);
 uint8_t *mdbfs_backend_berkeleydb_get_record_value(size_t *value_length, const char *key);
+int64_t mdbfs_backend_berkeleydb_get_record_length(const char *key);
+uint32_t mdbfs_backend_berkeleydb_get_page_size(void);
+const char *mdbfs_backend_berkeleydb_get_access_method(void);
+int mdbfs_backend_berkeleydb_get_space(uint32_t *page_size, int64_t *total_pages, int64_t *free_pages);
 
 int mdbfs_backend_berkeleydb_set_record_value(const char *key, const uint8_t *value, const size_t value_length);
+int64_t mdbfs_backend_berkeleydb_copy_record(const char *key_from, const char *key_to);
 
 int mdbfs_backend_berkeleydb_rename_record(const char *key_old, const char *key_new);
 int mdbfs_backend_berkeleydb_create_record(const char *key_new);
 int mdbfs_backend_berkeleydb_remove_record(const char *key);
 
+void mdbfs_backend_berkeleydb_set_bloom_memory(int64_t size);
+
 #endif
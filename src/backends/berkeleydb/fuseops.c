@@ -8,25 +8,116 @@
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <stdint.h>
+#include "utils/cancel.h"
 #include "utils/memory.h"
 #include "utils/path.h"
 #include "utils/print.h"
 #include "dbmgr.h"
 #include "fuseops.h"
 
+/**
+ * Extended attributes, see _getxattr.
+ */
+#define MDBFS_BERKELEYDB_XATTR_ACCESS   "user.mdbfs.access"
+#define MDBFS_BERKELEYDB_XATTR_PAGESIZE "user.mdbfs.pagesize"
+#define MDBFS_BERKELEYDB_XATTR_SIZE     "user.mdbfs.size"
+
 /********** Private APIs **********/
 
+/**
+ * Buckets per level when records are fanned out into buckets, or 0 if they are
+ * right at the root, see mdbfs_backend_berkeleydb_set_fanout.
+ */
+static int64_t g_fanout = 0;
+
+/**
+ * Hexadecimal digits in the name of a bucket.
+ */
+static int g_fanout_digits = 0;
+
+/**
+ * Tell the buckets a key is put in when records are fanned out, from a hash
+ * of the key (64-bit FNV-1a, with the finalizer of MurmurHash3, without which
+ * keys differing in their last bytes share the upper half), so that keys are
+ * spread evenly whatever they look like.
+ *
+ * @param key     [in]  The key.
+ * @param buckets [out] The two buckets.
+ */
+static void key_buckets(const char *key, uint32_t buckets[2])
+{
+  uint64_t h = 0xcbf29ce484222325ULL;
+
+  for (const unsigned char *p = (const unsigned char *)key; *p; p++) {
+    h ^= *p;
+    h *= 0x100000001b3ULL;
+  }
+
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+
+  buckets[0] = (uint32_t)(h >> 32) % g_fanout;
+  buckets[1] = (uint32_t)h % g_fanout;
+}
+
+/**
+ * Parse the name of a bucket, which has exactly as many lowercase hexadecimal
+ * digits as the names listed.
+ *
+ * @param name   [in]  The component of the path.
+ * @param bucket [out] The bucket.
+ * @return 1 if the name is such a bucket, 0 otherwise.
+ */
+static int bucket_from_string(const char *name, uint32_t *bucket)
+{
+  uint32_t value = 0;
+
+  if (strlen(name) != g_fanout_digits)
+    return 0;
+
+  for (const char *p = name; *p; p++) {
+    if (*p >= '0' && *p <= '9')
+      value = value * 16 + (*p - '0');
+    else if (*p >= 'a' && *p <= 'f')
+      value = value * 16 + (*p - 'a' + 10);
+    else
+      return 0;
+  }
+
+  if (value >= g_fanout)
+    return 0;
+
+  *bucket = value;
+  return 1;
+}
+
 /**
  * Extract record name from a legitimate path string.
  *
- * @param path [in] Path string.
- * @return The key name of record if the path is legitimate. If the path should
- *         not exist in the file system, the function will return NULL.
+ * When records are fanned out, they are two buckets down (`/B1/B2/R`), and
+ * the path of a bucket is a directory like the root.
+ *
+ * @param path     [in]  Path string.
+ * @param nbuckets [out] Number of buckets in the path, if it leads to a bucket
+ *                       (or the root) rather than a record. May be NULL, in
+ *                       which case paths of buckets are illegal.
+ * @param buckets  [out] The buckets in the path. May be NULL if `nbuckets`
+ *                       is.
+ * @return The key name of record if the path is legitimate, or an empty
+ *         string for the root and buckets. If the path should not exist in
+ *         the file system, the function will return NULL.
  */
-static char *key_from_path(const char *path)
+static char *key_from_path(const char *path, int *nbuckets, uint32_t buckets[2])
 {
   char *ret = NULL;
-  size_t ret_length = 0;
+  char *components[3] = {0};
+  size_t ncomponents = 0;
+  size_t max_components = g_fanout ? 3 : 1;
+  uint32_t path_buckets[2] = {0};
 
   if (!path) {
     mdbfs_error("berkeleydb: key_from_path: path is missing");
@@ -40,39 +131,108 @@ static char *key_from_path(const char *path)
     return NULL;
   }
 
+  if (nbuckets)
+    *nbuckets = 0;
+
   /* Special case: root */
   if (strcmp("/", normalized_path) == 0) {
     ret = mdbfs_malloc0(sizeof(char)); /* NUL */
+    mdbfs_free(normalized_path);
     return ret;
   }
 
-  /* Find the first slash and the second slash, between which should be the
-   * record key.
-   */
+  /* Cut the path into components, of which the record key is the last */
   const char *p_start = normalized_path + 1;
   const char *p_end   = p_start;
 
-  while (*p_end && *p_end != '/')
-    ++p_end;
+  for (;;) {
+    while (*p_end && *p_end != '/')
+      ++p_end;
 
-  ret_length = p_end - p_start;
-  ret = mdbfs_malloc0(ret_length + 1);
-  memcpy(ret, p_start, ret_length);
+    /* If there is still anything, the path is illegal */
+    if (ncomponents == max_components) {
+      mdbfs_warning("berkeleydb: the path \"%s\" contains more than %zu component(s), which is illegal", path, max_components);
+      goto illegal;
+    }
 
-  /* If there is still anything, the path is illegal */
-  if (*p_end) {
-    mdbfs_warning("berkeleydb: the path \"%s\" contains more than 1 component, which is illegal", path);
-    mdbfs_free(ret);
-    mdbfs_free(normalized_path);
-    return NULL;
+    size_t component_length = p_end - p_start;
+    components[ncomponents] = mdbfs_malloc0(component_length + 1);
+    memcpy(components[ncomponents], p_start, component_length);
+    ++ncomponents;
+
+    if (!*p_end)
+      break;
+
+    p_start = p_end + 1;
+    p_end = p_start;
+  }
+
+  if (g_fanout) {
+    for (size_t i = 0; i < ncomponents && i < 2; i++) {
+      if (!bucket_from_string(components[i], &path_buckets[i])) {
+        mdbfs_warning("berkeleydb: the path \"%s\" is not in a bucket of records, which is illegal", path);
+        goto illegal;
+      }
+    }
+
+    /* Buckets are directories, much like the root */
+    if (ncomponents < 3) {
+      if (!nbuckets) {
+        mdbfs_warning("berkeleydb: the path \"%s\" leads to a bucket rather than a record", path);
+        goto illegal;
+      }
+
+      *nbuckets = ncomponents;
+      memcpy(buckets, path_buckets, sizeof(path_buckets));
+      ret = mdbfs_malloc0(sizeof(char)); /* NUL */
+      goto finish;
+    }
+
+    /* Records are found in their own buckets only */
+    uint32_t key_in[2] = {0};
+    key_buckets(components[2], key_in);
+    if (key_in[0] != path_buckets[0] || key_in[1] != path_buckets[1]) {
+      mdbfs_warning("berkeleydb: the record in the path \"%s\" belongs to another bucket, which is illegal", path);
+      goto illegal;
+    }
   }
 
+  ret = components[ncomponents - 1];
+  components[ncomponents - 1] = NULL;
+
+finish:
   mdbfs_debug("berkeleydb: legitimate path %s", path);
 
+illegal:
+  for (size_t i = 0; i < 3; i++)
+    mdbfs_free(components[i]);
   mdbfs_free(normalized_path);
   return ret;
 }
 
+/**
+ * Reply an extended attribute value following getxattr(2): its length when
+ * asked for the size only, the value itself when the buffer is large enough.
+ *
+ * @param value   [in]  The value.
+ * @param buf     [out] The buffer to put the value in.
+ * @param bufsize [in]  Size of the buffer, or 0 to ask for the size.
+ * @return Length of the value, or -ERANGE if the buffer is too small.
+ */
+static int xattr_reply(const char *value, char *buf, size_t bufsize)
+{
+  size_t length = strlen(value);
+
+  if (!bufsize)
+    return length;
+
+  if (bufsize < length)
+    return -ERANGE;
+
+  memcpy(buf, value, length);
+  return length;
+}
+
 /********** FUSE APIs **********/
 
 static void *_init(struct fuse_conn_info *conn, struct fuse_config *cfg)
@@ -102,7 +262,7 @@ static int _mknod(const char *path, mode_t mode, dev_t device)
   (void)mode;
   (void)device;
 
-  key = key_from_path(path);
+  key = key_from_path(path, NULL, NULL);
   if (!key) {
     ret = -EINVAL;
     goto quit;
@@ -129,13 +289,13 @@ static int _rename(const char *path1, const char *path2, unsigned int flags)
   /* FIXME: flags should be respected */
   (void)flags;
 
-  key_old = key_from_path(path1);
+  key_old = key_from_path(path1, NULL, NULL);
   if (!key_old) {
     ret = -EINVAL;
     goto quit;
   }
 
-  key_new = key_from_path(path2);
+  key_new = key_from_path(path2, NULL, NULL);
   if (!key_new) {
     ret = -EINVAL;
     goto quit;
@@ -159,7 +319,7 @@ static int _unlink(const char *path)
   int ret = 0; /* Value to be returned by the function */
   int r = 0;   /* Value returned by other functions */
 
-  key = key_from_path(path);
+  key = key_from_path(path, NULL, NULL);
   if (!key) {
     ret = -EINVAL;
     goto quit;
@@ -182,12 +342,16 @@ static int _read(const char *path, char *buf, size_t bufsize, off_t offset, stru
   uint8_t *content = NULL;
   size_t content_size = 0;
   int ret = 0; /* Value to be returned by the function */
+  int cancelled = 0;
   int r = 0;   /* Value returned by other functions */
 
   /* XXX: Ignoring fileinfo from FUSE */
   (void)fileinfo;
 
-  key = key_from_path(path);
+  /* Reads are given up with the request (see utils/cancel.h) */
+  mdbfs_cancel_begin(fuse_interrupted);
+
+  key = key_from_path(path, NULL, NULL);
   if (!key) {
     ret = -EINVAL;
     goto quit;
@@ -216,6 +380,10 @@ static int _read(const char *path, char *buf, size_t bufsize, off_t offset, stru
   ret = copy_size;
 
 quit:
+  cancelled = mdbfs_cancel_end();
+  if (cancelled)
+    ret = -cancelled;
+
   mdbfs_free(content);
   mdbfs_free(key);
   return ret;
@@ -234,7 +402,7 @@ static int _write(const char *path, const char *buf, size_t bufsize, off_t offse
   /* XXX: Ignoring fileinfo from FUSE */
   (void)fileinfo;
 
-  key = key_from_path(path);
+  key = key_from_path(path, NULL, NULL);
   if (!key) {
     ret = -EINVAL;
     goto quit;
@@ -254,21 +422,79 @@ quit:
   return ret;
 }
 
+static ssize_t _copy_file_range(const char *path_in, struct fuse_file_info *fileinfo_in, off_t offset_in, const char *path_out, struct fuse_file_info *fileinfo_out, off_t offset_out, size_t size, int flags)
+{
+  char *key_in = NULL;
+  char *key_out = NULL;
+  ssize_t ret = 0; /* Value to be returned by the function */
+  int64_t r = 0;   /* Value returned by other functions */
+
+  /* XXX: Ignoring fileinfo from FUSE */
+  (void)fileinfo_in;
+  (void)fileinfo_out;
+  (void)flags;
+
+  /* XXX: No offset support; leave it to the kernel (see _write) */
+  if (offset_in > 0 || offset_out > 0)
+    return -EOPNOTSUPP;
+
+  key_in = key_from_path(path_in, NULL, NULL);
+  key_out = key_from_path(path_out, NULL, NULL);
+  if (!key_in || !key_out) {
+    ret = -EINVAL;
+    goto quit;
+  }
+
+  r = mdbfs_backend_berkeleydb_get_record_length(key_in);
+  if (r < 0) {
+    ret = -ENOENT;
+    goto quit;
+  }
+
+  /* Putting the record copied to is only a copy if all of it is replaced;
+   * anything else is a splice, left to the kernel as well
+   */
+  if (size < (uint64_t)r || mdbfs_backend_berkeleydb_get_record_length(key_out) > r) {
+    ret = -EOPNOTSUPP;
+    goto quit;
+  }
+
+  /* The value goes from one record to the other without leaving the process */
+  r = mdbfs_backend_berkeleydb_copy_record(key_in, key_out);
+  if (r < 0) {
+    ret = -EIO;
+    goto quit;
+  }
+
+  ret = r;
+
+quit:
+  mdbfs_free(key_in);
+  mdbfs_free(key_out);
+  return ret;
+}
+
 static int _getattr(const char *path, struct stat *stat, struct fuse_file_info *fileinfo)
 {
   char *key = NULL;
+  int nbuckets = 0;
+  uint32_t buckets[2] = {0};
   uint8_t *content = NULL;
   size_t content_size = 0;
   int ret = 0; /* Value to be returned by the function */
+  int cancelled = 0;
   int r = 0;   /* Value returned by other functions */
 
-  key = key_from_path(path);
+  /* Lookups are given up with the request */
+  mdbfs_cancel_begin(fuse_interrupted);
+
+  key = key_from_path(path, &nbuckets, buckets);
   if (!key) {
     ret = -ENOENT;
     goto quit;
   }
 
-  /* Only the root is a directory */
+  /* Only the root (and buckets) are directories */
   if (strcmp(key, "") == 0) {
 
     /* Directory file, 0755 */
@@ -301,16 +527,71 @@ static int _getattr(const char *path, struct stat *stat, struct fuse_file_info *
   }
 
 quit:
+  cancelled = mdbfs_cancel_end();
+  if (cancelled)
+    ret = -cancelled;
+
   mdbfs_free(content);
   mdbfs_free(key);
   return ret;
 }
 
+/**
+ * A listing of a bucket, see _readdir.
+ */
+struct readdir_bucket {
+  const char *path;              ///< Path to the bucket
+  uint32_t buckets[2];           ///< The bucket
+  void *buf;                     ///< The buffer to receive directory information
+  fuse_fill_dir_t filler;        ///< The function provided by FUSE to fill `buf`
+  struct fuse_file_info *fileinfo; ///< FUSE file information structure
+};
+
+/**
+ * Send a record to FUSE if it is in the bucket being listed.
+ */
+static int readdir_bucket_fill(const char *key, size_t key_length, void *data)
+{
+  struct readdir_bucket *bucket = data;
+  uint32_t key_in[2] = {0};
+
+  /* XXX: Empty keys and keys holding NUL cannot be file names */
+  if (!key_length || memchr(key, '\0', key_length))
+    return 0;
+
+  char *name = mdbfs_malloc0(key_length + 1);
+  memcpy(name, key, key_length);
+
+  key_buckets(name, key_in);
+  if (key_in[0] == bucket->buckets[0] && key_in[1] == bucket->buckets[1]) {
+    /* Construct a path to the record */
+    char *path_record = mdbfs_malloc0(strlen(bucket->path) + 1 + key_length + 1);
+    strcat(path_record, bucket->path);
+    strcat(path_record, "/");
+    strcat(path_record, name);
+
+    /* Attribution information is required */
+    struct stat attr = {0};
+    _getattr(path_record, &attr, bucket->fileinfo);
+
+    /* Send elements back to FUSE */
+    bucket->filler(bucket->buf, name, &attr, 0, 0);
+
+    mdbfs_free(path_record);
+  }
+
+  mdbfs_free(name);
+  return 0;
+}
+
 static int _readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fileinfo, enum fuse_readdir_flags flags)
 {
   char *key = NULL;
   char **record_keys = NULL;
+  int nbuckets = 0;
+  uint32_t buckets[2] = {0};
   int ret = 0; /* Value to be returned by the function */
+  int cancelled = 0;
   int r = 0;   /* Value returned by other functions */
 
   /* XXX: No offset support */
@@ -321,25 +602,63 @@ static int _readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t o
   (void)fileinfo;
   (void)flags;
 
-  key = key_from_path(path);
+  /* Listings of large databases are given up with the request */
+  mdbfs_cancel_begin(fuse_interrupted);
+
+  key = key_from_path(path, &nbuckets, buckets);
   if (!key) {
     ret = -ENOENT;
     goto quit;
   }
 
-  /* There is only one directory: root */
+  /* There is only one directory: root (and buckets) */
   if (strcmp(key, "") != 0) {
     ret = -ENOENT;
     goto quit;
   }
 
+  /* The root and the first level of buckets hold every bucket, whether it
+   * holds records or not, so they are listed without reading the database
+   */
+  if (g_fanout && nbuckets < 2) {
+    struct stat attr = {0};
+    char name[16] = {0};
+
+    attr.st_mode = S_IFDIR | S_IRUSR | S_IWUSR | S_IXUSR | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH;
+
+    for (int64_t i = 0; i < g_fanout; i++) {
+      snprintf(name, sizeof(name), "%0*x", g_fanout_digits, (unsigned)i);
+      filler(buf, name, &attr, 0, 0);
+    }
+
+    goto quit;
+  }
+
+  /* Records of a bucket are those whose keys hash into it, which takes a scan
+   * of the keys: hashes have no order to look a range up in
+   */
+  if (g_fanout) {
+    struct readdir_bucket bucket = {
+      .path     = path,
+      .buf      = buf,
+      .filler   = filler,
+      .fileinfo = fileinfo,
+    };
+    memcpy(bucket.buckets, buckets, sizeof(buckets));
+
+    r = mdbfs_backend_berkeleydb_walk_record_keys(readdir_bucket_fill, &bucket);
+    if (!r)
+      ret = -EINVAL;
+    goto quit;
+  }
+
   record_keys = mdbfs_backend_berkeleydb_get_record_keys();
   if (!record_keys) {
     ret = -EINVAL;
     goto quit;
   }
 
-  for (int i = 0; record_keys[i]; i++) {
+  for (int i = 0; record_keys[i] && !mdbfs_cancel_check(); i++) {
     /* XXX: We don't know, but empty filename should not appear, as it seems to
      * be legitimate in the database.
      */
@@ -367,13 +686,140 @@ static int _readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t o
     mdbfs_free(record_keys[i]);
   mdbfs_free(record_keys);
 
+quit:
+  cancelled = mdbfs_cancel_end();
+  if (cancelled)
+    ret = -cancelled;
+
+  mdbfs_free(key);
+  return ret;
+}
+
+/**
+ * Retrieve an extended attribute.
+ *
+ * The root (and buckets, when records are fanned out) has
+ * `user.mdbfs.access`, the access method of the database (e.g.
+ * `btree` or `hash`). Records have `user.mdbfs.size`, the size of the record,
+ * told without copying it. Both have `user.mdbfs.pagesize`, the page size of
+ * the database.
+ */
+static int _getxattr(const char *path, const char *name, char *buf, size_t bufsize)
+{
+  char *key = NULL;
+  int nbuckets = 0;
+  uint32_t buckets[2] = {0};
+  char value[32] = {0};
+  int ret = -ENODATA; /* Value to be returned by the function */
+
+  key = key_from_path(path, &nbuckets, buckets);
+  if (!key) {
+    ret = -ENOENT;
+    goto quit;
+  }
+
+  int is_root = strcmp(key, "") == 0;
+
+  if (strcmp(name, MDBFS_BERKELEYDB_XATTR_PAGESIZE) == 0) {
+    snprintf(value, sizeof(value), "%u", mdbfs_backend_berkeleydb_get_page_size());
+  } else if (is_root && strcmp(name, MDBFS_BERKELEYDB_XATTR_ACCESS) == 0) {
+    const char *access = mdbfs_backend_berkeleydb_get_access_method();
+    if (!access)
+      goto quit;
+    snprintf(value, sizeof(value), "%s", access);
+  } else if (!is_root && strcmp(name, MDBFS_BERKELEYDB_XATTR_SIZE) == 0) {
+    int64_t size = mdbfs_backend_berkeleydb_get_record_length(key);
+    if (size < 0) {
+      ret = -ENOENT;
+      goto quit;
+    }
+    snprintf(value, sizeof(value), "%lld", (long long)size);
+  } else {
+    goto quit;
+  }
+
+  ret = xattr_reply(value, buf, bufsize);
+
+quit:
+  mdbfs_free(key);
+  return ret;
+}
+
+static int _listxattr(const char *path, char *buf, size_t bufsize)
+{
+  /* NUL-separated, the NUL at the end included */
+  static const char root_names[]   = MDBFS_BERKELEYDB_XATTR_ACCESS "\0" MDBFS_BERKELEYDB_XATTR_PAGESIZE;
+  static const char record_names[] = MDBFS_BERKELEYDB_XATTR_SIZE "\0" MDBFS_BERKELEYDB_XATTR_PAGESIZE;
+  char *key = NULL;
+  int nbuckets = 0;
+  uint32_t buckets[2] = {0};
+  int ret = 0; /* Value to be returned by the function */
+
+  key = key_from_path(path, &nbuckets, buckets);
+  if (!key) {
+    ret = -ENOENT;
+    goto quit;
+  }
+
+  const char *names   = strcmp(key, "") == 0 ? root_names : record_names;
+  size_t names_length = strcmp(key, "") == 0 ? sizeof(root_names) : sizeof(record_names);
+
+  if (bufsize && bufsize < names_length) {
+    ret = -ERANGE;
+    goto quit;
+  }
+
+  if (bufsize)
+    memcpy(buf, names, names_length);
+
+  ret = names_length;
+
 quit:
   mdbfs_free(key);
   return ret;
 }
 
+/**
+ * Retrieve file system statistics, in database pages: the pages the database
+ * has, and the free ones, plus what the file system holding the database has
+ * left to both.
+ */
+static int _statfs(const char *path, struct statvfs *stat)
+{
+  uint32_t page_size  = 0;
+  int64_t total_pages = 0;
+  int64_t free_pages  = 0;
+
+  (void)path;
+
+  if (!mdbfs_backend_berkeleydb_get_space(&page_size, &total_pages, &free_pages))
+    return -EIO;
+
+  memset(stat, 0, sizeof(struct statvfs));
+  stat->f_bsize   = page_size;
+  stat->f_frsize  = page_size;
+  stat->f_blocks  = total_pages;
+  stat->f_bfree   = free_pages;
+  stat->f_bavail  = free_pages;
+  stat->f_namemax = 255;
+
+  return 0;
+}
+
 /********** Public APIs **********/
 
+void mdbfs_backend_berkeleydb_set_fanout(int64_t fanout)
+{
+  g_fanout = fanout;
+
+  /* Buckets are named in as many hexadecimal digits as the last one takes */
+  g_fanout_digits = 0;
+  for (int64_t last = fanout - 1; last > 0; last >>= 4)
+    g_fanout_digits += 1;
+  if (fanout && !g_fanout_digits)
+    g_fanout_digits = 1;
+}
+
 struct mdbfs_backend_berkeleydb_operations mdbfs_backend_berkeleydb_get_operations(void)
 {
   return (struct mdbfs_backend_berkeleydb_operations) {
@@ -386,8 +832,12 @@ struct mdbfs_backend_berkeleydb_operations mdbfs_backend_berkeleydb_get_operatio
 
     .read     = _read,
     .write    = _write,
+    .copy_file_range = _copy_file_range,
     .readdir  = _readdir,
 
-    .getattr  = _getattr,
+    .getattr   = _getattr,
+    .getxattr  = _getxattr,
+    .listxattr = _listxattr,
+    .statfs    = _statfs,
   };
 }
@@ -17,6 +17,38 @@
  *
  * There are only files, no directories, since Berkeley DB is a key-value
  * database.
+ *
+ * The access method and page size of the database, and the size of each
+ * record, are told as extended attributes (`getfattr -d`).
+ *
+ * Copying a record over another no longer than it with copy_file_range(2) (as
+ * `cp` does) copies the value within the process, instead of through the
+ * kernel and back; other ranges are left to the kernel.
+ *
+ * Listings, lookups and reads are given up with `EINTR` when interrupted, and
+ * with `ETIMEDOUT` once they run for longer than `--op-timeout` allows.
+ *
+ * With `--bloom-memory`, a Bloom filter of the keys is built in the background
+ * after mounting, so that looking up keys which do not exist does not probe
+ * the database. Its false positive rate is told in
+ * `berkeleydb_bloom_false_positive_ppm`.
+ *
+ * ## Fan-out
+ *
+ * A directory of millions of records is more than `ls`, shell globs and many
+ * other tools can cope with. With `--fanout=N`, records are put two buckets
+ * down instead:
+ *
+ * ```
+ * /B1/B2/R
+ * ```
+ *
+ * where `B1` and `B2` are picked by a hash of the key from N buckets each,
+ * named in hexadecimal (e.g. `/3f/a0/R` with 256), so that keys spread evenly
+ * whatever they look like. The two levels of buckets are listed without
+ * reading the database, and a path still leads to its record in one lookup;
+ * listing the records of a bucket takes a scan of the keys (not the values),
+ * since hashed keys have no range to look up.
  */
 
 #ifndef MDBFS_BACKENDS_BERKELEYDB_FUSEOPS_H
@@ -41,10 +73,14 @@ struct mdbfs_backend_berkeleydb_operations {
   /* I/O */
   int (*read)    (const char *, char *, size_t, off_t, struct fuse_file_info *);
   int (*write)   (const char *, const char *, size_t, off_t, struct fuse_file_info *);
+  ssize_t (*copy_file_range)(const char *, struct fuse_file_info *, off_t, const char *, struct fuse_file_info *, off_t, size_t, int);
   int (*readdir) (const char *, void *, fuse_fill_dir_t, off_t, struct fuse_file_info *, enum fuse_readdir_flags);
 
   /* Metadata */
-  int (*getattr) (const char *, struct stat *, struct fuse_file_info *);
+  int (*getattr)  (const char *, struct stat *, struct fuse_file_info *);
+  int (*getxattr) (const char *, const char *, char *, size_t);
+  int (*listxattr)(const char *, char *, size_t);
+  int (*statfs)   (const char *, struct statvfs *);
 };
 
 /**
@@ -56,4 +92,12 @@ struct mdbfs_backend_berkeleydb_operations {
  */
 struct mdbfs_backend_berkeleydb_operations mdbfs_backend_berkeleydb_get_operations(void);
 
+/**
+ * Fan records out into buckets (see "Fan-out" above).
+ *
+ * @param fanout [in] Buckets per level, at least 2, or 0 to keep records right
+ *                    at the root.
+ */
+void mdbfs_backend_berkeleydb_set_fanout(int64_t fanout);
+
 #endif
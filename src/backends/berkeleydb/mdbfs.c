@@ -6,7 +6,9 @@
  */
 
 #include <db.h>
+#include "utils/cancel.h"
 #include "utils/memory.h"
+#include "utils/options.h"
 #include "utils/print.h"
 #include "backend.h"
 #include "dbmgr.h"
@@ -16,7 +18,13 @@
 
 static const char const *mdbfs_backend_name = "berkeleydb";
 static const char const *mdbfs_backend_description = "backend for reading Berkeley DB files";
-static const char const *mdbfs_backend_help = NULL;
+static const char const *mdbfs_backend_help =
+  "    --op-timeout=<ms>     Give up lookups, listings and reads running for\n"
+  "                          longer, with ETIMEDOUT (default: 0, no limit).\n"
+  "    --bloom-memory=<MiB>  Memory for a Bloom filter telling keys that do not\n"
+  "                          exist without a lookup (default: 0, none).\n"
+  "    --fanout=<n>          Put records in two levels of n buckets by a hash\n"
+  "                          of their keys, as /B1/B2/R (default: 0, none).";
 static const char const *mdbfs_backend_version = "0.1.0\n  with " DB_VERSION_STRING;
 
 static const char *mdbfs_backend_berkeleydb_get_name(void)
@@ -41,10 +49,26 @@ static const char *mdbfs_backend_berkeleydb_get_version(void)
 
 static int mdbfs_backend_berkeleydb_init(int argc, char **argv)
 {
-  (void)argc;
-  (void)argv;
-
-  /* No-op */
+  int64_t op_timeout = mdbfs_option_get_int(argc, argv, "op-timeout", 0);
+  if (op_timeout < 0) {
+    mdbfs_error("berkeleydb: --op-timeout takes a number of milliseconds");
+    return 0;
+  }
+  mdbfs_cancel_set_timeout(op_timeout);
+
+  int64_t bloom_memory = mdbfs_option_get_int(argc, argv, "bloom-memory", 0);
+  if (bloom_memory < 0) {
+    mdbfs_error("berkeleydb: --bloom-memory takes a number of MiB");
+    return 0;
+  }
+  mdbfs_backend_berkeleydb_set_bloom_memory(bloom_memory * 1024 * 1024);
+
+  int64_t fanout = mdbfs_option_get_int(argc, argv, "fanout", 0);
+  if (fanout < 0 || fanout == 1 || fanout > 65536) {
+    mdbfs_error("berkeleydb: --fanout takes a number of buckets per level, from 2 to 65536");
+    return 0;
+  }
+  mdbfs_backend_berkeleydb_set_fanout(fanout);
 
   return 1;
 }
@@ -74,13 +98,13 @@ static struct fuse_operations mdbfs_backend_berkeleydb_get_fuse_operations(void)
     .open            = NULL,
     .read            = ops.read,
     .write           = ops.write,
-    .statfs          = NULL,
+    .statfs          = ops.statfs,
     .flush           = NULL,
     .release         = NULL,
     .fsync           = NULL,
     .setxattr        = NULL,
-    .getxattr        = NULL,
-    .listxattr       = NULL,
+    .getxattr        = ops.getxattr,
+    .listxattr       = ops.listxattr,
     .removexattr     = NULL,
     .opendir         = NULL,
     .readdir         = ops.readdir,
@@ -99,7 +123,7 @@ static struct fuse_operations mdbfs_backend_berkeleydb_get_fuse_operations(void)
     .read_buf        = NULL,
     .flock           = NULL,
     .fallocate       = NULL,
-    .copy_file_range = NULL,
+    .copy_file_range = ops.copy_file_range,
   };
 }
 
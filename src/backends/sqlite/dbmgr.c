@@ -6,50 +6,675 @@
  */
 
 #include <stdio.h>
+#include <ctype.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
 #include <sqlite3.h>
+#include "utils/bloom.h"
+#include "utils/cancel.h"
+#include "utils/format.h"
 #include "utils/memory.h"
+#include "utils/metrics.h"
 #include "utils/path.h"
 #include "utils/print.h"
 #include "dbmgr.h"
 
 /********** Private SQL Statement Strings **********/
 
-static const char const *sql_str_get_tables =
-  "SELECT \"name\" FROM \"sqlite_master\" WHERE \"type\" = \"table\"";
+static const char const *sql_fmt_get_tables =
+  "SELECT \"name\" FROM \"%s\".\"sqlite_master\" WHERE \"type\" IN ('table', 'view')";
+
+static const char const *sql_fmt_get_table_type =
+  "SELECT \"type\" FROM %s WHERE \"name\" = ?1 AND \"type\" IN ('table', 'view')";
+
+static const char const *sql_str_is_view =
+  "SELECT 1 FROM \"sqlite_temp_master\" WHERE \"type\" = 'view' AND \"name\" = ?1 "
+  "UNION ALL "
+  "SELECT 1 FROM \"sqlite_master\" WHERE \"type\" = 'view' AND \"name\" = ?1";
+
+static const char const *sql_fmt_is_view_in =
+  "SELECT 1 FROM %s WHERE \"type\" = 'view' AND \"name\" = ?1";
+
+static const char const *sql_fmt_select_all_from_view_at =
+  "SELECT * FROM %s LIMIT 1 OFFSET %lld";
+
+static const char const *sql_fmt_select_from_view_at =
+  "SELECT \"%s\" FROM %s LIMIT 1 OFFSET %lld";
+
+static const char const *sql_fmt_select_from_view_from =
+  "SELECT 1 FROM %s LIMIT -1 OFFSET %lld";
+
+static const char const *sql_fmt_create_temp_view =
+  "CREATE TEMP VIEW \"%s\" AS %s";
+
+static const char const *sql_fmt_drop_temp_view =
+  "DROP VIEW IF EXISTS \"temp\".\"%s\"";
 
 static const char const *sql_fmt_select_from =
-  "SELECT \"%s\" FROM \"%s\"";
+  "SELECT \"%s\" FROM %s";
 
 static const char const *sql_fmt_select_all_from_where =
-  "SELECT * FROM \"%s\" WHERE \"%s\" = \"%s\"";
+  "SELECT * FROM %s WHERE \"%s\" = \"%s\"";
 
 static const char const *sql_fmt_select_from_where =
-  "SELECT \"%s\" FROM \"%s\" WHERE \"%s\" = \"%s\"";
+  "SELECT \"%s\" FROM %s WHERE \"%s\" = \"%s\"";
 
 static const char const *sql_fmt_alter_table_add_column =
-  "ALTER TABLE \"%s\" ADD COLUMN \"%s\"";
+  "ALTER TABLE %s ADD COLUMN \"%s\"";
 
 static const char const *sql_fmt_alter_table_rename_to =
-  "ALTER TABLE \"%s\" RENAME TO \"%s\"";
+  "ALTER TABLE %s RENAME TO \"%s\"";
 
 static const char const *sql_fmt_alter_table_rename_column_to =
-  "ALTER TABLE \"%s\" RENAME COLUMN \"%s\" TO \"%s\"";
+  "ALTER TABLE %s RENAME COLUMN \"%s\" TO \"%s\"";
 
-static const char const *sql_fmt_update_set_where =
-  "UPDATE \"%s\" SET \"%s\" = \"%s\" WHERE \"%s\" = \"%s\"";
+static const char const *sql_fmt_update_cell_bytes =
+  "UPDATE %s SET \"%s\" = CASE WHEN %s THEN CAST(%s AS BLOB) ELSE CAST(%s AS TEXT) END WHERE ROWID = ?1";
 
 static const char const *sql_fmt_drop_table =
-  "DROP TABLE \"%s\"";
+  "DROP TABLE %s";
 
 static const char const *sql_fmt_delete_from_where =
-  "DELETE FROM \"%s\" WHERE \"%s\" = \"%s\"";
+  "DELETE FROM %s WHERE \"%s\" = \"%s\"";
+
+static const char const *sql_str_get_index_list =
+  "SELECT * FROM pragma_index_list(?1, ?2)";
+
+static const char const *sql_str_get_index_info =
+  "SELECT * FROM pragma_index_info(?1, ?2)";
+
+static const char const *sql_fmt_select_distinct_from =
+  "SELECT DISTINCT \"%s\" FROM %s WHERE \"%s\" IS NOT NULL";
+
+static const char const *sql_fmt_select_rowid_from_where_bind =
+  "SELECT ROWID FROM %s WHERE \"%s\" = ?1";
+
+static const char const *sql_fmt_insert_into =
+  "INSERT INTO %s (%s) VALUES (%s)";
+
+static const char const *sql_fmt_insert_rowid_into =
+  "INSERT INTO %s (ROWID) VALUES (?1)";
+
+static const char const *sql_fmt_create_table =
+  "CREATE TABLE %s (%s)";
+
+static const char const *sql_fmt_alter_table_drop_column =
+  "ALTER TABLE %s DROP COLUMN \"%s\"";
+
+static const char const *sql_str_get_table_info =
+  "SELECT * FROM pragma_table_info(?1, ?2)";
+
+static const char const *sql_str_get_index_sqls =
+  "SELECT name, sql FROM sqlite_master WHERE type = 'index' AND tbl_name = ?1 AND sql IS NOT NULL";
+
+static const char const *sql_str_get_table_sql =
+  "SELECT sql FROM sqlite_master WHERE type = 'table' AND name = ?1";
+
+static const char const *sql_str_get_other_sqls =
+  "SELECT type, name, sql FROM sqlite_master WHERE tbl_name <> ?1 AND sql IS NOT NULL "
+  "UNION ALL SELECT type, name, sql FROM sqlite_temp_master WHERE sql IS NOT NULL";
+
+static const char const *sql_str_get_trigger_sqls =
+  "SELECT name, sql FROM sqlite_master WHERE type = 'trigger' AND tbl_name = ?1 AND sql IS NOT NULL";
+
+static const char const *sql_str_delete_sequence =
+  "DELETE FROM sqlite_sequence WHERE name = ?2";
+
+static const char const *sql_str_copy_sequence =
+  "INSERT INTO sqlite_sequence (name, seq) SELECT ?2, seq FROM sqlite_sequence WHERE name = ?1";
+
+static const char const *sql_fmt_count_from =
+  "SELECT count(*) FROM %s";
+
+static const char const *sql_fmt_select_max_rowid_from =
+  "SELECT max(ROWID) FROM %s";
+
+static const char const *sql_fmt_select_rowid_range_from =
+  "SELECT min(ROWID), max(ROWID) FROM %s";
+
+static const char const *sql_fmt_select_rowid_all_from_between =
+  "SELECT ROWID, * FROM %s WHERE ROWID BETWEEN ?1 AND ?2 ORDER BY ROWID LIMIT ?3";
+
+static const char const *sql_fmt_insert_into_select_batch =
+  "INSERT INTO %s (ROWID, %s) SELECT ROWID, %s FROM %s WHERE ROWID >= ?1 ORDER BY ROWID LIMIT ?2";
+
+static const char const *sql_str_get_versions =
+  "SELECT \"schema_version\", \"data_version\" FROM pragma_schema_version(), pragma_data_version()";
+
+static const char const *sql_fmt_pragma_of =
+  "PRAGMA \"%s\".%s";
+
+static const char const *sql_fmt_attach =
+  "ATTACH DATABASE ?1 AS \"%s\"";
+
+static const char const *sql_fmt_detach =
+  "DETACH DATABASE \"%s\"";
+
+static const char const *sql_fmt_get_stat1_rows =
+  "SELECT \"stat\" FROM %s WHERE \"tbl\" = ?1 ORDER BY \"idx\" IS NOT NULL LIMIT 1";
+
+static const char const *sql_fmt_select_rowid_from_where_rowid_between =
+  "SELECT ROWID%s FROM %s WHERE ROWID BETWEEN ?1 AND ?2 ORDER BY ROWID";
+
+static const char const *sql_fmt_cell_length =
+  ", CASE typeof(\"%s\") WHEN 'real' THEN \"%s\" ELSE length(CAST(\"%s\" AS BLOB)) END";
+
+static const char const *sql_fmt_select_rowid_all_from_after =
+  "SELECT ROWID, * FROM %s WHERE ROWID > ?1 ORDER BY ROWID LIMIT ?2";
+
+static const char const *sql_fmt_select_rowid_all_from_since =
+  "SELECT ROWID, * FROM %s WHERE ROWID >= ?1 ORDER BY ROWID LIMIT ?2";
+
+static const char const *sql_fmt_select_null_all_from_offset =
+  "SELECT NULL, * FROM %s LIMIT ?2 OFFSET ?1";
+
+static const char const *sql_fmt_update_rowid =
+  "UPDATE %s SET ROWID = ?2 WHERE ROWID = ?1";
+
+static const char const *sql_fmt_update_set_select =
+  "UPDATE %s SET \"%s\" = (SELECT %s FROM %s WHERE ROWID = ?1) WHERE ROWID = ?2";
+
+static const char const *sql_fmt_insert_into_select_rowid =
+  "INSERT INTO %s (ROWID%s) SELECT ?2%s FROM %s WHERE ROWID = ?1";
+
+static const char const *sql_fmt_delete_rowid =
+  "DELETE FROM %s WHERE ROWID = ?1";
+
+static const char const *sql_str_savepoint_move =
+  "SAVEPOINT mdbfs_move";
+
+static const char const *sql_str_release_move =
+  "RELEASE mdbfs_move";
+
+static const char const *sql_str_rollback_move =
+  "ROLLBACK TO mdbfs_move; RELEASE mdbfs_move";
+
+static const char const *sql_fmt_cell_bytes =
+  "CAST(coalesce(\"%s\", '') AS BLOB)";
+
+static const char const *sql_fmt_cell_resized =
+  "coalesce(substr(%s, 1, ?2), '') || zeroblob(max(?2 - length(%s), 0))";
+
+static const char const *sql_fmt_cell_spliced =
+  "coalesce(substr(%s, 1, ?2), '') || zeroblob(max(?2 - length(%s), 0)) || ?3 || coalesce(substr(%s, ?2 + length(?3) + 1), '')";
+
+static const char const *sql_fmt_cell_resized_is_blob =
+  "typeof(\"%s\") = 'blob' OR (\"%s\" IS NULL AND ?2 > 0)";
+
+static const char const *sql_fmt_cell_spliced_is_blob =
+  "typeof(\"%s\") = 'blob'";
+
+static const char const *sql_str_begin =
+  "BEGIN";
+
+static const char const *sql_str_commit =
+  "COMMIT";
+
+static const char const *sql_str_rollback =
+  "ROLLBACK";
 
 /********** Private States **********/
 
 static sqlite3 *g_db = NULL;
 
+/**
+ * Databases open in a directory of databases at once at most, unless set by
+ * mdbfs_backend_sqlite_set_database_dir...
+ */
+#define MDBFS_SQLITE_DEFAULT_OPEN_DATABASES 8
+
+/**
+ * ... and how long a request waits for one of them to be closed, when all of
+ * them are in use, before giving up.
+ */
+#define MDBFS_SQLITE_DATABASE_WAIT_MS 1000
+
+/**
+ * Databases attached to `g_db` (see mdbfs_backend_sqlite_set_databases): their
+ * schema names, by which their tables are named `D/T`, and their paths. Both
+ * are NULL-terminated, and NULL if a database is opened on its own. They share
+ * the connection and its caches; queries name their tables as `"D"."T"`.
+ *
+ * In a directory of databases (see mdbfs_backend_sqlite_set_database_dir),
+ * these are the ones attached at the moment: files are attached as they are
+ * used, and those used least recently are detached to make room. Databases
+ * in use by a request, or still read by a statement (e.g. of an export), are
+ * pinned, and stay attached until it is done. Attaching or detaching one
+ * commits created rows and drops every cache. Queries can only name databases
+ * attached at the moment.
+ */
+static char          **g_databases = NULL;
+static char          **g_database_paths = NULL;
+static int            *g_database_pins = NULL;     ///< Requests using each of `g_databases`
+static uint64_t       *g_database_used = NULL;     ///< Tick of the last use of each
+static uint64_t        g_databases_tick = 0;
+static int64_t         g_databases_generation = 0; ///< Moves whenever one is attached or detached
+static char           *g_database_dir = NULL;      ///< Directory of databases, if any
+static size_t          g_databases_max = 0;        ///< Databases attached at once at most
+static pthread_mutex_t g_databases_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  g_databases_cond = PTHREAD_COND_INITIALIZER;
+
+/**
+ * A query written into `/.query`, backed by a temporary view of the same name.
+ */
+struct query {
+  char  *name;       ///< Name of the query (and its view)
+  char  *sql;        ///< The SELECT statement as written, not NUL-terminated
+  size_t sql_length; ///< Length of `sql`
+  int    defined;    ///< Whether the view has been defined from `sql`
+  struct query *next;
+};
+
+static struct query   *g_queries = NULL;
+static pthread_mutex_t g_queries_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Columns of tables created by mdbfs_backend_sqlite_create_table, unless set
+ * by mdbfs_backend_sqlite_set_table_template.
+ */
+#define MDBFS_SQLITE_DEFAULT_TABLE_TEMPLATE "id INTEGER PRIMARY KEY"
+
+static char *g_table_template = NULL;
+
+/**
+ * Virtual machine instructions between checks of whether the statement is to
+ * be given up, see progress.
+ */
+#define MDBFS_SQLITE_PROGRESS_STEPS 10000
+
+/**
+ * Rows copied in one step while rebuilding a table to drop a column.
+ */
+#define MDBFS_SQLITE_REBUILD_BATCH_ROWS 10000
+
+/**
+ * A batch of rows is committed once no row has been created for this long...
+ */
+#define MDBFS_SQLITE_BATCH_IDLE_MS 20
+
+/**
+ * ... or once it has been open for this long...
+ */
+#define MDBFS_SQLITE_BATCH_MAX_MS 1000
+
+/**
+ * ... or once it has this many rows, whichever comes first.
+ */
+#define MDBFS_SQLITE_BATCH_MAX_ROWS 10000
+
+/**
+ * A batch which cannot be committed as the database is busy is tried this
+ * many times in a row, before it is left open to be tried again later.
+ */
+#define MDBFS_SQLITE_BATCH_COMMIT_ATTEMPTS 5
+
+/**
+ * Statements wait this long for other connections to the database (e.g. of
+ * other processes) to let go of their locks, instead of failing at once.
+ */
+#define MDBFS_SQLITE_BUSY_MS 1000
+
+/**
+ * Who owns the transaction open on the connection, if any.
+ */
+enum transaction {
+  TRANSACTION_NONE = 0, ///< Statements are committed one by one
+  TRANSACTION_BATCH,    ///< Created rows, committed by the flusher
+  TRANSACTION_EXPLICIT, ///< Opened by mdbfs_backend_sqlite_begin
+};
+
+/**
+ * Rows created one by one (see mdbfs_backend_sqlite_create_row) are inserted
+ * in a shared transaction, which a background thread commits once creation
+ * pauses, so that creating many rows in a row does not pay a commit each.
+ */
+static enum transaction g_transaction = TRANSACTION_NONE;
+static int64_t          g_batch_rows = 0;
+static struct timespec  g_batch_opened;
+static struct timespec  g_batch_touched;
+static sqlite3_stmt    *g_batch_stmt = NULL;   ///< INSERT reused across rows
+static char            *g_batch_table = NULL;  ///< Table `g_batch_stmt` inserts into
+static int              g_flusher_running = 0;
+static pthread_t        g_flusher;
+static pthread_mutex_t  g_batch_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t   g_batch_cond = PTHREAD_COND_INITIALIZER;
+
+/**
+ * Transactions are connection-wide, so other writes are kept out of those
+ * opened by mdbfs_backend_sqlite_begin (e.g. imports): they wait for it to
+ * end, and it waits for those under way to finish (see write_begin). Guarded
+ * by `g_batch_lock`.
+ */
+static int64_t          g_writers = 0;          ///< Writes under way
+static int64_t          g_explicit_waiting = 0; ///< Callers of begin waiting for them
+static pthread_cond_t   g_write_cond = PTHREAD_COND_INITIALIZER;
+
+/**
+ * A transaction opened by mdbfs_backend_sqlite_begin may be paused between
+ * pieces of work (see mdbfs_backend_sqlite_pause), in which case the flusher
+ * commits it once it has been paused for MDBFS_SQLITE_BATCH_IDLE_MS, so that
+ * other writes do not wait on an idle one. Guarded by `g_batch_lock`.
+ */
+static int              g_explicit_paused = 0;
+static int              g_explicit_lost = 0;    ///< Whether the flusher failed to commit it
+static struct timespec  g_explicit_touched;
+
+/**
+ * Schema and statistics of a table, kept until the schema changes (or, for
+ * the row estimate, until the data changes), so that metadata is told without
+ * touching the table itself.
+ */
+struct schema {
+  char    *table_name;
+  char   **col_names;      ///< NULL-terminated
+  char   **col_decltypes;  ///< Declared type of each of `col_names`, maybe ""
+  int64_t  row_estimate;   ///< -1 if unknown
+  int      row_estimated;  ///< Whether `row_estimate` has been taken
+  int64_t  data_version;   ///< `PRAGMA data_version` at the estimate
+  int64_t  changes;        ///< sqlite3_total_changes at the estimate
+  enum mdbfs_backend_sqlite_table_type table_type; ///< See mdbfs_backend_sqlite_get_table_type
+  int      table_typed;    ///< Whether `table_type` has been taken
+  struct schema *next;
+};
+
+/**
+ * Space usage (see mdbfs_backend_sqlite_get_space) is kept for this long, so
+ * that polling it (e.g. by `df`) does not hit the database every time.
+ */
+#define MDBFS_SQLITE_SPACE_TTL_MS 1000
+
+static int64_t         g_space_page_size = 0;
+static int64_t         g_space_total_pages = 0;  ///< Pages, plus room to grow
+static int64_t         g_space_free_pages = 0;   ///< Free list, plus room to grow
+static int             g_space_valid = 0;
+static struct timespec g_space_taken;
+static pthread_mutex_t g_space_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Rows kept whole in the row cache (see row_cache_read)...
+ */
+#define MDBFS_SQLITE_ROW_CACHE_ROWS 64
+
+/**
+ * ... unless they take more than this many bytes.
+ */
+#define MDBFS_SQLITE_ROW_CACHE_MAX_BYTES (1024 * 1024)
+
+/**
+ * A row fetched whole, with every cell rendered, so that reading (or getting
+ * attributes of) every cell in a row takes one query instead of one per cell.
+ */
+struct cached_row {
+  char     *table_name;
+  char     *row_name;
+  int64_t   rowid;       ///< ROWID of the row, for rows of tables
+  int       is_view;     ///< Rows of views change with any table
+  size_t    ncols;
+  char    **col_names;
+  enum mdbfs_backend_sqlite_cell_type *col_types;
+  size_t   *col_offsets; ///< Where each cell starts in `data`
+  size_t   *col_lengths;
+  uint8_t  *data;        ///< Every cell, rendered, one after another
+  size_t    size;        ///< Bytes in `data`
+  int64_t   data_version; ///< `PRAGMA data_version` before the fetch, see rows_data_version
+  uint64_t  used;        ///< Tick of the last use, to evict the least recent
+  int       prefetched;  ///< Loaded ahead of a walk, and not visited yet
+};
+
+static struct cached_row *g_rows[MDBFS_SQLITE_ROW_CACHE_ROWS] = {NULL};
+static uint64_t           g_rows_tick = 0;
+static uint64_t           g_rows_generation = 0; ///< Moves on every invalidation
+static pthread_mutex_t    g_rows_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Rows whose cell lengths are worked out in one query, see
+ * mdbfs_backend_sqlite_prefetch_attrs...
+ */
+#define MDBFS_SQLITE_ATTR_BATCH_ROWS 1000
+
+/**
+ * ... up to this many cells in all.
+ */
+#define MDBFS_SQLITE_ATTR_MAX_CELLS (4 * 1024 * 1024)
+
+/**
+ * Lengths of every cell in a row of the table last listed, so that stat'ing
+ * what has been listed does not take a query per row or cell. These share
+ * `g_rows_lock`, `g_rows_generation` and the lifetime of the row cache.
+ */
+struct cached_attrs {
+  int64_t   rowid;
+  uint32_t *col_lengths; ///< In the order of `g_attrs_col_names`, or NULL once changed
+};
+
+static char                *g_attrs_table = NULL;
+static char               **g_attrs_col_names = NULL; ///< NULL-terminated
+static size_t               g_attrs_ncols = 0;
+static struct cached_attrs *g_attrs = NULL;           ///< Sorted by ROWID
+static size_t               g_attrs_nrows = 0;
+static int64_t              g_attrs_data_version = -1; ///< See rows_data_version
+
+/**
+ * Rows loaded ahead of a walk in ROWID order, see prefetch_visit, at first...
+ */
+#define MDBFS_SQLITE_PREFETCH_MIN_ROWS 4
+
+/**
+ * ... doubling as the walk keeps visiting prefetched rows, up to this many, so
+ * that the window never pushes the walk out of the row cache...
+ */
+#define MDBFS_SQLITE_PREFETCH_MAX_ROWS (MDBFS_SQLITE_ROW_CACHE_ROWS / 2)
+
+/**
+ * ... except rows larger than this, which are left to be fetched when read.
+ */
+#define MDBFS_SQLITE_PREFETCH_MAX_ROW_BYTES (64 * 1024)
+
+/**
+ * The walk being followed by the prefetcher, a background thread loading rows
+ * into the row cache while the walk is busy with the previous ones.
+ */
+static char           *g_prefetch_table = NULL;  ///< Table being walked
+static uint64_t        g_prefetch_stream = 0;    ///< Moves whenever the walk starts over
+static int64_t         g_prefetch_last = 0;      ///< ROWID of the row last visited
+static int64_t         g_prefetch_ahead = 0;     ///< Rows are prefetched up to this ROWID...
+static int64_t         g_prefetch_trigger = 0;   ///< ... and more once the walk gets past this one
+static int64_t         g_prefetch_window = 0;    ///< Rows to load next, 0 if not walking in order
+static int64_t         g_prefetch_from = 0;      ///< Rows after this ROWID are to be loaded...
+static int64_t         g_prefetch_count = 0;     ///< ... this many of them
+static int             g_prefetch_pending = 0;   ///< Whether the above awaits the prefetcher
+static int             g_prefetch_busy = 0;      ///< Whether a window is pending or being loaded
+static int             g_prefetcher_running = 0;
+static pthread_t       g_prefetcher;
+static pthread_mutex_t g_prefetch_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  g_prefetch_cond = PTHREAD_COND_INITIALIZER;
+
+/**
+ * A lookup in flight, which identical lookups arriving meanwhile wait for and
+ * share instead of running it again, so that many clients stat'ing, reading
+ * or listing the same node at once cost one query.
+ */
+struct flight {
+  const char *kind;    ///< What is looked up, e.g. "rowids"
+  char       *key;     ///< Of what, e.g. the table name, maybe NULL
+  char       *subkey;  ///< Further, e.g. the row name, maybe NULL
+  int         done;    ///< Whether the lookup has landed
+  int         refs;    ///< Parties yet to leave: the leader and the waiters
+  void       *result;  ///< What has been looked up, maybe NULL
+  int         found;   ///< Whether the thing looked up exists
+  struct flight *next;
+};
+
+static struct flight  *g_flights = NULL;  ///< Flights not landed yet
+static pthread_mutex_t g_flights_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  g_flights_cond = PTHREAD_COND_INITIALIZER;
+
+/**
+ * Memory for Bloom filters of ROWIDs, in bytes, or 0 for none; see
+ * mdbfs_backend_sqlite_set_bloom_memory.
+ */
+static int64_t g_bloom_memory = 0;
+
+/**
+ * A Bloom filter of the ROWIDs of a table, so that looking up rows which do
+ * not exist does not take a query. Filters are built by a background thread
+ * from a scan of every table, and kept up with our own changes by
+ * row_cache_hook; changes by anyone else, or to the schema, make them all be
+ * built again, as does removing most of their rows. `/.metrics` tells how
+ * many lookups they have saved, and how often they let a missing row through
+ * (see bloom_count).
+ */
+struct bloom {
+  char               *table_name;
+  struct mdbfs_bloom *filter;
+  int                 ready;          ///< Whether every ROWID has been added
+  int64_t             schema_version; ///< Versions of the database the filter stands for
+  int64_t             data_version;
+  struct bloom       *next;
+};
+
+static struct bloom   *g_blooms = NULL;
+static int             g_bloom_stale = 0; ///< Whether the filters are to be built (again)
+static int             g_bloom_builder_running = 0;
+static pthread_t       g_bloom_builder;
+static pthread_mutex_t g_bloom_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  g_bloom_cond = PTHREAD_COND_INITIALIZER;
+
+/**
+ * Threads warming tables up once mounted, unless set by
+ * mdbfs_backend_sqlite_set_prewarm...
+ */
+#define MDBFS_SQLITE_DEFAULT_PREWARM_THREADS 4
+
+/**
+ * ... each reading ROWIDs this many at a time, so that the file is not kept
+ * locked against writers for long...
+ */
+#define MDBFS_SQLITE_PREWARM_CHUNK_ROWS 1024
+
+/**
+ * ... and they wait at most this long for writers to let go of the file.
+ */
+#define MDBFS_SQLITE_PREWARM_BUSY_MS 1000
+
+/**
+ * A range of ROWIDs of a table to be read by a prewarmer.
+ */
+struct prewarm_range {
+  char   *path;  ///< File of the database holding the table
+  char   *table; ///< Name of the table in that file
+  int64_t first;
+  int64_t last;
+};
+
+/**
+ * Tables to warm up once mounted (see mdbfs_backend_sqlite_set_prewarm): the
+ * schema and row estimate of each are loaded into the schema cache, and then,
+ * up to a budget of bytes, every row is read from the file by threads of
+ * their own, on connections of their own, range by range, so that the pages
+ * are in the OS cache when they are first used. The mount serves requests
+ * meanwhile; `/.metrics` tells the progress (`sqlite_prewarm_*`).
+ */
+static char                **g_prewarm_tables = NULL;  ///< NULL-terminated, or `*` for every table
+static int64_t               g_prewarm_bytes = 0;      ///< Budget of bytes to read, 0 for none
+static int                   g_prewarm_nthreads = MDBFS_SQLITE_DEFAULT_PREWARM_THREADS;
+static int                   g_prewarm_asked = 0;      ///< Whether it has been asked for, see mdbfs_backend_sqlite_prewarm
+static int                   g_prewarm_opened = 0;     ///< Whether the database is open to warm up
+static int                   g_prewarm_running = 0;
+static pthread_t             g_prewarm_planner;
+static struct prewarm_range *g_prewarm_ranges = NULL;
+static size_t                g_prewarm_nranges = 0;
+static size_t                g_prewarm_next = 0;       ///< Range to be read next
+static int64_t               g_prewarm_left = 0;       ///< Bytes yet to be read
+static pthread_mutex_t       g_prewarm_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * ROWIDs of whole tables kept (with `--metadata-cache`) in all, beyond which
+ * listings are not kept.
+ */
+#define MDBFS_SQLITE_META_MAX_RUNS (1024 * 1024)
+
+/**
+ * ROWIDs of a whole table, as last listed.
+ */
+struct meta_rowids {
+  char *table_name;
+  struct mdbfs_backend_sqlite_rowids *rowids;
+  struct meta_rowids *next;
+};
+
+/**
+ * The metadata cache (see mdbfs_backend_sqlite_set_metadata_cache): the schema
+ * cache, and ROWIDs of whole tables, kept until anything changes, and saved to
+ * a file when closing the database, so that they are loaded back at once when
+ * it is opened again, if the database has not changed meanwhile (see
+ * meta_header_fill); otherwise the file is ignored, and written anew. This is
+ * not done for attached databases.
+ */
+static char               *g_meta_path = NULL;
+static struct meta_rowids *g_meta_rowids = NULL;
+static size_t              g_meta_nruns = 0;
+static int64_t             g_meta_stamp[3] = {-1, -1, -1}; ///< See meta_stamp, of `g_meta_rowids`
+static pthread_mutex_t     g_meta_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Layout of the metadata cache file: a header, then a record for each table,
+ * each followed by its ROWID runs (struct mdbfs_backend_sqlite_rowid_run) and
+ * then its name and the name and declared type of each of its columns, all
+ * NUL-terminated, padded to 8 bytes. Numbers are in the byte order of the
+ * machine, so that the file is read in place once mapped; a file written in
+ * another order does not match `format`.
+ */
+#define MDBFS_SQLITE_META_MAGIC  "MDBFSMD\n"
+#define MDBFS_SQLITE_META_FORMAT 1
+
+struct meta_header {
+  char     magic[8];
+  uint32_t format;
+  uint32_t ntables;
+  uint32_t change_counter; ///< File change counter in the header of the database
+  uint32_t reserved;
+  uint64_t checksum;       ///< Of the records, see meta_checksum
+  int64_t  schema_version;
+  int64_t  db_size;
+  int64_t  db_mtime_sec;
+  int64_t  db_mtime_nsec;
+  int64_t  wal_size;       ///< 0 if there is no WAL
+  int64_t  wal_mtime_sec;
+  int64_t  wal_mtime_nsec;
+};
+
+#define MDBFS_SQLITE_META_HAS_ESTIMATE 1
+#define MDBFS_SQLITE_META_HAS_ROWIDS   2
+
+struct meta_record {
+  uint64_t size;         ///< Bytes of the record, runs and names included
+  int64_t  row_estimate;
+  int64_t  count;        ///< ROWIDs in the runs
+  uint64_t nruns;
+  uint32_t flags;        ///< MDBFS_SQLITE_META_HAS_*
+  uint32_t ncols;        ///< Columns named, 0 if the schema is not there
+};
+
+static sqlite3_stmt   *g_versions_stmt = NULL; ///< See read_versions
+static sqlite3_stmt  **g_versions_stmts = NULL; ///< Likewise, two for each attached database
+static size_t          g_versions_nstmts = 0;
+static pthread_mutex_t g_versions_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct schema  *g_schemas = NULL;
+static int64_t         g_schemas_version = -1; ///< `PRAGMA schema_version` of `g_schemas`
+static pthread_mutex_t g_schemas_lock = PTHREAD_MUTEX_INITIALIZER;
+
 /********** Private APIs **********/
 
 static char *sql_from_fmt(const char *fmt, ...)
@@ -91,94 +716,6158 @@ end:
   return sql;
 }
 
-/********** Public APIs **********/
+/**
+ * Prepare exactly one statement, refusing SQL that goes on with another one
+ * after it, which sqlite3_exec would run as well.
+ *
+ * @param sql  [in]  The SQL. Blanks, comments and semicolons may follow the
+ *                   statement.
+ * @param stmt [out] The prepared statement.
+ * @return SQLITE_OK if the statement is prepared, any other result code
+ *         otherwise (SQLITE_MISUSE if the SQL holds no statement, or more).
+ */
+static int sql_prepare_one(const char *sql, sqlite3_stmt **stmt)
+{
+  sqlite3_stmt *next = NULL;
+  const char *tail = NULL;
+  int r = 0;
 
-int mdbfs_backend_sqlite_open_database_from_file(const char *path)
+  r = sqlite3_prepare_v2(g_db, sql, -1, stmt, &tail);
+  if (r != SQLITE_OK)
+    return r;
+
+  if (!*stmt)
+    return SQLITE_MISUSE;
+
+  /* What is left holds no statement if it prepares to nothing */
+  while (tail && *tail) {
+    const char *start = tail;
+
+    r = sqlite3_prepare_v2(g_db, start, -1, &next, &tail);
+    if (r != SQLITE_OK || next || tail == start) {
+      sqlite3_finalize(next);
+      sqlite3_finalize(*stmt);
+      *stmt = NULL;
+      return r != SQLITE_OK ? r : SQLITE_MISUSE;
+    }
+  }
+
+  return SQLITE_OK;
+}
+
+/**
+ * Tell the table a name refers to within its database, i.e. `T` of `D/T` for
+ * tables of attached databases, or the name as it is otherwise.
+ *
+ * @param table_name [in] Name of the table or view.
+ * @return Pointer into `table_name`.
+ */
+static const char *table_base(const char *table_name)
 {
-  if (!path) {
-    mdbfs_warning("sqlite: open: path is missing");
+  const char *slash = g_databases ? strchr(table_name, '/') : NULL;
+  return slash ? slash + 1 : table_name;
+}
+
+/**
+ * Tell the database a table is in, i.e. `D` of `D/T` for tables of attached
+ * databases.
+ *
+ * @param table_name [in] Name of the table or view.
+ * @return Schema name of the database, or NULL if the name is not qualified
+ *         (the main database, or temporary views). The caller is responsible
+ *         for freeing it.
+ */
+static char *table_schema(const char *table_name)
+{
+  const char *base = table_base(table_name);
+  if (base == table_name)
+    return NULL;
+
+  char *ret = mdbfs_malloc0(base - table_name);
+  memcpy(ret, table_name, base - table_name - 1);
+  return ret;
+}
+
+/**
+ * Quote a name in the database of a table, to be put in statements: `"D"."N"`
+ * for tables of attached databases, `"N"` otherwise.
+ *
+ * @param table_name [in] Name of the table telling the database.
+ * @param name       [in] The name to quote, e.g. `sqlite_master`.
+ * @return The quoted name. The caller is responsible for freeing it.
+ */
+static char *sql_table_in(const char *table_name, const char *name)
+{
+  char *schema = table_schema(table_name);
+  char *ret = schema ? sql_from_fmt("\"%s\".\"%s\"", schema, name) : sql_from_fmt("\"%s\"", name);
+
+  mdbfs_free(schema);
+  return ret;
+}
+
+/**
+ * Quote the name of a table, to be put in statements (see sql_table_in).
+ */
+static char *sql_table(const char *table_name)
+{
+  return sql_table_in(table_name, table_base(table_name));
+}
+
+/**
+ * Find a query by name. The caller must hold `g_queries_lock`.
+ */
+static struct query *query_find(const char *name)
+{
+  for (struct query *q = g_queries; q; q = q->next)
+    if (strcmp(q->name, name) == 0)
+      return q;
+
+  return NULL;
+}
+
+/**
+ * Check whether a table name is taken by a query, whose temporary view would
+ * shadow a table of the main database of the same name.
+ *
+ * @param table_name [in] Name of the table.
+ * @return 1 if it is taken, 0 otherwise.
+ */
+static int query_exists(const char *table_name)
+{
+  /* Queries are never in attached databases */
+  if (table_base(table_name) != table_name)
     return 0;
+
+  pthread_mutex_lock(&g_queries_lock);
+  int ret = query_find(table_name) != NULL;
+  pthread_mutex_unlock(&g_queries_lock);
+
+  return ret;
+}
+
+/**
+ * Check whether a name refers to a view, temporary ones included.
+ *
+ * @param table_name [in] Name of the table or view.
+ * @return 1 if it is a view, 0 otherwise.
+ */
+static int is_view(const char *table_name)
+{
+  sqlite3_stmt *stmt = NULL;
+  char *sql = NULL;
+  char *master = NULL;
+  int ret = 0;
+
+  /* Views of attached databases are looked for in their databases only */
+  if (table_base(table_name) != table_name) {
+    master = sql_table_in(table_name, "sqlite_master");
+    sql = sql_from_fmt(sql_fmt_is_view_in, master);
   }
 
-  if (g_db) {
-    mdbfs_warning("sqlite: open: it looks like a database is already loaded!");
-    mdbfs_warning("sqlite: open: dropping the (previous?) session");
-    g_db = NULL;
+  if (sqlite3_prepare_v2(g_db, sql ? sql : sql_str_is_view, -1, &stmt, NULL) != SQLITE_OK) {
+    mdbfs_error("sqlite: is_view: sqlite3 cannot prepare a sql statement for us: %s", sqlite3_errmsg(g_db));
+    goto quit;
   }
 
-  mdbfs_info("sqlite: opening database from %s", path);
+  sqlite3_bind_text(stmt, 1, table_base(table_name), -1, SQLITE_STATIC);
+  ret = sqlite3_step(stmt) == SQLITE_ROW;
 
-  int r = sqlite3_open_v2(path, &g_db, SQLITE_OPEN_READWRITE, NULL);
-  if (r != SQLITE_OK) {
-    mdbfs_error(
-      "unable to open SQLite3 database at %s: %s",
-      path, sqlite3_errmsg(g_db)
-    );
-    return 0;
+quit:
+  sqlite3_finalize(stmt);
+  mdbfs_free(master);
+  mdbfs_free(sql);
+  return ret;
+}
+
+/**
+ * Build the SQL selecting one cell, or the whole row, from a table or a view.
+ *
+ * Rows of tables are named after their ROWIDs. Views do not have ROWIDs, so
+ * rows of them are named after their positions in the result instead,
+ * starting from 0.
+ *
+ * @param col_name   [in] Name of the column, or NULL for all columns.
+ * @param table_name [in] Name of the table or view.
+ * @param row_name   [in] Name of the row.
+ * @return The SQL statement, or NULL if the row cannot exist. The caller is
+ *         responsible for freeing the memory.
+ */
+static char *sql_select_row(const char *col_name, const char *table_name, const char *row_name)
+{
+  char *table = sql_table(table_name);
+  char *ret = NULL;
+
+  if (!is_view(table_name)) {
+    if (col_name)
+      ret = sql_from_fmt(sql_fmt_select_from_where, col_name, table, "ROWID", row_name);
+    else
+      ret = sql_from_fmt(sql_fmt_select_all_from_where, table, "ROWID", row_name);
+    goto quit;
+  }
+
+  char *end = NULL;
+  long long position = strtoll(row_name, &end, 10);
+  if (!*row_name || *end || position < 0)
+    goto quit;
+
+  if (col_name)
+    ret = sql_from_fmt(sql_fmt_select_from_view_at, col_name, table, position);
+  else
+    ret = sql_from_fmt(sql_fmt_select_all_from_view_at, table, position);
+
+quit:
+  mdbfs_free(table);
+  return ret;
+}
+
+/**
+ * Prepare and step the statement selecting one cell.
+ *
+ * @param table_name [in] Name of the table or view.
+ * @param row_name   [in] Name of the row.
+ * @param col_name   [in] Name of the column.
+ * @param who        [in] Name of the caller, used in messages.
+ * @return The statement, standing on the only result row, or NULL if the row
+ *         does not exist or on errors. The caller is responsible for
+ *         finalizing it.
+ */
+static sqlite3_stmt *step_cell(const char *table_name, const char *row_name, const char *col_name, const char *who)
+{
+  sqlite3_stmt *stmt = NULL;
+  char *sql = NULL;
+  int r = 0;
+
+  sql = sql_select_row(col_name, table_name, row_name);
+  if (!sql) {
+    mdbfs_error("sqlite: %s: no sql no life!", who);
+    goto quit;
+  }
+
+  r = sqlite3_prepare_v2(g_db, sql, -1, &stmt, NULL);
+  if (r != SQLITE_OK) {
+    mdbfs_error("sqlite: %s: sqlite3 cannot prepare a sql statement for us: %s", who, sqlite3_errmsg(g_db));
+    goto quit;
+  }
+
+  r = sqlite3_step(stmt);
+
+  if (r == SQLITE_DONE) {
+    mdbfs_debug("sqlite: %s: nothing to show, confused", who);
+    goto fail;
+  }
+
+  if (r != SQLITE_ROW) {
+    mdbfs_warning("sqlite: %s: sqlite3 reported an error: %s", who, sqlite3_errmsg(g_db));
+    goto fail;
+  }
+
+  goto quit;
+
+fail:
+  sqlite3_finalize(stmt);
+  stmt = NULL;
+
+quit:
+  mdbfs_free(sql);
+  return stmt;
+}
+
+/**
+ * Render a column of a stepped statement by its storage class.
+ *
+ * Integers and reals are formatted into `number`, so that SQLite does not
+ * convert them into text of its own; text and BLOBs point into the statement,
+ * and stay valid until it is stepped, reset or finalized.
+ *
+ * @param stmt     [in]  The statement, standing on a result row.
+ * @param icol     [in]  Index of the column in the result.
+ * @param col_name [in]  Name of the column selected by name, or NULL if the
+ *                       column is known to exist.
+ * @param number   [out] Buffer of `MDBFS_FORMAT_NUMBER_MAX` bytes for numbers.
+ * @param cell     [out] The rendered cell, or NULL if it is empty.
+ * @param length   [out] Length of the rendered cell.
+ * @return Storage class of the cell, or `MDBFS_BACKEND_SQLITE_CELL_TYPE_NONE`
+ *         if the column does not exist.
+ */
+static enum mdbfs_backend_sqlite_cell_type render_cell(sqlite3_stmt *stmt, int icol, const char *col_name, char *number, const uint8_t **cell, size_t *length)
+{
+  *cell   = NULL;
+  *length = 0;
+
+  switch (sqlite3_column_type(stmt, icol)) {
+    case SQLITE_INTEGER:
+      *length = mdbfs_format_int64(number, sqlite3_column_int64(stmt, icol));
+      *cell   = (const uint8_t *)number;
+      return MDBFS_BACKEND_SQLITE_CELL_TYPE_INTEGER;
+
+    case SQLITE_FLOAT:
+      *length = mdbfs_format_double(number, sqlite3_column_double(stmt, icol));
+      *cell   = (const uint8_t *)number;
+      return MDBFS_BACKEND_SQLITE_CELL_TYPE_REAL;
+
+    case SQLITE_BLOB:
+      /* NOTE: Fetch the pointer before the length, as the API asks */
+      *cell   = sqlite3_column_blob(stmt, icol);
+      *length = sqlite3_column_bytes(stmt, icol);
+      return MDBFS_BACKEND_SQLITE_CELL_TYPE_BLOB;
+
+    case SQLITE_TEXT:
+      *cell   = sqlite3_column_text(stmt, icol);
+      *length = sqlite3_column_bytes(stmt, icol);
+
+      /* NOTE: Trick: If we get a string that is identical to the column name,
+       * the column does not exist, since SQLite takes an unknown "column" as a
+       * string literal.
+       */
+      if (col_name && *cell && strcmp((const char *)*cell, col_name) == 0)
+        return MDBFS_BACKEND_SQLITE_CELL_TYPE_NONE;
+
+      return MDBFS_BACKEND_SQLITE_CELL_TYPE_TEXT;
+
+    default:
+      return MDBFS_BACKEND_SQLITE_CELL_TYPE_NULL;
+  }
+}
+
+/**
+ * Step through a prepared statement, collecting the first column of every
+ * result row into a NULL-terminated list of strings.
+ *
+ * NULL values and values that cannot be used as a file name (empty, or
+ * containing a slash) are skipped.
+ *
+ * @param stmt [in] A prepared statement yielding at least one column.
+ * @param who  [in] Name of the caller, used in messages.
+ * @return A NULL-terminated list of strings, or NULL on failure. The caller is
+ *         responsible for freeing the list and its elements.
+ */
+static char **strings_from_stmt(sqlite3_stmt *stmt, const char *who)
+{
+  char **ret = NULL;
+  size_t ret_length = 0;
+  int r = 0;
+
+  for (;;) {
+    r = sqlite3_step(stmt);
+    if (r != SQLITE_ROW)
+      break;
+
+    const char *str = (const char *)sqlite3_column_text(stmt, 0);
+    if (!str || !*str || strchr(str, '/')) {
+      mdbfs_debug("sqlite: %s: skipping a value that cannot be a file name", who);
+      continue;
+    }
+
+    /* Stretch vector */
+    ret_length += 1;
+    ret = mdbfs_realloc(ret, ret_length * sizeof(char *));
+
+    /* Fill string element */
+    size_t str_length = strlen(str) + 1;
+    ret[ret_length - 1] = mdbfs_malloc0(str_length);
+    memcpy(ret[ret_length - 1], str, str_length);
+  }
+
+  if (r != SQLITE_DONE) {
+    mdbfs_warning("sqlite: %s: sqlite3 reported an error: %s", who, sqlite3_errmsg(g_db));
+    for (int i = 0; i < ret_length; i++) {
+      mdbfs_free(ret[i]);
+    }
+    mdbfs_free(ret);
+    return NULL;
+  }
+
+  /* Additionally add a NULL at the end of list for iteration */
+  ret_length += 1;
+  ret = mdbfs_realloc(ret, ret_length * sizeof(char *));
+  ret[ret_length - 1] = NULL;
+
+  return ret;
+}
+
+/**
+ * Copy a NULL-terminated list of strings, for flight_leave.
+ */
+static void *strings_copy(const void *strings)
+{
+  char *const *list = strings;
+  size_t n = 0;
+
+  while (list[n])
+    n++;
+
+  char **ret = mdbfs_malloc0((n + 1) * sizeof(char *));
+  for (size_t i = 0; i < n; i++) {
+    ret[i] = mdbfs_malloc0(strlen(list[i]) + 1);
+    strcpy(ret[i], list[i]);
+  }
+
+  return ret;
+}
+
+/**
+ * Copy ROWIDs of a table, for flight_leave.
+ */
+static void *rowids_copy(const void *rowids)
+{
+  const struct mdbfs_backend_sqlite_rowids *from = rowids;
+  struct mdbfs_backend_sqlite_rowids *ret = mdbfs_malloc0(sizeof(struct mdbfs_backend_sqlite_rowids));
+
+  ret->runs = mdbfs_malloc0((from->nruns ? from->nruns : 1) * sizeof(struct mdbfs_backend_sqlite_rowid_run));
+  memcpy(ret->runs, from->runs, from->nruns * sizeof(struct mdbfs_backend_sqlite_rowid_run));
+  ret->nruns = from->nruns;
+  ret->count = from->count;
+
+  return ret;
+}
+
+/**
+ * Tell the bucket of a ROWID: the ROWID divided by the width of buckets,
+ * rounded down, so that negative ROWIDs have their own buckets too.
+ */
+static int64_t rowid_bucket(int64_t rowid, int64_t width)
+{
+  int64_t bucket = rowid / width;
+
+  if (rowid % width < 0)
+    bucket -= 1;
+
+  return bucket;
+}
+
+/**
+ * Find the run holding the ROWID at a position among all ROWIDs of a table.
+ *
+ * @param rowids [in] ROWIDs of the table.
+ * @param index  [in] The position, from 0.
+ * @return Index of the run, or `rowids->nruns` if the position is past the
+ *         last ROWID.
+ */
+static size_t rowids_run_at(const struct mdbfs_backend_sqlite_rowids *rowids, int64_t index)
+{
+  size_t lo = 0;
+  size_t hi = rowids->nruns;
+
+  if (index < 0 || index >= rowids->count)
+    return rowids->nruns;
+
+  /* The last run starting at or before the position */
+  while (hi - lo > 1) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (rowids->runs[mid].index <= index)
+      lo = mid;
+    else
+      hi = mid;
+  }
+
+  return lo;
+}
+
+/**
+ * Run a statement that takes nothing and returns nothing.
+ */
+static int exec_simple(const char *sql, const char *who)
+{
+  char *errmsg = NULL;
+
+  int r = sqlite3_exec(g_db, sql, NULL, NULL, &errmsg);
+  if (r != SQLITE_OK) {
+    mdbfs_warning("sqlite: %s: sqlite3 reported an error: %s", who, errmsg ? errmsg : sqlite3_errstr(r));
+    sqlite3_free(errmsg);
+    return 0;
+  }
+
+  return 1;
+}
+
+/**
+ * Parse a row name into a ROWID.
+ *
+ * @param row_name [in]  Name of the row.
+ * @param rowid    [out] The ROWID.
+ * @return 1 if the name is a ROWID, 0 otherwise.
+ */
+static int rowid_from_name(const char *row_name, int64_t *rowid)
+{
+  char *end = NULL;
+
+  errno = 0;
+  long long n = strtoll(row_name, &end, 10);
+  if (!*row_name || *end || errno == ERANGE)
+    return 0;
+
+  *rowid = n;
+  return 1;
+}
+
+/**
+ * Prepare a statement describing the columns of a table, one row per column as
+ * `PRAGMA table_info` does.
+ *
+ * @param stmt       [out] The prepared statement, to be finalized by the caller.
+ * @param table_name [in]  Name of the table.
+ * @return 1 on success, 0 on failure.
+ */
+static int describe_table(sqlite3_stmt **stmt, const char *table_name)
+{
+  char *schema = table_schema(table_name);
+  int ret = 0;
+
+  if (sqlite3_prepare_v2(g_db, sql_str_get_table_info, -1, stmt, NULL) != SQLITE_OK)
+    goto quit;
+
+  sqlite3_bind_text(*stmt, 1, table_base(table_name), -1, SQLITE_STATIC);
+  if (schema)
+    sqlite3_bind_text(*stmt, 2, schema, -1, SQLITE_TRANSIENT);
+  ret = 1;
+
+quit:
+  mdbfs_free(schema);
+  return ret;
+}
+
+/**
+ * List the columns a row takes with it when moving from one table to another,
+ * i.e. those of the destination that the source also has, for
+ * sql_fmt_insert_into_select_rowid. A column aliasing the ROWID of the
+ * destination is left out, since it would take the place of the new ROWID.
+ *
+ * @param table_old [in] Name of the source table.
+ * @param table_new [in] Name of the destination table.
+ * @return Quoted names, each preceded by ", ", to be freed by the caller; NULL
+ *         if either table cannot be described.
+ */
+static char *move_columns(const char *table_old, const char *table_new)
+{
+  sqlite3_stmt *stmt = NULL;
+  char **names = NULL;
+  char *ret = NULL;
+  size_t nnames = 0;
+  size_t length = 1;
+  int64_t alias = -1;
+  int nkeys = 0;
+
+  if (!describe_table(&stmt, table_new)) {
+    mdbfs_warning("sqlite: move_row: cannot describe \"%s\": %s", table_new, sqlite3_errmsg(g_db));
+    goto quit;
+  }
+
+  while (sqlite3_step(stmt) == SQLITE_ROW) {
+    const char *name = (const char *)sqlite3_column_text(stmt, 1);
+    const char *type = (const char *)sqlite3_column_text(stmt, 2);
+    int pk = sqlite3_column_int(stmt, 5);
+
+    if (pk) {
+      nkeys += 1;
+      if (type && sqlite3_stricmp(type, "INTEGER") == 0)
+        alias = nnames;
+    }
+
+    names = mdbfs_realloc(names, (nnames + 1) * sizeof(char *));
+    names[nnames] = mdbfs_malloc0(strlen(name) + 1);
+    strcpy(names[nnames], name);
+    nnames += 1;
+  }
+
+  sqlite3_finalize(stmt);
+  stmt = NULL;
+
+  /* An INTEGER PRIMARY KEY on its own is the ROWID */
+  if (nkeys != 1)
+    alias = -1;
+
+  if (!nnames) {
+    mdbfs_warning("sqlite: move_row: there is no table \"%s\"", table_new);
+    goto quit;
+  }
+
+  /* Leave out the columns the source does not have */
+  if (!describe_table(&stmt, table_old)) {
+    mdbfs_warning("sqlite: move_row: cannot describe \"%s\": %s", table_old, sqlite3_errmsg(g_db));
+    goto quit;
+  }
+
+  ret = mdbfs_malloc0(length);
+  while (sqlite3_step(stmt) == SQLITE_ROW) {
+    const char *name = (const char *)sqlite3_column_text(stmt, 1);
+
+    for (size_t i = 0; i < nnames; i++) {
+      if ((int64_t)i == alias || strcmp(names[i], name) != 0)
+        continue;
+
+      length += strlen(name) + 4;
+      ret = mdbfs_realloc(ret, length);
+      sprintf(ret + strlen(ret), ", \"%s\"", name);
+      break;
+    }
+  }
+
+quit:
+  sqlite3_finalize(stmt);
+  for (size_t i = 0; i < nnames; i++)
+    mdbfs_free(names[i]);
+  mdbfs_free(names);
+  return ret;
+}
+
+/**
+ * Rewrite the bytes of a cell with an expression of them, keeping TEXT cells
+ * TEXT and BLOB cells BLOB. Numbers become TEXT, which the column affinity may
+ * turn back into numbers.
+ *
+ * @param is_blob_fmt    [in] Condition of the result being a BLOB, formatted
+ *                            with the column name twice.
+ * @param bytes_fmt      [in] The new bytes, formatted with the old bytes thrice.
+ * @param position       [in] Bound to ?2 (an offset or a size).
+ * @param content        [in] Bound to ?3 as a BLOB, if not NULL.
+ * @param content_length [in] Length of `content`.
+ * @param table_name     [in] Name of the table.
+ * @param rowid          [in] ROWID of the row.
+ * @param col_name       [in] Name of the column.
+ * @param who            [in] Name of the caller, for logs.
+ * @return 1 on success, 0 on failure (e.g. there is no such row).
+ */
+static int update_cell_bytes(const char *is_blob_fmt, const char *bytes_fmt, int64_t position, const uint8_t *content, size_t content_length, const char *table_name, int64_t rowid, const char *col_name, const char *who)
+{
+  sqlite3_stmt *stmt = NULL;
+  char *sql = NULL;
+  char *old_bytes = NULL;
+  char *new_bytes = NULL;
+  char *is_blob = NULL;
+  char *table = NULL;
+  int ret = 0;
+  int r = 0;
+
+  table = sql_table(table_name);
+  old_bytes = sql_from_fmt(sql_fmt_cell_bytes, col_name);
+  is_blob = sql_from_fmt(is_blob_fmt, col_name, col_name);
+  new_bytes = old_bytes ? sql_from_fmt(bytes_fmt, old_bytes, old_bytes, old_bytes) : NULL;
+  sql = new_bytes && is_blob ? sql_from_fmt(sql_fmt_update_cell_bytes, table, col_name, is_blob, new_bytes, new_bytes) : NULL;
+  if (!sql) {
+    mdbfs_error("sqlite: %s: no sql no life!", who);
+    goto quit;
+  }
+
+  r = sqlite3_prepare_v2(g_db, sql, -1, &stmt, NULL);
+  if (r != SQLITE_OK) {
+    mdbfs_warning("sqlite: %s: sqlite3 cannot prepare a sql statement for us: %s", who, sqlite3_errmsg(g_db));
+    goto quit;
+  }
+
+  sqlite3_bind_int64(stmt, 1, rowid);
+  sqlite3_bind_int64(stmt, 2, position);
+  if (content)
+    sqlite3_bind_blob64(stmt, 3, content, content_length, SQLITE_STATIC);
+  r = sqlite3_step(stmt);
+
+  if (r != SQLITE_DONE) {
+    mdbfs_warning("sqlite: %s: sqlite3 reported an error: %s", who, sqlite3_errmsg(g_db));
+    goto quit;
+  }
+
+  if (sqlite3_changes(g_db) != 1) {
+    mdbfs_warning("sqlite: %s: there is no row %lld in table \"%s\"", who, (long long)rowid, table_name);
+    goto quit;
+  }
+
+  mdbfs_debug("sqlite: %s: done updating content in cell (\"%s\", %lld, \"%s\")", who, table_name, (long long)rowid, col_name);
+  ret = 1;
+
+quit:
+  sqlite3_finalize(stmt);
+  mdbfs_free(sql);
+  mdbfs_free(old_bytes);
+  mdbfs_free(new_bytes);
+  mdbfs_free(is_blob);
+  mdbfs_free(table);
+  return ret;
+}
+
+/**
+ * Find the next token in SQL text, skipping blanks and comments. A quoted name
+ * or string is one token, quotes included.
+ *
+ * @param sql    [in]  Where to start looking.
+ * @param length [out] Length of the token.
+ * @return The token, or NULL at the end of the text.
+ */
+static const char *sql_token(const char *sql, size_t *length)
+{
+  const char *p = NULL;
+  char close = 0;
+
+  for (;;) {
+    while (*sql && isspace((unsigned char)*sql))
+      sql++;
+
+    if (sql[0] == '-' && sql[1] == '-') {
+      while (*sql && *sql != '\n')
+        sql++;
+    } else if (sql[0] == '/' && sql[1] == '*') {
+      p = strstr(sql + 2, "*/");
+      sql = p ? p + 2 : sql + strlen(sql);
+    } else {
+      break;
+    }
+  }
+
+  if (!*sql)
+    return NULL;
+
+  switch (*sql) {
+    case '"':
+    case '\'':
+    case '`':
+      close = *sql;
+      break;
+    case '[':
+      close = ']';
+      break;
+  }
+
+  p = sql + 1;
+  if (close) {
+    /* A quote is escaped by doubling it, except in brackets */
+    for (; *p; p++) {
+      if (*p != close)
+        continue;
+      if (close != ']' && p[1] == close) {
+        p++;
+        continue;
+      }
+      p++;
+      break;
+    }
+  } else if (isalnum((unsigned char)*sql) || *sql == '_' || *sql == '$' || (unsigned char)*sql >= 0x80) {
+    while (isalnum((unsigned char)*p) || *p == '_' || *p == '$' || (unsigned char)*p >= 0x80)
+      p++;
+  }
+
+  *length = p - sql;
+  return sql;
+}
+
+/**
+ * Tell whether a token is a name, quoted or not, compared the way SQLite does
+ * (ignoring ASCII case).
+ *
+ * @param token   [in] The token, as found by sql_token.
+ * @param length  [in] Length of the token.
+ * @param name    [in] The name, unquoted.
+ * @param keyword [in] Whether only an unquoted token counts (e.g. PRIMARY).
+ * @return 1 if it is, 0 if it is not.
+ */
+static int sql_token_is(const char *token, size_t length, const char *name, int keyword)
+{
+  const char *end = token + length - 1;
+  char close = 0;
+
+  switch (*token) {
+    case '"':
+    case '\'':
+    case '`':
+      close = *token;
+      break;
+    case '[':
+      close = ']';
+      break;
+  }
+
+  if (!close)
+    return strlen(name) == length && sqlite3_strnicmp(token, name, length) == 0;
+
+  if (keyword || length < 2 || *end != close)
+    return 0;
+
+  for (token++; token < end; token++, name++) {
+    if (!*name || tolower((unsigned char)*token) != tolower((unsigned char)*name))
+      return 0;
+    if (close != ']' && *token == close)
+      token++;
+  }
+
+  return *name == '\0';
+}
+
+/**
+ * Tell whether a name appears anywhere in (a piece of) SQL text, e.g. a column
+ * in a constraint, or a table in a view.
+ *
+ * @param sql     [in] The text.
+ * @param length  [in] Length of the text.
+ * @param name    [in] The name, unquoted.
+ * @param keyword [in] Whether only an unquoted token counts.
+ * @return 1 if it does, 0 if it does not.
+ */
+static int sql_mentions(const char *sql, size_t length, const char *name, int keyword)
+{
+  const char *end = sql + length;
+  const char *token = NULL;
+  size_t token_length = 0;
+
+  for (token = sql_token(sql, &token_length); token && token < end; token = sql_token(token + token_length, &token_length))
+    if (sql_token_is(token, token_length, name, keyword))
+      return 1;
+
+  return 0;
+}
+
+/**
+ * Write the CREATE TABLE statement of a table without one of its columns,
+ * keeping everything else (types, collations, defaults, constraints, and
+ * options like STRICT) as written in the schema.
+ *
+ * @param create_sql  [in] CREATE TABLE statement of the table, as kept in
+ *                         `sqlite_master`.
+ * @param new_table   [in] Quoted name of the table to create.
+ * @param column_name [in] Name of the column to leave out.
+ * @return The statement, or NULL if the column cannot be left out without
+ *         changing anything else: it is not there, it is part of the primary
+ *         key, another column or a table constraint names it, or rows cannot
+ *         be copied by ROWID. The caller is responsible for freeing it.
+ */
+static char *sql_create_table_without(const char *create_sql, const char *new_table, const char *column_name)
+{
+  const char *token = NULL;
+  const char *item = NULL;
+  const char *tail = NULL;
+  char *ret = NULL;
+  size_t length = 0;
+  int depth = 0;
+  int found = 0;
+  int nitems = 0;
+
+  ret = mdbfs_malloc0(strlen(create_sql) + strlen(new_table) + 32);
+  sprintf(ret, "CREATE TABLE %s (", new_table);
+
+  /* Columns and table constraints are separated by commas at the outer level */
+  for (token = sql_token(create_sql, &length); token; token = sql_token(token + length, &length)) {
+    if (length != 1 || (*token != '(' && *token != ')' && *token != ','))
+      continue;
+
+    if (*token == '(') {
+      if (++depth == 1)
+        item = token + 1;
+      continue;
+    }
+
+    if ((*token == ',' && depth != 1) || (*token == ')' && --depth != 0))
+      continue;
+
+    const char *first = NULL;
+    size_t first_length = 0;
+    size_t item_length = token - item;
+    int constraint = 0;
+
+    first = sql_token(item, &first_length);
+    if (!first || first >= token)
+      goto refuse;
+
+    constraint = sql_token_is(first, first_length, "CONSTRAINT", 1) ||
+                 sql_token_is(first, first_length, "PRIMARY", 1) ||
+                 sql_token_is(first, first_length, "UNIQUE", 1) ||
+                 sql_token_is(first, first_length, "CHECK", 1) ||
+                 sql_token_is(first, first_length, "FOREIGN", 1);
+
+    if (!constraint && sql_token_is(first, first_length, column_name, 0)) {
+      found = 1;
+      if (sql_mentions(first + first_length, token - first - first_length, "PRIMARY", 1)) {
+        mdbfs_warning("sqlite: rebuild: \"%s\" is the primary key, refusing to drop it", column_name);
+        goto refuse;
+      }
+    } else if (sql_mentions(constraint ? first : first + first_length, token - first - (constraint ? 0 : first_length), column_name, 0)) {
+      mdbfs_warning("sqlite: rebuild: \"%s\" is named by another column or a constraint (%.*s), refusing to drop it", column_name, (int)(token - first), first);
+      goto refuse;
+    } else {
+      if (nitems)
+        strcat(ret, ",");
+      strncat(ret, item, item_length);
+      nitems += 1;
+    }
+
+    item = token + 1;
+    if (*token == ')') {
+      tail = token + 1;
+      break;
+    }
+  }
+
+  if (!tail || !found || !nitems) {
+    mdbfs_warning("sqlite: rebuild: there is no column \"%s\", or nothing would be left without it", column_name);
+    goto refuse;
+  }
+
+  if (sql_mentions(tail, strlen(tail), "WITHOUT", 1)) {
+    mdbfs_warning("sqlite: rebuild: the table has no ROWID to copy rows by, refusing to rebuild it");
+    goto refuse;
+  }
+
+  strcat(ret, ")");
+  strcat(ret, tail);
+  return ret;
+
+refuse:
+  mdbfs_free(ret);
+  return NULL;
+}
+
+/**
+ * Drop a column by rebuilding its table: create a table from the table's own
+ * CREATE TABLE statement without the column, copy rows over batch by batch,
+ * then replace the table, and recreate its indexes and triggers, all in one
+ * transaction.
+ *
+ * Everything but the column is kept as written in the schema, including the
+ * AUTOINCREMENT counter; indexes on the column are dropped with it. If the
+ * column cannot go alone (it is part of the primary key, or a constraint or
+ * trigger names it), or the table cannot be replaced (a view, a trigger or a
+ * foreign key of another table names it), nothing is done. Progress can be
+ * watched in the `sqlite_rebuild_*` metrics. The connection is available to
+ * readers between batches, while writers wait until the rebuild is done, so
+ * that no write is lost with the old table, or rolled back along with a failed
+ * rebuild. Tables of attached databases are not rebuilt.
+ *
+ * @param table_name  [in] Name of the table.
+ * @param column_name [in] Name of the column to drop.
+ * @return 1 on success, 0 on failure (nothing is changed).
+ */
+static int rebuild_table_without(const char *table_name, const char *column_name)
+{
+  struct mdbfs_metric *running = mdbfs_metric_get("sqlite_rebuild_running");
+  struct mdbfs_metric *rows_total = mdbfs_metric_get("sqlite_rebuild_rows_total");
+  struct mdbfs_metric *rows_copied = mdbfs_metric_get("sqlite_rebuild_rows_copied");
+  sqlite3_stmt *stmt = NULL;
+  char *sql = NULL;
+  char *table = NULL;
+  char *new_table = NULL;
+  char *new_name = NULL;
+  char *create_sql = NULL;
+  char *cols = NULL;
+  char **sqls = NULL;
+  size_t cols_length = 0;
+  size_t nsqls = 0;
+  size_t nindexes = 0;
+  size_t ntriggers = 0;
+  int autoincrement = 0;
+  int ncols = 0;
+  int in_transaction = 0;
+  int ret = 0;
+  int r = 0;
+
+  if (table_base(table_name) != table_name) {
+    mdbfs_warning("sqlite: rebuild: \"%s\" is in an attached database, refusing to rebuild it", table_name);
+    goto quit;
+  }
+
+  table = sql_table(table_name);
+  new_name = sql_from_fmt("%s_mdbfs_rebuild", table_name);
+  new_table = sql_from_fmt("\"%s_mdbfs_rebuild\"", table_name);
+
+  /* Write the new table from the old one */
+  if (sqlite3_prepare_v2(g_db, sql_str_get_table_sql, -1, &stmt, NULL) != SQLITE_OK) {
+    mdbfs_warning("sqlite: rebuild: cannot look up \"%s\": %s", table_name, sqlite3_errmsg(g_db));
+    goto quit;
+  }
+  sqlite3_bind_text(stmt, 1, table_name, -1, SQLITE_STATIC);
+
+  if (sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_text(stmt, 0)) {
+    const char *old_sql = (const char *)sqlite3_column_text(stmt, 0);
+    autoincrement = sql_mentions(old_sql, strlen(old_sql), "AUTOINCREMENT", 1);
+    create_sql = sql_create_table_without(old_sql, new_table, column_name);
+  } else {
+    mdbfs_warning("sqlite: rebuild: \"%s\" is not a table", table_name);
+  }
+
+  sqlite3_finalize(stmt);
+  stmt = NULL;
+
+  if (!create_sql) {
+    mdbfs_warning("sqlite: rebuild: cannot drop \"%s\" from \"%s\" without changing anything else", column_name, table_name);
+    goto quit;
+  }
+
+  /*
+   * Nothing else may name the table: a view or trigger would stop the new
+   * table from being renamed, and a foreign key would act on dropping the old
+   * one.
+   */
+  if (sqlite3_prepare_v2(g_db, sql_str_get_other_sqls, -1, &stmt, NULL) != SQLITE_OK) {
+    mdbfs_warning("sqlite: rebuild: cannot list what depends on \"%s\": %s", table_name, sqlite3_errmsg(g_db));
+    goto quit;
+  }
+  sqlite3_bind_text(stmt, 1, table_name, -1, SQLITE_STATIC);
+
+  while ((r = sqlite3_step(stmt)) == SQLITE_ROW) {
+    const char *type = (const char *)sqlite3_column_text(stmt, 0);
+    const char *name = (const char *)sqlite3_column_text(stmt, 1);
+    const char *other_sql = (const char *)sqlite3_column_text(stmt, 2);
+
+    if (sql_mentions(other_sql, strlen(other_sql), table_name, 0)) {
+      mdbfs_warning("sqlite: rebuild: %s \"%s\" names \"%s\", refusing to rebuild it", type, name, table_name);
+      goto quit;
+    }
+  }
+
+  sqlite3_finalize(stmt);
+  stmt = NULL;
+
+  if (r != SQLITE_DONE) {
+    mdbfs_warning("sqlite: rebuild: cannot list what depends on \"%s\": %s", table_name, sqlite3_errmsg(g_db));
+    goto quit;
+  }
+
+  /* List the other columns to copy */
+  if (!describe_table(&stmt, table_name)) {
+    mdbfs_warning("sqlite: rebuild: cannot describe \"%s\": %s", table_name, sqlite3_errmsg(g_db));
+    goto quit;
+  }
+
+  while ((r = sqlite3_step(stmt)) == SQLITE_ROW) {
+    const char *name = (const char *)sqlite3_column_text(stmt, 1);
+
+    if (strcmp(name, column_name) == 0)
+      continue;
+
+    cols = mdbfs_realloc(cols, cols_length + strlen(name) + 5);
+    if (!cols_length)
+      cols[0] = '\0';
+    cols_length += strlen(name) + 4;
+
+    if (ncols)
+      strcat(cols, ", ");
+    sprintf(cols + strlen(cols), "\"%s\"", name);
+    ncols += 1;
+  }
+
+  sqlite3_finalize(stmt);
+  stmt = NULL;
+
+  if (r != SQLITE_DONE || ncols == 0) {
+    mdbfs_warning("sqlite: rebuild: cannot list the columns of \"%s\" to copy", table_name);
+    goto quit;
+  }
+
+  /* Remember the triggers, then the indexes, to recreate */
+  if (sqlite3_prepare_v2(g_db, sql_str_get_trigger_sqls, -1, &stmt, NULL) != SQLITE_OK) {
+    mdbfs_warning("sqlite: rebuild: cannot list triggers of \"%s\": %s", table_name, sqlite3_errmsg(g_db));
+    goto quit;
+  }
+  sqlite3_bind_text(stmt, 1, table_name, -1, SQLITE_STATIC);
+
+  while ((r = sqlite3_step(stmt)) == SQLITE_ROW) {
+    const char *trigger_name = (const char *)sqlite3_column_text(stmt, 0);
+    const char *trigger_sql = (const char *)sqlite3_column_text(stmt, 1);
+
+    if (sql_mentions(trigger_sql, strlen(trigger_sql), column_name, 0)) {
+      mdbfs_warning("sqlite: rebuild: trigger \"%s\" names \"%s\", refusing to drop it", trigger_name, column_name);
+      goto quit;
+    }
+
+    sqls = mdbfs_realloc(sqls, (nsqls + 2) * sizeof(char *));
+    sqls[nsqls] = mdbfs_malloc0(strlen(trigger_sql) + 1);
+    strcpy(sqls[nsqls], trigger_sql);
+    sqls[++nsqls] = NULL;
+  }
+
+  sqlite3_finalize(stmt);
+  stmt = NULL;
+  ntriggers = nsqls;
+
+  if (r != SQLITE_DONE) {
+    mdbfs_warning("sqlite: rebuild: cannot list triggers of \"%s\": %s", table_name, sqlite3_errmsg(g_db));
+    goto quit;
+  }
+
+  if (sqlite3_prepare_v2(g_db, sql_str_get_index_sqls, -1, &stmt, NULL) != SQLITE_OK) {
+    mdbfs_warning("sqlite: rebuild: cannot list indexes of \"%s\": %s", table_name, sqlite3_errmsg(g_db));
+    goto quit;
+  }
+  sqlite3_bind_text(stmt, 1, table_name, -1, SQLITE_STATIC);
+
+  while (sqlite3_step(stmt) == SQLITE_ROW) {
+    const char *index_name = (const char *)sqlite3_column_text(stmt, 0);
+    const char *index_sql = (const char *)sqlite3_column_text(stmt, 1);
+    sqlite3_stmt *info = NULL;
+    int involved = 0;
+
+    if (sqlite3_prepare_v2(g_db, sql_str_get_index_info, -1, &info, NULL) == SQLITE_OK) {
+      sqlite3_bind_text(info, 1, index_name, -1, SQLITE_STATIC);
+      while (sqlite3_step(info) == SQLITE_ROW) {
+        const char *name = (const char *)sqlite3_column_text(info, 2);
+        if (name && strcmp(name, column_name) == 0)
+          involved = 1;
+      }
+    }
+    sqlite3_finalize(info);
+
+    /* Indexes on expressions have no column name to tell by */
+    if (!involved)
+      involved = sql_mentions(index_sql, strlen(index_sql), column_name, 0);
+
+    if (involved) {
+      mdbfs_info("sqlite: rebuild: index \"%s\" involves \"%s\", dropping it", index_name, column_name);
+      continue;
+    }
+
+    sqls = mdbfs_realloc(sqls, (nsqls + 2) * sizeof(char *));
+    sqls[nsqls] = mdbfs_malloc0(strlen(index_sql) + 1);
+    strcpy(sqls[nsqls], index_sql);
+    sqls[++nsqls] = NULL;
+  }
+
+  sqlite3_finalize(stmt);
+  stmt = NULL;
+  nindexes = nsqls - ntriggers;
+
+  /* From here on, other writes wait (see write_begin) */
+  if (!mdbfs_backend_sqlite_begin())
+    goto quit;
+  in_transaction = 1;
+
+  mdbfs_metric_set(running, 1);
+  mdbfs_metric_set(rows_copied, 0);
+
+  sql = sql_from_fmt(sql_fmt_count_from, table);
+  if (sql && sqlite3_prepare_v2(g_db, sql, -1, &stmt, NULL) == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW)
+    mdbfs_metric_set(rows_total, sqlite3_column_int64(stmt, 0));
+  sqlite3_finalize(stmt);
+  stmt = NULL;
+  mdbfs_free(sql);
+  sql = NULL;
+
+  mdbfs_info("sqlite: rebuild: rebuilding \"%s\" (%lld rows) without \"%s\"", table_name, (long long)mdbfs_metric_value(rows_total), column_name);
+
+  if (!exec_simple(create_sql, "rebuild"))
+    goto quit;
+
+  /* Copy rows in ROWID order, one batch at a time */
+  sql = sql_from_fmt(sql_fmt_insert_into_select_batch, new_table, cols, cols, table);
+  if (!sql || sqlite3_prepare_v2(g_db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+    mdbfs_warning("sqlite: rebuild: cannot prepare copying rows: %s", sqlite3_errmsg(g_db));
+    goto quit;
+  }
+  mdbfs_free(sql);
+
+  sqlite3_stmt *max_stmt = NULL;
+  sql = sql_from_fmt(sql_fmt_select_max_rowid_from, new_table);
+  if (!sql || sqlite3_prepare_v2(g_db, sql, -1, &max_stmt, NULL) != SQLITE_OK) {
+    mdbfs_warning("sqlite: rebuild: cannot prepare tracking copied rows: %s", sqlite3_errmsg(g_db));
+    sqlite3_finalize(max_stmt);
+    goto quit;
+  }
+  mdbfs_free(sql);
+  sql = NULL;
+
+  sqlite3_int64 next = INT64_MIN;
+  for (;;) {
+    sqlite3_bind_int64(stmt, 1, next);
+    sqlite3_bind_int64(stmt, 2, MDBFS_SQLITE_REBUILD_BATCH_ROWS);
+    r = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+
+    if (r != SQLITE_DONE) {
+      mdbfs_warning("sqlite: rebuild: cannot copy rows: %s", sqlite3_errmsg(g_db));
+      break;
+    }
+
+    int copied = sqlite3_changes(g_db);
+    mdbfs_metric_add(rows_copied, copied);
+    mdbfs_debug("sqlite: rebuild: %lld of %lld rows copied", (long long)mdbfs_metric_value(rows_copied), (long long)mdbfs_metric_value(rows_total));
+
+    if (copied < MDBFS_SQLITE_REBUILD_BATCH_ROWS) {
+      r = 1;
+      break;
+    }
+
+    r = sqlite3_step(max_stmt);
+    next = sqlite3_column_int64(max_stmt, 0);
+    sqlite3_reset(max_stmt);
+    if (r != SQLITE_ROW) {
+      r = 0;
+      break;
+    }
+
+    /* Nothing can come after the largest ROWID */
+    if (next == INT64_MAX) {
+      r = 1;
+      break;
+    }
+    next += 1;
+  }
+
+  sqlite3_finalize(max_stmt);
+  sqlite3_finalize(stmt);
+  stmt = NULL;
+  if (!r)
+    goto quit;
+
+  /* Carry the AUTOINCREMENT counter over, as copying rows may leave it short */
+  if (autoincrement) {
+    const char *seq_sqls[] = { sql_str_delete_sequence, sql_str_copy_sequence };
+
+    for (size_t i = 0; i < sizeof(seq_sqls) / sizeof(seq_sqls[0]); i++) {
+      r = sqlite3_prepare_v2(g_db, seq_sqls[i], -1, &stmt, NULL) == SQLITE_OK;
+      if (r) {
+        sqlite3_bind_text(stmt, 1, table_name, -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 2, new_name, -1, SQLITE_STATIC);
+        r = sqlite3_step(stmt) == SQLITE_DONE;
+      }
+      sqlite3_finalize(stmt);
+      stmt = NULL;
+
+      if (!r) {
+        mdbfs_warning("sqlite: rebuild: cannot carry the AUTOINCREMENT counter over: %s", sqlite3_errmsg(g_db));
+        goto quit;
+      }
+    }
+  }
+
+  /* Replace the table */
+  sql = sql_from_fmt(sql_fmt_drop_table, table);
+  r = sql ? exec_simple(sql, "rebuild") : 0;
+  mdbfs_free(sql);
+  sql = NULL;
+  if (!r)
+    goto quit;
+
+  sql = sql_from_fmt(sql_fmt_alter_table_rename_to, new_table, table_name);
+  r = sql ? exec_simple(sql, "rebuild") : 0;
+  mdbfs_free(sql);
+  sql = NULL;
+  if (!r)
+    goto quit;
+
+  for (size_t i = 0; i < nsqls; i++)
+    if (!exec_simple(sqls[i], "rebuild"))
+      goto quit;
+
+  in_transaction = 0;
+  if (!mdbfs_backend_sqlite_commit())
+    goto quit;
+
+  mdbfs_info("sqlite: rebuild: rebuilt \"%s\" without \"%s\" (%zu indexes and %zu triggers recreated)", table_name, column_name, nindexes, ntriggers);
+  ret = 1;
+
+quit:
+  if (in_transaction)
+    mdbfs_backend_sqlite_rollback();
+  mdbfs_metric_set(running, 0);
+
+  sqlite3_finalize(stmt);
+  if (sqls) {
+    for (size_t i = 0; sqls[i]; i++)
+      mdbfs_free(sqls[i]);
+    mdbfs_free(sqls);
+  }
+  mdbfs_free(sql);
+  mdbfs_free(table);
+  mdbfs_free(new_table);
+  mdbfs_free(new_name);
+  mdbfs_free(create_sql);
+  mdbfs_free(cols);
+  return ret;
+}
+
+/**
+ * Forget cached cell lengths. The caller must hold `g_rows_lock`.
+ */
+static void attrs_clear_locked(void)
+{
+  for (size_t i = 0; i < g_attrs_nrows; i++)
+    mdbfs_free(g_attrs[i].col_lengths);
+  mdbfs_free(g_attrs);
+  g_attrs = NULL;
+  g_attrs_nrows = 0;
+
+  for (size_t i = 0; i < g_attrs_ncols; i++)
+    mdbfs_free(g_attrs_col_names[i]);
+  mdbfs_free(g_attrs_col_names);
+  g_attrs_col_names = NULL;
+  g_attrs_ncols = 0;
+
+  mdbfs_free(g_attrs_table);
+}
+
+/**
+ * Free a cached row.
+ *
+ * @param row [in] The row. May be NULL.
+ */
+static void cached_row_free(struct cached_row *row)
+{
+  if (!row)
+    return;
+
+  for (size_t i = 0; i < row->ncols; i++)
+    mdbfs_free(row->col_names[i]);
+  mdbfs_free(row->col_names);
+  mdbfs_free(row->col_types);
+  mdbfs_free(row->col_offsets);
+  mdbfs_free(row->col_lengths);
+  mdbfs_free(row->data);
+  mdbfs_free(row->table_name);
+  mdbfs_free(row->row_name);
+  mdbfs_free(row);
+}
+
+/**
+ * Drop every cached row and cell length, e.g. after the schema changes.
+ */
+static void row_cache_clear(void)
+{
+  pthread_mutex_lock(&g_rows_lock);
+
+  g_rows_generation++;
+  for (int i = 0; i < MDBFS_SQLITE_ROW_CACHE_ROWS; i++) {
+    cached_row_free(g_rows[i]);
+    g_rows[i] = NULL;
+  }
+  attrs_clear_locked();
+
+  pthread_mutex_unlock(&g_rows_lock);
+}
+
+/**
+ * Milliseconds from `from` to `to`.
+ */
+static int64_t ms_between(const struct timespec *from, const struct timespec *to)
+{
+  return (to->tv_sec - from->tv_sec) * 1000 + (to->tv_nsec - from->tv_nsec) / 1000000;
+}
+
+/**
+ * Give up statements run for a request that has been interrupted or has run
+ * out of time (see utils/cancel.h); installed with sqlite3_progress_handler.
+ *
+ * As it runs on the thread stepping the statement, this only stops the work
+ * of that request, unlike sqlite3_interrupt, which would stop every statement
+ * on the shared connection, including those of other requests.
+ */
+static int progress(void *data)
+{
+  (void)data;
+
+  return mdbfs_cancel_check() != 0;
+}
+
+/**
+ * Commit the batch of created rows, if there is one. The caller must hold
+ * `g_batch_lock`.
+ *
+ * @return 1 on success (or if there is nothing to commit), 0 on failure, in
+ *         which case the batch is left open, unless sqlite3 has rolled it back.
+ */
+static int batch_commit_locked(void)
+{
+  int r = SQLITE_BUSY;
+
+  if (g_transaction != TRANSACTION_BATCH)
+    return 1;
+
+  mdbfs_debug("sqlite: batch: committing %lld created rows", (long long)g_batch_rows);
+
+  /* Rows of the batch have been reported created, so it is never rolled back;
+   * while the database is busy, the transaction stays open to be committed
+   */
+  for (int i = 0; i < MDBFS_SQLITE_BATCH_COMMIT_ATTEMPTS && r == SQLITE_BUSY; i++)
+    r = sqlite3_exec(g_db, sql_str_commit, NULL, NULL, NULL);
+
+  if (r == SQLITE_OK || sqlite3_get_autocommit(g_db)) {
+    /* Other threads may have cached the rows while they were uncommitted */
+    if (r != SQLITE_OK) {
+      mdbfs_error("sqlite: batch: %lld created rows are lost, as sqlite3 has rolled them back: %s", (long long)g_batch_rows, sqlite3_errstr(r));
+      row_cache_clear();
+    }
+
+    g_transaction = TRANSACTION_NONE;
+    g_batch_rows = 0;
+    return r == SQLITE_OK;
+  }
+
+  mdbfs_warning("sqlite: batch: cannot commit %lld created rows yet: %s", (long long)g_batch_rows, sqlite3_errstr(r));
+  return 0;
+}
+
+/**
+ * Commit the paused transaction of mdbfs_backend_sqlite_begin. The caller must
+ * hold `g_batch_lock`.
+ *
+ * @return 1 on success, 0 on failure, in which case the transaction is left
+ *         open to be tried again, unless sqlite3 has rolled it back.
+ */
+static int explicit_commit_locked(void)
+{
+  int r = SQLITE_BUSY;
+
+  mdbfs_debug("sqlite: batch: committing an idle transaction");
+
+  /* As with batches, its writes have been reported done */
+  for (int i = 0; i < MDBFS_SQLITE_BATCH_COMMIT_ATTEMPTS && r == SQLITE_BUSY; i++)
+    r = sqlite3_exec(g_db, sql_str_commit, NULL, NULL, NULL);
+
+  if (r == SQLITE_OK || sqlite3_get_autocommit(g_db)) {
+    if (r != SQLITE_OK) {
+      mdbfs_error("sqlite: batch: an idle transaction is lost, as sqlite3 has rolled it back: %s", sqlite3_errstr(r));
+      g_explicit_lost = 1;
+      row_cache_clear();
+    }
+
+    g_transaction = TRANSACTION_NONE;
+    g_explicit_paused = 0;
+    pthread_cond_broadcast(&g_write_cond);
+    return r == SQLITE_OK;
+  }
+
+  mdbfs_warning("sqlite: batch: cannot commit an idle transaction yet: %s", sqlite3_errstr(r));
+  return 0;
+}
+
+/**
+ * Body of the thread committing batches of created rows, and idle transactions
+ * of mdbfs_backend_sqlite_begin, when they are due.
+ */
+static void *batch_flusher(void *data)
+{
+  (void)data;
+
+  pthread_mutex_lock(&g_batch_lock);
+
+  while (g_flusher_running) {
+    int paused = g_transaction == TRANSACTION_EXPLICIT && g_explicit_paused;
+
+    if (g_transaction != TRANSACTION_BATCH && !paused) {
+      pthread_cond_wait(&g_batch_cond, &g_batch_lock);
+      continue;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    int64_t wait = 0;
+    if (paused) {
+      wait = MDBFS_SQLITE_BATCH_IDLE_MS - ms_between(&g_explicit_touched, &now);
+    } else {
+      int64_t idle = MDBFS_SQLITE_BATCH_IDLE_MS - ms_between(&g_batch_touched, &now);
+      int64_t age  = MDBFS_SQLITE_BATCH_MAX_MS - ms_between(&g_batch_opened, &now);
+      wait = idle < age ? idle : age;
+    }
+
+    /* A batch left open is tried again after a while */
+    if (wait <= 0) {
+      if (paused ? explicit_commit_locked() : batch_commit_locked())
+        continue;
+      wait = MDBFS_SQLITE_BATCH_MAX_MS;
+    }
+
+    /* Condition variables wait on the real time clock */
+    struct timespec until;
+    clock_gettime(CLOCK_REALTIME, &until);
+    until.tv_sec  += wait / 1000;
+    until.tv_nsec += (wait % 1000) * 1000000;
+    if (until.tv_nsec >= 1000000000) {
+      until.tv_sec  += 1;
+      until.tv_nsec -= 1000000000;
+    }
+
+    pthread_cond_timedwait(&g_batch_cond, &g_batch_lock, &until);
+  }
+
+  pthread_mutex_unlock(&g_batch_lock);
+  return NULL;
+}
+
+/**
+ * Wait until a write may go to the connection without joining a transaction
+ * opened by mdbfs_backend_sqlite_begin. The caller must hold `g_batch_lock`,
+ * and keep it while writing.
+ */
+static void write_wait_locked(void)
+{
+  while (g_transaction == TRANSACTION_EXPLICIT || g_explicit_waiting > 0)
+    pthread_cond_wait(&g_write_cond, &g_batch_lock);
+}
+
+/**
+ * Start a write which does not hold `g_batch_lock` throughout, see
+ * write_wait_locked. Each call is paired with write_end.
+ */
+static void write_begin(void)
+{
+  pthread_mutex_lock(&g_batch_lock);
+  write_wait_locked();
+  g_writers += 1;
+  pthread_mutex_unlock(&g_batch_lock);
+}
+
+static void write_end(void)
+{
+  pthread_mutex_lock(&g_batch_lock);
+  g_writers -= 1;
+  if (g_writers == 0)
+    pthread_cond_broadcast(&g_write_cond);
+  pthread_mutex_unlock(&g_batch_lock);
+}
+
+/**
+ * Forget the statements kept by read_versions for attached databases, e.g.
+ * as the databases attached change. The caller must hold `g_versions_lock`.
+ */
+static void versions_clear_locked(void)
+{
+  for (size_t i = 0; i < g_versions_nstmts; i++)
+    sqlite3_finalize(g_versions_stmts[i]);
+  mdbfs_free(g_versions_stmts);
+  g_versions_stmts = NULL;
+  g_versions_nstmts = 0;
+}
+
+/**
+ * Read the versions of the schema (`PRAGMA schema_version`) and of the data
+ * (`PRAGMA data_version`, which moves with changes by other connections).
+ * Both only read the database header; nothing is scanned.
+ *
+ * @param schema_version [out] Version of the schema.
+ * @param data_version   [out] Version of the data.
+ * @return 1 if succeeded, 0 otherwise.
+ */
+static int read_versions(int64_t *schema_version, int64_t *data_version)
+{
+  size_t ndatabases = 0;
+  int ret = 0;
+
+  /* This is asked on every lookup ruled out by a Bloom filter, so the
+   * statement is kept rather than prepared every time
+   */
+  if (g_databases)
+    pthread_mutex_lock(&g_databases_lock);
+  pthread_mutex_lock(&g_versions_lock);
+
+  if (!g_databases) {
+    if (!g_versions_stmt && sqlite3_prepare_v2(g_db, sql_str_get_versions, -1, &g_versions_stmt, NULL) != SQLITE_OK) {
+      g_versions_stmt = NULL;
+      goto quit;
+    }
+
+    if (sqlite3_step(g_versions_stmt) == SQLITE_ROW) {
+      *schema_version = sqlite3_column_int64(g_versions_stmt, 0);
+      *data_version   = sqlite3_column_int64(g_versions_stmt, 1);
+      ret = 1;
+    }
+
+    sqlite3_reset(g_versions_stmt);
+    goto quit;
+  }
+
+  /* With attached databases, a change in any of them is a change; as the
+   * versions only go up, their sums only go up with them. Attaching or
+   * detaching one is a change as well, told by the generation. Pragmas taking
+   * a schema are statements of their own, so these are kept likewise
+   */
+  while (g_databases[ndatabases])
+    ndatabases++;
+
+  if (!g_versions_stmts && ndatabases) {
+    g_versions_stmts = mdbfs_malloc0(2 * ndatabases * sizeof(sqlite3_stmt *));
+    g_versions_nstmts = 2 * ndatabases;
+
+    for (size_t i = 0; i < g_versions_nstmts; i++) {
+      char *sql = sql_from_fmt(sql_fmt_pragma_of, g_databases[i / 2], i % 2 ? "data_version" : "schema_version");
+      int r = sql ? sqlite3_prepare_v2(g_db, sql, -1, &g_versions_stmts[i], NULL) : SQLITE_NOMEM;
+
+      mdbfs_free(sql);
+      if (r != SQLITE_OK) {
+        versions_clear_locked();
+        goto quit;
+      }
+    }
+  }
+
+  *schema_version = g_databases_generation;
+  *data_version = g_databases_generation;
+  ret = 1;
+
+  for (size_t i = 0; i < g_versions_nstmts; i++) {
+    if (sqlite3_step(g_versions_stmts[i]) == SQLITE_ROW)
+      *(i % 2 ? data_version : schema_version) += sqlite3_column_int64(g_versions_stmts[i], 0);
+    else
+      ret = 0;
+
+    sqlite3_reset(g_versions_stmts[i]);
+  }
+
+quit:
+  pthread_mutex_unlock(&g_versions_lock);
+  if (g_databases)
+    pthread_mutex_unlock(&g_databases_lock);
+  return ret;
+}
+
+/**
+ * Free a cached schema.
+ *
+ * @param schema [in] The schema. May be NULL.
+ */
+static void schema_free(struct schema *schema)
+{
+  if (!schema)
+    return;
+
+  for (int i = 0; schema->col_names && schema->col_names[i]; i++) {
+    mdbfs_free(schema->col_names[i]);
+    mdbfs_free(schema->col_decltypes[i]);
+  }
+  mdbfs_free(schema->col_names);
+  mdbfs_free(schema->col_decltypes);
+  mdbfs_free(schema->table_name);
+  mdbfs_free(schema);
+}
+
+/**
+ * Forget every cached schema. The caller must hold `g_schemas_lock`.
+ */
+static void schemas_clear_locked(void)
+{
+  while (g_schemas) {
+    struct schema *schema = g_schemas;
+    g_schemas = schema->next;
+    schema_free(schema);
+  }
+
+  g_schemas_version = -1;
+}
+
+/**
+ * Find the cached schema of a table, loading it from `PRAGMA table_info` if it
+ * is not cached. The cache is dropped as a whole once the schema version of
+ * the database moves. The caller must hold `g_schemas_lock`.
+ *
+ * @param table_name   [in]  Name of the table or view.
+ * @param data_version [out] `PRAGMA data_version` at the moment.
+ * @return The schema, or NULL if the table does not exist or on errors.
+ */
+static struct schema *schema_lookup_locked(const char *table_name, int64_t *data_version)
+{
+  sqlite3_stmt *stmt = NULL;
+  struct schema *ret = NULL;
+  int64_t schema_version = 0;
+  size_t ncols = 0;
+  int r = 0;
+
+  if (!read_versions(&schema_version, data_version)) {
+    mdbfs_warning("sqlite: schema_lookup: cannot tell the schema version: %s", sqlite3_errmsg(g_db));
+    goto quit;
+  }
+
+  if (schema_version != g_schemas_version) {
+    schemas_clear_locked();
+    g_schemas_version = schema_version;
+  }
+
+  for (ret = g_schemas; ret; ret = ret->next) {
+    if (strcmp(ret->table_name, table_name) == 0)
+      goto quit;
+  }
+
+  if (!describe_table(&stmt, table_name)) {
+    mdbfs_error("sqlite: schema_lookup: sqlite3 cannot prepare a sql statement for us: %s", sqlite3_errmsg(g_db));
+    goto quit;
+  }
+
+  ret = mdbfs_malloc0(sizeof(struct schema));
+  ret->row_estimate = -1;
+
+  /* Columns of table_info: cid, name, type, notnull, dflt_value, pk */
+  for (;;) {
+    r = sqlite3_step(stmt);
+    if (r != SQLITE_ROW)
+      break;
+
+    const char *name     = (const char *)sqlite3_column_text(stmt, 1);
+    const char *decltype = (const char *)sqlite3_column_text(stmt, 2);
+
+    /* Stretch vectors, keeping a NULL at the end */
+    ncols += 1;
+    ret->col_names     = mdbfs_realloc(ret->col_names, (ncols + 1) * sizeof(char *));
+    ret->col_decltypes = mdbfs_realloc(ret->col_decltypes, (ncols + 1) * sizeof(char *));
+
+    ret->col_names[ncols - 1]     = mdbfs_malloc0(strlen(name ? name : "") + 1);
+    ret->col_decltypes[ncols - 1] = mdbfs_malloc0(strlen(decltype ? decltype : "") + 1);
+    strcpy(ret->col_names[ncols - 1], name ? name : "");
+    strcpy(ret->col_decltypes[ncols - 1], decltype ? decltype : "");
+    ret->col_names[ncols]     = NULL;
+    ret->col_decltypes[ncols] = NULL;
+  }
+
+  /* A table without columns does not exist */
+  if (r != SQLITE_DONE || !ncols) {
+    if (r != SQLITE_DONE)
+      mdbfs_warning("sqlite: schema_lookup: sqlite3 reported an error: %s", sqlite3_errmsg(g_db));
+
+    schema_free(ret);
+    ret = NULL;
+    goto quit;
+  }
+
+  ret->table_name = mdbfs_malloc0(strlen(table_name) + 1);
+  strcpy(ret->table_name, table_name);
+
+  ret->next = g_schemas;
+  g_schemas = ret;
+
+  mdbfs_debug("sqlite: schema_lookup: cached the schema of \"%s\" (%zu columns)", table_name, ncols);
+
+quit:
+  sqlite3_finalize(stmt);
+  return ret;
+}
+
+/**
+ * Estimate the number of rows in a table without counting them: from the
+ * statistics gathered by `ANALYZE` (`sqlite_stat1`) if there are any, or from
+ * the largest ROWID otherwise, which is one lookup at the end of the B-tree.
+ *
+ * @param table_name [in] Name of the table.
+ * @return The estimate, or -1 if there is no cheap way to tell (e.g. views).
+ */
+static int64_t estimate_rows(const char *table_name)
+{
+  sqlite3_stmt *stmt = NULL;
+  char *sql = NULL;
+  char *table = NULL;
+  int64_t ret = -1;
+
+  /* Preparing fails if the database has never been analyzed, which is fine */
+  table = sql_table_in(table_name, "sqlite_stat1");
+  sql = sql_from_fmt(sql_fmt_get_stat1_rows, table);
+  if (sql && sqlite3_prepare_v2(g_db, sql, -1, &stmt, NULL) == SQLITE_OK) {
+    sqlite3_bind_text(stmt, 1, table_base(table_name), -1, SQLITE_STATIC);
+
+    /* The first number of "stat" is the number of rows */
+    if (sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_type(stmt, 0) != SQLITE_NULL) {
+      ret = strtoll((const char *)sqlite3_column_text(stmt, 0), NULL, 10);
+      goto quit;
+    }
+
+    sqlite3_finalize(stmt);
+    stmt = NULL;
+  }
+
+  mdbfs_free(sql);
+  mdbfs_free(table);
+  sql = NULL;
+  table = NULL;
+
+  if (is_view(table_name))
+    goto quit;
+
+  table = sql_table(table_name);
+  sql = sql_from_fmt(sql_fmt_select_max_rowid_from, table);
+  if (!sql) {
+    mdbfs_error("sqlite: estimate_rows: no sql no life!");
+    goto quit;
+  }
+
+  /* Tables without ROWIDs fail here, and have no estimate */
+  if (sqlite3_prepare_v2(g_db, sql, -1, &stmt, NULL) == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW)
+    ret = sqlite3_column_int64(stmt, 0); /* NULL (an empty table) reads 0 */
+
+quit:
+  mdbfs_free(sql);
+  mdbfs_free(table);
+  sqlite3_finalize(stmt);
+  return ret;
+}
+
+/**
+ * Order cached cell lengths by ROWID, for bsearch.
+ */
+static int attrs_compare(const void *a, const void *b)
+{
+  int64_t ra = ((const struct cached_attrs *)a)->rowid;
+  int64_t rb = ((const struct cached_attrs *)b)->rowid;
+
+  return (ra > rb) - (ra < rb);
+}
+
+/**
+ * Read the version of the data which cached rows and cell lengths are stamped
+ * with. They are trusted while it stays the same, i.e. until another
+ * connection changes the database; changes made through this one drop what
+ * they touch right away (see row_cache_hook). This must be called without
+ * `g_rows_lock` held, and before what is stamped is fetched.
+ *
+ * @return `PRAGMA data_version`, or -1 if it cannot be read, which no stamp
+ *         matches.
+ */
+static int64_t rows_data_version(void)
+{
+  int64_t schema_version = 0;
+  int64_t data_version = 0;
+
+  return read_versions(&schema_version, &data_version) ? data_version : -1;
+}
+
+/**
+ * Find the cached cell lengths of a row. The caller must hold `g_rows_lock`.
+ *
+ * @param table_name   [in] Name of the table.
+ * @param row_name     [in] Name of the row.
+ * @param data_version [in] Version of the data now, see rows_data_version.
+ * @return The cell lengths, or NULL if they are not cached.
+ */
+static struct cached_attrs *attrs_find_locked(const char *table_name, const char *row_name, int64_t data_version)
+{
+  char *end = NULL;
+
+  if (!g_attrs_table || strcmp(g_attrs_table, table_name) != 0)
+    return NULL;
+
+  if (data_version < 0 || g_attrs_data_version != data_version) {
+    attrs_clear_locked();
+    return NULL;
+  }
+
+  struct cached_attrs key = {.rowid = strtoll(row_name, &end, 10)};
+  if (!*row_name || *end)
+    return NULL;
+
+  struct cached_attrs *ret = bsearch(&key, g_attrs, g_attrs_nrows, sizeof(struct cached_attrs), attrs_compare);
+  return ret && ret->col_lengths ? ret : NULL;
+}
+
+/**
+ * Join an identical lookup in flight and wait for it to land, or start one.
+ *
+ * @param kind   [in]  What is looked up, e.g. "rowids".
+ * @param key    [in]  Of what, e.g. the table name. May be NULL.
+ * @param subkey [in]  Further, e.g. the row name. May be NULL.
+ * @param leader [out] Set if the caller has started the lookup, and is to run
+ *                     it and land the flight with flight_land.
+ * @return The flight, to be left with flight_leave.
+ */
+static struct flight *flight_join(const char *kind, const char *key, const char *subkey, int *leader)
+{
+  struct flight *flight = NULL;
+
+  pthread_mutex_lock(&g_flights_lock);
+
+  for (flight = g_flights; flight; flight = flight->next)
+    if (flight->kind == kind &&
+        strcmp(flight->key    ? flight->key    : "", key    ? key    : "") == 0 &&
+        strcmp(flight->subkey ? flight->subkey : "", subkey ? subkey : "") == 0)
+      break;
+
+  if (flight) {
+    mdbfs_metric_add(mdbfs_metric_get("sqlite_lookups_coalesced"), 1);
+
+    *leader = 0;
+    flight->refs++;
+    while (!flight->done)
+      pthread_cond_wait(&g_flights_cond, &g_flights_lock);
+  } else {
+    *leader = 1;
+    flight = mdbfs_malloc0(sizeof(struct flight));
+    flight->kind = kind;
+    if (key) {
+      flight->key = mdbfs_malloc0(strlen(key) + 1);
+      strcpy(flight->key, key);
+    }
+    if (subkey) {
+      flight->subkey = mdbfs_malloc0(strlen(subkey) + 1);
+      strcpy(flight->subkey, subkey);
+    }
+    flight->refs = 1;
+    flight->next = g_flights;
+    g_flights = flight;
+  }
+
+  pthread_mutex_unlock(&g_flights_lock);
+  return flight;
+}
+
+/**
+ * Land a flight with the result of its lookup, waking whoever waits for it.
+ * Lookups starting from now on start a flight of their own.
+ *
+ * @param flight [in] The flight, started by the caller.
+ * @param result [in] What has been looked up, which the flight takes over.
+ *                    May be NULL.
+ * @param found  [in] Whether the thing looked up exists.
+ */
+static void flight_land(struct flight *flight, void *result, int found)
+{
+  pthread_mutex_lock(&g_flights_lock);
+
+  for (struct flight **p = &g_flights; *p; p = &(*p)->next) {
+    if (*p == flight) {
+      *p = flight->next;
+      break;
+    }
+  }
+
+  flight->result = result;
+  flight->found  = found;
+  flight->done   = 1;
+  pthread_cond_broadcast(&g_flights_cond);
+
+  pthread_mutex_unlock(&g_flights_lock);
+}
+
+/**
+ * Leave a landed flight with its result.
+ *
+ * @param flight [in]  The flight.
+ * @param found  [out] Whether the thing looked up exists. May be NULL.
+ * @param copy   [in]  Function copying the result, for all but the last to
+ *                     leave. May be NULL if the flight lands with no result.
+ * @return What has been looked up, or NULL. The caller is responsible for
+ *         freeing it.
+ */
+static void *flight_leave(struct flight *flight, int *found, void *(*copy)(const void *))
+{
+  void *ret = NULL;
+
+  pthread_mutex_lock(&g_flights_lock);
+
+  if (found)
+    *found = flight->found;
+
+  /* The last to leave takes the result itself, everyone else a copy */
+  if (--flight->refs == 0) {
+    ret = flight->result;
+    mdbfs_free(flight->key);
+    mdbfs_free(flight->subkey);
+    mdbfs_free(flight);
+  } else if (flight->result && copy) {
+    ret = copy(flight->result);
+  }
+
+  pthread_mutex_unlock(&g_flights_lock);
+  return ret;
+}
+
+/**
+ * Count a lookup answered by a Bloom filter, and update its false positive
+ * rate: rows the filter could not rule out but which do not exist, out of all
+ * rows which do not exist.
+ *
+ * @param false_positive [in] Whether the row has been looked up in vain.
+ */
+static void bloom_count(int false_positive)
+{
+  struct mdbfs_metric *negatives = mdbfs_metric_get("sqlite_bloom_negatives");
+  struct mdbfs_metric *false_positives = mdbfs_metric_get("sqlite_bloom_false_positives");
+
+  mdbfs_metric_add(false_positive ? false_positives : negatives, 1);
+
+  int64_t fp = mdbfs_metric_value(false_positives);
+  int64_t all = fp + mdbfs_metric_value(negatives);
+  mdbfs_metric_set(mdbfs_metric_get("sqlite_bloom_false_positive_ppm"), all ? fp * 1000000 / all : 0);
+}
+
+/**
+ * Stop trusting the Bloom filters, and have them built again.
+ */
+static void bloom_invalidate(void)
+{
+  pthread_mutex_lock(&g_bloom_lock);
+
+  for (struct bloom *bloom = g_blooms; bloom; bloom = bloom->next)
+    bloom->ready = 0;
+
+  g_bloom_stale = 1;
+  pthread_cond_signal(&g_bloom_cond);
+
+  pthread_mutex_unlock(&g_bloom_lock);
+}
+
+/**
+ * Ask the Bloom filter of a table whether a row may exist.
+ *
+ * @param table_name [in] Name of the table.
+ * @param row_name   [in] Name of the row.
+ * @return 0 if the row surely does not exist, 1 if it may, or -1 if there is
+ *         no filter to ask.
+ */
+static int bloom_check(const char *table_name, const char *row_name)
+{
+  int64_t schema_version = 0;
+  int64_t data_version = 0;
+  char *end = NULL;
+  int ret = -1;
+
+  int64_t rowid = strtoll(row_name, &end, 10);
+  if (!*row_name || *end)
+    return -1;
+
+  pthread_mutex_lock(&g_bloom_lock);
+
+  for (struct bloom *bloom = g_blooms; bloom; bloom = bloom->next) {
+    if (bloom->ready && strcmp(bloom->table_name, table_name) == 0) {
+      ret = mdbfs_bloom_may_contain(bloom->filter, &rowid, sizeof(rowid));
+      schema_version = bloom->schema_version;
+      data_version = bloom->data_version;
+      break;
+    }
+  }
+
+  pthread_mutex_unlock(&g_bloom_lock);
+
+  if (ret != 0)
+    return ret;
+
+  /* The filter stands for the database as it was scanned, plus our changes
+   * since; a negative is trusted only if nobody else has changed it
+   */
+  int64_t schema_version_now = 0;
+  int64_t data_version_now = 0;
+  if (!read_versions(&schema_version_now, &data_version_now) ||
+      schema_version_now != schema_version || data_version_now != data_version) {
+    mdbfs_debug("sqlite: bloom_check: the database has changed; building filters again");
+    bloom_invalidate();
+    return -1;
+  }
+
+  bloom_count(0);
+  return 0;
+}
+
+/**
+ * Keep the Bloom filter of a table up with a change made by this connection,
+ * see row_cache_hook.
+ */
+static void bloom_update(int op, const char *table_name, int64_t rowid)
+{
+  pthread_mutex_lock(&g_bloom_lock);
+
+  for (struct bloom *bloom = g_blooms; bloom; bloom = bloom->next) {
+    if (strcmp(bloom->table_name, table_name) != 0)
+      continue;
+
+    /* Updates may move rows to another ROWID, which is what is told */
+    if (op != SQLITE_DELETE) {
+      mdbfs_bloom_add(bloom->filter, &rowid, sizeof(rowid));
+    } else {
+      mdbfs_bloom_remove(bloom->filter);
+      if (mdbfs_bloom_is_stale(bloom->filter)) {
+        g_bloom_stale = 1;
+        pthread_cond_signal(&g_bloom_cond);
+      }
+    }
+    break;
+  }
+
+  pthread_mutex_unlock(&g_bloom_lock);
+}
+
+/**
+ * Free Bloom filters.
+ *
+ * @param blooms [in] The filters. May be NULL.
+ */
+static void blooms_free(struct bloom *blooms)
+{
+  while (blooms) {
+    struct bloom *bloom = blooms;
+    blooms = bloom->next;
+    mdbfs_free(bloom->table_name);
+    mdbfs_bloom_free(bloom->filter);
+    mdbfs_free(bloom);
+  }
+}
+
+/**
+ * Drop cached rows as this connection changes them, and add new ROWIDs to the
+ * Bloom filters; installed with sqlite3_update_hook.
+ *
+ * NOTE: This runs with the connection locked, so the row cache must never be
+ * locked while calling into SQLite.
+ */
+static void row_cache_hook(void *data, int op, const char *db_name, const char *table_name, sqlite3_int64 rowid)
+{
+  char *qualified = NULL;
+
+  (void)data;
+
+  /* Tables of attached databases are known as D/T */
+  if (g_databases && strcmp(db_name, "main") != 0 && strcmp(db_name, "temp") != 0) {
+    qualified = sql_from_fmt("%s/%s", db_name, table_name);
+    table_name = qualified;
+  }
+
+  pthread_mutex_lock(&g_rows_lock);
+
+  g_rows_generation++;
+  for (int i = 0; i < MDBFS_SQLITE_ROW_CACHE_ROWS; i++) {
+    struct cached_row *row = g_rows[i];
+    if (!row)
+      continue;
+
+    if (row->is_view || (row->rowid == rowid && strcmp(row->table_name, table_name) == 0)) {
+      cached_row_free(row);
+      g_rows[i] = NULL;
+    }
+  }
+
+  if (g_attrs_table && strcmp(g_attrs_table, table_name) == 0) {
+    struct cached_attrs key = {.rowid = rowid};
+    struct cached_attrs *attrs = bsearch(&key, g_attrs, g_attrs_nrows, sizeof(struct cached_attrs), attrs_compare);
+
+    if (attrs) {
+      mdbfs_free(attrs->col_lengths);
+      attrs->col_lengths = NULL;
+    }
+  }
+
+  pthread_mutex_unlock(&g_rows_lock);
+
+  /* Filters are of tables in the databases, not temporary ones */
+  if (strcmp(db_name, "temp") != 0)
+    bloom_update(op, table_name, rowid);
+
+  mdbfs_free(qualified);
+}
+
+/**
+ * Build a cached row from the result row a statement stands on.
+ *
+ * @param stmt       [in] The statement, standing on the row.
+ * @param first      [in] Index of the first column of the row in the result.
+ * @param max_bytes  [in] Bytes the rendered row may take at most.
+ * @param table_name [in] Name of the table or view.
+ * @param row_name   [in] Name of the row.
+ * @return The row, or NULL if it is too large. The caller is responsible for
+ *         freeing it.
+ */
+static struct cached_row *cached_row_from_stmt(sqlite3_stmt *stmt, int first, size_t max_bytes, const char *table_name, const char *row_name)
+{
+  struct cached_row *ret = NULL;
+  size_t capacity = 0;
+
+  ret = mdbfs_malloc0(sizeof(struct cached_row));
+  ret->ncols       = sqlite3_column_count(stmt) - first;
+  ret->col_names   = mdbfs_malloc0(ret->ncols * sizeof(char *));
+  ret->col_types   = mdbfs_malloc0(ret->ncols * sizeof(enum mdbfs_backend_sqlite_cell_type));
+  ret->col_offsets = mdbfs_malloc0(ret->ncols * sizeof(size_t));
+  ret->col_lengths = mdbfs_malloc0(ret->ncols * sizeof(size_t));
+
+  for (size_t icol = 0; icol < ret->ncols; icol++) {
+    char number[MDBFS_FORMAT_NUMBER_MAX];
+    const uint8_t *cell = NULL;
+    size_t length = 0;
+
+    const char *col_name = sqlite3_column_name(stmt, first + icol);
+    ret->col_names[icol] = mdbfs_malloc0(strlen(col_name ? col_name : "") + 1);
+    strcpy(ret->col_names[icol], col_name ? col_name : "");
+
+    ret->col_types[icol]   = render_cell(stmt, first + icol, NULL, number, &cell, &length);
+    ret->col_offsets[icol] = ret->size;
+    ret->col_lengths[icol] = length;
+
+    if (ret->size + length > max_bytes) {
+      mdbfs_debug("sqlite: row_cache: row (\"%s\", \"%s\") is too large to be cached", table_name, row_name);
+      cached_row_free(ret);
+      return NULL;
+    }
+
+    /* Stretch the buffer geometrically */
+    if (ret->size + length > capacity) {
+      capacity = (ret->size + length) * 2;
+      ret->data = mdbfs_realloc(ret->data, capacity);
+    }
+
+    if (length)
+      memcpy(ret->data + ret->size, cell, length);
+    ret->size += length;
+  }
+
+  ret->table_name = mdbfs_malloc0(strlen(table_name) + 1);
+  strcpy(ret->table_name, table_name);
+  ret->row_name = mdbfs_malloc0(strlen(row_name) + 1);
+  strcpy(ret->row_name, row_name);
+  ret->rowid = strtoll(row_name, NULL, 10);
+
+  return ret;
+}
+
+/**
+ * Fetch a row whole, with one `SELECT *`.
+ *
+ * @param table_name [in]  Name of the table or view.
+ * @param row_name   [in]  Name of the row.
+ * @param found      [out] Whether the row exists.
+ * @return The row, or NULL if the row does not exist, is too large to be
+ *         cached, or on errors. The caller is responsible for freeing it.
+ */
+static struct cached_row *row_cache_fetch(const char *table_name, const char *row_name, int *found)
+{
+  sqlite3_stmt *stmt = NULL;
+  char *sql = NULL;
+  struct cached_row *ret = NULL;
+  int r = 0;
+
+  *found = 0;
+
+  sql = sql_select_row(NULL, table_name, row_name);
+  if (!sql)
+    goto quit;
+
+  r = sqlite3_prepare_v2(g_db, sql, -1, &stmt, NULL);
+  if (r != SQLITE_OK) {
+    mdbfs_error("sqlite: row_cache_fetch: sqlite3 cannot prepare a sql statement for us: %s", sqlite3_errmsg(g_db));
+    goto quit;
+  }
+
+  if (sqlite3_step(stmt) != SQLITE_ROW)
+    goto quit;
+
+  *found = 1;
+  ret = cached_row_from_stmt(stmt, 0, MDBFS_SQLITE_ROW_CACHE_MAX_BYTES, table_name, row_name);
+  if (ret)
+    ret->is_view = is_view(table_name);
+
+quit:
+  mdbfs_free(sql);
+  sqlite3_finalize(stmt);
+  return ret;
+}
+
+/**
+ * Find a row in the row cache, dropping rows that have gone stale on the way.
+ * The caller must hold `g_rows_lock`.
+ *
+ * @param table_name   [in] Name of the table or view.
+ * @param row_name     [in] Name of the row.
+ * @param data_version [in] Version of the data now, see rows_data_version.
+ * @return The row, or NULL if it is not cached.
+ */
+static struct cached_row *row_cache_find_locked(const char *table_name, const char *row_name, int64_t data_version)
+{
+  for (int i = 0; i < MDBFS_SQLITE_ROW_CACHE_ROWS; i++) {
+    struct cached_row *row = g_rows[i];
+    if (!row)
+      continue;
+
+    if (data_version < 0 || row->data_version != data_version) {
+      cached_row_free(row);
+      g_rows[i] = NULL;
+      continue;
+    }
+
+    if (strcmp(row->row_name, row_name) == 0 && strcmp(row->table_name, table_name) == 0)
+      return row;
+  }
+
+  return NULL;
+}
+
+/**
+ * Put a row into the row cache, in place of the least recently used one. The
+ * caller must hold `g_rows_lock`.
+ *
+ * @param row [in] The row, which the cache takes over.
+ */
+static void row_cache_insert_locked(struct cached_row *row)
+{
+  int victim = 0;
+  for (int i = 1; i < MDBFS_SQLITE_ROW_CACHE_ROWS && g_rows[victim]; i++)
+    if (!g_rows[i] || g_rows[i]->used < g_rows[victim]->used)
+      victim = i;
+
+  cached_row_free(g_rows[victim]);
+  g_rows[victim] = row;
+  row->used = ++g_rows_tick;
+}
+
+/**
+ * Load rows following a ROWID into the row cache, with one query.
+ *
+ * @param table_name [in]  Name of the table.
+ * @param from       [in]  Rows after this ROWID are loaded...
+ * @param count      [in]  ... this many of them.
+ * @param trigger    [out] ROWID halfway through the rows loaded, or INT64_MAX
+ *                         if there are none.
+ * @return ROWID of the last row loaded, or `from` if there are none.
+ */
+static int64_t prefetch_load(const char *table_name, int64_t from, int64_t count, int64_t *trigger)
+{
+  struct cached_row *rows[MDBFS_SQLITE_PREFETCH_MAX_ROWS] = {NULL};
+  int64_t rowids[MDBFS_SQLITE_PREFETCH_MAX_ROWS];
+  int64_t nrows = 0;
+  int64_t loaded = 0;
+  sqlite3_stmt *stmt = NULL;
+  char *sql = NULL;
+  char *table = NULL;
+  int r = 0;
+
+  *trigger = INT64_MAX;
+
+  if (count > MDBFS_SQLITE_PREFETCH_MAX_ROWS)
+    count = MDBFS_SQLITE_PREFETCH_MAX_ROWS;
+
+  /* Rows of views are named by positions, not ROWIDs */
+  if (is_view(table_name))
+    goto quit;
+
+  pthread_mutex_lock(&g_rows_lock);
+  uint64_t generation = g_rows_generation;
+  pthread_mutex_unlock(&g_rows_lock);
+
+  int64_t data_version = rows_data_version();
+
+  table = sql_table(table_name);
+  sql = sql_from_fmt(sql_fmt_select_rowid_all_from_after, table);
+  if (!sql)
+    goto quit;
+
+  r = sqlite3_prepare_v2(g_db, sql, -1, &stmt, NULL);
+  if (r != SQLITE_OK) {
+    /* e.g. WITHOUT ROWID tables */
+    mdbfs_debug("sqlite: prefetch: cannot walk \"%s\" by ROWID: %s", table_name, sqlite3_errmsg(g_db));
+    goto quit;
+  }
+
+  sqlite3_bind_int64(stmt, 1, from);
+  sqlite3_bind_int64(stmt, 2, count);
+
+  while (nrows < count && sqlite3_step(stmt) == SQLITE_ROW) {
+    char row_name[MDBFS_FORMAT_NUMBER_MAX];
+
+    rowids[nrows] = sqlite3_column_int64(stmt, 0);
+    row_name[mdbfs_format_int64(row_name, rowids[nrows])] = '\0';
+
+    /* Large rows are left out, but still count as walked over */
+    rows[nrows] = cached_row_from_stmt(stmt, 1, MDBFS_SQLITE_PREFETCH_MAX_ROW_BYTES, table_name, row_name);
+    nrows++;
+  }
+
+  if (!nrows)
+    goto quit;
+
+  *trigger = rowids[nrows / 2];
+
+  pthread_mutex_lock(&g_rows_lock);
+
+  /* Rows changed meanwhile may be stale; the walk fetches them itself */
+  for (int64_t i = 0; i < nrows && g_rows_generation == generation; i++) {
+    if (!rows[i] || row_cache_find_locked(table_name, rows[i]->row_name, data_version))
+      continue;
+
+    rows[i]->data_version = data_version;
+    rows[i]->prefetched = 1;
+    row_cache_insert_locked(rows[i]);
+    rows[i] = NULL;
+    loaded++;
+  }
+
+  pthread_mutex_unlock(&g_rows_lock);
+
+  mdbfs_debug("sqlite: prefetch: loaded %lld rows of \"%s\" after %lld", (long long)loaded, table_name, (long long)from);
+  mdbfs_metric_add(mdbfs_metric_get("sqlite_prefetch_rows"), loaded);
+
+quit:
+  for (int64_t i = 0; i < nrows; i++)
+    cached_row_free(rows[i]);
+  mdbfs_free(sql);
+  mdbfs_free(table);
+  sqlite3_finalize(stmt);
+  return nrows ? rowids[nrows - 1] : from;
+}
+
+/**
+ * Body of the thread loading rows ahead of a walk, as requested by
+ * prefetch_visit.
+ */
+static void *prefetcher(void *data)
+{
+  (void)data;
+
+  pthread_mutex_lock(&g_prefetch_lock);
+
+  while (g_prefetcher_running) {
+    if (!g_prefetch_pending) {
+      pthread_cond_wait(&g_prefetch_cond, &g_prefetch_lock);
+      continue;
+    }
+
+    g_prefetch_pending = 0;
+
+    uint64_t stream = g_prefetch_stream;
+    int64_t  from   = g_prefetch_from;
+    int64_t  count  = g_prefetch_count;
+    char *table_name = mdbfs_malloc0(strlen(g_prefetch_table) + 1);
+    strcpy(table_name, g_prefetch_table);
+
+    /* Load without the walk locked, so that visits do not wait for us */
+    pthread_mutex_unlock(&g_prefetch_lock);
+
+    int64_t trigger = INT64_MAX;
+    int64_t ahead = prefetch_load(table_name, from, count, &trigger);
+    mdbfs_free(table_name);
+
+    pthread_mutex_lock(&g_prefetch_lock);
+
+    /* The walk may have started over meanwhile */
+    if (stream == g_prefetch_stream) {
+      g_prefetch_ahead   = ahead;
+      g_prefetch_trigger = trigger;
+    }
+    g_prefetch_busy = 0;
+  }
+
+  pthread_mutex_unlock(&g_prefetch_lock);
+  return NULL;
+}
+
+/**
+ * Follow a walk over the rows of a table, and have the next rows loaded into
+ * the row cache in the background once it goes in ROWID order (as `find`,
+ * `du` and `rsync` do), so that the walk finds them there.
+ *
+ * The window of rows loaded ahead starts small, doubles each time the walk
+ * gets halfway through the rows prefetched for it, and collapses whenever the
+ * walk visits a row that has not been prefetched. Stepping backwards stops
+ * prefetching until the walk goes forwards again.
+ *
+ * @param table_name [in] Name of the table.
+ * @param row_name   [in] Name of the row visited.
+ * @param prefetched [in] Whether the row has been found prefetched.
+ */
+static void prefetch_visit(const char *table_name, const char *row_name, int prefetched)
+{
+  char *end = NULL;
+  int64_t rowid = strtoll(row_name, &end, 10);
+
+  if (!*row_name || *end)
+    return;
+
+  pthread_mutex_lock(&g_prefetch_lock);
+
+  if (!g_prefetcher_running)
+    goto quit;
+
+  if (!g_prefetch_table || strcmp(g_prefetch_table, table_name) != 0) {
+    mdbfs_free(g_prefetch_table);
+    g_prefetch_table = mdbfs_malloc0(strlen(table_name) + 1);
+    strcpy(g_prefetch_table, table_name);
+
+    g_prefetch_stream++;
+    g_prefetch_window = 0;
+    g_prefetch_last = rowid;
+    goto quit;
+  }
+
+  /* Another cell of the same row */
+  if (rowid == g_prefetch_last)
+    goto quit;
+
+  if (rowid < g_prefetch_last) {
+    if (g_prefetch_window)
+      mdbfs_metric_add(mdbfs_metric_get("sqlite_prefetch_misses"), 1);
+
+    g_prefetch_stream++;
+    g_prefetch_window = 0;
+  } else if (prefetched) {
+    mdbfs_metric_add(mdbfs_metric_get("sqlite_prefetch_hits"), 1);
+
+    if (!g_prefetch_window)
+      g_prefetch_window = MDBFS_SQLITE_PREFETCH_MIN_ROWS;
+    else if (rowid >= g_prefetch_trigger && g_prefetch_window < MDBFS_SQLITE_PREFETCH_MAX_ROWS)
+      g_prefetch_window *= 2;
+  } else {
+    /* Starting, outrunning the prefetcher, or visiting rows dropped since */
+    if (g_prefetch_window)
+      mdbfs_metric_add(mdbfs_metric_get("sqlite_prefetch_misses"), 1);
+
+    g_prefetch_stream++;
+    g_prefetch_window  = MDBFS_SQLITE_PREFETCH_MIN_ROWS;
+    g_prefetch_ahead   = rowid;
+    g_prefetch_trigger = rowid;
+  }
+
+  g_prefetch_last = rowid;
+
+  if (g_prefetch_window && !g_prefetch_busy && rowid >= g_prefetch_trigger) {
+    g_prefetch_from    = rowid > g_prefetch_ahead ? rowid : g_prefetch_ahead;
+    g_prefetch_count   = g_prefetch_window;
+    g_prefetch_pending = 1;
+    g_prefetch_busy    = 1;
+    pthread_cond_signal(&g_prefetch_cond);
+  }
+
+quit:
+  pthread_mutex_unlock(&g_prefetch_lock);
+}
+
+/**
+ * Get a row from the row cache, fetching it whole on a miss. Identical misses
+ * at the same time wait for one fetch.
+ *
+ * @param table_name [in]  Name of the table or view.
+ * @param row_name   [in]  Name of the row.
+ * @param prefetched [out] Whether the row has been prefetched, and not visited
+ *                         before.
+ * @param missing    [out] Whether the row is known not to exist.
+ * @return The row, with `g_rows_lock` held for the caller to release, or NULL
+ *         (with the lock released) if the row does not exist or cannot be
+ *         cached.
+ */
+static struct cached_row *row_cache_get(const char *table_name, const char *row_name, int *prefetched, int *missing)
+{
+  struct cached_row *row = NULL;
+  struct flight *flight = NULL;
+  int leader = 0;
+  int found = 0;
+
+  *prefetched = 0;
+  *missing = 0;
+
+  /* Read before the row may be fetched, so that a change meanwhile shows */
+  int64_t data_version = rows_data_version();
+
+  pthread_mutex_lock(&g_rows_lock);
+
+  row = row_cache_find_locked(table_name, row_name, data_version);
+  if (row) {
+    mdbfs_metric_add(mdbfs_metric_get("sqlite_row_cache_hits"), 1);
+
+    *prefetched = row->prefetched;
+    row->prefetched = 0;
+    row->used = ++g_rows_tick;
+    return row;
+  }
+
+  mdbfs_metric_add(mdbfs_metric_get("sqlite_row_cache_misses"), 1);
+
+  /* Fetch without the cache locked (see row_cache_hook), and keep the row
+   * only if nothing has been changed meanwhile
+   */
+  uint64_t generation = g_rows_generation;
+  pthread_mutex_unlock(&g_rows_lock);
+
+  /* Rows ruled out by the Bloom filter are not looked up at all */
+  int maybe = bloom_check(table_name, row_name);
+  if (!maybe) {
+    *missing = 1;
+    return NULL;
+  }
+
+  flight = flight_join("row", table_name, row_name, &leader);
+
+  if (!leader) {
+    /* The row has been fetched for us, if it could be cached */
+    flight_leave(flight, &found, NULL);
+    *missing = !found;
+
+    pthread_mutex_lock(&g_rows_lock);
+    row = row_cache_find_locked(table_name, row_name, data_version);
+    if (row) {
+      row->used = ++g_rows_tick;
+      return row;
+    }
+
+    pthread_mutex_unlock(&g_rows_lock);
+    return NULL;
+  }
+
+  row = row_cache_fetch(table_name, row_name, &found);
+
+  /* A fetch given up for us tells nothing to others */
+  if (!row && mdbfs_cancel_check())
+    found = 1;
+
+  if (row) {
+    row->data_version = data_version;
+
+    pthread_mutex_lock(&g_rows_lock);
+    if (g_rows_generation == generation) {
+      row_cache_insert_locked(row);
+    } else {
+      pthread_mutex_unlock(&g_rows_lock);
+      cached_row_free(row);
+      row = NULL;
+    }
+  }
+
+  flight_land(flight, NULL, found);
+  flight_leave(flight, NULL, NULL);
+
+  if (!found && maybe > 0)
+    bloom_count(1);
+
+  *missing = !found;
+  return row;
+}
+
+/**
+ * Read a cell from the row cache, fetching the row whole on a miss.
+ *
+ * @param cell_type   [out] Storage class of the cell. May be NULL.
+ * @param cell_length [out] Length of the whole rendered cell. May be NULL.
+ * @param buf         [out] The buffer to put content in.
+ * @param bufsize     [in]  Size of the buffer.
+ * @param offset      [in]  Offset in the cell from which to read.
+ * @param table_name  [in]  Name of the table or view.
+ * @param row_name    [in]  Name of the row.
+ * @param col_name    [in]  Name of the column.
+ * @param read        [out] Bytes read, or -1 if the column does not exist.
+ * @return 1 if the cell has been read from the cache (or the row is known not
+ *         to exist), 0 if the row cannot be cached and the cell has to be read
+ *         by itself.
+ */
+static int row_cache_read(enum mdbfs_backend_sqlite_cell_type *cell_type, size_t *cell_length, char *buf, size_t bufsize, int64_t offset, const char *table_name, const char *row_name, const char *col_name, int64_t *read)
+{
+  int prefetched = 0;
+  int missing = 0;
+  struct cached_row *row = row_cache_get(table_name, row_name, &prefetched, &missing);
+
+  if (!row) {
+    prefetch_visit(table_name, row_name, 0);
+    *read = -1;
+    return missing;
+  }
+
+  *read = -1;
+
+  for (size_t icol = 0; icol < row->ncols; icol++) {
+    if (strcmp(row->col_names[icol], col_name) != 0)
+      continue;
+
+    size_t length = row->col_lengths[icol];
+
+    if (cell_type)
+      *cell_type = row->col_types[icol];
+    if (cell_length)
+      *cell_length = length;
+
+    /* "This memory cannot be read" */
+    *read = 0;
+    if (offset < 0 || offset >= length || !bufsize)
+      break;
+
+    *read = length - offset <= bufsize ? length - offset : bufsize;
+    memcpy(buf, row->data + row->col_offsets[icol] + offset, *read);
+    break;
+  }
+
+  pthread_mutex_unlock(&g_rows_lock);
+
+  prefetch_visit(table_name, row_name, prefetched);
+  return 1;
+}
+
+/**
+ * List the columns of a row from the row cache, fetching the row whole on a
+ * miss, since listing a row is mostly followed by reading its cells.
+ *
+ * @param table_name [in]  Name of the table or view.
+ * @param row_name   [in]  Name of the row.
+ * @param missing    [out] Whether the row is known not to exist.
+ * @return NULL-terminated names of the columns, or NULL if the row does not
+ *         exist or cannot be cached. The caller is responsible for freeing it.
+ */
+static char **row_cache_column_names(const char *table_name, const char *row_name, int *missing)
+{
+  int prefetched = 0;
+  char **ret = NULL;
+  struct cached_row *row = row_cache_get(table_name, row_name, &prefetched, missing);
+
+  if (row) {
+    ret = mdbfs_malloc0((row->ncols + 1) * sizeof(char *));
+    for (size_t icol = 0; icol < row->ncols; icol++) {
+      ret[icol] = mdbfs_malloc0(strlen(row->col_names[icol]) + 1);
+      strcpy(ret[icol], row->col_names[icol]);
+    }
+
+    pthread_mutex_unlock(&g_rows_lock);
+  }
+
+  prefetch_visit(table_name, row_name, prefetched);
+  return ret;
+}
+
+/**
+ * List the names of tables and views, as `D/T` for those of attached
+ * databases.
+ *
+ * @return NULL-terminated list of names, or NULL on errors. The caller is
+ *         responsible for freeing it.
+ */
+static char **list_table_names(void)
+{
+  static const char *const single[] = {"main", NULL};
+  const char *const *databases = g_databases ? (const char *const *)g_databases : single;
+  sqlite3_stmt *stmt = NULL;
+  char *sql = NULL;
+  char **ret = NULL;
+  size_t ret_length = 0;
+  int r = SQLITE_DONE;
+
+  mdbfs_debug("sqlite: listing table names");
+
+  /* Databases are not to be detached meanwhile */
+  if (g_databases)
+    pthread_mutex_lock(&g_databases_lock);
+
+  for (size_t i = 0; databases[i] && r == SQLITE_DONE; i++) {
+    sql = sql_from_fmt(sql_fmt_get_tables, databases[i]);
+    r = sql ? sqlite3_prepare_v2(g_db, sql, -1, &stmt, NULL) : SQLITE_NOMEM;
+    mdbfs_free(sql);
+    if (r != SQLITE_OK) {
+      mdbfs_error("sqlite: get_table_names: sqlite3 cannot prepare a sql statement for us: %s", sqlite3_errmsg(g_db));
+      break;
+    }
+
+    for (;;) {
+      r = sqlite3_step(stmt);
+      if (r != SQLITE_ROW)
+        break;
+
+      const char *table_name = (const char *)sqlite3_column_text(stmt, 0);
+      if (!table_name) {
+        mdbfs_warning("sqlite: get_table_names: unexpected null");
+        continue;
+      }
+
+      mdbfs_debug("sqlite: get_table_names: .. %s/%s", databases[i], table_name);
+
+      /* Stretch vector */
+      ret_length += 1;
+      ret = mdbfs_realloc(ret, ret_length * sizeof(char *));
+
+      /* Fill string element */
+      if (g_databases)
+        ret[ret_length - 1] = sql_from_fmt("%s/%s", databases[i], table_name);
+      else {
+        size_t name_length = strlen(table_name) + 1;
+        ret[ret_length - 1] = mdbfs_malloc0(name_length);
+        strncpy(ret[ret_length - 1], table_name, name_length);
+      }
+    }
+
+    if (r != SQLITE_DONE)
+      mdbfs_warning("sqlite: get_table_names: sqlite3 reported an error: %s", sqlite3_errmsg(g_db));
+
+    if (sqlite3_finalize(stmt) != SQLITE_OK) {
+      mdbfs_warning("sqlite: get_table_names: sqlite3 cannot finalize a sql statement for us: %s", sqlite3_errmsg(g_db));
+      mdbfs_warning("sqlite: get_table_names: *leaking memory*");
+    }
+    stmt = NULL;
+  }
+
+  if (g_databases)
+    pthread_mutex_unlock(&g_databases_lock);
+
+  if (r != SQLITE_DONE) {
+    for (size_t i = 0; i < ret_length; i++) {
+      mdbfs_free(ret[i]);
+    }
+    mdbfs_free(ret);
+    return NULL;
+  }
+
+  /* Additionally add a NULL at the end of list for iteration */
+  ret_length += 1;
+  ret = mdbfs_realloc(ret, ret_length * sizeof(char *));
+  ret[ret_length - 1] = NULL;
+
+  mdbfs_debug("sqlite: get_table_names: done listing table names");
+  return ret;
+}
+
+/**
+ * List the ROWIDs of a table within a range.
+ *
+ * @param table_name [in] Name of the table.
+ * @param first      [in] Lowest ROWID to list.
+ * @param last       [in] Highest ROWID to list.
+ * @return ROWIDs of the table, or NULL on errors. The caller is responsible
+ *         for freeing them with mdbfs_backend_sqlite_free_rowids.
+ */
+static struct mdbfs_backend_sqlite_rowids *list_rowids(const char *table_name, int64_t first, int64_t last)
+{
+  sqlite3_stmt *stmt = NULL;
+  char *sql = NULL;
+  char *table = NULL;
+  struct mdbfs_backend_sqlite_rowids *ret = NULL;
+  size_t capacity = 0;
+  int r = 0;
+
+  mdbfs_debug("sqlite: listing rows in table \"%s\"", table_name);
+
+  table = sql_table(table_name);
+  sql = sql_from_fmt(sql_fmt_select_rowid_from_where_rowid_between, "", table);
+  if (!sql) {
+    mdbfs_error("sqlite: get_rowids: no sql no life!");
+    goto quit;
+  }
+
+  r = sqlite3_prepare_v2(g_db, sql, -1, &stmt, NULL);
+  if (r != SQLITE_OK) {
+    mdbfs_error("sqlite: get_rowids: sqlite3 cannot prepare a sql statement for us: %s", sqlite3_errmsg(g_db));
+    goto quit;
+  }
+
+  sqlite3_bind_int64(stmt, 1, first);
+  sqlite3_bind_int64(stmt, 2, last);
+
+  ret = mdbfs_malloc0(sizeof(struct mdbfs_backend_sqlite_rowids));
+
+  /* ROWIDs come in order; each either extends the last run or starts one */
+  for (;;) {
+    r = sqlite3_step(stmt);
+    if (r != SQLITE_ROW)
+      break;
+
+    int64_t rowid = sqlite3_column_int64(stmt, 0);
+
+    if (ret->nruns && ret->runs[ret->nruns - 1].last == rowid - 1) {
+      ret->runs[ret->nruns - 1].last = rowid;
+    } else {
+      /* Stretch vector */
+      if (ret->nruns == capacity) {
+        capacity = capacity ? capacity * 2 : 16;
+        ret->runs = mdbfs_realloc(ret->runs, capacity * sizeof(struct mdbfs_backend_sqlite_rowid_run));
+      }
+
+      ret->runs[ret->nruns].first = rowid;
+      ret->runs[ret->nruns].last  = rowid;
+      ret->runs[ret->nruns].index = ret->count;
+      ret->nruns += 1;
+    }
+
+    ret->count += 1;
+  }
+
+  if (r != SQLITE_DONE) {
+    mdbfs_warning("sqlite: get_rowids: sqlite3 reported an error: %s", sqlite3_errmsg(g_db));
+    mdbfs_backend_sqlite_free_rowids(ret);
+    ret = NULL;
+    goto quit;
+  }
+
+  mdbfs_debug("sqlite: done listing %lld rows in %zu runs in table \"%s\"", (long long)ret->count, ret->nruns, table_name);
+
+quit:
+  mdbfs_free(sql);
+  mdbfs_free(table);
+  r = sqlite3_finalize(stmt);
+  if (r != SQLITE_OK) {
+    mdbfs_warning("sqlite: get_rowids: sqlite3 cannot finalize a sql statement for us: %s", sqlite3_errmsg(g_db));
+    mdbfs_warning("sqlite: get_rowids: *leaking memory*");
+  }
+  return ret;
+}
+
+/**
+ * Build a Bloom filter for every table, splitting the memory among them by
+ * their numbers of rows. Runs on the Bloom filter builder.
+ */
+static void bloom_build(void)
+{
+  struct bloom *blooms = NULL;
+  int64_t schema_version = 0;
+  int64_t data_version = 0;
+  int64_t total_rows = 0;
+  size_t ntables = 0;
+
+  /* Versions are taken first, so that anything changed during the scan shows */
+  if (!read_versions(&schema_version, &data_version))
+    return;
+
+  char **table_names = list_table_names();
+  if (!table_names)
+    return;
+
+  for (size_t i = 0; table_names[i]; i++)
+    ntables++;
+
+  int64_t *rows = mdbfs_malloc0((ntables ? ntables : 1) * sizeof(int64_t));
+  for (size_t i = 0; i < ntables; i++) {
+    if (is_view(table_names[i]))
+      continue;
+
+    rows[i] = estimate_rows(table_names[i]);
+    if (rows[i] < 1)
+      rows[i] = 1;
+    total_rows += rows[i];
+  }
+
+  for (size_t i = 0; i < ntables; i++) {
+    if (!rows[i])
+      continue;
+
+    struct bloom *bloom = mdbfs_malloc0(sizeof(struct bloom));
+    bloom->table_name = table_names[i];
+    bloom->filter = mdbfs_bloom_new((double)g_bloom_memory * rows[i] / total_rows, rows[i]);
+    bloom->schema_version = schema_version;
+    bloom->data_version = data_version;
+    bloom->next = blooms;
+    blooms = bloom;
+    table_names[i] = NULL;
+  }
+
+  for (size_t i = 0; i < ntables; i++)
+    mdbfs_free(table_names[i]);
+  mdbfs_free(table_names);
+  mdbfs_free(rows);
+
+  /* Filters take changes from now on, while they are being filled */
+  int64_t size = 0;
+  for (struct bloom *bloom = blooms; bloom; bloom = bloom->next)
+    size += mdbfs_bloom_size(bloom->filter);
+
+  pthread_mutex_lock(&g_bloom_lock);
+  struct bloom *old = g_blooms;
+  g_blooms = blooms;
+  pthread_mutex_unlock(&g_bloom_lock);
+
+  blooms_free(old);
+  mdbfs_metric_set(mdbfs_metric_get("sqlite_bloom_bytes"), size);
+
+  for (struct bloom *bloom = blooms; bloom; bloom = bloom->next) {
+    sqlite3_stmt *stmt = NULL;
+    int64_t n = 0;
+    int r = 0;
+
+    mdbfs_debug("sqlite: bloom_build: adding rows of \"%s\"", bloom->table_name);
+
+    char *table = sql_table(bloom->table_name);
+    char *sql = sql_from_fmt(sql_fmt_select_from, "ROWID", table);
+    mdbfs_free(table);
+    if (!sql) {
+      mdbfs_error("sqlite: bloom_build: no sql no life!");
+      continue;
+    }
+
+    /* Tables without ROWIDs fail here, and go without a filter */
+    if (sqlite3_prepare_v2(g_db, sql, -1, &stmt, NULL) == SQLITE_OK) {
+      while ((r = sqlite3_step(stmt)) == SQLITE_ROW) {
+        int64_t rowid = sqlite3_column_int64(stmt, 0);
+        mdbfs_bloom_add(bloom->filter, &rowid, sizeof(rowid));
+
+        /* Closing the database, or building again, gives up this build */
+        if (++n % 4096 == 0 && (!__atomic_load_n(&g_bloom_builder_running, __ATOMIC_RELAXED) ||
+                                __atomic_load_n(&g_bloom_stale, __ATOMIC_RELAXED))) {
+          r = SQLITE_INTERRUPT;
+          break;
+        }
+      }
+    }
+
+    sqlite3_finalize(stmt);
+    mdbfs_free(sql);
+
+    if (r == SQLITE_INTERRUPT)
+      return;
+
+    if (r != SQLITE_DONE) {
+      mdbfs_debug("sqlite: bloom_build: \"%s\" goes without a filter", bloom->table_name);
+      continue;
+    }
+
+    pthread_mutex_lock(&g_bloom_lock);
+    bloom->ready = 1;
+    pthread_mutex_unlock(&g_bloom_lock);
+
+    mdbfs_debug("sqlite: bloom_build: added %lld rows of \"%s\"", (long long)n, bloom->table_name);
+  }
+}
+
+/**
+ * Body of the Bloom filter builder, a background thread building the filters
+ * whenever they are to be built.
+ */
+static void *bloom_builder(void *data)
+{
+  (void)data;
+
+  pthread_mutex_lock(&g_bloom_lock);
+
+  for (;;) {
+    while (g_bloom_builder_running && !g_bloom_stale)
+      pthread_cond_wait(&g_bloom_cond, &g_bloom_lock);
+
+    if (!g_bloom_builder_running)
+      break;
+
+    g_bloom_stale = 0;
+    pthread_mutex_unlock(&g_bloom_lock);
+
+    bloom_build();
+
+    pthread_mutex_lock(&g_bloom_lock);
+  }
+
+  pthread_mutex_unlock(&g_bloom_lock);
+  return NULL;
+}
+
+/**
+ * Read ranges of ROWIDs of tables to be warmed up, one after another, until
+ * none is left or the budget is spent. Runs on prewarmers, each on a read-only
+ * connection of its own, so that they read in parallel with each other and
+ * with requests.
+ */
+static void *prewarmer(void *data)
+{
+  struct mdbfs_metric *rows_read   = mdbfs_metric_get("sqlite_prewarm_rows");
+  struct mdbfs_metric *bytes_read  = mdbfs_metric_get("sqlite_prewarm_bytes");
+  struct mdbfs_metric *ranges_read = mdbfs_metric_get("sqlite_prewarm_ranges_done");
+  sqlite3 *db = NULL;
+  const char *db_path = NULL;
+
+  (void)data;
+
+  for (;;) {
+    struct prewarm_range *range = NULL;
+
+    pthread_mutex_lock(&g_prewarm_lock);
+    if (g_prewarm_running && __atomic_load_n(&g_prewarm_left, __ATOMIC_RELAXED) > 0 && g_prewarm_next < g_prewarm_nranges)
+      range = &g_prewarm_ranges[g_prewarm_next++];
+    pthread_mutex_unlock(&g_prewarm_lock);
+
+    if (!range)
+      break;
+
+    /* Ranges of a table come one after another, so the connection is kept */
+    if (!db_path || strcmp(db_path, range->path) != 0) {
+      sqlite3_close(db);
+      db = NULL;
+      db_path = range->path;
+
+      if (sqlite3_open_v2(range->path, &db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK) {
+        mdbfs_warning("sqlite: prewarm: cannot open %s: %s", range->path, sqlite3_errmsg(db));
+        sqlite3_close(db);
+        db = NULL;
+      } else {
+        sqlite3_busy_timeout(db, MDBFS_SQLITE_PREWARM_BUSY_MS);
+      }
+    }
+
+    sqlite3_stmt *stmt = NULL;
+    char *table = sql_from_fmt("\"%s\"", range->table);
+    char *sql = table ? sql_from_fmt(sql_fmt_select_rowid_all_from_between, table) : NULL;
+    mdbfs_free(table);
+
+    if (db && (!sql || sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK))
+      mdbfs_warning("sqlite: prewarm: cannot read \"%s\" in %s: %s", range->table, range->path, sqlite3_errmsg(db));
+    mdbfs_free(sql);
+
+    /* A chunk at a time, so that the file is not kept locked for long */
+    for (int64_t from = range->first; stmt; ) {
+      int64_t rowid = from;
+      int64_t rows = 0;
+      int64_t bytes = 0;
+
+      sqlite3_bind_int64(stmt, 1, from);
+      sqlite3_bind_int64(stmt, 2, range->last);
+      sqlite3_bind_int64(stmt, 3, MDBFS_SQLITE_PREWARM_CHUNK_ROWS);
+
+      /* Stepping reads every value, overflow pages and all */
+      while (sqlite3_step(stmt) == SQLITE_ROW) {
+        rowid = sqlite3_column_int64(stmt, 0);
+        for (int i = 1; i < sqlite3_column_count(stmt); i++)
+          bytes += sqlite3_column_bytes(stmt, i);
+        rows++;
+      }
+      sqlite3_reset(stmt);
+
+      mdbfs_metric_add(rows_read, rows);
+      mdbfs_metric_add(bytes_read, bytes);
+
+      if (rows < MDBFS_SQLITE_PREWARM_CHUNK_ROWS || rowid == range->last ||
+          __atomic_sub_fetch(&g_prewarm_left, bytes, __ATOMIC_RELAXED) <= 0 ||
+          !__atomic_load_n(&g_prewarm_running, __ATOMIC_RELAXED))
+        break;
+
+      from = rowid + 1;
+    }
+
+    sqlite3_finalize(stmt);
+    mdbfs_metric_add(ranges_read, 1);
+  }
+
+  sqlite3_close(db);
+  return NULL;
+}
+
+/**
+ * Split the ROWIDs of a table into a range for each prewarmer.
+ *
+ * @param table_name [in] Name of the table.
+ * @param path       [in] File of the database holding the table.
+ */
+static void prewarm_plan_table(const char *table_name, const char *path)
+{
+  sqlite3_stmt *stmt = NULL;
+
+  char *table = sql_table(table_name);
+  char *sql = table ? sql_from_fmt(sql_fmt_select_rowid_range_from, table) : NULL;
+  mdbfs_free(table);
+
+  /* Tables without ROWIDs fail here, and are not read */
+  if (!sql || sqlite3_prepare_v2(g_db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+    mdbfs_debug("sqlite: prewarm: rows of \"%s\" are not read", table_name);
+    goto quit;
+  }
+
+  /* Both ends are found at the ends of the table, without a scan */
+  if (sqlite3_step(stmt) != SQLITE_ROW || sqlite3_column_type(stmt, 0) == SQLITE_NULL)
+    goto quit;
+
+  int64_t min = sqlite3_column_int64(stmt, 0);
+  int64_t max = sqlite3_column_int64(stmt, 1);
+  uint64_t span  = (uint64_t)max - (uint64_t)min;
+  uint64_t width = span / g_prewarm_nthreads + 1;
+
+  for (uint64_t offset = 0; ; offset += width) {
+    struct prewarm_range *range = NULL;
+
+    g_prewarm_ranges = mdbfs_realloc(g_prewarm_ranges, (g_prewarm_nranges + 1) * sizeof(struct prewarm_range));
+    range = &g_prewarm_ranges[g_prewarm_nranges++];
+
+    range->path = mdbfs_malloc0(strlen(path) + 1);
+    strcpy(range->path, path);
+    range->table = mdbfs_malloc0(strlen(table_base(table_name)) + 1);
+    strcpy(range->table, table_base(table_name));
+    range->first = (int64_t)((uint64_t)min + offset);
+    range->last  = span - offset < width ? max : (int64_t)((uint64_t)min + offset + width - 1);
+
+    if (range->last == max)
+      break;
+  }
+
+quit:
+  sqlite3_finalize(stmt);
+  mdbfs_free(sql);
+}
+
+/**
+ * Body of the prewarm planner: loads the schema and the row estimate of every
+ * table to be warmed up into the schema cache, splits their ROWIDs into ranges,
+ * and has the ranges read by prewarmers, if there is a budget of bytes to read.
+ */
+static void *prewarm_planner(void *data)
+{
+  struct mdbfs_metric *tables_done = mdbfs_metric_get("sqlite_prewarm_tables_done");
+  char **table_names = NULL;
+  pthread_t *prewarmers = NULL;
+  int nprewarmers = 0;
+  int everything = 0;
+
+  (void)data;
+
+  mdbfs_info("sqlite: prewarm: warming tables up");
+  mdbfs_metric_set(mdbfs_metric_get("sqlite_prewarm_running"), 1);
+
+  for (size_t i = 0; g_prewarm_tables[i]; i++)
+    everything |= strcmp(g_prewarm_tables[i], "*") == 0;
+
+  table_names = everything ? list_table_names() : g_prewarm_tables;
+
+  for (size_t i = 0; table_names && table_names[i] && __atomic_load_n(&g_prewarm_running, __ATOMIC_RELAXED); i++) {
+    const char *table_name = table_names[i];
+    char *schema = table_schema(table_name);
+
+    /* Tables of a directory of databases are opened to be warmed up */
+    if (schema && !mdbfs_backend_sqlite_use_database(schema)) {
+      mdbfs_warning("sqlite: prewarm: there is no database \"%s\"", schema);
+      mdbfs_free(schema);
+      continue;
+    }
+
+    /* Estimating rows loads the schema along */
+    enum mdbfs_backend_sqlite_table_type type = mdbfs_backend_sqlite_get_table_type(table_name);
+    if (type == MDBFS_BACKEND_SQLITE_TABLE_TYPE_NONE) {
+      mdbfs_warning("sqlite: prewarm: there is no table \"%s\"", table_name);
+    } else {
+      mdbfs_backend_sqlite_get_row_estimate(table_name);
+      mdbfs_metric_add(tables_done, 1);
+
+      const char *path = sqlite3_db_filename(g_db, schema ? schema : "main");
+      if (type == MDBFS_BACKEND_SQLITE_TABLE_TYPE_TABLE && g_prewarm_bytes > 0 && path && *path)
+        prewarm_plan_table(table_name, path);
+    }
+
+    if (schema)
+      mdbfs_backend_sqlite_release_database(schema);
+    mdbfs_free(schema);
+  }
+
+  if (everything) {
+    for (size_t i = 0; table_names && table_names[i]; i++)
+      mdbfs_free(table_names[i]);
+    mdbfs_free(table_names);
+  }
+
+  /* Rows are read once every schema is in */
+  mdbfs_metric_set(mdbfs_metric_get("sqlite_prewarm_ranges_total"), g_prewarm_nranges);
+  g_prewarm_left = g_prewarm_bytes;
+
+  if (g_prewarm_nranges) {
+    prewarmers = mdbfs_malloc0(g_prewarm_nthreads * sizeof(pthread_t));
+    while (nprewarmers < g_prewarm_nthreads && pthread_create(&prewarmers[nprewarmers], NULL, prewarmer, NULL) == 0)
+      nprewarmers++;
+
+    /* Without any thread of its own, the planner reads them itself */
+    if (!nprewarmers)
+      prewarmer(NULL);
+
+    for (int i = 0; i < nprewarmers; i++)
+      pthread_join(prewarmers[i], NULL);
+    mdbfs_free(prewarmers);
+  }
+
+  mdbfs_metric_set(mdbfs_metric_get("sqlite_prewarm_running"), 0);
+  mdbfs_info("sqlite: prewarm: done, %lld bytes read", (long long)mdbfs_metric_value(mdbfs_metric_get("sqlite_prewarm_bytes")));
+  return NULL;
+}
+
+/**
+ * Start warming tables up, once it has been asked for and the database is
+ * open. The caller must hold `g_prewarm_lock`.
+ */
+static void prewarm_start_locked(void)
+{
+  if (!g_prewarm_tables || !g_prewarm_asked || !g_prewarm_opened || g_prewarm_running)
+    return;
+
+  g_prewarm_running = 1;
+  if (pthread_create(&g_prewarm_planner, NULL, prewarm_planner, NULL) != 0) {
+    mdbfs_warning("sqlite: cannot start warming tables up; they are loaded as they are used");
+    g_prewarm_running = 0;
+  }
+}
+
+/**
+ * Stop warming tables up, and forget what was left to do.
+ */
+static void prewarm_stop(void)
+{
+  pthread_mutex_lock(&g_prewarm_lock);
+  int running = g_prewarm_running;
+  g_prewarm_running = 0;
+  g_prewarm_opened = 0;
+  pthread_mutex_unlock(&g_prewarm_lock);
+
+  if (running)
+    pthread_join(g_prewarm_planner, NULL);
+
+  for (size_t i = 0; i < g_prewarm_nranges; i++) {
+    mdbfs_free(g_prewarm_ranges[i].path);
+    mdbfs_free(g_prewarm_ranges[i].table);
+  }
+  mdbfs_free(g_prewarm_ranges);
+  g_prewarm_nranges = 0;
+  g_prewarm_next = 0;
+}
+
+/**
+ * Tell the versions of the database that kept metadata holds for: those of
+ * its schema and data, and the changes made through this connection.
+ *
+ * @param stamp [out] The versions.
+ * @return 1 if succeeded, 0 otherwise.
+ */
+static int meta_stamp(int64_t stamp[3])
+{
+  if (!read_versions(&stamp[0], &stamp[1]))
+    return 0;
+
+  stamp[2] = sqlite3_total_changes(g_db);
+  return 1;
+}
+
+/**
+ * Forget kept ROWIDs. The caller must hold `g_meta_lock`.
+ */
+static void meta_clear_locked(void)
+{
+  while (g_meta_rowids) {
+    struct meta_rowids *meta = g_meta_rowids;
+    g_meta_rowids = meta->next;
+    mdbfs_free(meta->table_name);
+    mdbfs_backend_sqlite_free_rowids(meta->rowids);
+    mdbfs_free(meta);
+  }
+
+  g_meta_nruns = 0;
+}
+
+/**
+ * Find the kept ROWIDs of a table. Every one kept is forgotten once the
+ * database has changed. The caller must hold `g_meta_lock`.
+ *
+ * @param table_name [in] Name of the table.
+ * @param stamp      [in] Versions of the database at the moment.
+ * @return The ROWIDs, or NULL if they are not kept.
+ */
+static struct meta_rowids *meta_find_locked(const char *table_name, const int64_t stamp[3])
+{
+  if (memcmp(stamp, g_meta_stamp, sizeof(g_meta_stamp)) != 0) {
+    meta_clear_locked();
+    memcpy(g_meta_stamp, stamp, sizeof(g_meta_stamp));
+    return NULL;
+  }
+
+  for (struct meta_rowids *meta = g_meta_rowids; meta; meta = meta->next) {
+    if (strcmp(meta->table_name, table_name) == 0)
+      return meta;
+  }
+
+  return NULL;
+}
+
+/**
+ * List the ROWIDs of a table within a range from its kept ROWIDs.
+ *
+ * @param table_name [in] Name of the table.
+ * @param first      [in] Lowest ROWID to list.
+ * @param last       [in] Highest ROWID to list.
+ * @return ROWIDs as list_rowids tells, or NULL if they are not kept.
+ */
+static struct mdbfs_backend_sqlite_rowids *meta_rowids_get(const char *table_name, int64_t first, int64_t last)
+{
+  struct mdbfs_backend_sqlite_rowids *ret = NULL;
+  int64_t stamp[3];
+
+  if (!meta_stamp(stamp))
+    return NULL;
+
+  pthread_mutex_lock(&g_meta_lock);
+
+  struct meta_rowids *meta = meta_find_locked(table_name, stamp);
+  if (meta) {
+    const struct mdbfs_backend_sqlite_rowids *from = meta->rowids;
+
+    ret = mdbfs_malloc0(sizeof(struct mdbfs_backend_sqlite_rowids));
+    ret->runs = mdbfs_malloc0((from->nruns ? from->nruns : 1) * sizeof(struct mdbfs_backend_sqlite_rowid_run));
+
+    /* Runs are cut to the range, and counted from its start */
+    for (size_t i = 0; i < from->nruns; i++) {
+      struct mdbfs_backend_sqlite_rowid_run run = from->runs[i];
+      if (run.last < first || run.first > last)
+        continue;
+
+      run.first = run.first < first ? first : run.first;
+      run.last  = run.last > last ? last : run.last;
+      run.index = ret->count;
+
+      ret->runs[ret->nruns++] = run;
+      ret->count += run.last - run.first + 1;
+    }
+  }
+
+  pthread_mutex_unlock(&g_meta_lock);
+
+  if (ret)
+    mdbfs_metric_add(mdbfs_metric_get("sqlite_metadata_cache_hits"), 1);
+
+  return ret;
+}
+
+/**
+ * Keep the ROWIDs of a whole table, unless too many are kept already.
+ *
+ * @param table_name [in] Name of the table.
+ * @param rowids     [in] Its ROWIDs.
+ * @param stamp      [in] Versions of the database before they were listed.
+ */
+static void meta_rowids_put(const char *table_name, const struct mdbfs_backend_sqlite_rowids *rowids, const int64_t stamp[3])
+{
+  pthread_mutex_lock(&g_meta_lock);
+
+  if (!meta_find_locked(table_name, stamp) && g_meta_nruns + rowids->nruns <= MDBFS_SQLITE_META_MAX_RUNS) {
+    struct meta_rowids *meta = mdbfs_malloc0(sizeof(struct meta_rowids));
+
+    meta->table_name = mdbfs_malloc0(strlen(table_name) + 1);
+    strcpy(meta->table_name, table_name);
+    meta->rowids = rowids_copy(rowids);
+    meta->next = g_meta_rowids;
+
+    g_meta_rowids = meta;
+    g_meta_nruns += rowids->nruns;
+  }
+
+  pthread_mutex_unlock(&g_meta_lock);
+}
+
+/**
+ * Tell whether a row is among the kept ROWIDs of its table.
+ *
+ * @param table_name [in] Name of the table.
+ * @param row_name   [in] Name of the row.
+ * @return 1 if it is, 0 if it is not or its ROWIDs are not kept.
+ */
+static int meta_row_exists(const char *table_name, const char *row_name)
+{
+  int64_t stamp[3];
+  int64_t rowid = 0;
+  int ret = 0;
+
+  if (!rowid_from_name(row_name, &rowid) || !meta_stamp(stamp))
+    return 0;
+
+  pthread_mutex_lock(&g_meta_lock);
+
+  struct meta_rowids *meta = meta_find_locked(table_name, stamp);
+  if (meta) {
+    const struct mdbfs_backend_sqlite_rowids *rowids = meta->rowids;
+    size_t lo = 0;
+    size_t hi = rowids->nruns;
+
+    /* Runs are in ROWID order */
+    while (lo < hi) {
+      size_t mid = lo + (hi - lo) / 2;
+
+      if (rowids->runs[mid].last < rowid)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+    ret = lo < rowids->nruns && rowids->runs[lo].first <= rowid;
+  }
+
+  pthread_mutex_unlock(&g_meta_lock);
+  return ret;
+}
+
+/**
+ * Sum up the records of a metadata cache file (64-bit FNV-1a), so that a
+ * damaged file is not taken for ROWIDs.
+ */
+static uint64_t meta_checksum(const uint8_t *records, size_t size)
+{
+  uint64_t ret = 0xcbf29ce484222325ULL;
+
+  for (size_t i = 0; i < size; i++) {
+    ret ^= records[i];
+    ret *= 0x100000001b3ULL;
+  }
+
+  return ret;
+}
+
+/**
+ * Tell what a metadata cache file holds for: the size and modification time
+ * of the database and of its WAL, and the file change counter in the header
+ * of the database, which moves with every transaction outside WAL mode.
+ *
+ * @param header  [out] The header, of which these are filled.
+ * @param db_path [in]  Path to the database.
+ * @return 1 if succeeded, 0 otherwise.
+ */
+static int meta_header_fill(struct meta_header *header, const char *db_path)
+{
+  struct stat st;
+  uint8_t counter[4];
+  char *wal_path = NULL;
+  int ret = 0;
+
+  int fd = open(db_path, O_RDONLY);
+  if (fd < 0 || fstat(fd, &st) != 0)
+    goto quit;
+
+  header->db_size       = st.st_size;
+  header->db_mtime_sec  = st.st_mtim.tv_sec;
+  header->db_mtime_nsec = st.st_mtim.tv_nsec;
+
+  /* Big-endian, at offset 24 of the database header */
+  if (pread(fd, counter, sizeof(counter), 24) != sizeof(counter))
+    goto quit;
+
+  header->change_counter = (uint32_t)counter[0] << 24 | (uint32_t)counter[1] << 16 | (uint32_t)counter[2] << 8 | counter[3];
+
+  wal_path = sql_from_fmt("%s-wal", db_path);
+  if (!wal_path)
+    goto quit;
+
+  if (stat(wal_path, &st) == 0) {
+    header->wal_size       = st.st_size;
+    header->wal_mtime_sec  = st.st_mtim.tv_sec;
+    header->wal_mtime_nsec = st.st_mtim.tv_nsec;
+  } else {
+    header->wal_size       = 0;
+    header->wal_mtime_sec  = 0;
+    header->wal_mtime_nsec = 0;
+  }
+
+  ret = 1;
+
+quit:
+  if (fd >= 0)
+    close(fd);
+  mdbfs_free(wal_path);
+  return ret;
+}
+
+/**
+ * Load the metadata cache from its file, if the database has not changed
+ * since it was saved. The file is mapped, and read in place.
+ */
+static void meta_load(void)
+{
+  struct meta_header now = {0};
+  struct stat st;
+  uint8_t *map = MAP_FAILED;
+  size_t size = 0;
+  size_t ntables = 0;
+  int64_t stamp[3];
+
+  int fd = open(g_meta_path, O_RDONLY);
+  if (fd < 0) {
+    mdbfs_info("sqlite: there is no metadata cache at %s yet", g_meta_path);
+    return;
+  }
+
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct meta_header))
+    goto invalid;
+
+  size = st.st_size;
+  map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (map == MAP_FAILED)
+    goto invalid;
+
+  const struct meta_header *header = (const struct meta_header *)map;
+  if (memcmp(header->magic, MDBFS_SQLITE_META_MAGIC, sizeof(header->magic)) != 0 || header->format != MDBFS_SQLITE_META_FORMAT ||
+      header->checksum != meta_checksum(map + sizeof(struct meta_header), size - sizeof(struct meta_header)))
+    goto invalid;
+
+  if (!meta_header_fill(&now, sqlite3_db_filename(g_db, "main")) || !meta_stamp(stamp))
+    goto quit;
+
+  if (header->schema_version != stamp[0] || header->change_counter != now.change_counter ||
+      header->db_size != now.db_size || header->db_mtime_sec != now.db_mtime_sec || header->db_mtime_nsec != now.db_mtime_nsec ||
+      header->wal_size != now.wal_size || header->wal_mtime_sec != now.wal_mtime_sec || header->wal_mtime_nsec != now.wal_mtime_nsec) {
+    mdbfs_info("sqlite: the database has changed since the metadata cache was saved; it is loaded as it is used");
+    goto quit;
+  }
+
+  pthread_mutex_lock(&g_schemas_lock);
+  pthread_mutex_lock(&g_meta_lock);
+
+  schemas_clear_locked();
+  g_schemas_version = stamp[0];
+  meta_clear_locked();
+  memcpy(g_meta_stamp, stamp, sizeof(g_meta_stamp));
+
+  /* Records are checked against the size of the file as they are read */
+  size_t offset = sizeof(struct meta_header);
+  for (uint32_t i = 0; i < header->ntables; i++) {
+    const struct meta_record *record = (const struct meta_record *)(map + offset);
+
+    if (size - offset < sizeof(struct meta_record) || record->size < sizeof(struct meta_record) ||
+        record->size > size - offset || record->size % 8 ||
+        record->nruns > (record->size - sizeof(struct meta_record)) / sizeof(struct mdbfs_backend_sqlite_rowid_run))
+      break;
+
+    const struct mdbfs_backend_sqlite_rowid_run *runs = (const struct mdbfs_backend_sqlite_rowid_run *)(record + 1);
+    const char *names = (const char *)(runs + record->nruns);
+    const char *end = (const char *)record + record->size;
+    offset += record->size;
+
+    /* The table, then the name and declared type of each column */
+    size_t nnames = 1 + 2 * (size_t)record->ncols;
+    if (nnames > (size_t)(end - names))
+      break;
+
+    const char **strings = mdbfs_malloc0(nnames * sizeof(char *));
+    size_t nstrings = 0;
+    for (const char *p = names; nstrings < nnames; nstrings++) {
+      const char *nul = memchr(p, '\0', end - p);
+      if (!nul)
+        break;
+
+      strings[nstrings] = p;
+      p = nul + 1;
+    }
+
+    if (nstrings < nnames) {
+      mdbfs_free(strings);
+      break;
+    }
+
+    if (record->ncols) {
+      struct schema *schema = mdbfs_malloc0(sizeof(struct schema));
+
+      schema->table_name    = mdbfs_malloc0(strlen(strings[0]) + 1);
+      schema->col_names     = mdbfs_malloc0((record->ncols + 1) * sizeof(char *));
+      schema->col_decltypes = mdbfs_malloc0((record->ncols + 1) * sizeof(char *));
+      strcpy(schema->table_name, strings[0]);
+
+      for (size_t icol = 0; icol < record->ncols; icol++) {
+        schema->col_names[icol]     = mdbfs_malloc0(strlen(strings[1 + 2 * icol]) + 1);
+        schema->col_decltypes[icol] = mdbfs_malloc0(strlen(strings[2 + 2 * icol]) + 1);
+        strcpy(schema->col_names[icol], strings[1 + 2 * icol]);
+        strcpy(schema->col_decltypes[icol], strings[2 + 2 * icol]);
+      }
+
+      /* The estimate holds until the database changes from now on */
+      schema->row_estimate = -1;
+      if (record->flags & MDBFS_SQLITE_META_HAS_ESTIMATE) {
+        schema->row_estimate  = record->row_estimate;
+        schema->row_estimated = 1;
+        schema->data_version  = stamp[1];
+        schema->changes       = stamp[2];
+      }
+
+      schema->next = g_schemas;
+      g_schemas = schema;
+    }
+
+    /* Runs are to be in order, apart, and counted as list_rowids does */
+    int64_t count = 0;
+    int ordered = 1;
+    for (size_t irun = 0; irun < record->nruns && ordered; irun++) {
+      ordered = runs[irun].first <= runs[irun].last && runs[irun].index == count &&
+                (!irun || runs[irun - 1].last < runs[irun].first - 1) &&
+                (uint64_t)runs[irun].last - (uint64_t)runs[irun].first < (uint64_t)INT64_MAX - (uint64_t)count;
+      count += ordered ? runs[irun].last - runs[irun].first + 1 : 0;
+    }
+
+    if ((record->flags & MDBFS_SQLITE_META_HAS_ROWIDS) && ordered && count == record->count &&
+        g_meta_nruns + record->nruns <= MDBFS_SQLITE_META_MAX_RUNS) {
+      struct meta_rowids *meta = mdbfs_malloc0(sizeof(struct meta_rowids));
+
+      meta->table_name = mdbfs_malloc0(strlen(strings[0]) + 1);
+      strcpy(meta->table_name, strings[0]);
+      meta->rowids = mdbfs_malloc0(sizeof(struct mdbfs_backend_sqlite_rowids));
+      meta->rowids->runs = mdbfs_malloc0((record->nruns ? record->nruns : 1) * sizeof(struct mdbfs_backend_sqlite_rowid_run));
+      memcpy(meta->rowids->runs, runs, record->nruns * sizeof(struct mdbfs_backend_sqlite_rowid_run));
+      meta->rowids->nruns = record->nruns;
+      meta->rowids->count = record->count;
+      meta->next = g_meta_rowids;
+
+      g_meta_rowids = meta;
+      g_meta_nruns += record->nruns;
+    }
+
+    mdbfs_free(strings);
+    ntables++;
+  }
+
+  pthread_mutex_unlock(&g_meta_lock);
+  pthread_mutex_unlock(&g_schemas_lock);
+
+  mdbfs_info("sqlite: loaded metadata of %zu tables from %s", ntables, g_meta_path);
+  mdbfs_metric_set(mdbfs_metric_get("sqlite_metadata_cache_tables"), ntables);
+  goto quit;
+
+invalid:
+  mdbfs_warning("sqlite: %s is not a metadata cache; it is written anew once unmounted", g_meta_path);
+
+quit:
+  if (map != MAP_FAILED)
+    munmap(map, size);
+  close(fd);
+}
+
+/**
+ * Append the record of a table to the metadata cache being saved.
+ *
+ * @param buffer     [in,out] The file being saved.
+ * @param length     [in,out] Bytes in the file.
+ * @param table_name [in]     Name of the table.
+ * @param schema     [in]     Its schema. May be NULL.
+ * @param rowids     [in]     Its ROWIDs. May be NULL.
+ * @param stamp      [in]     Versions of the database at the moment.
+ */
+static void meta_append(uint8_t **buffer, size_t *length, const char *table_name, const struct schema *schema, const struct mdbfs_backend_sqlite_rowids *rowids, const int64_t stamp[3])
+{
+  struct meta_record record = {0};
+  size_t names_size = strlen(table_name) + 1;
+
+  for (size_t i = 0; schema && schema->col_names[i]; i++) {
+    names_size += strlen(schema->col_names[i]) + 1 + strlen(schema->col_decltypes[i]) + 1;
+    record.ncols++;
+  }
+
+  if (schema && schema->row_estimated && schema->data_version == stamp[1] && schema->changes == stamp[2]) {
+    record.flags |= MDBFS_SQLITE_META_HAS_ESTIMATE;
+    record.row_estimate = schema->row_estimate;
+  }
+
+  if (rowids) {
+    record.flags |= MDBFS_SQLITE_META_HAS_ROWIDS;
+    record.nruns = rowids->nruns;
+    record.count = rowids->count;
+  }
+
+  size_t runs_size = record.nruns * sizeof(struct mdbfs_backend_sqlite_rowid_run);
+  record.size = (sizeof(struct meta_record) + runs_size + names_size + 7) / 8 * 8;
+
+  *buffer = mdbfs_realloc(*buffer, *length + record.size);
+  uint8_t *p = *buffer + *length;
+  memset(p, 0, record.size);
+  *length += record.size;
+
+  memcpy(p, &record, sizeof(struct meta_record));
+  p += sizeof(struct meta_record);
+  if (runs_size)
+    memcpy(p, rowids->runs, runs_size);
+  p += runs_size;
+
+  strcpy((char *)p, table_name);
+  p += strlen(table_name) + 1;
+  for (size_t i = 0; i < record.ncols; i++) {
+    strcpy((char *)p, schema->col_names[i]);
+    p += strlen(schema->col_names[i]) + 1;
+    strcpy((char *)p, schema->col_decltypes[i]);
+    p += strlen(schema->col_decltypes[i]) + 1;
+  }
+}
+
+/**
+ * Put what still holds of the metadata cache into a file to be saved, see
+ * meta_save.
+ *
+ * @param length [out] Bytes in the file.
+ * @return The file, or NULL on errors. The caller is responsible for freeing
+ *         it with mdbfs_free.
+ */
+static uint8_t *meta_serialize(size_t *length)
+{
+  struct meta_header header = {0};
+  uint8_t *ret = NULL;
+  int64_t stamp[3];
+
+  if (!meta_stamp(stamp))
+    return NULL;
+
+  memcpy(header.magic, MDBFS_SQLITE_META_MAGIC, sizeof(header.magic));
+  header.format = MDBFS_SQLITE_META_FORMAT;
+  header.schema_version = stamp[0];
+
+  ret = mdbfs_malloc0(sizeof(struct meta_header));
+  *length = sizeof(struct meta_header);
+
+  pthread_mutex_lock(&g_schemas_lock);
+  pthread_mutex_lock(&g_meta_lock);
+
+  struct schema *schemas = g_schemas_version == stamp[0] ? g_schemas : NULL;
+  struct meta_rowids *metas = memcmp(stamp, g_meta_stamp, sizeof(g_meta_stamp)) == 0 ? g_meta_rowids : NULL;
+
+  /* Tables with schemas, along with their ROWIDs... */
+  for (struct schema *schema = schemas; schema; schema = schema->next) {
+    struct meta_rowids *meta = metas;
+    while (meta && strcmp(meta->table_name, schema->table_name) != 0)
+      meta = meta->next;
+
+    meta_append(&ret, length, schema->table_name, schema, meta ? meta->rowids : NULL, stamp);
+    header.ntables++;
+  }
+
+  /* ... then tables with ROWIDs alone */
+  for (struct meta_rowids *meta = metas; meta; meta = meta->next) {
+    struct schema *schema = schemas;
+    while (schema && strcmp(schema->table_name, meta->table_name) != 0)
+      schema = schema->next;
+
+    if (!schema) {
+      meta_append(&ret, length, meta->table_name, NULL, meta->rowids, stamp);
+      header.ntables++;
+    }
+  }
+
+  pthread_mutex_unlock(&g_meta_lock);
+  pthread_mutex_unlock(&g_schemas_lock);
+
+  header.checksum = meta_checksum(ret + sizeof(struct meta_header), *length - sizeof(struct meta_header));
+  memcpy(ret, &header, sizeof(struct meta_header));
+  return ret;
+}
+
+/**
+ * Save the metadata cache, put into a file by meta_serialize before the
+ * database is closed, once it is closed, so that the file holds for the
+ * database as it is left.
+ *
+ * @param buffer  [in] The file.
+ * @param length  [in] Bytes in the file.
+ * @param db_path [in] Path to the database.
+ */
+static void meta_save(uint8_t *buffer, size_t length, const char *db_path)
+{
+  char *tmp_path = NULL;
+  FILE *file = NULL;
+
+  if (!meta_header_fill((struct meta_header *)buffer, db_path)) {
+    mdbfs_warning("sqlite: cannot tell the state of %s; the metadata cache is not saved", db_path);
+    goto quit;
+  }
+
+  /* Written aside and renamed over, so that a file is never left half-written */
+  tmp_path = sql_from_fmt("%s.tmp", g_meta_path);
+  file = tmp_path ? fopen(tmp_path, "wb") : NULL;
+  if (!file || fwrite(buffer, 1, length, file) != length) {
+    mdbfs_warning("sqlite: cannot write the metadata cache to %s: %s", tmp_path ? tmp_path : g_meta_path, strerror(errno));
+    goto quit;
+  }
+
+  int r = fclose(file);
+  file = NULL;
+  if (r != 0 || rename(tmp_path, g_meta_path) != 0) {
+    mdbfs_warning("sqlite: cannot save the metadata cache to %s: %s", g_meta_path, strerror(errno));
+    remove(tmp_path);
+    goto quit;
+  }
+
+  mdbfs_info("sqlite: saved the metadata cache to %s", g_meta_path);
+
+quit:
+  if (file) {
+    fclose(file);
+    remove(tmp_path);
+  }
+  mdbfs_free(tmp_path);
+}
+
+/**
+ * Forget the databases to attach, see mdbfs_backend_sqlite_set_databases and
+ * mdbfs_backend_sqlite_set_database_dir.
+ */
+static void databases_free(void)
+{
+  for (size_t i = 0; g_databases && g_databases[i]; i++) {
+    mdbfs_free(g_databases[i]);
+    mdbfs_free(g_database_paths[i]);
+  }
+  mdbfs_free(g_databases);
+  mdbfs_free(g_database_paths);
+  mdbfs_free(g_database_pins);
+  mdbfs_free(g_database_used);
+  mdbfs_free(g_database_dir);
+  g_databases_max = 0;
+}
+
+/**
+ * Make room for the names, paths, pins and ticks of databases, none yet.
+ *
+ * @param capacity [in] Databases to make room for.
+ */
+static void databases_alloc(size_t capacity)
+{
+  g_databases      = mdbfs_malloc0((capacity + 1) * sizeof(char *));
+  g_database_paths = mdbfs_malloc0((capacity + 1) * sizeof(char *));
+  g_database_pins  = mdbfs_malloc0((capacity + 1) * sizeof(int));
+  g_database_used  = mdbfs_malloc0((capacity + 1) * sizeof(uint64_t));
+  g_databases_max  = capacity;
+}
+
+/**
+ * Check whether a database can be named so. The name becomes a directory and
+ * the schema name of the database, so it can be neither hidden, nor quoted,
+ * nor one SQLite has taken.
+ *
+ * @param name [in] Name of the database.
+ * @return 1 if it can, 0 otherwise.
+ */
+static int database_name_is_valid(const char *name)
+{
+  return name[0] && name[0] != '.' && !strchr(name, '"') && !strchr(name, '/') &&
+         sqlite3_stricmp(name, "main") != 0 && sqlite3_stricmp(name, "temp") != 0;
+}
+
+/**
+ * Tell the path of a file in the directory of databases, if it can be opened
+ * as one: a regular file, named as a database can be, and not one SQLite keeps
+ * beside a database (`-journal`, `-wal` and `-shm`).
+ *
+ * @param name  [in] Name of the file, and of the database.
+ * @param check [in] Whether to check that the file is there.
+ * @return Path of the file, or NULL if it cannot be a database. The caller
+ *         is responsible for freeing it.
+ */
+static char *database_dir_path(const char *name, int check)
+{
+  static const char *const suffixes[] = {"-journal", "-wal", "-shm", NULL};
+  struct stat st;
+  size_t name_length = strlen(name);
+
+  if (!database_name_is_valid(name))
+    return NULL;
+
+  for (int i = 0; suffixes[i]; i++) {
+    size_t suffix_length = strlen(suffixes[i]);
+    if (name_length > suffix_length && strcmp(name + name_length - suffix_length, suffixes[i]) == 0)
+      return NULL;
+  }
+
+  char *ret = mdbfs_malloc0(strlen(g_database_dir) + 1 + name_length + 1);
+  strcat(ret, g_database_dir);
+  strcat(ret, "/");
+  strcat(ret, name);
+
+  if (check && (stat(ret, &st) != 0 || !S_ISREG(st.st_mode)))
+    mdbfs_free(ret);
+
+  return ret;
+}
+
+/**
+ * Attach a database to the connection.
+ *
+ * @param name [in] Schema name of the database.
+ * @param path [in] Path of the database.
+ * @return 1 on success, 0 on failure.
+ */
+static int attach_database(const char *name, const char *path)
+{
+  sqlite3_stmt *stmt = NULL;
+  int ret = 0;
+
+  mdbfs_info("sqlite: attaching database %s as %s", path, name);
+
+  /* Files are not created, as the connection is not opened to create */
+  char *sql = sql_from_fmt(sql_fmt_attach, name);
+  if (!sql || sqlite3_prepare_v2(g_db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+    mdbfs_error("sqlite: attach: sqlite3 cannot prepare a sql statement for us: %s", sqlite3_errmsg(g_db));
+    goto quit;
+  }
+
+  sqlite3_bind_text(stmt, 1, path, -1, SQLITE_STATIC);
+  if (sqlite3_step(stmt) != SQLITE_DONE) {
+    mdbfs_error("unable to attach SQLite3 database at %s: %s", path, sqlite3_errmsg(g_db));
+    goto quit;
+  }
+
+  ret = 1;
+
+quit:
+  sqlite3_finalize(stmt);
+  mdbfs_free(sql);
+  return ret;
+}
+
+/**
+ * Attach the databases given to mdbfs_backend_sqlite_set_databases to the
+ * connection just opened.
+ *
+ * @return 1 on success, 0 on failure.
+ */
+static int attach_databases(void)
+{
+  size_t ndatabases = 0;
+
+  while (g_databases[ndatabases])
+    ndatabases++;
+
+  if (ndatabases > (size_t)sqlite3_limit(g_db, SQLITE_LIMIT_ATTACHED, -1)) {
+    mdbfs_error("sqlite: open: %zu databases are given, but SQLite attaches at most %d", ndatabases, sqlite3_limit(g_db, SQLITE_LIMIT_ATTACHED, -1));
+    return 0;
+  }
+
+  for (size_t i = 0; i < ndatabases; i++)
+    if (!attach_database(g_databases[i], g_database_paths[i]))
+      return 0;
+
+  return 1;
+}
+
+/**
+ * Pin a database attached, if it is, so that it stays attached until it is
+ * released. The caller must hold `g_databases_lock`.
+ *
+ * @param name [in] Name of the database.
+ * @return 1 if it is attached, 0 otherwise.
+ */
+static int database_pin_locked(const char *name)
+{
+  for (size_t i = 0; g_databases[i]; i++) {
+    if (strcmp(g_databases[i], name) == 0) {
+      g_database_pins[i] += 1;
+      g_database_used[i] = ++g_databases_tick;
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * Note that the databases attached have changed, which is a change to every
+ * cache of them. The caller must hold `g_databases_lock`.
+ */
+static void databases_changed_locked(void)
+{
+  size_t ndatabases = 0;
+
+  while (g_databases[ndatabases])
+    ndatabases++;
+
+  /* The statements are prepared again for the databases attached now, and
+   * the versions they tell move on, so that the schema cache and Bloom
+   * filters follow
+   */
+  pthread_mutex_lock(&g_versions_lock);
+  versions_clear_locked();
+  g_databases_generation++;
+  pthread_mutex_unlock(&g_versions_lock);
+
+  g_space_valid = 0;
+  mdbfs_metric_set(mdbfs_metric_get("sqlite_databases_open"), ndatabases);
+}
+
+/**
+ * Attach a database of the directory of databases, pinned, there being room.
+ * The caller must hold `g_batch_lock` and `g_databases_lock`.
+ *
+ * @param name [in] Name of the database.
+ * @param path [in] Path of the database.
+ * @return 1 on success, 0 on failure.
+ */
+static int database_attach_locked(const char *name, const char *path)
+{
+  size_t i = 0;
+
+  if (!attach_database(name, path))
+    return 0;
+
+  while (g_databases[i])
+    i++;
+
+  g_databases[i] = mdbfs_malloc0(strlen(name) + 1);
+  strcpy(g_databases[i], name);
+  g_database_paths[i] = mdbfs_malloc0(strlen(path) + 1);
+  strcpy(g_database_paths[i], path);
+  g_database_pins[i] = 1;
+  g_database_used[i] = ++g_databases_tick;
+
+  databases_changed_locked();
+  mdbfs_metric_add(mdbfs_metric_get("sqlite_databases_attached"), 1);
+  return 1;
+}
+
+/**
+ * Detach a database of the directory of databases. The caller must hold
+ * `g_batch_lock` and `g_databases_lock`.
+ *
+ * @param i [in] Index of the database in `g_databases`.
+ * @return 1 on success, 0 if it cannot be detached for now (e.g. a statement
+ *         is still reading it).
+ */
+static int database_detach_locked(size_t i)
+{
+  size_t last = i;
+  int ret = 0;
+
+  char *sql = sql_from_fmt(sql_fmt_detach, g_databases[i]);
+  if (!sql)
+    return 0;
+
+  /* Statements kept on it go first */
+  pthread_mutex_lock(&g_versions_lock);
+  versions_clear_locked();
+  pthread_mutex_unlock(&g_versions_lock);
+
+  size_t name_length = strlen(g_databases[i]);
+  if (g_batch_table && strncmp(g_batch_table, g_databases[i], name_length) == 0 && g_batch_table[name_length] == '/') {
+    sqlite3_finalize(g_batch_stmt);
+    g_batch_stmt = NULL;
+    mdbfs_free(g_batch_table);
+  }
+
+  if (sqlite3_exec(g_db, sql, NULL, NULL, NULL) != SQLITE_OK) {
+    mdbfs_debug("sqlite: database %s cannot be detached for now: %s", g_databases[i], sqlite3_errmsg(g_db));
+    goto quit;
+  }
+
+  mdbfs_info("sqlite: detached database %s", g_database_paths[i]);
+
+  mdbfs_free(g_databases[i]);
+  mdbfs_free(g_database_paths[i]);
+
+  /* The last one takes its place */
+  while (g_databases[last + 1])
+    last++;
+
+  g_databases[i]      = g_databases[last];
+  g_database_paths[i] = g_database_paths[last];
+  g_database_pins[i]  = g_database_pins[last];
+  g_database_used[i]  = g_database_used[last];
+  g_databases[last]      = NULL;
+  g_database_paths[last] = NULL;
+
+  /* Rows of it must not be served when it is attached again */
+  databases_changed_locked();
+  row_cache_clear();
+  mdbfs_metric_add(mdbfs_metric_get("sqlite_databases_detached"), 1);
+  ret = 1;
+
+quit:
+  mdbfs_free(sql);
+  return ret;
+}
+
+/**
+ * Detach the least recently used database not in use, to make room for
+ * another. Those which cannot be detached for now are passed over. The caller
+ * must hold `g_batch_lock` and `g_databases_lock`.
+ *
+ * @return 1 if one has been detached, 0 otherwise.
+ */
+static int database_evict_locked(void)
+{
+  uint64_t passed = 0; /* Those used up to then have been passed over */
+
+  for (;;) {
+    size_t victim = SIZE_MAX;
+
+    for (size_t i = 0; g_databases[i]; i++) {
+      if (g_database_pins[i] || g_database_used[i] <= passed)
+        continue;
+      if (victim == SIZE_MAX || g_database_used[i] < g_database_used[victim])
+        victim = i;
+    }
+
+    if (victim == SIZE_MAX)
+      return 0;
+
+    passed = g_database_used[victim];
+    if (database_detach_locked(victim))
+      return 1;
+  }
+}
+
+/********** Public APIs **********/
+
+int mdbfs_backend_sqlite_set_databases(const char *const *paths)
+{
+  size_t npaths = 0;
+
+  databases_free();
+
+  if (!paths)
+    return 1;
+
+  while (paths[npaths])
+    npaths++;
+
+  databases_alloc(npaths);
+
+  for (size_t i = 0; i < npaths; i++) {
+    /* Named by the file name, up to its last dot */
+    const char *name = strrchr(paths[i], '/');
+    name = name ? name + 1 : paths[i];
+
+    const char *dot = strrchr(name, '.');
+    size_t name_length = dot && dot != name ? (size_t)(dot - name) : strlen(name);
+
+    g_databases[i] = mdbfs_malloc0(name_length + 1);
+    memcpy(g_databases[i], name, name_length);
+    g_database_paths[i] = mdbfs_malloc0(strlen(paths[i]) + 1);
+    strcpy(g_database_paths[i], paths[i]);
+
+    if (!database_name_is_valid(g_databases[i])) {
+      mdbfs_error("sqlite: database %s cannot be named \"%s\" after its file name", paths[i], g_databases[i]);
+      databases_free();
+      return 0;
+    }
+
+    for (size_t j = 0; j < i; j++) {
+      if (sqlite3_stricmp(g_databases[i], g_databases[j]) == 0) {
+        mdbfs_error("sqlite: databases %s and %s would both be named \"%s\"", g_database_paths[j], paths[i], g_databases[i]);
+        databases_free();
+        return 0;
+      }
+    }
+  }
+
+  return 1;
+}
+
+int mdbfs_backend_sqlite_set_database_dir(const char *path, int64_t max_open)
+{
+  databases_free();
+
+  if (!path)
+    return 1;
+
+  if (max_open < 0) {
+    mdbfs_error("sqlite: at least one database is to be open at once");
+    return 0;
+  }
+
+  databases_alloc(max_open ? max_open : MDBFS_SQLITE_DEFAULT_OPEN_DATABASES);
+  g_database_dir = mdbfs_malloc0(strlen(path) + 1);
+  strcpy(g_database_dir, path);
+
+  return 1;
+}
+
+int mdbfs_backend_sqlite_open_database_from_file(const char *path)
+{
+  if (!path) {
+    mdbfs_warning("sqlite: open: path is missing");
+    return 0;
+  }
+
+  if (g_db) {
+    mdbfs_warning("sqlite: open: it looks like a database is already loaded!");
+    mdbfs_warning("sqlite: open: dropping the (previous?) session");
+    g_db = NULL;
+  }
+
+  /* Attached databases hang off an empty one of their own */
+  if (g_databases)
+    path = ":memory:";
+
+  mdbfs_info("sqlite: opening database from %s", path);
+
+  int r = sqlite3_open_v2(path, &g_db, SQLITE_OPEN_READWRITE, NULL);
+  if (r != SQLITE_OK) {
+    mdbfs_error(
+      "unable to open SQLite3 database at %s: %s",
+      path, sqlite3_errmsg(g_db)
+    );
+    return 0;
+  }
+
+  sqlite3_busy_timeout(g_db, MDBFS_SQLITE_BUSY_MS);
+
+  if (g_databases && !attach_databases()) {
+    sqlite3_close(g_db);
+    g_db = NULL;
+    return 0;
+  }
+
+  /* Databases of a directory are attached as they are used */
+  if (g_database_dir && g_databases_max > (size_t)sqlite3_limit(g_db, SQLITE_LIMIT_ATTACHED, -1)) {
+    g_databases_max = sqlite3_limit(g_db, SQLITE_LIMIT_ATTACHED, -1);
+    mdbfs_warning("sqlite: open: SQLite attaches at most %zu databases, which are open at once", g_databases_max);
+  }
+
+  sqlite3_update_hook(g_db, row_cache_hook, NULL);
+  sqlite3_progress_handler(g_db, MDBFS_SQLITE_PROGRESS_STEPS, progress, NULL);
+
+  /* Metadata is kept for a database on its own */
+  if (g_meta_path && g_databases) {
+    mdbfs_warning("sqlite: open: metadata is not kept across mounts for more than one database");
+    mdbfs_free(g_meta_path);
+  }
+
+  /* Before anything else reads the database, which creates its WAL */
+  if (g_meta_path)
+    meta_load();
+
+  pthread_mutex_lock(&g_batch_lock);
+  g_flusher_running = 1;
+  if (pthread_create(&g_flusher, NULL, batch_flusher, NULL) != 0) {
+    mdbfs_warning("sqlite: open: cannot start the batch flusher; created rows will be committed one by one");
+    g_flusher_running = 0;
+  }
+  pthread_mutex_unlock(&g_batch_lock);
+
+  pthread_mutex_lock(&g_prefetch_lock);
+  g_prefetcher_running = 1;
+  if (pthread_create(&g_prefetcher, NULL, prefetcher, NULL) != 0) {
+    mdbfs_warning("sqlite: open: cannot start the prefetcher; rows will be fetched as they are visited");
+    g_prefetcher_running = 0;
+  }
+  pthread_mutex_unlock(&g_prefetch_lock);
+
+  if (g_bloom_memory > 0) {
+    pthread_mutex_lock(&g_bloom_lock);
+    g_bloom_builder_running = 1;
+    g_bloom_stale = 1;
+    if (pthread_create(&g_bloom_builder, NULL, bloom_builder, NULL) != 0) {
+      mdbfs_warning("sqlite: open: cannot start the Bloom filter builder; every row will be looked up");
+      g_bloom_builder_running = 0;
+    }
+    pthread_mutex_unlock(&g_bloom_lock);
+  }
+
+  pthread_mutex_lock(&g_prewarm_lock);
+  g_prewarm_opened = 1;
+  prewarm_start_locked();
+  pthread_mutex_unlock(&g_prewarm_lock);
+
+  return 1;
+}
+
+void mdbfs_backend_sqlite_close_database(void)
+{
+  if (!g_db) {
+    mdbfs_warning("sqlite: close: attempting to close a closed connection!");
+    return;
+  }
+
+  mdbfs_info("closing sqlite3 database");
+
+  /* Prewarmers go first, as the planner may be using the connection */
+  prewarm_stop();
+
+  /* Commit what is left, then stop the flusher */
+  pthread_mutex_lock(&g_batch_lock);
+  if (!batch_commit_locked() && g_transaction == TRANSACTION_BATCH)
+    mdbfs_error("sqlite: close: %lld created rows are lost, as the database stays busy", (long long)g_batch_rows);
+  int flusher_running = g_flusher_running;
+  g_flusher_running = 0;
+  pthread_cond_signal(&g_batch_cond);
+  pthread_mutex_unlock(&g_batch_lock);
+
+  if (flusher_running)
+    pthread_join(g_flusher, NULL);
+
+  sqlite3_finalize(g_batch_stmt);
+  g_batch_stmt = NULL;
+  mdbfs_free(g_batch_table);
+
+  /* Stop the prefetcher, which may be using the connection */
+  pthread_mutex_lock(&g_prefetch_lock);
+  int prefetcher_running = g_prefetcher_running;
+  g_prefetcher_running = 0;
+  g_prefetch_pending = 0;
+  g_prefetch_busy = 0;
+  g_prefetch_window = 0;
+  mdbfs_free(g_prefetch_table);
+  pthread_cond_signal(&g_prefetch_cond);
+  pthread_mutex_unlock(&g_prefetch_lock);
+
+  if (prefetcher_running)
+    pthread_join(g_prefetcher, NULL);
+
+  /* Stop the Bloom filter builder likewise */
+  pthread_mutex_lock(&g_bloom_lock);
+  int bloom_builder_running = g_bloom_builder_running;
+  g_bloom_builder_running = 0;
+  pthread_cond_signal(&g_bloom_cond);
+  pthread_mutex_unlock(&g_bloom_lock);
+
+  if (bloom_builder_running)
+    pthread_join(g_bloom_builder, NULL);
+
+  pthread_mutex_lock(&g_bloom_lock);
+  blooms_free(g_blooms);
+  g_blooms = NULL;
+  g_bloom_stale = 0;
+  pthread_mutex_unlock(&g_bloom_lock);
+
+  /* Nothing changes the database from here on, so metadata kept now holds
+   * for it as it is left
+   */
+  uint8_t *meta = NULL;
+  size_t meta_length = 0;
+  char *db_path = NULL;
+
+  if (g_meta_path) {
+    meta = meta_serialize(&meta_length);
+    db_path = sql_from_fmt("%s", sqlite3_db_filename(g_db, "main"));
+  }
+
+  pthread_mutex_lock(&g_meta_lock);
+  meta_clear_locked();
+  memset(g_meta_stamp, -1, sizeof(g_meta_stamp));
+  pthread_mutex_unlock(&g_meta_lock);
+
+  /* Temporary views go away with the connection */
+  pthread_mutex_lock(&g_queries_lock);
+  while (g_queries) {
+    struct query *q = g_queries;
+    g_queries = q->next;
+    mdbfs_free(q->name);
+    mdbfs_free(q->sql);
+    mdbfs_free(q);
+  }
+  pthread_mutex_unlock(&g_queries_lock);
+
+  pthread_mutex_lock(&g_schemas_lock);
+  schemas_clear_locked();
+  pthread_mutex_unlock(&g_schemas_lock);
+  row_cache_clear();
+
+  pthread_mutex_lock(&g_versions_lock);
+  sqlite3_finalize(g_versions_stmt);
+  g_versions_stmt = NULL;
+  versions_clear_locked();
+  pthread_mutex_unlock(&g_versions_lock);
+
+  g_space_valid = 0;
+
+  sqlite3_close(g_db);
+  g_db = NULL;
+
+  if (meta && db_path)
+    meta_save(meta, meta_length, db_path);
+  mdbfs_free(meta);
+  mdbfs_free(db_path);
+
+  databases_free();
+}
+
+int mdbfs_backend_sqlite_has_databases(void)
+{
+  return g_databases != NULL;
+}
+
+char **mdbfs_backend_sqlite_get_database_names(void)
+{
+  char **ret = NULL;
+  size_t ret_length = 0;
+
+  if (!g_databases)
+    return NULL;
+
+  if (!g_database_dir) {
+    while (g_databases[ret_length])
+      ret_length++;
+
+    ret = mdbfs_malloc0((ret_length + 1) * sizeof(char *));
+    for (size_t i = 0; i < ret_length; i++) {
+      ret[i] = mdbfs_malloc0(strlen(g_databases[i]) + 1);
+      strcpy(ret[i], g_databases[i]);
+    }
+
+    return ret;
+  }
+
+  /* Files in a directory are listed as they are, without being opened */
+  DIR *dir = opendir(g_database_dir);
+  if (!dir) {
+    mdbfs_warning("sqlite: cannot list databases in %s: %s", g_database_dir, strerror(errno));
+    return mdbfs_malloc0(sizeof(char *));
+  }
+
+  for (struct dirent *entry = readdir(dir); entry; entry = readdir(dir)) {
+    if (entry->d_type != DT_REG && entry->d_type != DT_LNK && entry->d_type != DT_UNKNOWN)
+      continue;
+
+    char *path = database_dir_path(entry->d_name, 0);
+    if (!path)
+      continue;
+    mdbfs_free(path);
+
+    ret_length += 1;
+    ret = mdbfs_realloc(ret, ret_length * sizeof(char *));
+    ret[ret_length - 1] = mdbfs_malloc0(strlen(entry->d_name) + 1);
+    strcpy(ret[ret_length - 1], entry->d_name);
+  }
+
+  closedir(dir);
+
+  ret = mdbfs_realloc(ret, (ret_length + 1) * sizeof(char *));
+  ret[ret_length] = NULL;
+  return ret;
+}
+
+int mdbfs_backend_sqlite_database_exists(const char *name)
+{
+  int ret = 0;
+
+  if (!g_databases || !name)
+    return 0;
+
+  if (g_database_dir) {
+    char *path = database_dir_path(name, 1);
+    ret = path != NULL;
+    mdbfs_free(path);
+    return ret;
+  }
+
+  for (size_t i = 0; g_databases[i] && !ret; i++)
+    ret = strcmp(g_databases[i], name) == 0;
+
+  return ret;
+}
+
+int mdbfs_backend_sqlite_use_database(const char *name)
+{
+  struct timespec deadline;
+  int ret = 0;
+
+  if (!g_databases || !name)
+    return 0;
+
+  pthread_mutex_lock(&g_databases_lock);
+  ret = database_pin_locked(name);
+  pthread_mutex_unlock(&g_databases_lock);
+
+  if (ret || !g_database_dir)
+    return ret;
+
+  char *path = database_dir_path(name, 1);
+  if (!path)
+    return 0;
+
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_sec  += MDBFS_SQLITE_DATABASE_WAIT_MS / 1000;
+  deadline.tv_nsec += MDBFS_SQLITE_DATABASE_WAIT_MS % 1000 * 1000000;
+  if (deadline.tv_nsec >= 1000000000) {
+    deadline.tv_sec  += 1;
+    deadline.tv_nsec -= 1000000000;
+  }
+
+  for (;;) {
+    /* Databases cannot be attached or detached within a transaction: created
+     * rows are committed first, but an import is not cut short
+     */
+    pthread_mutex_lock(&g_batch_lock);
+    if (!batch_commit_locked() || g_transaction != TRANSACTION_NONE) {
+      mdbfs_warning("sqlite: cannot open database %s while a transaction is open", name);
+      pthread_mutex_unlock(&g_batch_lock);
+      break;
+    }
+
+    pthread_mutex_lock(&g_databases_lock);
+
+    size_t ndatabases = 0;
+    while (g_databases[ndatabases])
+      ndatabases++;
+
+    /* Someone else may have attached it meanwhile */
+    if (database_pin_locked(name)) {
+      ret = 1;
+    } else if (ndatabases < g_databases_max || database_evict_locked()) {
+      ret = database_attach_locked(name, path);
+    } else {
+      /* Every database attached is in use; wait for one to be released */
+      pthread_mutex_unlock(&g_batch_lock);
+      int r = pthread_cond_timedwait(&g_databases_cond, &g_databases_lock, &deadline);
+      pthread_mutex_unlock(&g_databases_lock);
+
+      if (r == ETIMEDOUT) {
+        mdbfs_warning("sqlite: cannot open database %s, as all %zu databases open are in use", name, g_databases_max);
+        break;
+      }
+
+      continue;
+    }
+
+    pthread_mutex_unlock(&g_databases_lock);
+    pthread_mutex_unlock(&g_batch_lock);
+    break;
+  }
+
+  mdbfs_free(path);
+  return ret;
+}
+
+void mdbfs_backend_sqlite_release_database(const char *name)
+{
+  if (!g_databases || !name)
+    return;
+
+  pthread_mutex_lock(&g_databases_lock);
+
+  for (size_t i = 0; g_databases[i]; i++) {
+    if (strcmp(g_databases[i], name) == 0 && g_database_pins[i] > 0) {
+      if (--g_database_pins[i] == 0)
+        pthread_cond_broadcast(&g_databases_cond);
+      break;
+    }
+  }
+
+  pthread_mutex_unlock(&g_databases_lock);
+}
+
+char **mdbfs_backend_sqlite_get_table_names(void)
+{
+  int leader = 0;
+  int found = 0;
+  struct flight *flight = flight_join("tables", NULL, NULL, &leader);
+
+  if (leader)
+    flight_land(flight, list_table_names(), !mdbfs_cancel_check());
+
+  /* If the listing has been given up for whoever ran it, list for ourselves */
+  char **ret = flight_leave(flight, &found, strings_copy);
+  if (!found && !leader)
+    ret = list_table_names();
+
+  return ret;
+}
+
+char **mdbfs_backend_sqlite_get_column_names(const char *table_name, const char *row_name)
+{
+  sqlite3_stmt *stmt = NULL;
+  char *sql = NULL;
+  char **ret = NULL;
+  size_t ret_length = 0;
+  int r = 0;
+
+  if (!table_name) {
+    mdbfs_warning("sqlite: get_column_names: table name is missing, this is unexpected. returning");
+    return NULL;
+  }
+
+  mdbfs_debug("sqlite: listing column names in table \"%s\"", table_name);
+
+  if (row_name) {
+    int missing = 0;
+    ret = row_cache_column_names(table_name, row_name, &missing);
+    if (ret || missing)
+      return ret;
+  }
+
+  sql = sql_select_row(NULL, table_name, row_name);
+  if (!sql) {
+    mdbfs_error("sqlite: get_column_names: no sql no life!");
+    goto quit;
+  }
+
+  r = sqlite3_prepare_v2(g_db, sql, -1, &stmt, NULL);
+  if (r != SQLITE_OK) {
+    mdbfs_error("sqlite: get_column_names: sqlite3 cannot prepare a sql statement for us: %s", sqlite3_errmsg(g_db));
+    goto quit;
+  }
+
+  r = sqlite3_step(stmt);
+
+  if (r == SQLITE_DONE) {
+    mdbfs_debug("sqlite: get_column_names: nothing to show, the row may not exist");
+    goto quit;
+  }
+
+  if (r != SQLITE_ROW) {
+    mdbfs_warning("sqlite: get_column_names: sqlite3 reported an error: %s", sqlite3_errmsg(g_db));
+    goto quit;
+  }
+
+  int ncol = sqlite3_column_count(stmt);
+  for (int icol = 0; icol < ncol; icol++) {
+    /* Views may have expressions as columns, which have no origin */
+    const char *column_name = sqlite3_column_name(stmt, icol);
+    if (!column_name) {
+      mdbfs_warning("sqlite: get_column_names: unexpected null");
+      continue;
+    }
+
+    /* Stretch vector */
+    ret_length += 1;
+    ret = mdbfs_realloc(ret, ret_length * sizeof(char *));
+
+    /* Fill string element */
+    size_t name_length = strlen(column_name) + 1;
+    ret[ret_length - 1] = mdbfs_malloc0(name_length);
+    strncpy(ret[ret_length - 1], column_name, name_length);
+  }
+
+  /* Additionally add a NULL at the end of list for iteration */
+  ret_length += 1;
+  ret = mdbfs_realloc(ret, ret_length * sizeof(char *));
+  ret[ret_length - 1] = NULL;
+
+  mdbfs_debug("sqlite: done listing column names in table \"%s\"", table_name);
+
+quit:
+  mdbfs_free(sql);
+  r = sqlite3_finalize(stmt);
+  if (r != SQLITE_OK) {
+    mdbfs_warning("sqlite: get_column_names: sqlite3 cannot finalize a sql statement for us: %s", sqlite3_errmsg(g_db));
+    mdbfs_warning("sqlite: get_column_names: *leaking memory*");
+  }
+  return ret;
+}
+
+struct mdbfs_backend_sqlite_rowids *mdbfs_backend_sqlite_get_rowids(const char *table_name, int64_t first, int64_t last)
+{
+  char range[MDBFS_FORMAT_NUMBER_MAX * 2 + 1];
+  size_t range_length = 0;
+  int leader = 0;
+  int found = 0;
+
+  if (!table_name) {
+    mdbfs_warning("sqlite: get_rowids: table name is missing, this is unexpected. returning");
+    return NULL;
+  }
+
+  range_length += mdbfs_format_int64(range + range_length, first);
+  range[range_length++] = ':';
+  range_length += mdbfs_format_int64(range + range_length, last);
+  range[range_length] = '\0';
+
+  /* Tables listed before (or before remounting) are not scanned again */
+  if (g_meta_path) {
+    struct mdbfs_backend_sqlite_rowids *ret = meta_rowids_get(table_name, first, last);
+    if (ret)
+      return ret;
+  }
+
+  struct flight *flight = flight_join("rowids", table_name, range, &leader);
+
+  if (leader) {
+    int64_t stamp[3];
+    int stamped = g_meta_path && meta_stamp(stamp);
+    struct mdbfs_backend_sqlite_rowids *rowids = list_rowids(table_name, first, last);
+
+    if (stamped && rowids && first == INT64_MIN && last == INT64_MAX && !mdbfs_cancel_check())
+      meta_rowids_put(table_name, rowids, stamp);
+
+    flight_land(flight, rowids, !mdbfs_cancel_check());
+  }
+
+  /* If the listing has been given up for whoever ran it, list for ourselves */
+  struct mdbfs_backend_sqlite_rowids *ret = flight_leave(flight, &found, rowids_copy);
+  if (!found && !leader) {
+    mdbfs_backend_sqlite_free_rowids(ret);
+    ret = list_rowids(table_name, first, last);
+  }
+
+  return ret;
+}
+
+int64_t mdbfs_backend_sqlite_walk_rowids(const struct mdbfs_backend_sqlite_rowids *rowids, int64_t offset, mdbfs_backend_sqlite_row_walker walker, void *data)
+{
+  char row_name[MDBFS_FORMAT_NUMBER_MAX];
+
+  if (!rowids || !walker) {
+    mdbfs_warning("sqlite: walk_rowids: either ROWIDs or walker are missing, this is unexpected. returning");
+    return 0;
+  }
+
+  /* Names are made up one at a time, from the run holding the offset on */
+  int64_t index = offset;
+  for (size_t irun = rowids_run_at(rowids, offset); irun < rowids->nruns; irun++) {
+    const struct mdbfs_backend_sqlite_rowid_run *run = &rowids->runs[irun];
+
+    for (int64_t rowid = run->first + (index - run->index); ; rowid++) {
+      row_name[mdbfs_format_int64(row_name, rowid)] = '\0';
+
+      if (walker(row_name, index + 1, data))
+        return index;
+
+      index++;
+      if (rowid == run->last)
+        break;
+    }
+  }
+
+  return rowids->count;
+}
+
+int mdbfs_backend_sqlite_walk_rowid_buckets(const char *table_name, int64_t first, int64_t last, int64_t width, mdbfs_backend_sqlite_bucket_walker walker, void *data)
+{
+  sqlite3_stmt *stmt = NULL;
+  char *sql = NULL;
+  char *table = NULL;
+  int ret = 0;
+  int r = 0;
+
+  if (!table_name || !walker || width <= 0) {
+    mdbfs_warning("sqlite: walk_rowid_buckets: either table name, walker or width is missing, this is unexpected. returning");
+    return 0;
+  }
+
+  mdbfs_debug("sqlite: walking buckets of %lld rows in \"%s\" from %lld", (long long)width, table_name, (long long)first);
+
+  table = sql_table(table_name);
+  sql = sql_from_fmt(sql_fmt_select_rowid_from_where_rowid_between, "", table);
+  if (!sql) {
+    mdbfs_error("sqlite: walk_rowid_buckets: no sql no life!");
+    goto quit;
+  }
+
+  r = sqlite3_prepare_v2(g_db, sql, -1, &stmt, NULL);
+  if (r != SQLITE_OK) {
+    mdbfs_error("sqlite: walk_rowid_buckets: sqlite3 cannot prepare a sql statement for us: %s", sqlite3_errmsg(g_db));
+    goto quit;
+  }
+
+  /* Each bucket takes one probe for its lowest ROWID, after which the rest of
+   * the bucket is skipped; a scan would read every row in it instead
+   */
+  int64_t last_bucket = rowid_bucket(last, width);
+  r = SQLITE_DONE;
+  while (first <= last) {
+    sqlite3_reset(stmt);
+    sqlite3_bind_int64(stmt, 1, first);
+    sqlite3_bind_int64(stmt, 2, last);
+
+    r = sqlite3_step(stmt);
+    if (r != SQLITE_ROW)
+      break;
+
+    int64_t bucket = rowid_bucket(sqlite3_column_int64(stmt, 0), width);
+    if (walker(bucket, data) != 0 || bucket == last_bucket) {
+      r = SQLITE_DONE;
+      break;
+    }
+
+    first = (bucket + 1) * width;
+  }
+
+  if (r != SQLITE_DONE) {
+    mdbfs_warning("sqlite: walk_rowid_buckets: sqlite3 reported an error: %s", sqlite3_errmsg(g_db));
+    goto quit;
+  }
+
+  ret = 1;
+
+quit:
+  mdbfs_free(sql);
+  mdbfs_free(table);
+  r = sqlite3_finalize(stmt);
+  if (r != SQLITE_OK) {
+    mdbfs_warning("sqlite: walk_rowid_buckets: sqlite3 cannot finalize a sql statement for us: %s", sqlite3_errmsg(g_db));
+    mdbfs_warning("sqlite: walk_rowid_buckets: *leaking memory*");
+  }
+  return ret;
+}
+
+void mdbfs_backend_sqlite_free_rowids(struct mdbfs_backend_sqlite_rowids *rowids)
+{
+  if (!rowids)
+    return;
+
+  mdbfs_free(rowids->runs);
+  mdbfs_free(rowids);
+}
+
+uint8_t *mdbfs_backend_sqlite_get_cell(size_t *cell_length, const char *table_name, const char *row_name, const char *col_name)
+{
+  sqlite3_stmt *stmt = NULL;
+  uint8_t *ret = NULL;
+  size_t   ret_length = 0;
+  int r = 0;
+
+  if (!table_name || !row_name || !col_name) {
+    mdbfs_warning("sqlite: get_cell: either table name, row name, or column name is missing, this is unexpected. returning");
+    return NULL;
+  }
+
+  mdbfs_debug("sqlite: get_cell: querying content in cell (\"%s\", \"%s\", \"%s\")", table_name, row_name, col_name);
+
+  stmt = step_cell(table_name, row_name, col_name, "get_cell");
+  if (!stmt)
+    goto quit;
+
+  char number[MDBFS_FORMAT_NUMBER_MAX];
+  const uint8_t *cell = NULL;
+
+  if (render_cell(stmt, 0, col_name, number, &cell, &ret_length) == MDBFS_BACKEND_SQLITE_CELL_TYPE_NONE) {
+    mdbfs_debug("sqlite: get_cell: the column does not exist");
+    goto quit;
+  }
+
+  /* Empty cells still get a buffer with only a NUL to indicate that there is
+   * no error.
+   */
+  ret = mdbfs_malloc0(ret_length + 1); /* + 1 NUL */
+
+  if (cell)
+    memcpy(ret, cell, ret_length);
+
+  if (cell_length)
+    *cell_length = ret_length;
+
+  mdbfs_debug("sqlite: get_cell: done querying content in cell (\"%s\", \"%s\", \"%s\")", table_name, row_name, col_name);
+
+quit:
+  r = sqlite3_finalize(stmt);
+  if (r != SQLITE_OK) {
+    mdbfs_warning("sqlite: get_cell: sqlite3 cannot finalize a sql statement for us: %s", sqlite3_errmsg(g_db));
+    mdbfs_warning("sqlite: get_cell: *leaking memory*");
+  }
+  return ret;
+}
+
+size_t mdbfs_backend_sqlite_get_cell_length(const char *table_name, const char *row_name, const char *col_name)
+{
+  size_t ret = 0;
+
+  if (!table_name || !row_name || !col_name) {
+    mdbfs_warning("sqlite: get_cell_length: either table name, row name, or column name is missing, this is unexpected. returning");
+    return 0;
+  }
+
+  mdbfs_backend_sqlite_read_cell(NULL, &ret, NULL, 0, 0, table_name, row_name, col_name);
+  return ret;
+}
+
+int64_t mdbfs_backend_sqlite_read_cell(enum mdbfs_backend_sqlite_cell_type *cell_type, size_t *cell_length, char *buf, size_t bufsize, int64_t offset, const char *table_name, const char *row_name, const char *col_name)
+{
+  sqlite3_stmt *stmt = NULL;
+  int64_t ret = -1;
+  int r = 0;
+
+  if (!table_name || !row_name || !col_name) {
+    mdbfs_warning("sqlite: read_cell: either table name, row name, or column name is missing, this is unexpected. returning");
+    return -1;
+  }
+
+  mdbfs_debug("sqlite: read_cell: reading cell (\"%s\", \"%s\", \"%s\") at %lld", table_name, row_name, col_name, (long long)offset);
+
+  /* Lengths may have been worked out while listing the table */
+  if (!bufsize && !cell_type) {
+    int64_t data_version = rows_data_version();
+
+    pthread_mutex_lock(&g_rows_lock);
+
+    struct cached_attrs *attrs = attrs_find_locked(table_name, row_name, data_version);
+    for (size_t icol = 0; attrs && icol < g_attrs_ncols; icol++) {
+      if (strcmp(g_attrs_col_names[icol], col_name) != 0)
+        continue;
+
+      if (cell_length)
+        *cell_length = attrs->col_lengths[icol];
+
+      pthread_mutex_unlock(&g_rows_lock);
+      return 0;
+    }
+
+    pthread_mutex_unlock(&g_rows_lock);
+  }
+
+  /* Sibling cells are mostly read together; fetch the row whole */
+  if (row_cache_read(cell_type, cell_length, buf, bufsize, offset, table_name, row_name, col_name, &ret)) {
+    if (ret < 0)
+      mdbfs_debug("sqlite: read_cell: the column does not exist");
+    return ret;
+  }
+
+  stmt = step_cell(table_name, row_name, col_name, "read_cell");
+  if (!stmt)
+    goto quit;
+
+  char number[MDBFS_FORMAT_NUMBER_MAX];
+  const uint8_t *cell = NULL;
+  size_t length = 0;
+
+  enum mdbfs_backend_sqlite_cell_type type = render_cell(stmt, 0, col_name, number, &cell, &length);
+  if (type == MDBFS_BACKEND_SQLITE_CELL_TYPE_NONE) {
+    mdbfs_debug("sqlite: read_cell: the column does not exist");
+    goto quit;
+  }
+
+  if (cell_type)
+    *cell_type = type;
+  if (cell_length)
+    *cell_length = length;
+
+  /* "This memory cannot be read" */
+  ret = 0;
+  if (offset < 0 || offset >= length || !bufsize)
+    goto quit;
+
+  ret = length - offset <= bufsize ? length - offset : bufsize;
+  memcpy(buf, cell + offset, ret);
+
+quit:
+  r = sqlite3_finalize(stmt);
+  if (r != SQLITE_OK) {
+    mdbfs_warning("sqlite: read_cell: sqlite3 cannot finalize a sql statement for us: %s", sqlite3_errmsg(g_db));
+    mdbfs_warning("sqlite: read_cell: *leaking memory*");
+  }
+  return ret;
+}
+
+const char *mdbfs_backend_sqlite_cell_type_name(enum mdbfs_backend_sqlite_cell_type cell_type)
+{
+  switch (cell_type) {
+    case MDBFS_BACKEND_SQLITE_CELL_TYPE_NULL:
+      return "null";
+    case MDBFS_BACKEND_SQLITE_CELL_TYPE_INTEGER:
+      return "integer";
+    case MDBFS_BACKEND_SQLITE_CELL_TYPE_REAL:
+      return "real";
+    case MDBFS_BACKEND_SQLITE_CELL_TYPE_TEXT:
+      return "text";
+    case MDBFS_BACKEND_SQLITE_CELL_TYPE_BLOB:
+      return "blob";
+    default:
+      return NULL;
+  }
+}
+
+int mdbfs_backend_sqlite_prefetch_attrs(const char *table_name, const struct mdbfs_backend_sqlite_rowids *rowids, int64_t offset)
+{
+  sqlite3_stmt *stmt = NULL;
+  char **col_names = NULL;
+  size_t ncols = 0;
+  char *projection = NULL;
+  size_t projection_length = 0;
+  char *sql = NULL;
+  char *table = NULL;
+  struct cached_attrs *batch = NULL;
+  size_t nbatch = 0;
+  int64_t data_version = 0;
+  char first_name[MDBFS_FORMAT_NUMBER_MAX];
+  int ret = 0;
+  int r = 0;
+
+  if (!table_name || !rowids) {
+    mdbfs_warning("sqlite: prefetch_attrs: either table name or ROWIDs are missing, this is unexpected. returning");
+    return 0;
+  }
+
+  /* The batch spans the rows listed from the offset on, which are all the rows
+   * between its first and last ROWID
+   */
+  size_t irun = rowids_run_at(rowids, offset);
+  if (irun == rowids->nruns)
+    return 1;
+
+  int64_t end = rowids->count - offset > MDBFS_SQLITE_ATTR_BATCH_ROWS ? offset + MDBFS_SQLITE_ATTR_BATCH_ROWS : rowids->count;
+  size_t jrun = rowids_run_at(rowids, end - 1);
+  int64_t first = rowids->runs[irun].first + (offset - rowids->runs[irun].index);
+  int64_t last  = rowids->runs[jrun].first + (end - 1 - rowids->runs[jrun].index);
+  size_t nids = end - offset;
+
+  first_name[mdbfs_format_int64(first_name, first)] = '\0';
+
+  /* Pages of a listing are smaller than a batch; only the first page of each
+   * batch has anything to do, while listing the table again starts over
+   */
+  if (offset) {
+    int64_t data_version_now = rows_data_version();
+
+    pthread_mutex_lock(&g_rows_lock);
+    int cached = attrs_find_locked(table_name, first_name, data_version_now) != NULL;
+    pthread_mutex_unlock(&g_rows_lock);
+
+    if (cached)
+      return 1;
+  }
+
+  /* Listings of the same table at the same time share the lengths */
+  int leader = 0;
+  struct flight *flight = flight_join("attrs", table_name, first_name, &leader);
+  if (!leader) {
+    flight_leave(flight, &ret, NULL);
+    return ret;
+  }
+
+  /* Columns come from the cached schema */
+  pthread_mutex_lock(&g_schemas_lock);
+  struct schema *schema = schema_lookup_locked(table_name, &data_version);
+  for (size_t i = 0; schema && schema->col_names[i]; i++) {
+    ncols += 1;
+    col_names = mdbfs_realloc(col_names, (ncols + 1) * sizeof(char *));
+    col_names[ncols - 1] = mdbfs_malloc0(strlen(schema->col_names[i]) + 1);
+    strcpy(col_names[ncols - 1], schema->col_names[i]);
+    col_names[ncols] = NULL;
+  }
+  pthread_mutex_unlock(&g_schemas_lock);
+
+  if (!ncols)
+    goto quit;
+
+  mdbfs_debug("sqlite: prefetch_attrs: working out cell lengths of rows %lld to %lld in \"%s\"", (long long)first, (long long)last, table_name);
+
+  /* One length per column; reals are fetched as they are, since their length
+   * is that of our formatting, not SQLite's
+   */
+  for (size_t i = 0; i < ncols; i++) {
+    char *fragment = sql_from_fmt(sql_fmt_cell_length, col_names[i], col_names[i], col_names[i]);
+    if (!fragment) {
+      mdbfs_error("sqlite: prefetch_attrs: no sql no life!");
+      goto quit;
+    }
+
+    size_t fragment_length = strlen(fragment);
+    projection = mdbfs_realloc(projection, projection_length + fragment_length + 1);
+    memcpy(projection + projection_length, fragment, fragment_length + 1);
+    projection_length += fragment_length;
+    mdbfs_free(fragment);
+  }
+
+  /* Listing the table again, or another one, or once the data has changed,
+   * starts over; the version was read along with the schema, before the query
+   */
+  pthread_mutex_lock(&g_rows_lock);
+  int same = offset && g_attrs_table && strcmp(g_attrs_table, table_name) == 0 && g_attrs_ncols == ncols &&
+             g_attrs_data_version == data_version;
+  for (size_t i = 0; same && i < ncols; i++)
+    same = strcmp(g_attrs_col_names[i], col_names[i]) == 0;
+
+  if (!same) {
+    attrs_clear_locked();
+    g_attrs_table = mdbfs_malloc0(strlen(table_name) + 1);
+    strcpy(g_attrs_table, table_name);
+    g_attrs_col_names = col_names;
+    g_attrs_ncols = ncols;
+    g_attrs_data_version = data_version;
+    col_names = NULL;
+  }
+
+  uint64_t generation = g_rows_generation;
+  int full = (g_attrs_nrows + nids) * ncols > MDBFS_SQLITE_ATTR_MAX_CELLS;
+  pthread_mutex_unlock(&g_rows_lock);
+
+  if (full) {
+    mdbfs_debug("sqlite: prefetch_attrs: too many cells to keep; the rest is worked out on demand");
+    ret = 1;
+    goto quit;
+  }
+
+  if (mdbfs_cancel_check())
+    goto quit;
+
+  table = sql_table(table_name);
+  sql = sql_from_fmt(sql_fmt_select_rowid_from_where_rowid_between, projection, table);
+  if (!sql) {
+    mdbfs_error("sqlite: prefetch_attrs: no sql no life!");
+    goto quit;
+  }
+
+  r = sqlite3_prepare_v2(g_db, sql, -1, &stmt, NULL);
+  if (r != SQLITE_OK) {
+    mdbfs_error("sqlite: prefetch_attrs: sqlite3 cannot prepare a sql statement for us: %s", sqlite3_errmsg(g_db));
+    goto quit;
+  }
+
+  sqlite3_bind_int64(stmt, 1, first);
+  sqlite3_bind_int64(stmt, 2, last);
+
+  batch = mdbfs_malloc0(nids * sizeof(struct cached_attrs));
+
+  while (nbatch < nids && (r = sqlite3_step(stmt)) == SQLITE_ROW) {
+    struct cached_attrs *attrs = &batch[nbatch++];
+    attrs->rowid = sqlite3_column_int64(stmt, 0);
+    attrs->col_lengths = mdbfs_malloc0(ncols * sizeof(uint32_t));
+
+    for (size_t icol = 0; icol < ncols; icol++) {
+      char number[MDBFS_FORMAT_NUMBER_MAX];
+
+      if (sqlite3_column_type(stmt, icol + 1) == SQLITE_FLOAT)
+        attrs->col_lengths[icol] = mdbfs_format_double(number, sqlite3_column_double(stmt, icol + 1));
+      else
+        attrs->col_lengths[icol] = sqlite3_column_int64(stmt, icol + 1); /* NULL reads 0 */
+    }
+  }
+
+  /* Keep the batch only if nothing has changed meanwhile */
+  pthread_mutex_lock(&g_rows_lock);
+  if (generation == g_rows_generation && g_attrs_table && strcmp(g_attrs_table, table_name) == 0 && g_attrs_ncols == ncols) {
+    /* Batches come in ROWID order unless the listing has gone back, in which
+     * case the batch starts over
+     */
+    if (g_attrs_nrows && nbatch && g_attrs[g_attrs_nrows - 1].rowid >= batch[0].rowid) {
+      for (size_t i = 0; i < g_attrs_nrows; i++)
+        mdbfs_free(g_attrs[i].col_lengths);
+      g_attrs_nrows = 0;
+    }
+
+    g_attrs = mdbfs_realloc(g_attrs, (g_attrs_nrows + nbatch) * sizeof(struct cached_attrs));
+    memcpy(g_attrs + g_attrs_nrows, batch, nbatch * sizeof(struct cached_attrs));
+    g_attrs_nrows += nbatch;
+    nbatch = 0;
+  }
+  pthread_mutex_unlock(&g_rows_lock);
+
+  mdbfs_debug("sqlite: prefetch_attrs: done working out cell lengths in \"%s\"", table_name);
+  ret = 1;
+
+quit:
+  for (size_t i = 0; i < nbatch; i++)
+    mdbfs_free(batch[i].col_lengths);
+  mdbfs_free(batch);
+  for (size_t i = 0; col_names && col_names[i]; i++)
+    mdbfs_free(col_names[i]);
+  mdbfs_free(col_names);
+  mdbfs_free(projection);
+  mdbfs_free(sql);
+  mdbfs_free(table);
+  sqlite3_finalize(stmt);
+  flight_land(flight, NULL, ret);
+  flight_leave(flight, NULL, NULL);
+  return ret;
+}
+
+int mdbfs_backend_sqlite_row_is_cached(const char *table_name, const char *row_name)
+{
+  int ret = 0;
+
+  if (!table_name || !row_name)
+    return 0;
+
+  int64_t data_version = rows_data_version();
+
+  pthread_mutex_lock(&g_rows_lock);
+
+  if (attrs_find_locked(table_name, row_name, data_version) || row_cache_find_locked(table_name, row_name, data_version))
+    ret = 1;
+
+  pthread_mutex_unlock(&g_rows_lock);
+
+  /* So are rows of tables whose ROWIDs are kept */
+  if (!ret && g_meta_path)
+    ret = meta_row_exists(table_name, row_name);
+
+  return ret;
+}
+
+char *mdbfs_backend_sqlite_get_column_decltype(const char *table_name, const char *col_name)
+{
+  char *ret = NULL;
+  int64_t data_version = 0;
+
+  if (!table_name || !col_name) {
+    mdbfs_warning("sqlite: get_column_decltype: either table name or column name is missing, this is unexpected. returning");
+    return NULL;
+  }
+
+  pthread_mutex_lock(&g_schemas_lock);
+
+  struct schema *schema = schema_lookup_locked(table_name, &data_version);
+  if (!schema)
+    goto quit;
+
+  for (int i = 0; schema->col_names[i]; i++) {
+    if (strcmp(schema->col_names[i], col_name) != 0)
+      continue;
+
+    ret = mdbfs_malloc0(strlen(schema->col_decltypes[i]) + 1);
+    strcpy(ret, schema->col_decltypes[i]);
+    break;
+  }
+
+quit:
+  pthread_mutex_unlock(&g_schemas_lock);
+  return ret;
+}
+
+int64_t mdbfs_backend_sqlite_get_row_estimate(const char *table_name)
+{
+  int64_t ret = -1;
+  int64_t data_version = 0;
+
+  if (!table_name) {
+    mdbfs_warning("sqlite: get_row_estimate: table name is missing, this is unexpected. returning");
+    return -1;
+  }
+
+  pthread_mutex_lock(&g_schemas_lock);
+
+  struct schema *schema = schema_lookup_locked(table_name, &data_version);
+  if (!schema)
+    goto quit;
+
+  /* The estimate holds until another connection commits (data_version) or
+   * this one changes anything (total_changes)
+   */
+  int64_t changes = sqlite3_total_changes(g_db);
+
+  if (!schema->row_estimated || schema->data_version != data_version || schema->changes != changes) {
+    schema->row_estimate  = estimate_rows(table_name);
+    schema->row_estimated = 1;
+    schema->data_version  = data_version;
+    schema->changes       = changes;
+  }
+
+  ret = schema->row_estimate;
+
+quit:
+  pthread_mutex_unlock(&g_schemas_lock);
+  return ret;
+}
+
+int mdbfs_backend_sqlite_set_cell(const uint8_t *content, const size_t content_length, int64_t offset, const char *table_name, const char *row_name, const char *col_name)
+{
+  sqlite3_blob *blob = NULL;
+  int64_t rowid = 0;
+  int r = 0;
+
+  if (!table_name || !row_name || !col_name) {
+    mdbfs_warning("sqlite: set_cell: either table name, row name, or column name is missing, this is unexpected. returning");
+    return 0;
+  }
+
+  if (!rowid_from_name(row_name, &rowid) || offset < 0) {
+    mdbfs_warning("sqlite: set_cell: \"%s\" is not a ROWID, or the offset is negative", row_name);
+    return 0;
+  }
+
+  if (!content_length)
+    return 1;
+
+  mdbfs_debug("sqlite: set_cell: updating content in cell (\"%s\", \"%s\", \"%s\") at %lld", table_name, row_name, col_name, (long long)offset);
+
+  write_begin();
+
+  /* Write in place if the cell is large enough already (e.g. sized by
+   * mdbfs_backend_sqlite_resize_cell), so that the value is not rewritten
+   */
+  char *schema = table_schema(table_name);
+  r = sqlite3_blob_open(g_db, schema ? schema : "main", table_base(table_name), col_name, rowid, 1, &blob);
+  if (r == SQLITE_OK && offset + (int64_t)content_length <= sqlite3_blob_bytes(blob)) {
+    r = sqlite3_blob_write(blob, content, content_length, offset);
+    sqlite3_blob_close(blob);
+
+    /* Incremental I/O does not go through the update hook */
+    row_cache_hook(NULL, SQLITE_UPDATE, schema ? schema : "main", table_base(table_name), rowid);
+    mdbfs_free(schema);
+    write_end();
+
+    if (r != SQLITE_OK) {
+      mdbfs_warning("sqlite: set_cell: sqlite3 reported an error: %s", sqlite3_errstr(r));
+      return 0;
+    }
+
+    mdbfs_debug("sqlite: set_cell: done updating content in cell (\"%s\", \"%s\", \"%s\") in place", table_name, row_name, col_name);
+    return 1;
+  }
+  sqlite3_blob_close(blob);
+  mdbfs_free(schema);
+
+  /* Otherwise splice it into the value, zero-filling any gap */
+  r = update_cell_bytes(sql_fmt_cell_spliced_is_blob, sql_fmt_cell_spliced, offset, content, content_length, table_name, rowid, col_name, "set_cell");
+  write_end();
+
+  return r;
+}
+
+int mdbfs_backend_sqlite_resize_cell(int64_t size, const char *table_name, const char *row_name, const char *col_name)
+{
+  int64_t rowid = 0;
+  int ret = 0;
+
+  if (!table_name || !row_name || !col_name) {
+    mdbfs_warning("sqlite: resize_cell: either table name, row name, or column name is missing, this is unexpected. returning");
+    return 0;
+  }
+
+  if (!rowid_from_name(row_name, &rowid) || size < 0) {
+    mdbfs_warning("sqlite: resize_cell: \"%s\" is not a ROWID, or the size is negative", row_name);
+    return 0;
+  }
+
+  mdbfs_debug("sqlite: resize_cell: resizing cell (\"%s\", \"%s\", \"%s\") to %lld", table_name, row_name, col_name, (long long)size);
+
+  write_begin();
+  ret = update_cell_bytes(sql_fmt_cell_resized_is_blob, sql_fmt_cell_resized, size, NULL, 0, table_name, rowid, col_name, "resize_cell");
+  write_end();
+
+  return ret;
+}
+
+int mdbfs_backend_sqlite_copy_cell(const char *table_from, const char *row_from, const char *col_from, const char *table_to, const char *row_to, const char *col_to)
+{
+  sqlite3_stmt *stmt = NULL;
+  char *sql = NULL;
+  char *from = NULL;
+  char *to = NULL;
+  char *value = NULL;
+  int64_t rowid_from = 0;
+  int64_t rowid_to = 0;
+  int ret = 0;
+  int r = 0;
+
+  if (!table_from || !row_from || !col_from || !table_to || !row_to || !col_to) {
+    mdbfs_warning("sqlite: copy_cell: either table names, row names, or column names are missing, this is unexpected. returning");
+    return 0;
+  }
+
+  if (!rowid_from_name(row_from, &rowid_from) || !rowid_from_name(row_to, &rowid_to)) {
+    mdbfs_warning("sqlite: copy_cell: either \"%s\" or \"%s\" is not a ROWID", row_from, row_to);
+    return 0;
+  }
+
+  mdbfs_debug("sqlite: copy_cell: copying cell (\"%s\", \"%s\", \"%s\") to (\"%s\", \"%s\", \"%s\")", table_from, row_from, col_from, table_to, row_to, col_to);
+
+  write_begin();
+
+  /* The value keeps its type */
+  value = sql_from_fmt("\"%s\"", col_from);
+
+  from = sql_table(table_from);
+  to = sql_table(table_to);
+  sql = value ? sql_from_fmt(sql_fmt_update_set_select, to, col_to, value, from) : NULL;
+  if (!sql) {
+    mdbfs_error("sqlite: copy_cell: no sql no life!");
+    goto quit;
+  }
+
+  r = sqlite3_prepare_v2(g_db, sql, -1, &stmt, NULL);
+  if (r != SQLITE_OK) {
+    mdbfs_warning("sqlite: copy_cell: sqlite3 cannot prepare a sql statement for us: %s", sqlite3_errmsg(g_db));
+    goto quit;
+  }
+
+  sqlite3_bind_int64(stmt, 1, rowid_from);
+  sqlite3_bind_int64(stmt, 2, rowid_to);
+  r = sqlite3_step(stmt);
+
+  if (r != SQLITE_DONE) {
+    mdbfs_warning("sqlite: copy_cell: sqlite3 reported an error: %s", sqlite3_errmsg(g_db));
+    goto quit;
+  }
+
+  if (sqlite3_changes(g_db) != 1) {
+    mdbfs_warning("sqlite: copy_cell: there is no row \"%s\" in table \"%s\"", row_to, table_to);
+    goto quit;
+  }
+
+  mdbfs_debug("sqlite: copy_cell: copied cell (\"%s\", \"%s\", \"%s\") to (\"%s\", \"%s\", \"%s\")", table_from, row_from, col_from, table_to, row_to, col_to);
+  ret = 1;
+
+quit:
+  write_end();
+  sqlite3_finalize(stmt);
+  mdbfs_free(sql);
+  mdbfs_free(from);
+  mdbfs_free(to);
+  mdbfs_free(value);
+  return ret;
+}
+
+int mdbfs_backend_sqlite_rename_table(const char *table_old, const char *table_new)
+{
+  sqlite3_stmt *stmt = NULL;
+  char *sql = NULL;
+  char *table = NULL;
+  int r = 0;
+
+  if (!table_old || !table_new) {
+    mdbfs_warning("sqlite: rename_table: either old or new table name is empty, this is unexpected. returning");
+    return 0;
+  }
+
+  /* Tables do not move between attached databases */
+  size_t schema_length = table_base(table_old) - table_old;
+  if (schema_length != (size_t)(table_base(table_new) - table_new) || strncmp(table_old, table_new, schema_length) != 0) {
+    mdbfs_warning("sqlite: rename_table: \"%s\" and \"%s\" are in different databases", table_old, table_new);
+    return 0;
+  }
+
+  if (query_exists(table_new)) {
+    mdbfs_warning("sqlite: rename_table: \"%s\" would be shadowed by the query of the same name", table_new);
+    return 0;
+  }
+
+  mdbfs_debug("sqlite: rename_table: altering table name from %s to %s", table_old, table_new);
+
+  write_begin();
+
+  table = sql_table(table_old);
+  sql = sql_from_fmt(sql_fmt_alter_table_rename_to, table, table_base(table_new));
+  if (!sql) {
+    mdbfs_error("sqlite: rename_table: no sql no life!");
+    goto quit;
+  }
+
+  r = sqlite3_prepare_v2(g_db, sql, -1, &stmt, NULL);
+  if (r != SQLITE_OK) {
+    mdbfs_error("sqlite: rename_table: sqlite3 cannot prepare a sql statement for us: %s", sqlite3_errmsg(g_db));
+    goto quit;
+  }
+
+  r = sqlite3_step(stmt);
+
+  /* No result is given */
+  if (r != SQLITE_DONE) {
+    mdbfs_warning("sqlite: rename_table: sqlite3 reported an error: %s", sqlite3_errmsg(g_db));
+    goto quit;
+  }
+
+  mdbfs_debug("sqlite: rename_table: done altering table name from %s to %s", table_old, table_new);
+
+quit:
+  write_end();
+  row_cache_clear();
+  mdbfs_free(sql);
+  mdbfs_free(table);
+  r = sqlite3_finalize(stmt);
+  if (r != SQLITE_OK) {
+    mdbfs_warning("sqlite: rename_table: sqlite3 cannot finalize a sql statement for us: %s", sqlite3_errmsg(g_db));
+    mdbfs_warning("sqlite: rename_table: *leaking memory*");
+  }
+  return 1;
+}
+
+int mdbfs_backend_sqlite_rename_column(const char *table_name, const char *column_old, const char *column_new)
+{
+  sqlite3_stmt *stmt = NULL;
+  char *sql = NULL;
+  char *table = NULL;
+  int r = 0;
+
+  if (!table_name || !column_old || !column_new) {
+    mdbfs_warning("sqlite: rename_column: either table name, old column name, or new column name is missing, this is unexpected. returning");
+    return 0;
+  }
+
+  mdbfs_debug("sqlite: rename_column: altering column name in table \"%s\" from \"%s\" to \"%s\"", table_name, column_old, column_new);
+
+  write_begin();
+
+  table = sql_table(table_name);
+  sql = sql_from_fmt(sql_fmt_alter_table_rename_column_to, table, column_old, column_new);
+  if (!sql) {
+    mdbfs_error("sqlite: rename_column: no sql no life!");
+    goto quit;
+  }
+
+  r = sqlite3_prepare_v2(g_db, sql, -1, &stmt, NULL);
+  if (r != SQLITE_OK) {
+    mdbfs_error("sqlite: rename_column: sqlite3 cannot prepare a sql statement for us: %s", sqlite3_errmsg(g_db));
+    goto quit;
+  }
+
+  r = sqlite3_step(stmt);
+
+  /* No result is given */
+  if (r != SQLITE_DONE) {
+    mdbfs_warning("sqlite: rename_column: sqlite3 reported an error: %s", sqlite3_errmsg(g_db));
+    goto quit;
+  }
+
+  mdbfs_debug("sqlite: rename_column: done altering column name in table \"%s\" from \"%s\" to \"%s\"", table_name, column_old, column_new);
+
+quit:
+  write_end();
+  row_cache_clear();
+  mdbfs_free(sql);
+  mdbfs_free(table);
+  r = sqlite3_finalize(stmt);
+  if (r != SQLITE_OK) {
+    mdbfs_warning("sqlite: rename_column: sqlite3 cannot finalize a sql statement for us: %s", sqlite3_errmsg(g_db));
+    mdbfs_warning("sqlite: rename_column: *leaking memory*");
+  }
+  return 1;
+}
+
+int mdbfs_backend_sqlite_rename_row(const char *table_name, const char *row_old, const char *row_new)
+{
+  sqlite3_stmt *stmt = NULL;
+  char *sql = NULL;
+  char *table = NULL;
+  int64_t rowid_old = 0;
+  int64_t rowid_new = 0;
+  int ret = 0;
+  int r = 0;
+
+  if (!table_name || !row_old || !row_new) {
+    mdbfs_warning("sqlite: rename_row: either table name, old row name, or new row name is missing, this is unexpected. returning");
+    return 0;
+  }
+
+  if (!rowid_from_name(row_old, &rowid_old) || !rowid_from_name(row_new, &rowid_new)) {
+    mdbfs_warning("sqlite: rename_row: either \"%s\" or \"%s\" is not a ROWID", row_old, row_new);
+    return 0;
+  }
+
+  mdbfs_debug("sqlite: rename_row: altering row name in table \"%s\" from \"%s\" to \"%s\"", table_name, row_old, row_new);
+
+  write_begin();
+
+  table = sql_table(table_name);
+  sql = sql_from_fmt(sql_fmt_update_rowid, table);
+  if (!sql) {
+    mdbfs_error("sqlite: rename_row: no sql no life!");
+    goto quit;
+  }
+
+  r = sqlite3_prepare_v2(g_db, sql, -1, &stmt, NULL);
+  if (r != SQLITE_OK) {
+    mdbfs_error("sqlite: rename_row: sqlite3 cannot prepare a sql statement for us: %s", sqlite3_errmsg(g_db));
+    goto quit;
+  }
+
+  sqlite3_bind_int64(stmt, 1, rowid_old);
+  sqlite3_bind_int64(stmt, 2, rowid_new);
+  r = sqlite3_step(stmt);
+
+  /* No result is given */
+  if (r != SQLITE_DONE) {
+    mdbfs_warning("sqlite: rename_row: sqlite3 reported an error: %s", sqlite3_errmsg(g_db));
+    goto quit;
+  }
+
+  if (sqlite3_changes(g_db) != 1) {
+    mdbfs_warning("sqlite: rename_row: there is no row \"%s\" in table \"%s\"", row_old, table_name);
+    goto quit;
+  }
+
+  mdbfs_debug("sqlite: rename_row: altered row name in table \"%s\" from \"%s\" to \"%s\"", table_name, row_old, row_new);
+  ret = 1;
+
+quit:
+  write_end();
+  row_cache_clear();
+  mdbfs_free(sql);
+  mdbfs_free(table);
+  r = sqlite3_finalize(stmt);
+  if (r != SQLITE_OK) {
+    mdbfs_warning("sqlite: rename_row: sqlite3 cannot finalize a sql statement for us: %s", sqlite3_errmsg(g_db));
+    mdbfs_warning("sqlite: rename_row: *leaking memory*");
+  }
+  return ret;
+}
+
+int mdbfs_backend_sqlite_move_row(const char *table_old, const char *row_old, const char *table_new, const char *row_new)
+{
+  sqlite3_stmt *stmt = NULL;
+  char *sql = NULL;
+  char *from = NULL;
+  char *to = NULL;
+  char *cols = NULL;
+  int64_t rowid_old = 0;
+  int64_t rowid_new = 0;
+  int in_savepoint = 0;
+  int ret = 0;
+  int r = 0;
+
+  if (!table_old || !row_old || !table_new || !row_new) {
+    mdbfs_warning("sqlite: move_row: either table names or row names are missing, this is unexpected. returning");
+    return 0;
+  }
+
+  if (!rowid_from_name(row_old, &rowid_old) || !rowid_from_name(row_new, &rowid_new)) {
+    mdbfs_warning("sqlite: move_row: either \"%s\" or \"%s\" is not a ROWID", row_old, row_new);
+    return 0;
+  }
+
+  mdbfs_debug("sqlite: move_row: moving row \"%s\" in table \"%s\" to \"%s\" in table \"%s\"", row_old, table_old, row_new, table_new);
+
+  cols = move_columns(table_old, table_new);
+  if (!cols)
+    return 0;
+
+  /* Keep the flusher from committing the batch halfway, and join the batch
+   * if it is open
+   */
+  pthread_mutex_lock(&g_batch_lock);
+  write_wait_locked();
+
+  if (!exec_simple(sql_str_savepoint_move, "move_row"))
+    goto quit;
+  in_savepoint = 1;
+
+  from = sql_table(table_old);
+  to = sql_table(table_new);
+  sql = sql_from_fmt(sql_fmt_insert_into_select_rowid, to, cols, cols, from);
+  if (!sql || sqlite3_prepare_v2(g_db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+    mdbfs_warning("sqlite: move_row: cannot prepare copying the row: %s", sqlite3_errmsg(g_db));
+    goto quit;
+  }
+  mdbfs_free(sql);
+  sql = NULL;
+
+  sqlite3_bind_int64(stmt, 1, rowid_old);
+  sqlite3_bind_int64(stmt, 2, rowid_new);
+  r = sqlite3_step(stmt);
+  sqlite3_finalize(stmt);
+  stmt = NULL;
+
+  if (r != SQLITE_DONE || sqlite3_changes(g_db) != 1) {
+    mdbfs_warning("sqlite: move_row: cannot copy the row: %s", r != SQLITE_DONE ? sqlite3_errmsg(g_db) : "no such row");
+    goto quit;
+  }
+
+  sql = sql_from_fmt(sql_fmt_delete_rowid, from);
+  if (!sql || sqlite3_prepare_v2(g_db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+    mdbfs_warning("sqlite: move_row: cannot prepare removing the row: %s", sqlite3_errmsg(g_db));
+    goto quit;
+  }
+
+  sqlite3_bind_int64(stmt, 1, rowid_old);
+  r = sqlite3_step(stmt);
+
+  if (r != SQLITE_DONE) {
+    mdbfs_warning("sqlite: move_row: cannot remove the row: %s", sqlite3_errmsg(g_db));
+    goto quit;
+  }
+
+  if (!exec_simple(sql_str_release_move, "move_row"))
+    goto quit;
+  in_savepoint = 0;
+
+  mdbfs_debug("sqlite: move_row: moved row \"%s\" in table \"%s\" to \"%s\" in table \"%s\"", row_old, table_old, row_new, table_new);
+  ret = 1;
+
+quit:
+  sqlite3_finalize(stmt);
+  if (in_savepoint) {
+    sqlite3_exec(g_db, sql_str_rollback_move, NULL, NULL, NULL);
+    row_cache_clear();
+  }
+  pthread_mutex_unlock(&g_batch_lock);
+  mdbfs_free(sql);
+  mdbfs_free(from);
+  mdbfs_free(to);
+  mdbfs_free(cols);
+  return ret;
+}
+
+int mdbfs_backend_sqlite_create_table(const char *table_new)
+{
+  char *sql = NULL;
+  char *table = NULL;
+  int ret = 0;
+
+  if (!table_new) {
+    mdbfs_warning("sqlite: create_table: new table name is missing, this is unexpected. returning");
+    return 0;
+  }
+
+  if (query_exists(table_new)) {
+    mdbfs_warning("sqlite: create_table: \"%s\" would be shadowed by the query of the same name", table_new);
+    return 0;
+  }
+
+  mdbfs_debug("sqlite: create_table: creating table \"%s\"", table_new);
+
+  table = sql_table(table_new);
+  sql = sql_from_fmt(sql_fmt_create_table, table, g_table_template ? g_table_template : MDBFS_SQLITE_DEFAULT_TABLE_TEMPLATE);
+  mdbfs_free(table);
+  if (!sql) {
+    mdbfs_error("sqlite: create_table: no sql no life!");
+    return 0;
+  }
+
+  write_begin();
+  ret = exec_simple(sql, "create_table");
+  write_end();
+
+  mdbfs_free(sql);
+  return ret;
+}
+
+void mdbfs_backend_sqlite_set_table_template(const char *columns)
+{
+  mdbfs_free(g_table_template);
+
+  if (columns) {
+    g_table_template = mdbfs_malloc0(strlen(columns) + 1);
+    strcpy(g_table_template, columns);
+  }
+}
+
+void mdbfs_backend_sqlite_set_bloom_memory(int64_t size)
+{
+  g_bloom_memory = size > 0 ? size : 0;
+}
+
+void mdbfs_backend_sqlite_set_prewarm(const char *tables, int64_t bytes, int64_t threads)
+{
+  for (size_t i = 0; g_prewarm_tables && g_prewarm_tables[i]; i++)
+    mdbfs_free(g_prewarm_tables[i]);
+  mdbfs_free(g_prewarm_tables);
+
+  g_prewarm_bytes = bytes > 0 ? bytes : 0;
+  g_prewarm_nthreads = threads > 0 ? threads : MDBFS_SQLITE_DEFAULT_PREWARM_THREADS;
+
+  if (!tables)
+    return;
+
+  /* Names are separated by commas */
+  size_t ntables = 0;
+  for (const char *p = tables; ; ) {
+    const char *end = strchr(p, ',');
+    size_t length = end ? (size_t)(end - p) : strlen(p);
+
+    if (length) {
+      g_prewarm_tables = mdbfs_realloc(g_prewarm_tables, (ntables + 2) * sizeof(char *));
+      g_prewarm_tables[ntables] = mdbfs_malloc0(length + 1);
+      memcpy(g_prewarm_tables[ntables], p, length);
+      g_prewarm_tables[++ntables] = NULL;
+    }
+
+    if (!end)
+      break;
+    p = end + 1;
+  }
+}
+
+void mdbfs_backend_sqlite_set_metadata_cache(const char *path)
+{
+  mdbfs_free(g_meta_path);
+
+  if (path && *path) {
+    g_meta_path = mdbfs_malloc0(strlen(path) + 1);
+    strcpy(g_meta_path, path);
+  }
+}
+
+void mdbfs_backend_sqlite_prewarm(void)
+{
+  pthread_mutex_lock(&g_prewarm_lock);
+  g_prewarm_asked = 1;
+  prewarm_start_locked();
+  pthread_mutex_unlock(&g_prewarm_lock);
+}
+
+int mdbfs_backend_sqlite_create_column(const char *table_name, const char *column_new)
+{
+  sqlite3_stmt *stmt = NULL;
+  char *sql = NULL;
+  char *table = NULL;
+  int r = 0;
+
+  if (!table_name || !column_new) {
+    mdbfs_warning("sqlite: create_column: either table name or new column name is missing, this is unexpected. returning");
+    return 0;
+  }
+
+  mdbfs_debug("sqlite: create_column: creating column \"%s\" in table \"%s\"", column_new, table_name);
+
+  write_begin();
+
+  table = sql_table(table_name);
+  sql = sql_from_fmt(sql_fmt_alter_table_add_column, table, column_new);
+  if (!sql) {
+    mdbfs_error("sqlite: create_column: no sql no life!");
+    goto quit;
+  }
+
+  r = sqlite3_prepare_v2(g_db, sql, -1, &stmt, NULL);
+  if (r != SQLITE_OK) {
+    mdbfs_error("sqlite: create_column: sqlite3 cannot prepare a sql statement for us: %s", sqlite3_errmsg(g_db));
+    goto quit;
+  }
+
+  r = sqlite3_step(stmt);
+
+  /* No result is given */
+  if (r != SQLITE_DONE) {
+    mdbfs_warning("sqlite: create_column: sqlite3 reported an error: %s", sqlite3_errmsg(g_db));
+    goto quit;
+  }
+
+  mdbfs_debug("sqlite: create_column: done creating column \"%s\" in table \"%s\"", column_new, table_name);
+
+quit:
+  write_end();
+  row_cache_clear();
+  mdbfs_free(sql);
+  mdbfs_free(table);
+  r = sqlite3_finalize(stmt);
+  if (r != SQLITE_OK) {
+    mdbfs_warning("sqlite: create_column: sqlite3 cannot finalize a sql statement for us: %s", sqlite3_errmsg(g_db));
+    mdbfs_warning("sqlite: create_column: *leaking memory*");
+  }
+  return 1;
+}
+
+int mdbfs_backend_sqlite_create_row(const char *table_name, const char *row_new)
+{
+  char *sql = NULL;
+  char *table = NULL;
+  char *row_end = NULL;
+  int ret = 0;
+  int r = 0;
+
+  if (!table_name || !row_new) {
+    mdbfs_warning("sqlite: create_row: either table name or new row name is missing, this is unexpected. returning");
+    return 0;
+  }
+
+  /* Rows are named by ROWIDs */
+  errno = 0;
+  long long rowid = strtoll(row_new, &row_end, 10);
+  if (!*row_new || *row_end || errno == ERANGE) {
+    mdbfs_warning("sqlite: create_row: \"%s\" is not a ROWID", row_new);
+    return 0;
+  }
+
+  mdbfs_debug("sqlite: create_row: inserting row %lld into table \"%s\"", rowid, table_name);
+
+  pthread_mutex_lock(&g_batch_lock);
+  write_wait_locked();
+
+  /* Reuse the INSERT as long as rows go into the same table */
+  if (!g_batch_table || strcmp(g_batch_table, table_name) != 0) {
+    sqlite3_finalize(g_batch_stmt);
+    g_batch_stmt = NULL;
+    mdbfs_free(g_batch_table);
+
+    table = sql_table(table_name);
+    sql = sql_from_fmt(sql_fmt_insert_rowid_into, table);
+    if (!sql) {
+      mdbfs_error("sqlite: create_row: no sql no life!");
+      goto quit;
+    }
+
+    r = sqlite3_prepare_v2(g_db, sql, -1, &g_batch_stmt, NULL);
+    if (r != SQLITE_OK) {
+      mdbfs_warning("sqlite: create_row: sqlite3 cannot prepare a sql statement for us: %s", sqlite3_errmsg(g_db));
+      sqlite3_finalize(g_batch_stmt);
+      g_batch_stmt = NULL;
+      goto quit;
+    }
+
+    g_batch_table = mdbfs_malloc0(strlen(table_name) + 1);
+    strcpy(g_batch_table, table_name);
+  }
+
+  /* Open a batch, unless rows are committed one by one, or it is open */
+  if (g_transaction == TRANSACTION_NONE && g_flusher_running) {
+    if (!exec_simple(sql_str_begin, "create_row"))
+      goto quit;
+
+    g_transaction = TRANSACTION_BATCH;
+    clock_gettime(CLOCK_MONOTONIC, &g_batch_opened);
+    g_batch_touched = g_batch_opened;
+    pthread_cond_signal(&g_batch_cond);
+  }
+
+  sqlite3_bind_int64(g_batch_stmt, 1, rowid);
+  r = sqlite3_step(g_batch_stmt);
+  sqlite3_reset(g_batch_stmt);
+
+  if (r != SQLITE_DONE) {
+    mdbfs_warning("sqlite: create_row: sqlite3 reported an error: %s", sqlite3_errmsg(g_db));
+
+    /* Some errors roll the whole batch back */
+    if (g_transaction == TRANSACTION_BATCH && sqlite3_get_autocommit(g_db)) {
+      mdbfs_error("sqlite: batch: %lld created rows are lost, as sqlite3 has rolled them back", (long long)g_batch_rows);
+      row_cache_clear();
+      g_transaction = TRANSACTION_NONE;
+      g_batch_rows = 0;
+    }
+    goto quit;
+  }
+
+  if (g_transaction == TRANSACTION_BATCH) {
+    clock_gettime(CLOCK_MONOTONIC, &g_batch_touched);
+    g_batch_rows += 1;
+
+    /* The row is in, even if the batch is to be committed later */
+    if (g_batch_rows >= MDBFS_SQLITE_BATCH_MAX_ROWS)
+      batch_commit_locked();
+  }
+
+  mdbfs_debug("sqlite: create_row: inserted row %lld into table \"%s\"", rowid, table_name);
+  ret = 1;
+
+quit:
+  pthread_mutex_unlock(&g_batch_lock);
+  mdbfs_free(sql);
+  mdbfs_free(table);
+  return ret;
+}
+
+int mdbfs_backend_sqlite_remove_table(const char *table_name)
+{
+  sqlite3_stmt *stmt = NULL;
+  char *sql = NULL;
+  char *table = NULL;
+  int r = 0;
+
+  if (!table_name) {
+    mdbfs_warning("sqlite: remove_table: table name is missing, this is unexpected. returning");
+    return 0;
+  }
+
+  mdbfs_debug("sqlite: remove_table: dropping table \"%s\"", table_name);
+
+  write_begin();
+
+  table = sql_table(table_name);
+  sql = sql_from_fmt(sql_fmt_drop_table, table);
+  if (!sql) {
+    mdbfs_error("sqlite: remove_table: no sql no life!");
+    goto quit;
+  }
+
+  r = sqlite3_prepare_v2(g_db, sql, -1, &stmt, NULL);
+  if (r != SQLITE_OK) {
+    mdbfs_error("sqlite: remove_table: sqlite3 cannot prepare a sql statement for us: %s", sqlite3_errmsg(g_db));
+    goto quit;
+  }
+
+  r = sqlite3_step(stmt);
+
+  /* No result is given */
+  if (r != SQLITE_DONE) {
+    mdbfs_warning("sqlite: remove_table: sqlite3 reported an error: %s", sqlite3_errmsg(g_db));
+    goto quit;
+  }
+
+  mdbfs_debug("sqlite: remove_table: dropped table \"%s\"", table_name);
+
+quit:
+  write_end();
+  row_cache_clear();
+  mdbfs_free(sql);
+  mdbfs_free(table);
+  r = sqlite3_finalize(stmt);
+  if (r != SQLITE_OK) {
+    mdbfs_warning("sqlite: remove_table: sqlite3 cannot finalize a sql statement for us: %s", sqlite3_errmsg(g_db));
+    mdbfs_warning("sqlite: remove_table: *leaking memory*");
+  }
+  return 1;
+}
+
+int mdbfs_backend_sqlite_remove_column(const char *table_name, const char *column_name)
+{
+  char *sql = NULL;
+  int r = 0;
+
+  if (!table_name || !column_name) {
+    mdbfs_warning("sqlite: remove_column: either table name or column name is missing, this is unexpected. returning");
+    return 0;
+  }
+
+  mdbfs_debug("sqlite: remove_column: dropping column \"%s\" in table \"%s\"", column_name, table_name);
+
+  /* ALTER TABLE DROP COLUMN is there since SQLite 3.35.0. It refuses to drop
+   * keys and indexed columns, which the rebuild can do.
+   */
+  if (sqlite3_libversion_number() >= 3035000) {
+    char *table = sql_table(table_name);
+    sql = sql_from_fmt(sql_fmt_alter_table_drop_column, table, column_name);
+    mdbfs_free(table);
+    if (!sql) {
+      mdbfs_error("sqlite: remove_column: no sql no life!");
+      return 0;
+    }
+
+    write_begin();
+    r = exec_simple(sql, "remove_column");
+    write_end();
+    mdbfs_free(sql);
+
+    if (r) {
+      mdbfs_metric_add(mdbfs_metric_get("sqlite_columns_dropped"), 1);
+      row_cache_clear();
+      return 1;
+    }
+
+    mdbfs_info("sqlite: remove_column: rebuilding \"%s\" without \"%s\" instead", table_name, column_name);
+  }
+
+  r = rebuild_table_without(table_name, column_name);
+  if (r)
+    mdbfs_metric_add(mdbfs_metric_get("sqlite_columns_dropped"), 1);
+
+  row_cache_clear();
+
+  return r;
+}
+
+int mdbfs_backend_sqlite_remove_row(const char *table_name, const char *row_name)
+{
+  sqlite3_stmt *stmt = NULL;
+  char *sql = NULL;
+  char *table = NULL;
+  int r = 0;
+
+  if (!table_name || !row_name) {
+    mdbfs_warning("sqlite: remove_row: either table name or row name is missing, this is unexpected. returning");
+    return 0;
+  }
+
+  mdbfs_debug("sqlite: remove_row: deleting row \"%s\" in table \"%s\"", row_name, table_name);
+
+  write_begin();
+
+  table = sql_table(table_name);
+  sql = sql_from_fmt(sql_fmt_delete_from_where, table, "ROWID", row_name);
+  if (!sql) {
+    mdbfs_error("sqlite: remove_row: no sql no life!");
+    goto quit;
+  }
+
+  r = sqlite3_prepare_v2(g_db, sql, -1, &stmt, NULL);
+  if (r != SQLITE_OK) {
+    mdbfs_error("sqlite: remove_row: sqlite3 cannot prepare a sql statement for us: %s", sqlite3_errmsg(g_db));
+    goto quit;
   }
 
-  return 1;
-}
+  r = sqlite3_step(stmt);
 
-void mdbfs_backend_sqlite_close_database(void)
-{
-  if (!g_db) {
-    mdbfs_warning("sqlite: close: attempting to close a closed connection!");
-    return;
+  /* No result is given */
+  if (r != SQLITE_DONE) {
+    mdbfs_warning("sqlite: remove_row: sqlite3 reported an error: %s", sqlite3_errmsg(g_db));
+    goto quit;
   }
 
-  mdbfs_info("closing sqlite3 database");
-  sqlite3_close(g_db);
-  g_db = NULL;
-}
+  mdbfs_debug("sqlite: remove_row: deleted row \"%s\" in table \"%s\"", row_name, table_name);
 
-char *mdbfs_backend_sqlite_get_database_name(void)
-{
-  char *ret = mdbfs_malloc0(strlen("main") + 1);
-  strcpy(ret, "main");
-  return ret;
+quit:
+  write_end();
+  mdbfs_free(sql);
+  mdbfs_free(table);
+  r = sqlite3_finalize(stmt);
+  if (r != SQLITE_OK) {
+    mdbfs_warning("sqlite: remove_row: sqlite3 cannot finalize a sql statement for us: %s", sqlite3_errmsg(g_db));
+    mdbfs_warning("sqlite: remove_row: *leaking memory*");
+  }
+  return 1;
 }
 
-char **mdbfs_backend_sqlite_get_table_names(void)
+char **mdbfs_backend_sqlite_get_indexed_column_names(const char *table_name)
 {
   sqlite3_stmt *stmt = NULL;
+  char *schema = NULL;
   char **ret = NULL;
   size_t ret_length = 0;
   int r = 0;
 
-  mdbfs_debug("sqlite: listing table names");
+  if (!table_name) {
+    mdbfs_warning("sqlite: get_indexed_column_names: table name is missing, this is unexpected. returning");
+    return NULL;
+  }
 
-  r = sqlite3_prepare_v2(g_db, sql_str_get_tables, -1, &stmt, NULL);
+  mdbfs_debug("sqlite: listing indexed columns in table \"%s\"", table_name);
+
+  r = sqlite3_prepare_v2(g_db, sql_str_get_index_list, -1, &stmt, NULL);
   if (r != SQLITE_OK) {
-    mdbfs_error("sqlite: get_table_names: sqlite3 cannot prepare a sql statement for us: %s", sqlite3_errmsg(g_db));
+    mdbfs_error("sqlite: get_indexed_column_names: sqlite3 cannot prepare a sql statement for us: %s", sqlite3_errmsg(g_db));
     goto quit;
   }
 
+  schema = table_schema(table_name);
+  sqlite3_bind_text(stmt, 1, table_base(table_name), -1, SQLITE_STATIC);
+  sqlite3_bind_text(stmt, 2, schema, -1, SQLITE_STATIC);
+
+  /* Start with an empty list, so that a table without any index is not an
+   * error.
+   */
+  ret = mdbfs_malloc0(sizeof(char *));
+
+  /* index_list yields (seq, name, unique, origin, partial) */
   for (;;) {
     r = sqlite3_step(stmt);
     if (r != SQLITE_ROW)
       break;
 
-    const char *table_name = sqlite3_column_text(stmt, 0);
-    if (!table_name) {
-      mdbfs_warning("sqlite: get_table_names: unexpected null");
+    const char *index_name = (const char *)sqlite3_column_text(stmt, 1);
+    int partial = sqlite3_column_int(stmt, 4);
+
+    /* A partial index does not cover every row, so lookups through it would
+     * miss some; leave them out.
+     */
+    if (!index_name || partial)
+      continue;
+
+    /* Only the leading column of an index can be probed by equality alone */
+    sqlite3_stmt *stmt_info = NULL;
+
+    r = sqlite3_prepare_v2(g_db, sql_str_get_index_info, -1, &stmt_info, NULL);
+    if (r != SQLITE_OK) {
+      mdbfs_warning("sqlite: get_indexed_column_names: cannot inspect index \"%s\": %s", index_name, sqlite3_errmsg(g_db));
+      sqlite3_finalize(stmt_info);
       continue;
     }
 
-    mdbfs_debug("sqlite: get_table_names: .. %s", table_name);
+    sqlite3_bind_text(stmt_info, 1, index_name, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt_info, 2, schema, -1, SQLITE_STATIC);
 
-    /* Stretch vector */
-    ret_length += 1;
-    ret = mdbfs_realloc(ret, ret_length * sizeof(char *));
+    /* index_info yields (seqno, cid, name), ordered by seqno; the name is NULL
+     * for expressions and the rowid.
+     */
+    if (sqlite3_step(stmt_info) == SQLITE_ROW) {
+      const char *column_name = (const char *)sqlite3_column_text(stmt_info, 2);
 
-    /* Fill string element */
-    size_t name_length = strlen(table_name) + 1;
-    ret[ret_length - 1] = mdbfs_malloc0(name_length);
-    strncpy(ret[ret_length - 1], table_name, name_length);
+      int duplicated = 0;
+      for (int i = 0; column_name && i < ret_length; i++)
+        if (strcmp(ret[i], column_name) == 0)
+          duplicated = 1;
+
+      if (column_name && !duplicated) {
+        mdbfs_debug("sqlite: get_indexed_column_names: .. %s (%s)", column_name, index_name);
+
+        /* Stretch vector, keeping the NULL at the end */
+        ret_length += 1;
+        ret = mdbfs_realloc(ret, (ret_length + 1) * sizeof(char *));
+
+        size_t name_length = strlen(column_name) + 1;
+        ret[ret_length - 1] = mdbfs_malloc0(name_length);
+        memcpy(ret[ret_length - 1], column_name, name_length);
+        ret[ret_length] = NULL;
+      }
+    }
+
+    sqlite3_finalize(stmt_info);
   }
 
   if (r != SQLITE_DONE) {
-    mdbfs_warning("sqlite: get_table_names: sqlite3 reported an error: %s", sqlite3_errmsg(g_db));
+    mdbfs_warning("sqlite: get_indexed_column_names: sqlite3 reported an error: %s", sqlite3_errmsg(g_db));
     for (int i = 0; i < ret_length; i++) {
       mdbfs_free(ret[i]);
     }
@@ -186,660 +6875,850 @@ char **mdbfs_backend_sqlite_get_table_names(void)
     goto quit;
   }
 
-  /* Additionally add a NULL at the end of list for iteration */
-  ret_length += 1;
-  ret = mdbfs_realloc(ret, ret_length * sizeof(char *));
-  ret[ret_length - 1] = NULL;
-
-  mdbfs_debug("sqlite: get_table_names: done listing table names");
+  mdbfs_debug("sqlite: done listing indexed columns in table \"%s\"", table_name);
 
 quit:
   r = sqlite3_finalize(stmt);
+  mdbfs_free(schema);
   if (r != SQLITE_OK) {
-    mdbfs_warning("sqlite: get_table_names: sqlite3 cannot finalize a sql statement for us: %s", sqlite3_errmsg(g_db));
-    mdbfs_warning("sqlite: get_table_names: *leaking memory*");
+    mdbfs_warning("sqlite: get_indexed_column_names: sqlite3 cannot finalize a sql statement for us: %s", sqlite3_errmsg(g_db));
+    mdbfs_warning("sqlite: get_indexed_column_names: *leaking memory*");
   }
   return ret;
 }
 
-char **mdbfs_backend_sqlite_get_column_names(const char *table_name, const char *row_name)
+char **mdbfs_backend_sqlite_get_indexed_values(const char *table_name, const char *col_name)
 {
   sqlite3_stmt *stmt = NULL;
   char *sql = NULL;
+  char *table = NULL;
   char **ret = NULL;
-  size_t ret_length = 0;
   int r = 0;
 
-  if (!table_name) {
-    mdbfs_warning("sqlite: get_column_names: table name is missing, this is unexpected. returning");
+  if (!table_name || !col_name) {
+    mdbfs_warning("sqlite: get_indexed_values: either table name or column name is missing, this is unexpected. returning");
     return NULL;
   }
 
-  mdbfs_debug("sqlite: listing column names in table \"%s\"", table_name);
+  mdbfs_debug("sqlite: listing distinct values of \"%s\" in table \"%s\"", col_name, table_name);
 
-  sql = sql_from_fmt(sql_fmt_select_all_from_where, table_name, "ROWID", row_name);
+  /* DISTINCT on an indexed column is answered by walking the index */
+  table = sql_table(table_name);
+  sql = sql_from_fmt(sql_fmt_select_distinct_from, col_name, table, col_name);
   if (!sql) {
-    mdbfs_error("sqlite: get_column_names: no sql no life!");
+    mdbfs_error("sqlite: get_indexed_values: no sql no life!");
     goto quit;
   }
 
   r = sqlite3_prepare_v2(g_db, sql, -1, &stmt, NULL);
   if (r != SQLITE_OK) {
-    mdbfs_error("sqlite: get_column_names: sqlite3 cannot prepare a sql statement for us: %s", sqlite3_errmsg(g_db));
-    goto quit;
-  }
-
-  r = sqlite3_step(stmt);
-
-  if (r == SQLITE_DONE) {
-    mdbfs_debug("sqlite: get_column_names: nothing to show, the row may not exist");
+    mdbfs_error("sqlite: get_indexed_values: sqlite3 cannot prepare a sql statement for us: %s", sqlite3_errmsg(g_db));
     goto quit;
   }
 
-  if (r != SQLITE_ROW) {
-    mdbfs_warning("sqlite: get_column_names: sqlite3 reported an error: %s", sqlite3_errmsg(g_db));
-    goto quit;
-  }
-
-  int ncol = sqlite3_column_count(stmt);
-  for (int icol = 0; icol < ncol; icol++) {
-    const char *column_name = sqlite3_column_origin_name(stmt, icol);
-    if (!column_name) {
-      mdbfs_warning("sqlite: get_column_names: unexpected null");
-      continue;
-    }
-
-    /* Stretch vector */
-    ret_length += 1;
-    ret = mdbfs_realloc(ret, ret_length * sizeof(char *));
-
-    /* Fill string element */
-    size_t name_length = strlen(column_name) + 1;
-    ret[ret_length - 1] = mdbfs_malloc0(name_length);
-    strncpy(ret[ret_length - 1], column_name, name_length);
-  }
-
-  /* Additionally add a NULL at the end of list for iteration */
-  ret_length += 1;
-  ret = mdbfs_realloc(ret, ret_length * sizeof(char *));
-  ret[ret_length - 1] = NULL;
+  ret = strings_from_stmt(stmt, "get_indexed_values");
 
-  mdbfs_debug("sqlite: done listing column names in table \"%s\"", table_name);
+  mdbfs_debug("sqlite: done listing distinct values of \"%s\" in table \"%s\"", col_name, table_name);
 
 quit:
   mdbfs_free(sql);
+  mdbfs_free(table);
   r = sqlite3_finalize(stmt);
   if (r != SQLITE_OK) {
-    mdbfs_warning("sqlite: get_column_names: sqlite3 cannot finalize a sql statement for us: %s", sqlite3_errmsg(g_db));
-    mdbfs_warning("sqlite: get_column_names: *leaking memory*");
+    mdbfs_warning("sqlite: get_indexed_values: sqlite3 cannot finalize a sql statement for us: %s", sqlite3_errmsg(g_db));
+    mdbfs_warning("sqlite: get_indexed_values: *leaking memory*");
   }
   return ret;
 }
 
-char **mdbfs_backend_sqlite_get_row_names(const char *table_name)
+char **mdbfs_backend_sqlite_get_row_names_by_value(const char *table_name, const char *col_name, const char *value)
 {
   sqlite3_stmt *stmt = NULL;
   char *sql = NULL;
+  char *table = NULL;
   char **ret = NULL;
-  size_t ret_length = 0;
   int r = 0;
 
-  if (!table_name) {
-    mdbfs_warning("sqlite: get_row_names: table name is missing, this is unexpected. returning");
+  if (!table_name || !col_name || !value) {
+    mdbfs_warning("sqlite: get_row_names_by_value: either table name, column name, or value is missing, this is unexpected. returning");
     return NULL;
   }
 
-  mdbfs_debug("sqlite: listing rows in table \"%s\"", table_name);
+  mdbfs_debug("sqlite: get_row_names_by_value: looking up \"%s\" = \"%s\" in table \"%s\"", col_name, value, table_name);
 
-  sql = sql_from_fmt(sql_fmt_select_from, "ROWID", table_name);
+  table = sql_table(table_name);
+  sql = sql_from_fmt(sql_fmt_select_rowid_from_where_bind, table, col_name);
   if (!sql) {
-    mdbfs_error("sqlite: get_row_names: no sql no life!");
+    mdbfs_error("sqlite: get_row_names_by_value: no sql no life!");
     goto quit;
   }
 
   r = sqlite3_prepare_v2(g_db, sql, -1, &stmt, NULL);
   if (r != SQLITE_OK) {
-    mdbfs_error("sqlite: get_row_names: sqlite3 cannot prepare a sql statement for us: %s", sqlite3_errmsg(g_db));
+    mdbfs_error("sqlite: get_row_names_by_value: sqlite3 cannot prepare a sql statement for us: %s", sqlite3_errmsg(g_db));
     goto quit;
   }
 
-  /* Iterate over the result to get a list of rows */
-  for (;;) {
-    r = sqlite3_step(stmt);
-    if (r != SQLITE_ROW)
-      break;
-
-    const char *row_name = sqlite3_column_text(stmt, 0);
-    if (!row_name) {
-      mdbfs_warning("sqlite: get_row_names: unexpected null");
-      continue;
-    }
-
-    mdbfs_debug("sqlite: get_row_names: .. %s", row_name);
-
-    /* Stretch vector */
-    ret_length += 1;
-    ret = mdbfs_realloc(ret, ret_length * sizeof(char *));
-
-    /* Fill string element */
-    size_t name_length = strlen(row_name) + 1;
-    ret[ret_length - 1] = mdbfs_malloc0(name_length);
-    strncpy(ret[ret_length - 1], row_name, name_length);
-  }
-
-  if (r != SQLITE_DONE) {
-    mdbfs_warning("sqlite: get_row_names: sqlite3 reported an error: %s", sqlite3_errmsg(g_db));
-    for (int i = 0; i < ret_length; i++) {
-      mdbfs_free(ret[i]);
-    }
-    mdbfs_free(ret);
+  /* The value is bound rather than printed, so that the column affinity is
+   * applied to it and the comparison can be answered by one index probe.
+   */
+  r = sqlite3_bind_text(stmt, 1, value, -1, SQLITE_STATIC);
+  if (r != SQLITE_OK) {
+    mdbfs_error("sqlite: get_row_names_by_value: cannot bind value: %s", sqlite3_errmsg(g_db));
     goto quit;
   }
 
-  /* Additionally add a NULL at the end of list for iteration */
-  ret_length += 1;
-  ret = mdbfs_realloc(ret, ret_length * sizeof(char *));
-  ret[ret_length - 1] = NULL;
+  ret = strings_from_stmt(stmt, "get_row_names_by_value");
 
-  mdbfs_debug("sqlite: done listing rows in table \"%s\"", table_name);
+  mdbfs_debug("sqlite: get_row_names_by_value: done looking up \"%s\" = \"%s\" in table \"%s\"", col_name, value, table_name);
 
 quit:
   mdbfs_free(sql);
+  mdbfs_free(table);
   r = sqlite3_finalize(stmt);
   if (r != SQLITE_OK) {
-    mdbfs_warning("sqlite: get_row_names: sqlite3 cannot finalize a sql statement for us: %s", sqlite3_errmsg(g_db));
-    mdbfs_warning("sqlite: get_row_names: *leaking memory*");
+    mdbfs_warning("sqlite: get_row_names_by_value: sqlite3 cannot finalize a sql statement for us: %s", sqlite3_errmsg(g_db));
+    mdbfs_warning("sqlite: get_row_names_by_value: *leaking memory*");
   }
   return ret;
 }
 
-uint8_t *mdbfs_backend_sqlite_get_cell(size_t *cell_length, const char *table_name, const char *row_name, const char *col_name)
+enum mdbfs_backend_sqlite_table_type mdbfs_backend_sqlite_get_table_type(const char *table_name)
 {
   sqlite3_stmt *stmt = NULL;
+  struct schema *schema = NULL;
   char *sql = NULL;
-  uint8_t *ret = NULL;
-  size_t   ret_length = 0;
+  char *master = NULL;
+  enum mdbfs_backend_sqlite_table_type ret = MDBFS_BACKEND_SQLITE_TABLE_TYPE_NONE;
+  int64_t data_version = 0;
   int r = 0;
 
-  if (!table_name || !row_name || !col_name) {
-    mdbfs_warning("sqlite: get_cell: either table name, row name, or column name is missing, this is unexpected. returning");
-    return NULL;
+  if (!table_name) {
+    mdbfs_warning("sqlite: get_table_type: table name is missing, this is unexpected. returning");
+    return ret;
   }
 
-  mdbfs_debug("sqlite: get_cell: querying content in cell (\"%s\", \"%s\", \"%s\")", table_name, row_name, col_name);
+  /* Paths are told apart by this on every lookup (see fuseops.c), so the type
+   * is kept with the schema; a table without one does not exist
+   */
+  pthread_mutex_lock(&g_schemas_lock);
+  schema = schema_lookup_locked(table_name, &data_version);
+  if (!schema || schema->table_typed) {
+    ret = schema ? schema->table_type : MDBFS_BACKEND_SQLITE_TABLE_TYPE_NONE;
+    goto quit;
+  }
 
-  sql = sql_from_fmt(sql_fmt_select_from_where, col_name, table_name, "ROWID", row_name);
+  master = sql_table_in(table_name, "sqlite_master");
+  sql = sql_from_fmt(sql_fmt_get_table_type, master);
   if (!sql) {
-    mdbfs_error("sqlite: get_cell: no sql no life!");
+    mdbfs_error("sqlite: get_table_type: no sql no life!");
     goto quit;
   }
 
   r = sqlite3_prepare_v2(g_db, sql, -1, &stmt, NULL);
   if (r != SQLITE_OK) {
-    mdbfs_error("sqlite: get_cell: sqlite3 cannot prepare a sql statement for us: %s", sqlite3_errmsg(g_db));
+    mdbfs_error("sqlite: get_table_type: sqlite3 cannot prepare a sql statement for us: %s", sqlite3_errmsg(g_db));
     goto quit;
   }
 
-  r = sqlite3_step(stmt);
+  sqlite3_bind_text(stmt, 1, table_base(table_name), -1, SQLITE_STATIC);
 
-  if (r == SQLITE_DONE) {
-    mdbfs_debug("sqlite: get_cell: nothing to show, confused");
+  r = sqlite3_step(stmt);
+  if (r == SQLITE_ROW) {
+    const char *type = (const char *)sqlite3_column_text(stmt, 0);
+    if (type && strcmp(type, "view") == 0)
+      ret = MDBFS_BACKEND_SQLITE_TABLE_TYPE_VIEW;
+    else
+      ret = MDBFS_BACKEND_SQLITE_TABLE_TYPE_TABLE;
+  } else if (r != SQLITE_DONE) {
+    mdbfs_warning("sqlite: get_table_type: sqlite3 reported an error: %s", sqlite3_errmsg(g_db));
     goto quit;
   }
 
-  if (r != SQLITE_ROW) {
-    mdbfs_warning("sqlite: get_cell: sqlite3 reported an error: %s", sqlite3_errmsg(g_db));
-    goto quit;
+  schema->table_type = ret;
+  schema->table_typed = 1;
+
+quit:
+  pthread_mutex_unlock(&g_schemas_lock);
+  sqlite3_finalize(stmt);
+  mdbfs_free(sql);
+  mdbfs_free(master);
+  return ret;
+}
+
+int mdbfs_backend_sqlite_walk_view_row_names(const char *view_name, int64_t offset, mdbfs_backend_sqlite_row_walker walker, void *data)
+{
+  sqlite3_stmt *stmt = NULL;
+  char *sql = NULL;
+  char *view = NULL;
+  char row_name[24] = {0};
+  int ret = 0;
+  int r = 0;
+
+  if (!view_name || !walker) {
+    mdbfs_warning("sqlite: walk_view_row_names: either view name or walker is missing, this is unexpected. returning");
+    return 0;
   }
 
-  const uint8_t *cell = sqlite3_column_text(stmt, 0);
+  mdbfs_debug("sqlite: walking rows in view \"%s\" from %lld", view_name, (long long)offset);
 
-  /* Don't quit, we still allocate a buffer with only a NUL to indicate that
-   * there is no error.
+  /* Nothing is computed for the rows before offset, and the rest is stepped
+   * through one by one, as far as the walker wants to go.
    */
-  if (!cell) {
-    mdbfs_debug("sqlite: get_cell: the cell is empty");
-    goto alloc;
+  view = sql_table(view_name);
+  sql = sql_from_fmt(sql_fmt_select_from_view_from, view, (long long)offset);
+  if (!sql) {
+    mdbfs_error("sqlite: walk_view_row_names: no sql no life!");
+    goto quit;
   }
 
-  /* NOTE: If we get a string that is identical to the column name, then the
-   * column does not exist.
-   */
-  if (strcmp(cell, col_name) == 0) {
-    mdbfs_debug("sqlite: get_cell: the column does not exist");
+  r = sqlite3_prepare_v2(g_db, sql, -1, &stmt, NULL);
+  if (r != SQLITE_OK) {
+    mdbfs_error("sqlite: walk_view_row_names: sqlite3 cannot prepare a sql statement for us: %s", sqlite3_errmsg(g_db));
     goto quit;
   }
 
-alloc:
-  /* NOTE: sqlite3_column_bytes does not include NUL */
-  ret_length = sqlite3_column_bytes(stmt, 0);
-  ret = mdbfs_malloc0(ret_length + 1); /* + 1 NUL */
+  for (int64_t position = offset;; position++) {
+    r = sqlite3_step(stmt);
+    if (r != SQLITE_ROW)
+      break;
 
-  if (cell)
-    memcpy(ret, cell, ret_length);
+    snprintf(row_name, sizeof(row_name), "%lld", (long long)position);
+    if (walker(row_name, position + 1, data) != 0) {
+      r = SQLITE_DONE;
+      break;
+    }
+  }
 
-  if (cell_length)
-    *cell_length = ret_length;
+  if (r != SQLITE_DONE) {
+    mdbfs_warning("sqlite: walk_view_row_names: sqlite3 reported an error: %s", sqlite3_errmsg(g_db));
+    goto quit;
+  }
 
-  mdbfs_debug("sqlite: get_cell: done querying content in cell (\"%s\", \"%s\", \"%s\")", table_name, row_name, col_name);
+  ret = 1;
+
+  mdbfs_debug("sqlite: done walking rows in view \"%s\"", view_name);
 
 quit:
   mdbfs_free(sql);
+  mdbfs_free(view);
   r = sqlite3_finalize(stmt);
   if (r != SQLITE_OK) {
-    mdbfs_warning("sqlite: get_cell: sqlite3 cannot finalize a sql statement for us: %s", sqlite3_errmsg(g_db));
-    mdbfs_warning("sqlite: get_cell: *leaking memory*");
+    mdbfs_warning("sqlite: walk_view_row_names: sqlite3 cannot finalize a sql statement for us: %s", sqlite3_errmsg(g_db));
+    mdbfs_warning("sqlite: walk_view_row_names: *leaking memory*");
   }
   return ret;
 }
 
-size_t mdbfs_backend_sqlite_get_cell_length(const char *table_name, const char *row_name, const char *col_name)
+int mdbfs_backend_sqlite_create_query(const char *name)
+{
+  int ret = 0;
+
+  if (!name) {
+    mdbfs_warning("sqlite: create_query: name is missing, this is unexpected. returning");
+    return 0;
+  }
+
+  /* Temporary views shadow tables of the same name */
+  if (mdbfs_backend_sqlite_get_table_type(name) != MDBFS_BACKEND_SQLITE_TABLE_TYPE_NONE) {
+    mdbfs_warning("sqlite: create_query: \"%s\" would shadow a table or view of the same name", name);
+    return 0;
+  }
+
+  pthread_mutex_lock(&g_queries_lock);
+
+  if (!query_find(name)) {
+    struct query *q = mdbfs_malloc0(sizeof(struct query));
+    size_t name_length = strlen(name) + 1;
+
+    q->name = mdbfs_malloc0(name_length);
+    memcpy(q->name, name, name_length);
+    q->next = g_queries;
+    g_queries = q;
+
+    mdbfs_debug("sqlite: create_query: created query \"%s\"", name);
+    ret = 1;
+  }
+
+  pthread_mutex_unlock(&g_queries_lock);
+  return ret;
+}
+
+int mdbfs_backend_sqlite_set_query(const char *name, const char *sql, size_t sql_length, size_t offset)
+{
+  int ret = 0;
+
+  if (!name || !sql) {
+    mdbfs_warning("sqlite: set_query: either name or sql is missing, this is unexpected. returning");
+    return 0;
+  }
+
+  pthread_mutex_lock(&g_queries_lock);
+
+  struct query *q = query_find(name);
+  if (q) {
+    /* Like cells, writing from the beginning replaces the whole content */
+    size_t new_length = offset == 0 ? sql_length : offset + sql_length;
+    if (new_length < q->sql_length && offset != 0)
+      new_length = q->sql_length;
+
+    q->sql = mdbfs_realloc(q->sql, new_length + 1);
+    if (offset > q->sql_length)
+      memset(q->sql + q->sql_length, ' ', offset - q->sql_length);
+    memcpy(q->sql + offset, sql, sql_length);
+    q->sql_length = new_length;
+
+    ret = 1;
+  }
+
+  pthread_mutex_unlock(&g_queries_lock);
+  return ret;
+}
+
+int mdbfs_backend_sqlite_truncate_query(const char *name, size_t length)
+{
+  int ret = 0;
+
+  if (!name) {
+    mdbfs_warning("sqlite: truncate_query: name is missing, this is unexpected. returning");
+    return 0;
+  }
+
+  pthread_mutex_lock(&g_queries_lock);
+
+  struct query *q = query_find(name);
+  if (q) {
+    q->sql = mdbfs_realloc(q->sql, length + 1);
+    if (length > q->sql_length)
+      memset(q->sql + q->sql_length, ' ', length - q->sql_length);
+    q->sql_length = length;
+
+    ret = 1;
+  }
+
+  pthread_mutex_unlock(&g_queries_lock);
+  return ret;
+}
+
+int mdbfs_backend_sqlite_commit_query(const char *name)
 {
   sqlite3_stmt *stmt = NULL;
-  char *sql = NULL;
-  size_t ret = 0;
+  char *sql_view = NULL;
+  char *sql_drop = NULL;
+  char *errmsg = NULL;
+  int ret = 0;
   int r = 0;
 
-  if (!table_name || !row_name || !col_name) {
-    mdbfs_warning("sqlite: get_cell_length: either table name, row name, or column name is missing, this is unexpected. returning");
+  if (!name) {
+    mdbfs_warning("sqlite: commit_query: name is missing, this is unexpected. returning");
     return 0;
   }
 
-  mdbfs_debug("sqlite: get_cell_length: querying length of cell (\"%s\", \"%s\", \"%s\")", table_name, row_name, col_name);
+  write_begin();
+  pthread_mutex_lock(&g_queries_lock);
 
-  sql = sql_from_fmt(sql_fmt_select_from_where, col_name, table_name, "ROWID", row_name);
-  if (!sql) {
-    mdbfs_error("sqlite: get_cell_length: no sql no life!");
+  struct query *q = query_find(name);
+  if (!q)
     goto quit;
-  }
 
-  r = sqlite3_prepare_v2(g_db, sql, -1, &stmt, NULL);
-  if (r != SQLITE_OK) {
-    mdbfs_error("sqlite: get_cell_length: sqlite3 cannot prepare a sql statement for us: %s", sqlite3_errmsg(g_db));
+  /* An empty query is yet to be written; it has no view */
+  if (!q->sql_length) {
+    ret = 1;
     goto quit;
   }
 
-  r = sqlite3_step(stmt);
+  /* Whatever happens below, the old view is gone, and so is its schema, since
+   * temporary views do not move the schema version of the database
+   */
+  q->defined = 0;
 
-  if (r == SQLITE_DONE) {
-    mdbfs_debug("sqlite: get_cell_length: nothing to show, confused");
+  pthread_mutex_lock(&g_schemas_lock);
+  schemas_clear_locked();
+  pthread_mutex_unlock(&g_schemas_lock);
+  row_cache_clear();
+
+  q->sql[q->sql_length] = '\0';
+
+  /* Only one statement reading the database makes a query; anything after it
+   * would otherwise run along with the definition of the view
+   */
+  r = sql_prepare_one(q->sql, &stmt);
+  if (r != SQLITE_OK || !sqlite3_stmt_readonly(stmt)) {
+    mdbfs_warning("sqlite: commit_query: cannot define query \"%s\": %s", name,
+                  r != SQLITE_OK ? "not a single statement" : "not a read-only statement");
     goto quit;
   }
 
-  if (r != SQLITE_ROW) {
-    mdbfs_warning("sqlite: get_cell_length: sqlite3 reported an error: %s", sqlite3_errmsg(g_db));
+  sqlite3_finalize(stmt);
+  stmt = NULL;
+
+  /* The view is only defined here; the query runs when the result is read */
+  sql_drop = sql_from_fmt(sql_fmt_drop_temp_view, name);
+  sql_view = sql_from_fmt(sql_fmt_create_temp_view, name, q->sql);
+  if (!sql_drop || !sql_view) {
+    mdbfs_error("sqlite: commit_query: no sql no life!");
     goto quit;
   }
 
-  /* It's still inevitable to get the content first (see below) */
-  const uint8_t *cell = sqlite3_column_text(stmt, 0);
-  if (!cell) {
-    mdbfs_warning("sqlite: get_cell_length: unexpected null");
+  r = sqlite3_exec(g_db, sql_drop, NULL, NULL, &errmsg);
+  if (r != SQLITE_OK) {
+    mdbfs_warning("sqlite: commit_query: cannot define query \"%s\": %s", name, errmsg);
     goto quit;
   }
 
-  /* NOTE: Trick: If we get a string that is identical to the column name, the
-   * column does not exist. Jesus.
-   */
-  if (strcmp(cell, col_name) == 0) {
-    mdbfs_debug("sqlite: get_cell_length: the column does not exist");
+  r = sql_prepare_one(sql_view, &stmt);
+  if (r == SQLITE_OK)
+    r = sqlite3_step(stmt);
+  if (r != SQLITE_DONE) {
+    mdbfs_warning("sqlite: commit_query: cannot define query \"%s\": %s", name, sqlite3_errmsg(g_db));
     goto quit;
   }
 
-  /* NOTE: sqlite3_column_bytes does not include NUL, but we include it */
-  ret = sqlite3_column_bytes(stmt, 0);
+  mdbfs_debug("sqlite: commit_query: defined query \"%s\"", name);
+  q->defined = 1;
+  ret = 1;
+
+quit:
+  pthread_mutex_unlock(&g_queries_lock);
+  write_end();
+  sqlite3_finalize(stmt);
+  sqlite3_free(errmsg);
+  mdbfs_free(sql_drop);
+  mdbfs_free(sql_view);
+  return ret;
+}
+
+char *mdbfs_backend_sqlite_get_query(size_t *sql_length, const char *name)
+{
+  char *ret = NULL;
+
+  if (!name) {
+    mdbfs_warning("sqlite: get_query: name is missing, this is unexpected. returning");
+    return NULL;
+  }
+
+  pthread_mutex_lock(&g_queries_lock);
 
-  mdbfs_debug("sqlite: get_cell_length: done querying length of cell (\"%s\", \"%s\", \"%s\")", table_name, row_name, col_name);
+  struct query *q = query_find(name);
+  if (q) {
+    ret = mdbfs_malloc0(q->sql_length + 1); /* + 1 NUL */
+    if (q->sql_length)
+      memcpy(ret, q->sql, q->sql_length);
 
-quit:
-  mdbfs_free(sql);
-  r = sqlite3_finalize(stmt);
-  if (r != SQLITE_OK) {
-    mdbfs_warning("sqlite: get_cell_length: sqlite3 cannot finalize a sql statement for us: %s", sqlite3_errmsg(g_db));
-    mdbfs_warning("sqlite: get_cell_length: *leaking memory*");
+    if (sql_length)
+      *sql_length = q->sql_length;
   }
+
+  pthread_mutex_unlock(&g_queries_lock);
   return ret;
 }
 
-int mdbfs_backend_sqlite_set_cell(const uint8_t *content, const size_t content_length, const char *table_name, const char *row_name, const char *col_name)
+int mdbfs_backend_sqlite_query_is_defined(const char *name)
 {
-  sqlite3_stmt *stmt = NULL;
-  char *sql = NULL;
-  int r = 0;
+  int ret = 0;
 
-  if (!table_name || !row_name || !col_name) {
-    mdbfs_warning("sqlite: set_cell: either table name, row name, or column name is missing, this is unexpected. returning");
+  if (!name) {
+    mdbfs_warning("sqlite: query_is_defined: name is missing, this is unexpected. returning");
     return 0;
   }
 
-  mdbfs_debug("sqlite: set_cell: updating content in cell (\"%s\", \"%s\", \"%s\")", table_name, row_name, col_name);
+  pthread_mutex_lock(&g_queries_lock);
 
-  sql = sql_from_fmt(sql_fmt_update_set_where, table_name, col_name, content, "ROWID", row_name);
-  if (!sql) {
-    mdbfs_error("sqlite: set_cell: no sql no life!");
-    goto quit;
-  }
+  struct query *q = query_find(name);
+  if (q)
+    ret = q->defined;
 
-  r = sqlite3_prepare_v2(g_db, sql, -1, &stmt, NULL);
-  if (r != SQLITE_OK) {
-    mdbfs_error("sqlite: set_cell: sqlite3 cannot prepare a sql statement for us: %s", sqlite3_errmsg(g_db));
-    goto quit;
-  }
+  pthread_mutex_unlock(&g_queries_lock);
+  return ret;
+}
 
-  r = sqlite3_step(stmt);
+char **mdbfs_backend_sqlite_get_query_names(void)
+{
+  char **ret = NULL;
+  size_t ret_length = 0;
 
-  if (r != SQLITE_DONE) {
-    mdbfs_warning("sqlite: set_cell: sqlite3 reported an error: %s", sqlite3_errmsg(g_db));
-    goto quit;
-  }
+  pthread_mutex_lock(&g_queries_lock);
 
-  mdbfs_debug("sqlite: set_cell: done updating content in cell (\"%s\", \"%s\", \"%s\")", table_name, row_name, col_name);
+  for (struct query *q = g_queries; q; q = q->next) {
+    /* Stretch vector */
+    ret_length += 1;
+    ret = mdbfs_realloc(ret, ret_length * sizeof(char *));
 
-quit:
-  mdbfs_free(sql);
-  r = sqlite3_finalize(stmt);
-  if (r != SQLITE_OK) {
-    mdbfs_warning("sqlite: set_cell: sqlite3 cannot finalize a sql statement for us: %s", sqlite3_errmsg(g_db));
-    mdbfs_warning("sqlite: set_cell: *leaking memory*");
+    /* Fill string element */
+    size_t name_length = strlen(q->name) + 1;
+    ret[ret_length - 1] = mdbfs_malloc0(name_length);
+    memcpy(ret[ret_length - 1], q->name, name_length);
   }
-  return 1;
+
+  pthread_mutex_unlock(&g_queries_lock);
+
+  /* Additionally add a NULL at the end of list for iteration */
+  ret_length += 1;
+  ret = mdbfs_realloc(ret, ret_length * sizeof(char *));
+  ret[ret_length - 1] = NULL;
+
+  return ret;
 }
 
-int mdbfs_backend_sqlite_rename_table(const char *table_old, const char *table_new)
+int mdbfs_backend_sqlite_remove_query(const char *name)
 {
-  sqlite3_stmt *stmt = NULL;
   char *sql = NULL;
-  int r = 0;
+  int ret = 0;
 
-  if (!table_old || !table_new) {
-    mdbfs_warning("sqlite: rename_table: either old or new table name is empty, this is unexpected. returning");
+  if (!name) {
+    mdbfs_warning("sqlite: remove_query: name is missing, this is unexpected. returning");
     return 0;
   }
 
-  mdbfs_debug("sqlite: rename_table: altering table name from %s to %s", table_old, table_new);
+  write_begin();
+  pthread_mutex_lock(&g_queries_lock);
 
-  sql = sql_from_fmt(sql_fmt_alter_table_rename_to, table_old, table_new);
-  if (!sql) {
-    mdbfs_error("sqlite: rename_table: no sql no life!");
-    goto quit;
-  }
+  for (struct query **pq = &g_queries; *pq; pq = &(*pq)->next) {
+    struct query *q = *pq;
+    if (strcmp(q->name, name) != 0)
+      continue;
 
-  r = sqlite3_prepare_v2(g_db, sql, -1, &stmt, NULL);
-  if (r != SQLITE_OK) {
-    mdbfs_error("sqlite: rename_table: sqlite3 cannot prepare a sql statement for us: %s", sqlite3_errmsg(g_db));
-    goto quit;
-  }
+    sql = sql_from_fmt(sql_fmt_drop_temp_view, name);
+    if (sql && sqlite3_exec(g_db, sql, NULL, NULL, NULL) != SQLITE_OK)
+      mdbfs_warning("sqlite: remove_query: cannot drop the view of \"%s\": %s", name, sqlite3_errmsg(g_db));
 
-  r = sqlite3_step(stmt);
+    pthread_mutex_lock(&g_schemas_lock);
+    schemas_clear_locked();
+    pthread_mutex_unlock(&g_schemas_lock);
+    row_cache_clear();
 
-  /* No result is given */
-  if (r != SQLITE_DONE) {
-    mdbfs_warning("sqlite: rename_table: sqlite3 reported an error: %s", sqlite3_errmsg(g_db));
-    goto quit;
-  }
+    *pq = q->next;
+    mdbfs_free(q->name);
+    mdbfs_free(q->sql);
+    mdbfs_free(q);
 
-  mdbfs_debug("sqlite: rename_table: done altering table name from %s to %s", table_old, table_new);
+    mdbfs_debug("sqlite: remove_query: removed query \"%s\"", name);
+    ret = 1;
+    break;
+  }
 
-quit:
+  pthread_mutex_unlock(&g_queries_lock);
+  write_end();
   mdbfs_free(sql);
-  r = sqlite3_finalize(stmt);
-  if (r != SQLITE_OK) {
-    mdbfs_warning("sqlite: rename_table: sqlite3 cannot finalize a sql statement for us: %s", sqlite3_errmsg(g_db));
-    mdbfs_warning("sqlite: rename_table: *leaking memory*");
-  }
-  return 1;
+  return ret;
 }
 
-int mdbfs_backend_sqlite_rename_column(const char *table_name, const char *column_old, const char *column_new)
+sqlite3_stmt *mdbfs_backend_sqlite_prepare_select(const char *table_name, const char *row_name, int *keyed)
 {
   sqlite3_stmt *stmt = NULL;
   char *sql = NULL;
+  char *table = NULL;
   int r = 0;
 
-  if (!table_name || !column_old || !column_new) {
-    mdbfs_warning("sqlite: rename_column: either table name, old column name, or new column name is missing, this is unexpected. returning");
-    return 0;
+  if (!table_name) {
+    mdbfs_warning("sqlite: prepare_select: table name is missing, this is unexpected. returning");
+    return NULL;
   }
 
-  mdbfs_debug("sqlite: rename_column: altering column name in table \"%s\" from \"%s\" to \"%s\"", table_name, column_old, column_new);
+  if (row_name) {
+    sql = sql_select_row(NULL, table_name, row_name);
+  } else {
+    table = sql_table(table_name);
+
+    /* Pages of tables go from ROWIDs; views (and e.g. WITHOUT ROWID tables)
+     * only have positions
+     */
+    *keyed = !is_view(table_name);
+    if (*keyed) {
+      sql = sql_from_fmt(sql_fmt_select_rowid_all_from_since, table);
+      if (sql && sqlite3_prepare_v2(g_db, sql, -1, &stmt, NULL) == SQLITE_OK)
+        goto quit;
+
+      mdbfs_debug("sqlite: prepare_select: cannot page \"%s\" by ROWID: %s", table_name, sqlite3_errmsg(g_db));
+      sqlite3_finalize(stmt);
+      stmt = NULL;
+      mdbfs_free(sql);
+      *keyed = 0;
+    }
+
+    sql = sql_from_fmt(sql_fmt_select_null_all_from_offset, table);
+  }
 
-  sql = sql_from_fmt(sql_fmt_alter_table_rename_column_to, table_name, column_old, column_new);
   if (!sql) {
-    mdbfs_error("sqlite: rename_column: no sql no life!");
+    mdbfs_error("sqlite: prepare_select: no sql no life!");
     goto quit;
   }
 
   r = sqlite3_prepare_v2(g_db, sql, -1, &stmt, NULL);
   if (r != SQLITE_OK) {
-    mdbfs_error("sqlite: rename_column: sqlite3 cannot prepare a sql statement for us: %s", sqlite3_errmsg(g_db));
-    goto quit;
-  }
-
-  r = sqlite3_step(stmt);
-
-  /* No result is given */
-  if (r != SQLITE_DONE) {
-    mdbfs_warning("sqlite: rename_column: sqlite3 reported an error: %s", sqlite3_errmsg(g_db));
+    mdbfs_error("sqlite: prepare_select: sqlite3 cannot prepare a sql statement for us: %s", sqlite3_errmsg(g_db));
+    sqlite3_finalize(stmt);
+    stmt = NULL;
     goto quit;
   }
 
-  mdbfs_debug("sqlite: rename_column: done altering column name in table \"%s\" from \"%s\" to \"%s\"", table_name, column_old, column_new);
-
 quit:
   mdbfs_free(sql);
-  r = sqlite3_finalize(stmt);
-  if (r != SQLITE_OK) {
-    mdbfs_warning("sqlite: rename_column: sqlite3 cannot finalize a sql statement for us: %s", sqlite3_errmsg(g_db));
-    mdbfs_warning("sqlite: rename_column: *leaking memory*");
-  }
-  return 1;
+  mdbfs_free(table);
+  return stmt;
 }
 
-int mdbfs_backend_sqlite_rename_row(const char *table_name, const char *row_old, const char *row_new)
+sqlite3_stmt *mdbfs_backend_sqlite_prepare_insert(const char *table_name, char **col_names)
 {
   sqlite3_stmt *stmt = NULL;
   char *sql = NULL;
+  char *table = NULL;
+  char *cols = NULL;
+  char *params = NULL;
+  size_t cols_length = 0;
+  size_t ncols = 0;
   int r = 0;
 
-  if (!table_name || !row_old || !row_new) {
-    mdbfs_warning("sqlite: rename_row: either table name, old row name, or new row name is missing, this is unexpected. returning");
-    return 0;
+  if (!table_name || !col_names || !col_names[0]) {
+    mdbfs_warning("sqlite: prepare_insert: either table name or column names are missing, this is unexpected. returning");
+    return NULL;
   }
 
-  mdbfs_debug("sqlite: rename_row: altering row name in table \"%s\" from \"%s\" to \"%s\"", table_name, row_old, row_new);
+  /* "a","b",... and ?1,?2,... */
+  for (ncols = 0; col_names[ncols]; ncols++)
+    cols_length += strlen(col_names[ncols]) + 3;
+
+  cols   = mdbfs_malloc0(cols_length + 1);
+  params = mdbfs_malloc0(ncols * 24 + 1);
+
+  for (size_t i = 0; i < ncols; i++) {
+    if (i) {
+      strcat(cols, ",");
+      strcat(params, ",");
+    }
+    strcat(cols, "\"");
+    strcat(cols, col_names[i]);
+    strcat(cols, "\"");
+    sprintf(params + strlen(params), "?%zu", i + 1);
+  }
 
-  sql = sql_from_fmt(sql_fmt_update_set_where, table_name, row_old, row_new);
+  table = sql_table(table_name);
+  sql = sql_from_fmt(sql_fmt_insert_into, table, cols, params);
   if (!sql) {
-    mdbfs_error("sqlite: rename_row: no sql no life!");
+    mdbfs_error("sqlite: prepare_insert: no sql no life!");
     goto quit;
   }
 
   r = sqlite3_prepare_v2(g_db, sql, -1, &stmt, NULL);
   if (r != SQLITE_OK) {
-    mdbfs_error("sqlite: rename_row: sqlite3 cannot prepare a sql statement for us: %s", sqlite3_errmsg(g_db));
-    goto quit;
-  }
-
-  r = sqlite3_step(stmt);
-
-  /* No result is given */
-  if (r != SQLITE_DONE) {
-    mdbfs_warning("sqlite: rename_row: sqlite3 reported an error: %s", sqlite3_errmsg(g_db));
+    mdbfs_warning("sqlite: prepare_insert: sqlite3 cannot prepare a sql statement for us: %s", sqlite3_errmsg(g_db));
+    sqlite3_finalize(stmt);
+    stmt = NULL;
     goto quit;
   }
 
-  mdbfs_debug("sqlite: rename_row: altered row name in table \"%s\" from \"%s\" to \"%s\"", table_name, row_old, row_new);
-
 quit:
+  mdbfs_free(cols);
+  mdbfs_free(params);
   mdbfs_free(sql);
-  r = sqlite3_finalize(stmt);
-  if (r != SQLITE_OK) {
-    mdbfs_warning("sqlite: rename_row: sqlite3 cannot finalize a sql statement for us: %s", sqlite3_errmsg(g_db));
-    mdbfs_warning("sqlite: rename_row: *leaking memory*");
-  }
-  return 1;
-}
-
-int mdbfs_backend_sqlite_create_table(const char *table_new)
-{
-  (void)table_new;
-
-  mdbfs_info("sqlite: create_table: not implemented");
-
-  return 0;
+  mdbfs_free(table);
+  return stmt;
 }
 
-int mdbfs_backend_sqlite_create_column(const char *table_name, const char *column_new)
+int mdbfs_backend_sqlite_get_space(int64_t *page_size, int64_t *total_pages, int64_t *free_pages)
 {
+  static const char *const single[] = {"main", NULL};
+  const char *const *databases = g_databases && g_databases[0] ? (const char *const *)g_databases : single;
   sqlite3_stmt *stmt = NULL;
   char *sql = NULL;
+  unsigned long *fsids = NULL;
+  size_t nfsids = 0;
+  struct timespec now;
+  int ret = 0;
   int r = 0;
 
-  if (!table_name || !column_new) {
-    mdbfs_warning("sqlite: create_column: either table name or new column name is missing, this is unexpected. returning");
-    return 0;
-  }
+  pthread_mutex_lock(&g_space_lock);
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  if (g_space_valid && ms_between(&g_space_taken, &now) < MDBFS_SQLITE_SPACE_TTL_MS)
+    goto reply;
+
+  mdbfs_debug("sqlite: get_space: querying page statistics");
+
+  g_space_valid       = 0;
+  g_space_page_size   = 0;
+  g_space_total_pages = 0;
+  g_space_free_pages  = 0;
+
+  /* Databases are not to be detached meanwhile */
+  if (g_databases)
+    pthread_mutex_lock(&g_databases_lock);
+
+  /* Attached databases add up, in pages the size of those of the first */
+  for (size_t i = 0; databases[i]; i++) {
+    /* These only read the database header */
+    static const char *const pragmas[] = {"page_size", "page_count", "freelist_count"};
+    int64_t values[3] = {0};
+
+    for (int k = 0; k < 3; k++) {
+      sql = sql_from_fmt(sql_fmt_pragma_of, databases[i], pragmas[k]);
+      r = sql ? sqlite3_prepare_v2(g_db, sql, -1, &stmt, NULL) : SQLITE_NOMEM;
+      mdbfs_free(sql);
+      sql = NULL;
+      if (r != SQLITE_OK) {
+        mdbfs_error("sqlite: get_space: sqlite3 cannot prepare a sql statement for us: %s", sqlite3_errmsg(g_db));
+        goto unlock;
+      }
+
+      r = sqlite3_step(stmt);
+      if (r != SQLITE_ROW) {
+        mdbfs_warning("sqlite: get_space: sqlite3 reported an error: %s", sqlite3_errmsg(g_db));
+        goto unlock;
+      }
+
+      values[k] = sqlite3_column_int64(stmt, 0);
+      sqlite3_finalize(stmt);
+      stmt = NULL;
+    }
 
-  mdbfs_debug("sqlite: create_column: creating column \"%s\" in table \"%s\"", column_new, table_name);
+    if (!g_space_page_size)
+      g_space_page_size = values[0];
+    if (g_space_page_size <= 0)
+      continue;
 
-  sql = sql_from_fmt(sql_fmt_alter_table_add_column, table_name, column_new);
-  if (!sql) {
-    mdbfs_error("sqlite: create_column: no sql no life!");
-    goto quit;
-  }
+    /* Pages on the free list are reused first, then the database grows into
+     * the file system it lives on, so what that has left counts as free too;
+     * once for each file system
+     */
+    struct statvfs host = {0};
+    const char *filename = sqlite3_db_filename(g_db, databases[i]);
+    int64_t room = 0;
+
+    if (filename && *filename && statvfs(filename, &host) == 0) {
+      size_t k = 0;
+      while (k < nfsids && fsids[k] != host.f_fsid)
+        k++;
+
+      if (k == nfsids) {
+        fsids = mdbfs_realloc(fsids, (nfsids + 1) * sizeof(unsigned long));
+        fsids[nfsids++] = host.f_fsid;
+        room = (int64_t)host.f_bavail * host.f_frsize;
+      }
+    }
 
-  r = sqlite3_prepare_v2(g_db, sql, -1, &stmt, NULL);
-  if (r != SQLITE_OK) {
-    mdbfs_error("sqlite: create_column: sqlite3 cannot prepare a sql statement for us: %s", sqlite3_errmsg(g_db));
-    goto quit;
+    g_space_total_pages += (values[1] * values[0] + room) / g_space_page_size;
+    g_space_free_pages  += (values[2] * values[0] + room) / g_space_page_size;
   }
 
-  r = sqlite3_step(stmt);
+  g_space_taken = now;
+  g_space_valid = 1;
 
-  /* No result is given */
-  if (r != SQLITE_DONE) {
-    mdbfs_warning("sqlite: create_column: sqlite3 reported an error: %s", sqlite3_errmsg(g_db));
+unlock:
+  if (g_databases)
+    pthread_mutex_unlock(&g_databases_lock);
+
+  if (!g_space_valid)
     goto quit;
-  }
 
-  mdbfs_debug("sqlite: create_column: done creating column \"%s\" in table \"%s\"", column_new, table_name);
+reply:
+  *page_size   = g_space_page_size;
+  *total_pages = g_space_total_pages;
+  *free_pages  = g_space_free_pages;
+  ret = 1;
 
 quit:
-  mdbfs_free(sql);
-  r = sqlite3_finalize(stmt);
-  if (r != SQLITE_OK) {
-    mdbfs_warning("sqlite: create_column: sqlite3 cannot finalize a sql statement for us: %s", sqlite3_errmsg(g_db));
-    mdbfs_warning("sqlite: create_column: *leaking memory*");
-  }
-  return 1;
-}
-
-int mdbfs_backend_sqlite_create_row(const char *table_name, const char *row_new)
-{
-  (void)table_name;
-  (void)row_new;
-
-  mdbfs_info("sqlite: create_row: not implemented");
-
-  return 0;
+  pthread_mutex_unlock(&g_space_lock);
+  sqlite3_finalize(stmt);
+  mdbfs_free(fsids);
+  return ret;
 }
 
-int mdbfs_backend_sqlite_remove_table(const char *table_name)
+int mdbfs_backend_sqlite_begin(void)
 {
-  sqlite3_stmt *stmt = NULL;
-  char *sql = NULL;
-  int r = 0;
-
-  if (!table_name) {
-    mdbfs_warning("sqlite: remove_table: table name is missing, this is unexpected. returning");
-    return 0;
-  }
+  int ret = 0;
 
-  mdbfs_debug("sqlite: remove_table: dropping table \"%s\"", table_name);
+  pthread_mutex_lock(&g_batch_lock);
 
-  sql = sql_from_fmt(sql_fmt_drop_table, table_name);
-  if (!sql) {
-    mdbfs_error("sqlite: remove_table: no sql no life!");
-    goto quit;
-  }
+  /* Writes under way finish first, while new ones wait until the transaction
+   * ends, so that none of them is committed or rolled back along with it
+   */
+  g_explicit_waiting += 1;
+  while (g_transaction == TRANSACTION_EXPLICIT || g_writers > 0)
+    pthread_cond_wait(&g_write_cond, &g_batch_lock);
+  g_explicit_waiting -= 1;
 
-  r = sqlite3_prepare_v2(g_db, sql, -1, &stmt, NULL);
-  if (r != SQLITE_OK) {
-    mdbfs_error("sqlite: remove_table: sqlite3 cannot prepare a sql statement for us: %s", sqlite3_errmsg(g_db));
+  /* Created rows go first, so that the transaction starts from a clean state */
+  if (!batch_commit_locked() || g_transaction != TRANSACTION_NONE)
     goto quit;
-  }
-
-  r = sqlite3_step(stmt);
 
-  /* No result is given */
-  if (r != SQLITE_DONE) {
-    mdbfs_warning("sqlite: remove_table: sqlite3 reported an error: %s", sqlite3_errmsg(g_db));
-    goto quit;
+  ret = exec_simple(sql_str_begin, "begin");
+  if (ret) {
+    g_transaction = TRANSACTION_EXPLICIT;
+    g_explicit_paused = 0;
+    g_explicit_lost = 0;
   }
 
-  mdbfs_debug("sqlite: remove_table: dropped table \"%s\"", table_name);
-
 quit:
-  mdbfs_free(sql);
-  r = sqlite3_finalize(stmt);
-  if (r != SQLITE_OK) {
-    mdbfs_warning("sqlite: remove_table: sqlite3 cannot finalize a sql statement for us: %s", sqlite3_errmsg(g_db));
-    mdbfs_warning("sqlite: remove_table: *leaking memory*");
-  }
-  return 1;
+  if (!ret)
+    pthread_cond_broadcast(&g_write_cond);
+  pthread_mutex_unlock(&g_batch_lock);
+  return ret;
 }
 
-int mdbfs_backend_sqlite_remove_column(const char *table_name, const char *column_name)
+int mdbfs_backend_sqlite_commit(void)
 {
-  (void)table_name;
-  (void)column_name;
+  pthread_mutex_lock(&g_batch_lock);
 
-  mdbfs_info("sqlite: remove_column: not implemented");
+  /* Leave no transaction behind, whatever state it is in */
+  int ret = exec_simple(sql_str_commit, "commit");
+  if (!ret) {
+    sqlite3_exec(g_db, sql_str_rollback, NULL, NULL, NULL);
+    row_cache_clear();
+  }
+  g_transaction = TRANSACTION_NONE;
+  g_explicit_paused = 0;
+  pthread_cond_broadcast(&g_write_cond);
 
-  return 0;
+  pthread_mutex_unlock(&g_batch_lock);
+
+  return ret;
 }
 
-int mdbfs_backend_sqlite_remove_row(const char *table_name, const char *row_name)
+int mdbfs_backend_sqlite_rollback(void)
 {
-  sqlite3_stmt *stmt = NULL;
-  char *sql = NULL;
-  int r = 0;
+  pthread_mutex_lock(&g_batch_lock);
+  int ret = exec_simple(sql_str_rollback, "rollback");
+  row_cache_clear(); /* Neither the update hook nor data_version sees it */
+  g_transaction = TRANSACTION_NONE;
+  g_explicit_paused = 0;
+  pthread_cond_broadcast(&g_write_cond);
+  pthread_mutex_unlock(&g_batch_lock);
 
-  if (!table_name || !row_name) {
-    mdbfs_warning("sqlite: remove_row: either table name or row name is missing, this is unexpected. returning");
-    return 0;
-  }
+  return ret;
+}
 
-  mdbfs_debug("sqlite: remove_row: deleting row \"%s\" in table \"%s\"", row_name, table_name);
+void mdbfs_backend_sqlite_pause(void)
+{
+  pthread_mutex_lock(&g_batch_lock);
 
-  sql = sql_from_fmt(sql_fmt_delete_from_where, table_name, "ROWID", row_name);
-  if (!sql) {
-    mdbfs_error("sqlite: remove_row: no sql no life!");
-    goto quit;
-  }
+  if (g_transaction == TRANSACTION_EXPLICIT) {
+    g_explicit_paused = 1;
+    clock_gettime(CLOCK_MONOTONIC, &g_explicit_touched);
 
-  r = sqlite3_prepare_v2(g_db, sql, -1, &stmt, NULL);
-  if (r != SQLITE_OK) {
-    mdbfs_error("sqlite: remove_row: sqlite3 cannot prepare a sql statement for us: %s", sqlite3_errmsg(g_db));
-    goto quit;
+    /* Without the flusher, nothing would ever commit it */
+    if (!g_flusher_running)
+      explicit_commit_locked();
+    else
+      pthread_cond_signal(&g_batch_cond);
   }
 
-  r = sqlite3_step(stmt);
+  pthread_mutex_unlock(&g_batch_lock);
+}
 
-  /* No result is given */
-  if (r != SQLITE_DONE) {
-    mdbfs_warning("sqlite: remove_row: sqlite3 reported an error: %s", sqlite3_errmsg(g_db));
-    goto quit;
-  }
+int mdbfs_backend_sqlite_resume(void)
+{
+  int ret = 0;
 
-  mdbfs_debug("sqlite: remove_row: deleted row \"%s\" in table \"%s\"", row_name, table_name);
+  pthread_mutex_lock(&g_batch_lock);
 
-quit:
-  mdbfs_free(sql);
-  r = sqlite3_finalize(stmt);
-  if (r != SQLITE_OK) {
-    mdbfs_warning("sqlite: remove_row: sqlite3 cannot finalize a sql statement for us: %s", sqlite3_errmsg(g_db));
-    mdbfs_warning("sqlite: remove_row: *leaking memory*");
+  if (g_transaction == TRANSACTION_EXPLICIT && g_explicit_paused) {
+    g_explicit_paused = 0;
+    ret = 1;
+  } else {
+    ret = g_explicit_lost ? -1 : 0;
+    g_explicit_lost = 0;
   }
-  return 1;
+
+  pthread_mutex_unlock(&g_batch_lock);
+  return ret;
 }
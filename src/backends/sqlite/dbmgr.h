@@ -8,27 +8,125 @@
 #ifndef MDBFS_BACKENDS_SQLITE_DBMGR_H
 #define MDBFS_BACKENDS_SQLITE_DBMGR_H
 
+#include <stddef.h>
 #include <stdint.h>
+#include <sqlite3.h>
 
 /* TODO: Documentation */
 
+enum mdbfs_backend_sqlite_table_type {
+  MDBFS_BACKEND_SQLITE_TABLE_TYPE_NONE = 0, ///< No such table or view
+  MDBFS_BACKEND_SQLITE_TABLE_TYPE_TABLE,    ///< A table, with rows named by ROWIDs
+  MDBFS_BACKEND_SQLITE_TABLE_TYPE_VIEW,     ///< A view, with rows named by positions
+};
+
+/**
+ * Storage class of a cell, as SQLite stores it.
+ */
+enum mdbfs_backend_sqlite_cell_type {
+  MDBFS_BACKEND_SQLITE_CELL_TYPE_NONE = 0, ///< No such cell
+  MDBFS_BACKEND_SQLITE_CELL_TYPE_NULL,     ///< NULL, read as an empty file
+  MDBFS_BACKEND_SQLITE_CELL_TYPE_INTEGER,  ///< Integer, read in decimal
+  MDBFS_BACKEND_SQLITE_CELL_TYPE_REAL,     ///< Real, read in its shortest exact form
+  MDBFS_BACKEND_SQLITE_CELL_TYPE_TEXT,     ///< Text, read as is
+  MDBFS_BACKEND_SQLITE_CELL_TYPE_BLOB,     ///< BLOB, read as is
+};
+
+/**
+ * A run of consecutive ROWIDs.
+ */
+struct mdbfs_backend_sqlite_rowid_run {
+  int64_t first; ///< First ROWID of the run
+  int64_t last;  ///< Last ROWID of the run
+  int64_t index; ///< Position of `first` among all ROWIDs of the table
+};
+
+/**
+ * ROWIDs of a table in ascending order, kept as runs of consecutive ones, so
+ * that tables of mostly consecutive ROWIDs take a few bytes to list however
+ * large they are.
+ */
+struct mdbfs_backend_sqlite_rowids {
+  struct mdbfs_backend_sqlite_rowid_run *runs;
+  size_t  nruns;
+  int64_t count; ///< ROWIDs in all runs
+};
+
+/**
+ * Callback receiving rows one by one, see
+ * mdbfs_backend_sqlite_walk_view_row_names and
+ * mdbfs_backend_sqlite_walk_rowids.
+ *
+ * @param row_name    [in] Name of the row.
+ * @param next_offset [in] Offset to resume walking from after this row.
+ * @param data        [in] User data given to the walk.
+ * @return 0 to continue walking, non-zero to stop.
+ */
+typedef int (*mdbfs_backend_sqlite_row_walker)(const char *row_name, int64_t next_offset, void *data);
+
+/**
+ * Callback receiving buckets of ROWIDs one by one, see
+ * mdbfs_backend_sqlite_walk_rowid_buckets.
+ *
+ * @param bucket [in] Number of the bucket: ROWIDs in it divided by the width
+ *                    of buckets, rounded down.
+ * @param data   [in] User data given to the walk.
+ * @return 0 to continue walking, non-zero to stop.
+ */
+typedef int (*mdbfs_backend_sqlite_bucket_walker)(int64_t bucket, void *data);
+
+int mdbfs_backend_sqlite_set_databases(const char *const *paths);
+int mdbfs_backend_sqlite_set_database_dir(const char *path, int64_t max_open);
 int mdbfs_backend_sqlite_open_database_from_file(const char *path);
 void mdbfs_backend_sqlite_close_database(void);
 
-char *mdbfs_backend_sqlite_get_database_name(void);
+int mdbfs_backend_sqlite_has_databases(void);
+char **mdbfs_backend_sqlite_get_database_names(void);
+int mdbfs_backend_sqlite_database_exists(const char *name);
+int mdbfs_backend_sqlite_use_database(const char *name);
+void mdbfs_backend_sqlite_release_database(const char *name);
 char **mdbfs_backend_sqlite_get_table_names(void);
 char **mdbfs_backend_sqlite_get_column_names(const char *table_name, const char *row_name);
-char **mdbfs_backend_sqlite_get_row_names(const char *table_name);
+struct mdbfs_backend_sqlite_rowids *mdbfs_backend_sqlite_get_rowids(const char *table_name, int64_t first, int64_t last);
+int64_t mdbfs_backend_sqlite_walk_rowids(const struct mdbfs_backend_sqlite_rowids *rowids, int64_t offset, mdbfs_backend_sqlite_row_walker walker, void *data);
+int mdbfs_backend_sqlite_walk_rowid_buckets(const char *table_name, int64_t first, int64_t last, int64_t width, mdbfs_backend_sqlite_bucket_walker walker, void *data);
+void mdbfs_backend_sqlite_free_rowids(struct mdbfs_backend_sqlite_rowids *rowids);
+enum mdbfs_backend_sqlite_table_type mdbfs_backend_sqlite_get_table_type(const char *table_name);
+int mdbfs_backend_sqlite_walk_view_row_names(const char *view_name, int64_t offset, mdbfs_backend_sqlite_row_walker walker, void *data);
+sqlite3_stmt *mdbfs_backend_sqlite_prepare_select(const char *table_name, const char *row_name, int *keyed);
+sqlite3_stmt *mdbfs_backend_sqlite_prepare_insert(const char *table_name, char **col_names);
+
+int mdbfs_backend_sqlite_get_space(int64_t *page_size, int64_t *total_pages, int64_t *free_pages);
+
+int mdbfs_backend_sqlite_begin(void);
+int mdbfs_backend_sqlite_commit(void);
+int mdbfs_backend_sqlite_rollback(void);
+void mdbfs_backend_sqlite_pause(void);
+int mdbfs_backend_sqlite_resume(void);
 
 uint8_t *mdbfs_backend_sqlite_get_cell(size_t *cell_length, const char *table_name, const char *row_name, const char *col_name);
 size_t mdbfs_backend_sqlite_get_cell_length(const char *table_name, const char *row_name, const char *col_name);
-int mdbfs_backend_sqlite_set_cell(const uint8_t *content, const size_t content_length, const char *table_name, const char *row_name, const char *col_name);
+int mdbfs_backend_sqlite_prefetch_attrs(const char *table_name, const struct mdbfs_backend_sqlite_rowids *rowids, int64_t offset);
+int mdbfs_backend_sqlite_row_is_cached(const char *table_name, const char *row_name);
+int64_t mdbfs_backend_sqlite_read_cell(enum mdbfs_backend_sqlite_cell_type *cell_type, size_t *cell_length, char *buf, size_t bufsize, int64_t offset, const char *table_name, const char *row_name, const char *col_name);
+const char *mdbfs_backend_sqlite_cell_type_name(enum mdbfs_backend_sqlite_cell_type cell_type);
+char *mdbfs_backend_sqlite_get_column_decltype(const char *table_name, const char *col_name);
+int64_t mdbfs_backend_sqlite_get_row_estimate(const char *table_name);
+int mdbfs_backend_sqlite_set_cell(const uint8_t *content, const size_t content_length, int64_t offset, const char *table_name, const char *row_name, const char *col_name);
+int mdbfs_backend_sqlite_resize_cell(int64_t size, const char *table_name, const char *row_name, const char *col_name);
+int mdbfs_backend_sqlite_copy_cell(const char *table_from, const char *row_from, const char *col_from, const char *table_to, const char *row_to, const char *col_to);
 
 int mdbfs_backend_sqlite_rename_table(const char *table_old, const char *table_new);
 int mdbfs_backend_sqlite_rename_column(const char *table_name, const char *column_old, const char *column_new);
 int mdbfs_backend_sqlite_rename_row(const char *table_name, const char *row_old, const char *row_new);
+int mdbfs_backend_sqlite_move_row(const char *table_old, const char *row_old, const char *table_new, const char *row_new);
 
 int mdbfs_backend_sqlite_create_table(const char *table_new);
+void mdbfs_backend_sqlite_set_table_template(const char *columns);
+void mdbfs_backend_sqlite_set_bloom_memory(int64_t size);
+void mdbfs_backend_sqlite_set_prewarm(const char *tables, int64_t bytes, int64_t threads);
+void mdbfs_backend_sqlite_set_metadata_cache(const char *path);
+void mdbfs_backend_sqlite_prewarm(void);
 int mdbfs_backend_sqlite_create_column(const char *table_name, const char *column_new);
 int mdbfs_backend_sqlite_create_row(const char *table_name, const char *row_new);
 
@@ -36,4 +134,17 @@ int mdbfs_backend_sqlite_remove_table(const char *table_name);
 int mdbfs_backend_sqlite_remove_column(const char *table_name, const char *column_name);
 int mdbfs_backend_sqlite_remove_row(const char *table_name, const char *row_name);
 
+char **mdbfs_backend_sqlite_get_indexed_column_names(const char *table_name);
+char **mdbfs_backend_sqlite_get_indexed_values(const char *table_name, const char *col_name);
+char **mdbfs_backend_sqlite_get_row_names_by_value(const char *table_name, const char *col_name, const char *value);
+
+int mdbfs_backend_sqlite_create_query(const char *name);
+int mdbfs_backend_sqlite_set_query(const char *name, const char *sql, size_t sql_length, size_t offset);
+int mdbfs_backend_sqlite_truncate_query(const char *name, size_t length);
+int mdbfs_backend_sqlite_commit_query(const char *name);
+char *mdbfs_backend_sqlite_get_query(size_t *sql_length, const char *name);
+int mdbfs_backend_sqlite_query_is_defined(const char *name);
+char **mdbfs_backend_sqlite_get_query_names(void);
+int mdbfs_backend_sqlite_remove_query(const char *name);
+
 #endif
@@ -0,0 +1,535 @@
+/**
+ * @file export.c
+ *
+ * Implementation of serialized (whole-table and whole-row) files for the MDBFS
+ * SQLite backend.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <sqlite3.h>
+#include "utils/escape.h"
+#include "utils/format.h"
+#include "utils/memory.h"
+#include "utils/print.h"
+#include "dbmgr.h"
+#include "export.h"
+
+/**
+ * Rows of a table scanned by one statement before it is bound again, see
+ * export_generate.
+ */
+#define MDBFS_SQLITE_EXPORT_PAGE_ROWS 1024
+
+/********** Private Structures **********/
+
+/**
+ * A growable text buffer.
+ */
+struct text {
+  char  *data;     ///< Content, not NUL-terminated
+  size_t length;   ///< Bytes used
+  size_t capacity; ///< Bytes allocated
+};
+
+struct mdbfs_backend_sqlite_export {
+  enum mdbfs_backend_sqlite_export_format format;
+  char *table_name; ///< Table (or view) being exported
+  char *row_name;   ///< Row being exported, or NULL for the whole table
+
+  sqlite3_stmt *stmt; ///< The scan, prepared on the first read
+  int keyed;          ///< Whether the scan goes by ROWIDs, or by positions
+  int64_t next;       ///< ROWID (or position) the next page starts from
+  int64_t page_rows;  ///< Rows of the page stepped over, or -1 if none is bound
+  int header_done;    ///< Whether the header line has been generated
+  int done;           ///< Whether the scan has finished
+
+  struct text window;     ///< Generated content which is not yet read past
+  int64_t window_offset;  ///< Offset of the first byte of `window` in the file
+
+  pthread_mutex_t lock; ///< Reads of one open file may come from many threads
+};
+
+/**
+ * Known file name suffixes and their formats.
+ */
+static const struct {
+  const char *suffix;
+  enum mdbfs_backend_sqlite_export_format format;
+} export_suffixes[] = {
+  {".csv",   MDBFS_BACKEND_SQLITE_EXPORT_FORMAT_CSV},
+  {".tsv",   MDBFS_BACKEND_SQLITE_EXPORT_FORMAT_TSV},
+  {".jsonl", MDBFS_BACKEND_SQLITE_EXPORT_FORMAT_JSONL},
+  {".json",  MDBFS_BACKEND_SQLITE_EXPORT_FORMAT_JSON},
+  {NULL,     MDBFS_BACKEND_SQLITE_EXPORT_FORMAT_NONE},
+};
+
+/********** Private APIs **********/
+
+/**
+ * Make room for at least `length` more bytes in a text buffer.
+ */
+static void text_reserve(struct text *text, size_t length)
+{
+  if (text->length + length <= text->capacity)
+    return;
+
+  size_t capacity = text->capacity ? text->capacity : 4096;
+  while (capacity < text->length + length)
+    capacity *= 2;
+
+  text->data = mdbfs_realloc(text->data, capacity);
+  text->capacity = capacity;
+}
+
+static void text_append(struct text *text, const char *data, size_t length)
+{
+  text_reserve(text, length);
+  memcpy(text->data + text->length, data, length);
+  text->length += length;
+}
+
+static void text_append_str(struct text *text, const char *str)
+{
+  text_append(text, str, strlen(str));
+}
+
+static void text_append_char(struct text *text, char c)
+{
+  text_reserve(text, 1);
+  text->data[text->length++] = c;
+}
+
+/**
+ * Append a BLOB in hexadecimal.
+ */
+static void text_append_hex(struct text *text, const uint8_t *data, size_t length)
+{
+  static const char digits[] = "0123456789abcdef";
+
+  text_reserve(text, length * 2);
+  for (size_t i = 0; i < length; i++) {
+    text->data[text->length++] = digits[data[i] >> 4];
+    text->data[text->length++] = digits[data[i] & 0x0f];
+  }
+}
+
+/**
+ * Append a CSV field, quoting it if it contains a separator, a quote, or a
+ * line break (RFC 4180), or if it is empty, since an unquoted empty field is
+ * NULL.
+ */
+static void text_append_csv(struct text *text, const char *data, size_t length)
+{
+  if (length && mdbfs_escape_span(MDBFS_ESCAPE_SET_CSV, data, length) == length) {
+    text_append(text, data, length);
+    return;
+  }
+
+  /* Inside quotes, only quotes need escaping (by doubling them) */
+  text_append_char(text, '"');
+  for (;;) {
+    const char *quote = memchr(data, '"', length);
+    size_t span = quote ? (size_t)(quote - data) + 1 : length;
+
+    text_append(text, data, span);
+    if (!quote)
+      break;
+
+    text_append_char(text, '"');
+    data += span;
+    length -= span;
+  }
+  text_append_char(text, '"');
+}
+
+/**
+ * Append a TSV field, escaping tabs, line breaks and backslashes.
+ */
+static void text_append_tsv(struct text *text, const char *data, size_t length)
+{
+  for (;;) {
+    size_t span = mdbfs_escape_span(MDBFS_ESCAPE_SET_TSV, data, length);
+
+    text_append(text, data, span);
+    if (span == length)
+      break;
+
+    switch (data[span]) {
+      case '\t': text_append_str(text, "\\t");  break;
+      case '\n': text_append_str(text, "\\n");  break;
+      case '\r': text_append_str(text, "\\r");  break;
+      default:   text_append_str(text, "\\\\"); break;
+    }
+
+    data += span + 1;
+    length -= span + 1;
+  }
+}
+
+/**
+ * Append a JSON string, with quotes, escaping quotes, backslashes and control
+ * characters.
+ */
+static void text_append_json(struct text *text, const char *data, size_t length)
+{
+  text_append_char(text, '"');
+
+  for (;;) {
+    size_t span = mdbfs_escape_span(MDBFS_ESCAPE_SET_JSON, data, length);
+
+    text_append(text, data, span);
+    if (span == length)
+      break;
+
+    unsigned char c = data[span];
+
+    switch (c) {
+      case '"':  text_append_str(text, "\\\""); break;
+      case '\\': text_append_str(text, "\\\\"); break;
+      case '\n': text_append_str(text, "\\n");  break;
+      case '\r': text_append_str(text, "\\r");  break;
+      case '\t': text_append_str(text, "\\t");  break;
+      default: {
+        char escaped[8];
+        snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+        text_append_str(text, escaped);
+        break;
+      }
+    }
+
+    data += span + 1;
+    length -= span + 1;
+  }
+
+  text_append_char(text, '"');
+}
+
+/**
+ * Append one value of the current row in the format of the export.
+ */
+static void export_append_value(struct mdbfs_backend_sqlite_export *export, int icol)
+{
+  struct text *text = &export->window;
+  sqlite3_stmt *stmt = export->stmt;
+  int json = export->format == MDBFS_BACKEND_SQLITE_EXPORT_FORMAT_JSONL ||
+             export->format == MDBFS_BACKEND_SQLITE_EXPORT_FORMAT_JSON;
+  char number[MDBFS_FORMAT_NUMBER_MAX];
+
+  switch (sqlite3_column_type(stmt, icol)) {
+    case SQLITE_NULL:
+      if (json)
+        text_append_str(text, "null");
+      else if (export->format == MDBFS_BACKEND_SQLITE_EXPORT_FORMAT_TSV)
+        text_append_str(text, "\\N");
+      break;
+
+    case SQLITE_INTEGER:
+      text_append(text, number, mdbfs_format_int64(number, sqlite3_column_int64(stmt, icol)));
+      break;
+
+    case SQLITE_FLOAT: {
+      double value = sqlite3_column_double(stmt, icol);
+
+      /* JSON has no representation of infinities and NaN */
+      if (json && !isfinite(value)) {
+        text_append_str(text, "null");
+        break;
+      }
+
+      text_append(text, number, mdbfs_format_double(number, value));
+      break;
+    }
+
+    case SQLITE_BLOB: {
+      const uint8_t *blob = sqlite3_column_blob(stmt, icol);
+      size_t blob_length = sqlite3_column_bytes(stmt, icol);
+
+      /* BLOBs are written in hexadecimal, so that every format stays text */
+      if (json || (!blob_length && export->format == MDBFS_BACKEND_SQLITE_EXPORT_FORMAT_CSV))
+        text_append_char(text, '"');
+      text_append_hex(text, blob, blob_length);
+      if (json || (!blob_length && export->format == MDBFS_BACKEND_SQLITE_EXPORT_FORMAT_CSV))
+        text_append_char(text, '"');
+      break;
+    }
+
+    case SQLITE_TEXT:
+    default: {
+      const char *str = (const char *)sqlite3_column_text(stmt, icol);
+      size_t str_length = sqlite3_column_bytes(stmt, icol);
+
+      if (json)
+        text_append_json(text, str, str_length);
+      else if (export->format == MDBFS_BACKEND_SQLITE_EXPORT_FORMAT_TSV)
+        text_append_tsv(text, str, str_length);
+      else
+        text_append_csv(text, str, str_length);
+      break;
+    }
+  }
+}
+
+/**
+ * Append a column name in the format of the export.
+ */
+static void export_append_name(struct mdbfs_backend_sqlite_export *export, const char *name)
+{
+  struct text *text = &export->window;
+
+  if (export->format == MDBFS_BACKEND_SQLITE_EXPORT_FORMAT_TSV)
+    text_append_tsv(text, name, strlen(name));
+  else if (export->format == MDBFS_BACKEND_SQLITE_EXPORT_FORMAT_CSV)
+    text_append_csv(text, name, strlen(name));
+  else
+    text_append_json(text, name, strlen(name));
+}
+
+/**
+ * Generate the next piece of the file (the header, or one row) at the end of
+ * the window.
+ *
+ * Tables are scanned page by page, each page from where the last one ended
+ * (by ROWID, or by position for views), so that the statement can be reset
+ * between reads instead of holding a read transaction open.
+ *
+ * @return 0 on success, -1 on database errors.
+ */
+static int export_generate(struct mdbfs_backend_sqlite_export *export)
+{
+  if (!export->stmt) {
+    export->stmt = mdbfs_backend_sqlite_prepare_select(export->table_name, export->row_name, &export->keyed);
+    if (!export->stmt)
+      return -1;
+
+    export->next = export->keyed ? INT64_MIN : 0;
+    export->page_rows = -1;
+  }
+
+  /* Pages lead with their key, which is not exported */
+  int first = export->row_name ? 0 : 1;
+  int ncol = sqlite3_column_count(export->stmt);
+  char separator = export->format == MDBFS_BACKEND_SQLITE_EXPORT_FORMAT_TSV ? '\t' : ',';
+
+  if (!export->header_done) {
+    export->header_done = 1;
+
+    if (export->format == MDBFS_BACKEND_SQLITE_EXPORT_FORMAT_CSV ||
+        export->format == MDBFS_BACKEND_SQLITE_EXPORT_FORMAT_TSV) {
+      for (int icol = first; icol < ncol; icol++) {
+        if (icol > first)
+          text_append_char(&export->window, separator);
+        export_append_name(export, sqlite3_column_name(export->stmt, icol));
+      }
+      text_append_char(&export->window, '\n');
+      return 0;
+    }
+  }
+
+  int r = 0;
+
+  for (;;) {
+    if (!export->row_name && export->page_rows < 0) {
+      sqlite3_reset(export->stmt);
+      sqlite3_bind_int64(export->stmt, 1, export->next);
+      sqlite3_bind_int64(export->stmt, 2, MDBFS_SQLITE_EXPORT_PAGE_ROWS);
+      export->page_rows = 0;
+    }
+
+    r = sqlite3_step(export->stmt);
+
+    /* A full page may be followed by another */
+    if (r == SQLITE_DONE && !export->row_name && export->page_rows == MDBFS_SQLITE_EXPORT_PAGE_ROWS) {
+      export->page_rows = -1;
+      continue;
+    }
+
+    break;
+  }
+
+  if (r == SQLITE_DONE) {
+    export->done = 1;
+    return 0;
+  }
+
+  if (r != SQLITE_ROW) {
+    mdbfs_warning("sqlite: export: sqlite3 reported an error while scanning \"%s\": %s", export->table_name, sqlite3_errstr(r));
+    return -1;
+  }
+
+  if (!export->row_name) {
+    export->page_rows++;
+
+    if (!export->keyed) {
+      export->next++;
+    } else {
+      int64_t rowid = sqlite3_column_int64(export->stmt, 0);
+
+      /* Nothing comes after the highest ROWID there can be */
+      if (rowid == INT64_MAX)
+        export->done = 1;
+      else
+        export->next = rowid + 1;
+    }
+  }
+
+  if (export->format == MDBFS_BACKEND_SQLITE_EXPORT_FORMAT_JSONL ||
+      export->format == MDBFS_BACKEND_SQLITE_EXPORT_FORMAT_JSON) {
+    text_append_char(&export->window, '{');
+    for (int icol = first; icol < ncol; icol++) {
+      if (icol > first)
+        text_append_char(&export->window, ',');
+      export_append_name(export, sqlite3_column_name(export->stmt, icol));
+      text_append_char(&export->window, ':');
+      export_append_value(export, icol);
+    }
+    text_append_str(&export->window, "}\n");
+  } else {
+    for (int icol = first; icol < ncol; icol++) {
+      if (icol > first)
+        text_append_char(&export->window, separator);
+      export_append_value(export, icol);
+    }
+    text_append_char(&export->window, '\n');
+  }
+
+  /* A row file holds exactly one row */
+  if (export->row_name)
+    export->done = 1;
+
+  return 0;
+}
+
+/**
+ * Throw away everything generated, so that the file is generated again from
+ * the beginning.
+ */
+static void export_restart(struct mdbfs_backend_sqlite_export *export)
+{
+  mdbfs_debug("sqlite: export: restarting \"%s\" from the beginning", export->table_name);
+
+  sqlite3_finalize(export->stmt);
+  export->stmt = NULL;
+  export->header_done = 0;
+  export->done = 0;
+  export->window.length = 0;
+  export->window_offset = 0;
+}
+
+/********** Public APIs **********/
+
+enum mdbfs_backend_sqlite_export_format mdbfs_backend_sqlite_export_format_from_name(const char *name, size_t *name_length)
+{
+  if (!name)
+    return MDBFS_BACKEND_SQLITE_EXPORT_FORMAT_NONE;
+
+  size_t length = strlen(name);
+
+  for (int i = 0; export_suffixes[i].suffix; i++) {
+    size_t suffix_length = strlen(export_suffixes[i].suffix);
+
+    if (length > suffix_length && strcmp(name + length - suffix_length, export_suffixes[i].suffix) == 0) {
+      if (name_length)
+        *name_length = length - suffix_length;
+      return export_suffixes[i].format;
+    }
+  }
+
+  return MDBFS_BACKEND_SQLITE_EXPORT_FORMAT_NONE;
+}
+
+struct mdbfs_backend_sqlite_export *mdbfs_backend_sqlite_export_open(enum mdbfs_backend_sqlite_export_format format, const char *table_name, const char *row_name)
+{
+  struct mdbfs_backend_sqlite_export *ret = mdbfs_malloc0(sizeof(struct mdbfs_backend_sqlite_export));
+
+  ret->format = format;
+
+  ret->table_name = mdbfs_malloc0(strlen(table_name) + 1);
+  strcpy(ret->table_name, table_name);
+
+  if (row_name) {
+    ret->row_name = mdbfs_malloc0(strlen(row_name) + 1);
+    strcpy(ret->row_name, row_name);
+  }
+
+  pthread_mutex_init(&ret->lock, NULL);
+
+  return ret;
+}
+
+int64_t mdbfs_backend_sqlite_export_read(struct mdbfs_backend_sqlite_export *export, char *buf, size_t bufsize, int64_t offset)
+{
+  int64_t ret = 0;
+
+  pthread_mutex_lock(&export->lock);
+
+  /* What is before the window has been thrown away; start over */
+  if (offset < export->window_offset)
+    export_restart(export);
+
+  for (;;) {
+    /* Forget what is before the offset, so that the window only holds what is
+     * yet to be read
+     */
+    if (offset > export->window_offset) {
+      size_t drop = offset - export->window_offset;
+      if (drop > export->window.length)
+        drop = export->window.length;
+
+      memmove(export->window.data, export->window.data + drop, export->window.length - drop);
+      export->window.length -= drop;
+      export->window_offset += drop;
+    }
+
+    if (export->window_offset == offset && export->window.length >= bufsize)
+      break;
+
+    if (export->done)
+      break;
+
+    /* A scan that has failed (e.g. been interrupted) cannot go on; the next
+     * read starts over
+     */
+    if (export_generate(export) < 0) {
+      export_restart(export);
+      ret = -1;
+      goto quit;
+    }
+  }
+
+  /* The file ends before the offset */
+  if (export->window_offset != offset)
+    goto quit;
+
+  ret = export->window.length < bufsize ? export->window.length : bufsize;
+  memcpy(buf, export->window.data, ret);
+
+quit:
+  /* Nothing is left stepped between reads, so that the database is not held
+   * by a reader which may never come back; the scan goes on with a new page
+   */
+  if (export->stmt) {
+    sqlite3_reset(export->stmt);
+    export->page_rows = -1;
+  }
+
+  pthread_mutex_unlock(&export->lock);
+  return ret;
+}
+
+void mdbfs_backend_sqlite_export_close(struct mdbfs_backend_sqlite_export *export)
+{
+  if (!export)
+    return;
+
+  sqlite3_finalize(export->stmt);
+  pthread_mutex_destroy(&export->lock);
+
+  mdbfs_free(export->window.data);
+  mdbfs_free(export->table_name);
+  mdbfs_free(export->row_name);
+  mdbfs_free(export);
+}
@@ -0,0 +1,76 @@
+/**
+ * @file export.h
+ *
+ * Definition of serialized (whole-table and whole-row) files for the MDBFS
+ * SQLite backend.
+ *
+ * An export is generated incrementally from one sequential scan as the reader
+ * advances, so that a table is never materialized in memory. Reading at an
+ * offset before what has been generated restarts the scan, so that any offset
+ * can be read, with sequential reading being the fast path.
+ */
+
+#ifndef MDBFS_BACKENDS_SQLITE_EXPORT_H
+#define MDBFS_BACKENDS_SQLITE_EXPORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Format of a serialized file.
+ */
+enum mdbfs_backend_sqlite_export_format {
+  MDBFS_BACKEND_SQLITE_EXPORT_FORMAT_NONE = 0, ///< Not a serialized file
+  MDBFS_BACKEND_SQLITE_EXPORT_FORMAT_CSV,      ///< RFC 4180 CSV with a header
+  MDBFS_BACKEND_SQLITE_EXPORT_FORMAT_TSV,      ///< Tab-separated, with a header
+  MDBFS_BACKEND_SQLITE_EXPORT_FORMAT_JSONL,    ///< One JSON object per line
+  MDBFS_BACKEND_SQLITE_EXPORT_FORMAT_JSON,     ///< One JSON object
+};
+
+/**
+ * An open serialized file.
+ */
+struct mdbfs_backend_sqlite_export;
+
+/**
+ * Tell the format of a serialized file from its name.
+ *
+ * @param name        [in]  The file name.
+ * @param name_length [out] Length of the name without the suffix.
+ * @return The format, or `MDBFS_BACKEND_SQLITE_EXPORT_FORMAT_NONE` if the name
+ *         does not have a known suffix.
+ */
+enum mdbfs_backend_sqlite_export_format mdbfs_backend_sqlite_export_format_from_name(const char *name, size_t *name_length);
+
+/**
+ * Open a serialized file of a table, or of one row in it.
+ *
+ * Nothing is read from the database until the first read.
+ *
+ * @param format     [in] Format of the file.
+ * @param table_name [in] Name of the table (or view).
+ * @param row_name   [in] Name of the row, or NULL for the whole table.
+ * @return The open file. The caller is responsible for closing it with
+ *         mdbfs_backend_sqlite_export_close.
+ */
+struct mdbfs_backend_sqlite_export *mdbfs_backend_sqlite_export_open(enum mdbfs_backend_sqlite_export_format format, const char *table_name, const char *row_name);
+
+/**
+ * Read from a serialized file.
+ *
+ * @param export  [in]  The open file.
+ * @param buf     [out] The buffer to put content in.
+ * @param bufsize [in]  Size of the buffer.
+ * @param offset  [in]  Offset from which the file should be read.
+ * @return Bytes read (0 at the end of file), or -1 on database errors.
+ */
+int64_t mdbfs_backend_sqlite_export_read(struct mdbfs_backend_sqlite_export *export, char *buf, size_t bufsize, int64_t offset);
+
+/**
+ * Close a serialized file and free related resources.
+ *
+ * @param export [in] The open file. May be NULL.
+ */
+void mdbfs_backend_sqlite_export_close(struct mdbfs_backend_sqlite_export *export);
+
+#endif
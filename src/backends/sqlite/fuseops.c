@@ -5,25 +5,107 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include "utils/cancel.h"
+#include "utils/format.h"
 #include "utils/memory.h"
+#include "utils/metrics.h"
 #include "utils/path.h"
 #include "utils/print.h"
 #include "dbmgr.h"
+#include "export.h"
+#include "import.h"
 #include "fuseops.h"
 
 /********** Private APIs **********/
 
+/**
+ * Mode of fallocate(2) only allocating the range without growing the file,
+ * which <fcntl.h> declares only for _GNU_SOURCE.
+ */
+#ifndef FALLOC_FL_KEEP_SIZE
+#define FALLOC_FL_KEEP_SIZE 0x01
+#endif
+
+/**
+ * Name of the virtual directory under a table holding index-backed lookups.
+ */
+#define MDBFS_SQLITE_INDEX_DIR ".by"
+
+/**
+ * Name of the virtual directory at the root holding ad-hoc queries.
+ */
+#define MDBFS_SQLITE_QUERY_DIR ".query"
+
+/**
+ * Suffix of the files in the query directory holding the SQL of queries.
+ */
+#define MDBFS_SQLITE_QUERY_SUFFIX ".sql"
+
+/**
+ * Name of the file under a table into which rows are imported in bulk.
+ */
+#define MDBFS_SQLITE_IMPORT_FILE ".import"
+
+/**
+ * Name of the file at the root holding metrics of the file system.
+ */
+#define MDBFS_SQLITE_METRICS_FILE ".metrics"
+
+/**
+ * Extended attributes, see _getxattr.
+ */
+#define MDBFS_SQLITE_XATTR_KIND     "user.mdbfs.kind"
+#define MDBFS_SQLITE_XATTR_ROWS     "user.mdbfs.rows"
+#define MDBFS_SQLITE_XATTR_ROWID    "user.mdbfs.rowid"
+#define MDBFS_SQLITE_XATTR_TYPE     "user.mdbfs.type"
+#define MDBFS_SQLITE_XATTR_DECLTYPE "user.mdbfs.decltype"
+
+/**
+ * Maximum number of components a legitimate path in this backend can have
+ * (`/D/T/.by/C/V/R`, or `/D/T/B/B/R/C`, with databases attached).
+ */
+#define MDBFS_SQLITE_PATH_MAX_COMPONENTS 6
+
+/**
+ * Rows per bucket when rows of tables are fanned out into buckets, or 0 if
+ * they are right in their tables, see mdbfs_backend_sqlite_set_fanout.
+ *
+ * A directory of millions of rows is more than `ls`, shell globs and many
+ * other tools can cope with, so with `--fanout=N`, rows of tables are put two
+ * buckets down instead, as `/T/B1/B2/R/C` (see mdbfs_sqlite_rowid_buckets),
+ * so that every directory holds at most about N entries when ROWIDs are mostly
+ * consecutive. Buckets holding no rows are not listed, but are there to create
+ * rows in, and a path still leads to its row in one lookup. Views and queries
+ * are not fanned out.
+ */
+static int64_t g_fanout = 0;
+
 /**
  * Type of a path in this backend, used in `struct mdbfs_sqlite_path`.
  */
 enum mdbfs_sqlite_path_type {
-  MDBFS_SQLITE_PATH_TYPE_DATABASE, ///< The path is pointing at database level.
-  MDBFS_SQLITE_PATH_TYPE_TABLE,    ///< The path is pointing at table level.
-  MDBFS_SQLITE_PATH_TYPE_ROW,      ///< The path is pointing at row level.
-  MDBFS_SQLITE_PATH_TYPE_COLUMN,   ///< The path is pointing to column level.
+  MDBFS_SQLITE_PATH_TYPE_DATABASES,    ///< The path is pointing at `/`, above attached databases.
+  MDBFS_SQLITE_PATH_TYPE_DATABASE,     ///< The path is pointing at database level.
+  MDBFS_SQLITE_PATH_TYPE_TABLE,        ///< The path is pointing at table level.
+  MDBFS_SQLITE_PATH_TYPE_ROW,          ///< The path is pointing at row level.
+  MDBFS_SQLITE_PATH_TYPE_COLUMN,       ///< The path is pointing to column level.
+  MDBFS_SQLITE_PATH_TYPE_INDEX_ROOT,   ///< The path is pointing at `/T/.by`.
+  MDBFS_SQLITE_PATH_TYPE_INDEX_COLUMN, ///< The path is pointing at `/T/.by/C`.
+  MDBFS_SQLITE_PATH_TYPE_INDEX_VALUE,  ///< The path is pointing at `/T/.by/C/V`.
+  MDBFS_SQLITE_PATH_TYPE_INDEX_ENTRY,  ///< The path is pointing to `/T/.by/C/V/R`.
+  MDBFS_SQLITE_PATH_TYPE_QUERY_ROOT,   ///< The path is pointing at `/.query`.
+  MDBFS_SQLITE_PATH_TYPE_QUERY_FILE,   ///< The path is pointing to `/.query/Q.sql`.
+  MDBFS_SQLITE_PATH_TYPE_EXPORT_TABLE, ///< The path is pointing to `/T.csv` (etc.).
+  MDBFS_SQLITE_PATH_TYPE_EXPORT_ROW,   ///< The path is pointing to `/T/R.json`.
+  MDBFS_SQLITE_PATH_TYPE_IMPORT,       ///< The path is pointing to `/T/.import`.
+  MDBFS_SQLITE_PATH_TYPE_METRICS,      ///< The path is pointing to `/.metrics`.
+  MDBFS_SQLITE_PATH_TYPE_BUCKET,       ///< The path is pointing at `/T/B` or `/T/B/B`.
 };
 
 /**
@@ -31,9 +113,15 @@ enum mdbfs_sqlite_path_type {
  */
 struct mdbfs_sqlite_path {
   enum mdbfs_sqlite_path_type type; ///< Where the path is pointing to
-  char *table;  ///< Table name (1st component in the path)
-  char *row;    ///< Row name (2nd component in the path)
+  char *database; ///< Database name, if databases are attached (taken out of the path)
+  char *table;  ///< Table name (1st component in the path, `D/T` if databases are attached)
+  char *row;    ///< Row name (2nd component, or 5th in index lookups)
   char *column; ///< Column name (3rd component in the path)
+  char *value;  ///< Value looked up in an index (4th component in the path)
+  int   query;  ///< Whether `table` is a query under `/.query`
+  int   nbuckets;   ///< Buckets in the path when rows are fanned out (0 to 2)
+  int64_t buckets[2]; ///< The buckets (2nd and 3rd components in the path)
+  enum mdbfs_backend_sqlite_export_format format; ///< Format of a serialized file
 };
 
 /**
@@ -42,18 +130,156 @@ struct mdbfs_sqlite_path {
  * Note that this only frees the content of the structure, not the structure
  * itself. Use mdbfs_free to free the structure itself.
  *
- * @param sqlite_path [in] `struct mdbfs_sqlite_path` to free.
+ * @param sqlite_path [in] `struct mdbfs_sqlite_path` to free. May be NULL.
  */
 static void mdbfs_sqlite_path_free(struct mdbfs_sqlite_path *sqlite_path)
 {
+  if (!sqlite_path)
+    return;
+
+  /* The database has been in use since the path was parsed, if anything in
+   * it is pointed at
+   */
+  if (sqlite_path->type != MDBFS_SQLITE_PATH_TYPE_DATABASE)
+    mdbfs_backend_sqlite_release_database(sqlite_path->database);
+
+  mdbfs_free(sqlite_path->database);
   mdbfs_free(sqlite_path->table);
   mdbfs_free(sqlite_path->row);
   mdbfs_free(sqlite_path->column);
+  mdbfs_free(sqlite_path->value);
+}
+
+/**
+ * Divide, rounding down rather than towards zero, so that negative ROWIDs are
+ * put in buckets of their own.
+ */
+static int64_t mdbfs_sqlite_floor_div(int64_t dividend, int64_t divisor)
+{
+  int64_t quotient = dividend / divisor;
+
+  if (dividend % divisor < 0)
+    quotient -= 1;
+
+  return quotient;
+}
+
+/**
+ * Parse a number in a path, which must be written exactly as it is formatted
+ * (e.g. no leading zeros), so that every row and bucket has one name only.
+ *
+ * @param name   [in]  The component of the path.
+ * @param min    [in]  Lowest number allowed.
+ * @param max    [in]  Highest number allowed.
+ * @param number [out] The number.
+ * @return 1 if the name is such a number, 0 otherwise.
+ */
+static int mdbfs_sqlite_number_from_string(const char *name, int64_t min, int64_t max, int64_t *number)
+{
+  char formatted[MDBFS_FORMAT_NUMBER_MAX];
+  char *end = NULL;
+
+  if (!name || !*name)
+    return 0;
+
+  long long value = strtoll(name, &end, 10);
+  if (*end)
+    return 0;
+
+  formatted[mdbfs_format_int64(formatted, value)] = '\0';
+  if (strcmp(formatted, name) != 0 || value < min || value > max)
+    return 0;
+
+  *number = value;
+  return 1;
+}
+
+/**
+ * Tell the buckets a row is put in when rows are fanned out: the ROWID divided
+ * by the square of the fan-out, then the ROWID divided by the fan-out within
+ * that.
+ *
+ * @param rowid   [in]  ROWID of the row.
+ * @param buckets [out] The two buckets.
+ */
+static void mdbfs_sqlite_rowid_buckets(int64_t rowid, int64_t buckets[2])
+{
+  buckets[0] = mdbfs_sqlite_floor_div(rowid, g_fanout * g_fanout);
+  buckets[1] = mdbfs_sqlite_floor_div(rowid, g_fanout) - buckets[0] * g_fanout;
+}
+
+/**
+ * Tell the ROWIDs a bucket in a path spans.
+ *
+ * @param sqlite_path [in]  A path of `MDBFS_SQLITE_PATH_TYPE_BUCKET`.
+ * @param first       [out] Lowest ROWID in the bucket.
+ * @param last        [out] Highest ROWID in the bucket.
+ */
+static void mdbfs_sqlite_path_bucket_range(const struct mdbfs_sqlite_path *sqlite_path, int64_t *first, int64_t *last)
+{
+  int64_t width  = sqlite_path->nbuckets == 1 ? g_fanout * g_fanout : g_fanout;
+  int64_t bucket = sqlite_path->nbuckets == 1 ? sqlite_path->buckets[0] : sqlite_path->buckets[0] * g_fanout + sqlite_path->buckets[1];
+
+  /* The lowest and the highest buckets are cut by the range of ROWIDs */
+  *first = bucket < INT64_MIN / width ? INT64_MIN : bucket * width;
+  *last  = *first > INT64_MAX - (width - 1) ? INT64_MAX : *first + (width - 1);
+}
+
+/**
+ * Write the target of the link to a row in an index lookup, e.g.
+ * `../../../R`, or `../../../B/B/R` when rows are fanned out.
+ *
+ * @param buf      [out] The buffer to put the target in. May be NULL.
+ * @param bufsize  [in]  Size of the buffer.
+ * @param row_name [in]  Name of the row.
+ * @return Length of the target, as snprintf(3).
+ */
+static int mdbfs_sqlite_row_link(char *buf, size_t bufsize, const char *row_name)
+{
+  int64_t rowid = 0;
+  int64_t buckets[2] = {0};
+
+  if (!g_fanout || !mdbfs_sqlite_number_from_string(row_name, INT64_MIN, INT64_MAX, &rowid))
+    return snprintf(buf, bufsize, "../../../%s", row_name);
+
+  mdbfs_sqlite_rowid_buckets(rowid, buckets);
+  return snprintf(buf, bufsize, "../../../%lld/%lld/%s", (long long)buckets[0], (long long)buckets[1], row_name);
+}
+
+/**
+ * Tell whether a table is hidden behind a virtual file of the same name, which
+ * mdbfs_sqlite_path_from_string looks up before tables. Such a table cannot be
+ * reached, so it is left out of listings, with a warning.
+ *
+ * @param table_name [in] Name of the table, without its database.
+ * @param top        [in] Whether the table is listed at the root.
+ * @return What hides the table, or NULL if it can be reached.
+ */
+static const char *mdbfs_sqlite_table_hidden_by(const char *table_name, int top)
+{
+  if (top && strcmp(table_name, MDBFS_SQLITE_METRICS_FILE) == 0)
+    return "the metrics file";
+
+  if (top && strcmp(table_name, MDBFS_SQLITE_QUERY_DIR) == 0)
+    return "the query directory";
+
+  /* Rows are exported as JSON beside other rows, not tables */
+  enum mdbfs_backend_sqlite_export_format format = mdbfs_backend_sqlite_export_format_from_name(table_name, NULL);
+  if (format != MDBFS_BACKEND_SQLITE_EXPORT_FORMAT_NONE && format != MDBFS_BACKEND_SQLITE_EXPORT_FORMAT_JSON)
+    return "an exported table";
+
+  return NULL;
 }
 
 /**
  * Convert a legitimate path string into `struct mdbfs_sqlite_path`.
  *
+ * With several databases attached (`--db` given more than once, or as a glob),
+ * each is a directory above its tables, as `/D/T/R/C`, where `D` is the file
+ * name up to its last dot (`shards/eu.db` is `eu`); in a directory of
+ * databases, `D` is the whole file name (`tenants/a.db` is `a.db`). Everything
+ * below `D` is as without it, while `/.query` and `/.metrics` stay at the top.
+ *
  * @param path [in] Path string.
  * @return A `struct mdbfs_sqlite_path` if the path is legitimate. If the path
  *         should not exist in the file system, the function will return NULL.
@@ -75,20 +301,10 @@ static struct mdbfs_sqlite_path *mdbfs_sqlite_path_from_string(const char *path)
   /* Fill the structure with NULL to make it valid */
   struct mdbfs_sqlite_path *ret = mdbfs_malloc0(sizeof(struct mdbfs_sqlite_path));
 
-  const char *p_table  = NULL; /* Pointer to the table component */
-  const char *p_row    = NULL; /* Pointer to the row component */
-  const char *p_column = NULL; /* Pointer to the column component */
-  size_t table_length  = 0;    /* Length of the table component */
-  size_t row_length    = 0;    /* Length of the row component */
-  size_t column_length = 0;    /* Length of the column component */
-
-  /* Special case: root */
-  if (strcmp("/", normalized_path) == 0) {
-    ret->type = MDBFS_SQLITE_PATH_TYPE_DATABASE;
-    goto finish;
-  }
+  char *components[MDBFS_SQLITE_PATH_MAX_COMPONENTS] = {0};
+  size_t ncomponents = 0;
 
-  /* Walk the path:
+  /* Walk the path, cutting it into components:
    *
    *     /path/to/cell
    *      ^   ^
@@ -98,68 +314,538 @@ static struct mdbfs_sqlite_path *mdbfs_sqlite_path_from_string(const char *path)
   const char *p_start = normalized_path + 1;
   const char *p_end   = p_start;
 
-  /* Table */
-  while (*p_end && *p_end != '/')
-    ++p_end;
+  while (*p_start) {
+    while (*p_end && *p_end != '/')
+      ++p_end;
+
+    /* If there is still anything, the path is illegal */
+    if (ncomponents == MDBFS_SQLITE_PATH_MAX_COMPONENTS) {
+      mdbfs_warning("sqlite: the path \"%s\" contains too many components, which is illegal", path);
+      goto illegal;
+    }
+
+    size_t component_length = p_end - p_start;
+    components[ncomponents] = mdbfs_malloc0(component_length + 1);
+    memcpy(components[ncomponents], p_start, component_length);
+    ++ncomponents;
+
+    if (!*p_end)
+      break;
 
-  table_length = p_end - p_start;
-  ret->table = mdbfs_malloc0(table_length + 1);
-  memcpy(ret->table, p_start, table_length);
+    p_start = p_end + 1;
+    p_end = p_start;
+  }
 
-  if (!*p_end) {
-    ret->type = MDBFS_SQLITE_PATH_TYPE_TABLE;
+  if (ncomponents == 1 && strcmp(components[0], MDBFS_SQLITE_METRICS_FILE) == 0) {
+    ret->type = MDBFS_SQLITE_PATH_TYPE_METRICS;
     goto finish;
   }
 
-  p_start = p_end + 1;
-  p_end = p_start;
+  /* Queries are browsed like tables, one level down */
+  if (ncomponents >= 1 && strcmp(components[0], MDBFS_SQLITE_QUERY_DIR) == 0) {
+    size_t suffix_length = strlen(MDBFS_SQLITE_QUERY_SUFFIX);
+
+    if (ncomponents == 1) {
+      ret->type = MDBFS_SQLITE_PATH_TYPE_QUERY_ROOT;
+      goto finish;
+    }
 
-  /* Row */
-  while (*p_end && *p_end != '/')
-    ++p_end;
+    size_t name_length = strlen(components[1]);
+    if (ncomponents == 2 && name_length > suffix_length &&
+        strcmp(components[1] + name_length - suffix_length, MDBFS_SQLITE_QUERY_SUFFIX) == 0) {
+      ret->type  = MDBFS_SQLITE_PATH_TYPE_QUERY_FILE;
+      ret->table = components[1];
+      ret->table[name_length - suffix_length] = '\0';
+      components[1] = NULL;
+      goto finish;
+    }
 
-  table_length = p_end - p_start;
-  ret->row = mdbfs_malloc0(table_length + 1);
-  memcpy(ret->row, p_start, table_length);
+    mdbfs_free(components[0]);
+    memmove(components, components + 1, (MDBFS_SQLITE_PATH_MAX_COMPONENTS - 1) * sizeof(char *));
+    components[MDBFS_SQLITE_PATH_MAX_COMPONENTS - 1] = NULL;
+    ncomponents -= 1;
+    ret->query = 1;
+  }
 
-  if (!*p_end) {
-    ret->type = MDBFS_SQLITE_PATH_TYPE_ROW;
-    goto finish;
+  /* Attached databases are one level above their tables, which they are
+   * taken out of the path into: /D/T/R/C is parsed as the table "D/T" (see
+   * mdbfs_backend_sqlite_set_databases). Once anything in it is pointed at,
+   * the database is in use until the path is freed, so that it is not closed
+   * meanwhile (see mdbfs_backend_sqlite_set_database_dir)
+   */
+  if (mdbfs_backend_sqlite_has_databases() && !ret->query) {
+    if (ncomponents == 0) {
+      ret->type = MDBFS_SQLITE_PATH_TYPE_DATABASES;
+      goto finish;
+    }
+
+    int found = ncomponents == 1 ? mdbfs_backend_sqlite_database_exists(components[0]) : mdbfs_backend_sqlite_use_database(components[0]);
+    if (!found) {
+      mdbfs_warning("sqlite: the path \"%s\" is not in an attached database, which is illegal", path);
+      goto illegal;
+    }
+
+    if (ncomponents >= 2) {
+      char *table = mdbfs_malloc0(strlen(components[0]) + 1 + strlen(components[1]) + 1);
+      strcat(table, components[0]);
+      strcat(table, "/");
+      strcat(table, components[1]);
+      mdbfs_free(components[1]);
+      components[1] = table;
+    }
+
+    ret->database = components[0];
+    memmove(components, components + 1, (MDBFS_SQLITE_PATH_MAX_COMPONENTS - 1) * sizeof(char *));
+    components[MDBFS_SQLITE_PATH_MAX_COMPONENTS - 1] = NULL;
+    ncomponents -= 1;
   }
 
-  p_start = p_end + 1;
-  p_end = p_start;
+  /* Rows fanned out are two buckets down in their tables; the buckets are
+   * taken out of the path, and the rest is parsed as if rows were right in
+   * their tables (see mdbfs_backend_sqlite_set_fanout)
+   */
+  if (g_fanout && !ret->query && ncomponents >= 2 &&
+      strcmp(components[1], MDBFS_SQLITE_INDEX_DIR) != 0 &&
+      strcmp(components[1], MDBFS_SQLITE_IMPORT_FILE) != 0 &&
+      mdbfs_backend_sqlite_get_table_type(components[0]) == MDBFS_BACKEND_SQLITE_TABLE_TYPE_TABLE) {
+    int64_t width = g_fanout * g_fanout;
+
+    if (!mdbfs_sqlite_number_from_string(components[1], mdbfs_sqlite_floor_div(INT64_MIN, width), mdbfs_sqlite_floor_div(INT64_MAX, width), &ret->buckets[0])) {
+      mdbfs_warning("sqlite: the path \"%s\" is not in a bucket of rows, which is illegal", path);
+      goto illegal;
+    }
+    ret->nbuckets = 1;
+
+    if (ncomponents >= 3) {
+      int64_t min = mdbfs_sqlite_floor_div(INT64_MIN, g_fanout) - ret->buckets[0] * g_fanout;
+      int64_t max = mdbfs_sqlite_floor_div(INT64_MAX, g_fanout) - ret->buckets[0] * g_fanout;
+
+      if (!mdbfs_sqlite_number_from_string(components[2], min > 0 ? min : 0, max < g_fanout - 1 ? max : g_fanout - 1, &ret->buckets[1])) {
+        mdbfs_warning("sqlite: the path \"%s\" is not in a bucket of rows, which is illegal", path);
+        goto illegal;
+      }
+      ret->nbuckets = 2;
+    }
 
-  /* Column */
-  while (*p_end && *p_end != '/')
-    ++p_end;
+    if (ncomponents <= 3) {
+      ret->type  = MDBFS_SQLITE_PATH_TYPE_BUCKET;
+      ret->table = components[0];
+      components[0] = NULL;
+      goto finish;
+    }
 
-  table_length = p_end - p_start;
-  ret->column = mdbfs_malloc0(table_length + 1);
-  memcpy(ret->column, p_start, table_length);
+    mdbfs_free(components[1]);
+    mdbfs_free(components[2]);
+    memmove(components + 1, components + 3, (MDBFS_SQLITE_PATH_MAX_COMPONENTS - 3) * sizeof(char *));
+    components[MDBFS_SQLITE_PATH_MAX_COMPONENTS - 2] = components[MDBFS_SQLITE_PATH_MAX_COMPONENTS - 1] = NULL;
+    ncomponents -= 2;
+  }
 
-  if (!*p_end) {
-    ret->type = MDBFS_SQLITE_PATH_TYPE_COLUMN;
+  /* Rows are imported into a table through a file beside them */
+  if (ncomponents == 2 && strcmp(components[1], MDBFS_SQLITE_IMPORT_FILE) == 0) {
+    ret->type  = MDBFS_SQLITE_PATH_TYPE_IMPORT;
+    ret->table = components[0];
+    components[0] = NULL;
     goto finish;
   }
 
-  p_start = p_end + 1;
-  p_end = p_start;
+  /* Serialized files carry the name of their table or row before a suffix */
+  if (ncomponents == 1 || (ncomponents == 2 && strcmp(components[1], MDBFS_SQLITE_INDEX_DIR) != 0)) {
+    char *name = components[ncomponents - 1];
+    size_t name_length = 0;
+    enum mdbfs_backend_sqlite_export_format format = mdbfs_backend_sqlite_export_format_from_name(name, &name_length);
+
+    /* Tables are exported as a whole in CSV, TSV or JSON Lines; rows as JSON */
+    if (format != MDBFS_BACKEND_SQLITE_EXPORT_FORMAT_NONE &&
+        (format == MDBFS_BACKEND_SQLITE_EXPORT_FORMAT_JSON) == (ncomponents == 2)) {
+      name[name_length] = '\0';
+
+      ret->type   = ncomponents == 1 ? MDBFS_SQLITE_PATH_TYPE_EXPORT_TABLE : MDBFS_SQLITE_PATH_TYPE_EXPORT_ROW;
+      ret->format = format;
+      ret->table  = components[0];
+      ret->row    = components[1];
+      components[0] = components[1] = NULL;
+      goto finish;
+    }
+  }
+
+  /* Components are moved into the structure as they are classified */
+  int is_index = ncomponents >= 2 && strcmp(components[1], MDBFS_SQLITE_INDEX_DIR) == 0;
+
+  switch (ncomponents) {
+    case 0:
+      ret->type = MDBFS_SQLITE_PATH_TYPE_DATABASE;
+      break;
+    case 1:
+      ret->type = MDBFS_SQLITE_PATH_TYPE_TABLE;
+      break;
+    case 2:
+      ret->type = is_index ? MDBFS_SQLITE_PATH_TYPE_INDEX_ROOT : MDBFS_SQLITE_PATH_TYPE_ROW;
+      break;
+    case 3:
+      ret->type = is_index ? MDBFS_SQLITE_PATH_TYPE_INDEX_COLUMN : MDBFS_SQLITE_PATH_TYPE_COLUMN;
+      break;
+    case 4:
+      ret->type = MDBFS_SQLITE_PATH_TYPE_INDEX_VALUE;
+      break;
+    case 5:
+      ret->type = MDBFS_SQLITE_PATH_TYPE_INDEX_ENTRY;
+      break;
+    default:
+      mdbfs_warning("sqlite: the path \"%s\" contains too many components, which is illegal", path);
+      goto illegal;
+  }
 
-  /* If there is still anything, the path is illegal */
-  mdbfs_warning("sqlite: the path \"%s\" contains more than 3 components, which is illegal", path);
-  mdbfs_free(ret->table);
-  mdbfs_free(ret->row);
-  mdbfs_free(ret->column)
-  mdbfs_free(ret);
-  mdbfs_free(normalized_path);
-  return NULL;
+  if (ncomponents > 3 && !is_index) {
+    mdbfs_warning("sqlite: the path \"%s\" contains more than 3 components, which is illegal", path);
+    goto illegal;
+  }
+
+  if (ncomponents >= 1) {
+    ret->table = components[0];
+    components[0] = NULL;
+  }
+
+  if (is_index) {
+    ret->column = components[2];
+    ret->value  = components[3];
+    ret->row    = components[4];
+    components[2] = components[3] = components[4] = NULL;
+  } else {
+    ret->row    = components[1];
+    ret->column = components[2];
+    components[1] = components[2] = NULL;
+  }
 
 finish:
+  /* Rows fanned out are found in their own buckets only */
+  if (ret->nbuckets == 2 && ret->type != MDBFS_SQLITE_PATH_TYPE_BUCKET) {
+    int64_t rowid = 0;
+    int64_t buckets[2] = {0};
+
+    if (!mdbfs_sqlite_number_from_string(ret->row, INT64_MIN, INT64_MAX, &rowid)) {
+      mdbfs_warning("sqlite: the path \"%s\" does not lead to a row in its bucket, which is illegal", path);
+      goto illegal;
+    }
+
+    mdbfs_sqlite_rowid_buckets(rowid, buckets);
+    if (buckets[0] != ret->buckets[0] || buckets[1] != ret->buckets[1]) {
+      mdbfs_warning("sqlite: the row in the path \"%s\" belongs to another bucket, which is illegal", path);
+      goto illegal;
+    }
+  }
+
   mdbfs_debug("sqlite: legitimate path %s", path);
 
+  for (size_t i = 0; i < MDBFS_SQLITE_PATH_MAX_COMPONENTS; i++)
+    mdbfs_free(components[i]);
   mdbfs_free(normalized_path);
   return ret;
+
+illegal:
+  for (size_t i = 0; i < MDBFS_SQLITE_PATH_MAX_COMPONENTS; i++)
+    mdbfs_free(components[i]);
+  mdbfs_sqlite_path_free(ret);
+  mdbfs_free(ret);
+  mdbfs_free(normalized_path);
+  return NULL;
+}
+
+/**
+ * Free a NULL-terminated list of strings returned by the database manager.
+ *
+ * @param list [in] The list to free. May be NULL.
+ */
+static void mdbfs_sqlite_list_free(char **list)
+{
+  if (!list)
+    return;
+
+  for (int i = 0; list[i]; i++)
+    mdbfs_free(list[i]);
+  mdbfs_free(list);
+}
+
+/**
+ * Check whether a string appears in a NULL-terminated list of strings.
+ *
+ * @param list [in] The list to search in.
+ * @param str  [in] The string to look for.
+ * @return 1 if found, 0 otherwise.
+ */
+static int mdbfs_sqlite_list_contains(char **list, const char *str)
+{
+  if (!list || !str)
+    return 0;
+
+  for (int i = 0; list[i]; i++)
+    if (strcmp(list[i], str) == 0)
+      return 1;
+
+  return 0;
+}
+
+/**
+ * Tell what the table in a path is, without touching any row.
+ *
+ * Queries under `/.query` are views which exist once their SQL is written and
+ * defined (see _flush).
+ *
+ * @param sqlite_path [in] A path with a table component.
+ * @return Type of the table, or `MDBFS_BACKEND_SQLITE_TABLE_TYPE_NONE` if it
+ *         does not exist.
+ */
+static enum mdbfs_backend_sqlite_table_type mdbfs_sqlite_path_table_type(const struct mdbfs_sqlite_path *sqlite_path)
+{
+  if (!sqlite_path->query)
+    return mdbfs_backend_sqlite_get_table_type(sqlite_path->table);
+
+  if (mdbfs_backend_sqlite_query_is_defined(sqlite_path->table))
+    return MDBFS_BACKEND_SQLITE_TABLE_TYPE_VIEW;
+  else
+    return MDBFS_BACKEND_SQLITE_TABLE_TYPE_NONE;
+}
+
+/**
+ * Tell whether a path points to a serialized file.
+ */
+static int mdbfs_sqlite_path_is_export(const struct mdbfs_sqlite_path *sqlite_path)
+{
+  return sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_EXPORT_TABLE ||
+         sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_EXPORT_ROW;
+}
+
+/**
+ * State of a paged listing of rows, see _readdir.
+ */
+struct mdbfs_sqlite_readdir_page {
+  void *buf;                      ///< The buffer to receive directory information
+  fuse_fill_dir_t filler;         ///< The function provided by FUSE to fill `buf`
+  enum fuse_fill_dir_flags flags; ///< How to fill `buf`
+  int full;                       ///< Whether `buf` has been filled up
+};
+
+/**
+ * Send a row to FUSE, stopping the walk once its buffer is full.
+ */
+static int mdbfs_sqlite_readdir_page_fill(const char *row_name, int64_t next_offset, void *data)
+{
+  struct mdbfs_sqlite_readdir_page *page = data;
+  struct stat attr = {0};
+
+  attr.st_mode = S_IFDIR | S_IRUSR | S_IWUSR | S_IXUSR | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH;
+
+  page->full = page->filler(page->buf, row_name, &attr, next_offset, page->flags);
+  return page->full;
+}
+
+/**
+ * State of a paged listing of buckets, see mdbfs_sqlite_readdir_buckets.
+ */
+struct mdbfs_sqlite_readdir_buckets {
+  struct mdbfs_sqlite_readdir_page *page; ///< The listing
+  int64_t origin;    ///< Bucket listed at offset 1
+  int64_t name_base; ///< Bucket named 0
+};
+
+/**
+ * Send a bucket to FUSE, stopping the walk once its buffer is full.
+ */
+static int mdbfs_sqlite_readdir_buckets_fill(int64_t bucket, void *data)
+{
+  struct mdbfs_sqlite_readdir_buckets *buckets = data;
+  char name[MDBFS_FORMAT_NUMBER_MAX];
+
+  name[mdbfs_format_int64(name, bucket - buckets->name_base)] = '\0';
+
+  return mdbfs_sqlite_readdir_page_fill(name, bucket - buckets->origin + 1, buckets->page);
+}
+
+/**
+ * An open directory of a table, see _opendir.
+ */
+struct mdbfs_sqlite_dir {
+  struct mdbfs_backend_sqlite_rowids *rowids; ///< Taken when listing from the start
+};
+
+/**
+ * Type of what an open file keeps, see `struct mdbfs_sqlite_file`.
+ */
+enum mdbfs_sqlite_file_type {
+  MDBFS_SQLITE_FILE_TYPE_EXPORT, ///< A `struct mdbfs_backend_sqlite_export`
+  MDBFS_SQLITE_FILE_TYPE_IMPORT, ///< A `struct mdbfs_backend_sqlite_import`
+};
+
+/**
+ * An open serialized or import file, see _open. Its type is kept along, since
+ * the path may no longer parse by the time the file is released (e.g. once
+ * the table is renamed).
+ */
+struct mdbfs_sqlite_file {
+  enum mdbfs_sqlite_file_type type;
+  void *handle;
+};
+
+/**
+ * Tell what an open file keeps, if it is of the given type.
+ *
+ * @param fileinfo [in] FUSE file information structure. May be NULL.
+ * @param type     [in] Type expected.
+ * @return The export or import, or NULL if there is none of the type.
+ */
+static void *mdbfs_sqlite_file_handle(const struct fuse_file_info *fileinfo, enum mdbfs_sqlite_file_type type)
+{
+  const struct mdbfs_sqlite_file *file = fileinfo ? (const struct mdbfs_sqlite_file *)(uintptr_t)fileinfo->fh : NULL;
+
+  return file && file->type == type ? file->handle : NULL;
+}
+
+/**
+ * Tell that a bucket holds rows, stopping the walk, see _rmdir.
+ */
+static int mdbfs_sqlite_bucket_found(int64_t bucket, void *data)
+{
+  int *empty = data;
+
+  (void)bucket;
+
+  *empty = 0;
+  return 1;
+}
+
+/**
+ * List rows of a table within a range of ROWIDs from an offset, for as many
+ * rows as the buffer of FUSE takes.
+ *
+ * Rows are numbered from 1 in ROWID order. The ROWIDs are taken when listing
+ * from the start, and kept with the open directory until _releasedir.
+ *
+ * @param table_name [in]     Name of the table.
+ * @param first      [in]     Lowest ROWID to list.
+ * @param last       [in]     Highest ROWID to list.
+ * @param offset     [in]     Number of rows already listed.
+ * @param dir        [in,out] The open directory. May be NULL.
+ * @param page       [in,out] The listing.
+ * @return Number of rows in the range if succeeded, negated error codes
+ *         otherwise.
+ */
+static int64_t mdbfs_sqlite_readdir_rows(const char *table_name, int64_t first, int64_t last, off_t offset, struct mdbfs_sqlite_dir *dir, struct mdbfs_sqlite_readdir_page *page)
+{
+  struct mdbfs_backend_sqlite_rowids *rowids = dir ? dir->rowids : NULL;
+
+  if (!rowids || !offset) {
+    mdbfs_backend_sqlite_free_rowids(rowids);
+    rowids = mdbfs_backend_sqlite_get_rowids(table_name, first, last);
+    if (dir)
+      dir->rowids = rowids;
+  }
+
+  if (!rowids)
+    return -ENOENT;
+
+  /* Existence and cell lengths of the rows about to be listed are worked out
+   * a batch of rows per query, so that stat'ing them afterwards (e.g. `ls -l`)
+   * does not take a query per row or cell
+   */
+  mdbfs_backend_sqlite_prefetch_attrs(table_name, rowids, offset);
+
+  int64_t nrows = rowids->count;
+  mdbfs_backend_sqlite_walk_rowids(rowids, offset, mdbfs_sqlite_readdir_page_fill, page);
+
+  if (!dir)
+    mdbfs_backend_sqlite_free_rowids(rowids);
+
+  return nrows;
+}
+
+/**
+ * List buckets of rows within a range of ROWIDs from an offset, for as many
+ * buckets as the buffer of FUSE takes.
+ *
+ * Buckets holding no row are not listed. Each one listed takes a probe for its
+ * lowest ROWID, so that listing them does not scan the rows in them.
+ *
+ * @param table_name [in]     Name of the table.
+ * @param first      [in]     Lowest ROWID in the buckets.
+ * @param last       [in]     Highest ROWID in the buckets.
+ * @param width      [in]     ROWIDs per bucket.
+ * @param name_base  [in]     Bucket to be named 0; others are named by how far
+ *                            they are from it.
+ * @param offset     [in]     Offset of the last bucket already listed.
+ * @param page       [in,out] The listing.
+ * @return Number of offsets taken by the buckets (whether they hold rows or
+ *         not) if succeeded, negated error codes otherwise.
+ */
+static int64_t mdbfs_sqlite_readdir_buckets(const char *table_name, int64_t first, int64_t last, int64_t width, int64_t name_base, off_t offset, struct mdbfs_sqlite_readdir_page *page)
+{
+  struct mdbfs_sqlite_readdir_buckets buckets = {
+    .page      = page,
+    .origin    = mdbfs_sqlite_floor_div(first, width),
+    .name_base = name_base,
+  };
+  int64_t nbuckets = mdbfs_sqlite_floor_div(last, width) - buckets.origin + 1;
+
+  /* Buckets are numbered from 1, whether they hold rows or not, so that the
+   * listing is resumed from the bucket after the last one listed
+   */
+  if (offset >= nbuckets)
+    return nbuckets;
+
+  if (offset) {
+    int64_t next = buckets.origin + offset;
+    first = next < INT64_MIN / width ? INT64_MIN : next * width;
+  }
+
+  if (!mdbfs_backend_sqlite_walk_rowid_buckets(table_name, first, last, width, mdbfs_sqlite_readdir_buckets_fill, &buckets))
+    return -EIO;
+
+  return nbuckets;
+}
+
+/**
+ * List a table from an offset, for as many entries as the buffer of FUSE
+ * takes: its rows (or buckets of them, when rows are fanned out), followed by
+ * index lookups and the import file.
+ *
+ * Entries are numbered from 1: rows in ROWID order (or buckets in order), then
+ * the index lookups and the import file.
+ *
+ * @param table_name [in]     Name of the table.
+ * @param offset     [in]     Number of entries already listed.
+ * @param dir        [in,out] The open directory. May be NULL.
+ * @param page       [in,out] The listing.
+ * @return 0 if succeeded, negated error codes otherwise.
+ */
+static int mdbfs_sqlite_readdir_table(const char *table_name, off_t offset, struct mdbfs_sqlite_dir *dir, struct mdbfs_sqlite_readdir_page *page)
+{
+  struct stat attr = {0};
+  int64_t nentries = 0;
+
+  if (g_fanout)
+    nentries = mdbfs_sqlite_readdir_buckets(table_name, INT64_MIN, INT64_MAX, g_fanout * g_fanout, 0, offset, page);
+  else
+    nentries = mdbfs_sqlite_readdir_rows(table_name, INT64_MIN, INT64_MAX, offset, dir, page);
+
+  if (nentries < 0)
+    return nentries;
+
+  /* Offer index lookups if the table has anything to look up with */
+  if (!page->full && offset <= nentries) {
+    char **indexed_columns = mdbfs_backend_sqlite_get_indexed_column_names(table_name);
+    if (indexed_columns && indexed_columns[0]) {
+      attr.st_mode = S_IFDIR | S_IRUSR | S_IXUSR | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH;
+      page->full = page->filler(page->buf, MDBFS_SQLITE_INDEX_DIR, &attr, nentries + 1, 0);
+    }
+    mdbfs_sqlite_list_free(indexed_columns);
+  }
+
+  /* Rows can be imported into tables */
+  if (!page->full && offset <= nentries + 1) {
+    attr.st_mode = S_IFREG | S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH;
+    page->full = page->filler(page->buf, MDBFS_SQLITE_IMPORT_FILE, &attr, nentries + 2, 0);
+  }
+
+  return 0;
 }
 
 /********** FUSE APIs **********/
@@ -174,6 +860,9 @@ static void *_init(struct fuse_conn_info *conn, struct fuse_config *cfg)
   cfg->use_ino   = 0;
   cfg->direct_io = 1;
 
+  /* Mounted (and daemonized) by now, so warming up stays with us */
+  mdbfs_backend_sqlite_prewarm();
+
   return NULL;
 }
 
@@ -211,6 +900,14 @@ static int _mknod(const char *path, mode_t mode, dev_t device)
     goto quit;
   }
 
+  /* Creating a query file registers a query to be written */
+  if (sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_QUERY_FILE) {
+    r = mdbfs_backend_sqlite_create_query(sqlite_path->table);
+    if (!r)
+      ret = -EEXIST;
+    goto quit;
+  }
+
   /* One cannot create a file on directory (db, table, row) levels */
   if (sqlite_path->type != MDBFS_SQLITE_PATH_TYPE_COLUMN) {
     ret = -EROFS;
@@ -232,6 +929,11 @@ quit:
 /**
  * Rename, cpoy, or move a directory or a file.
  *
+ * Moving a row into another table (`mv /T/1 /U/2`) inserts it there and
+ * removes it from `T` in one transaction, taking the columns both tables have,
+ * even across attached databases; renaming it within its table changes its
+ * ROWID. Tables are not moved between databases.
+ *
  * @param path1 [in] The original path.
  * @param path2 [in] The target path.
  * @parma flags [in] A flag given by FUSE representing a renaming scheme, which
@@ -263,15 +965,22 @@ static int _rename(const char *path1, const char *path2, unsigned int flags)
     goto quit;
   }
 
+  /* Queries are not tables; they are only written and removed */
+  if (sqlite_path_old->query || sqlite_path_new->query) {
+    ret = -EROFS;
+    goto quit;
+  }
+
   /* It's just impossible to move things around */
   if (sqlite_path_old->type != sqlite_path_new->type) {
     ret = -ENOSPC;
     goto quit;
   }
 
-  if (sqlite_path_old->type == MDBFS_SQLITE_PATH_TYPE_DATABASE) {
+  if (sqlite_path_old->type == MDBFS_SQLITE_PATH_TYPE_DATABASES ||
+      sqlite_path_old->type == MDBFS_SQLITE_PATH_TYPE_DATABASE) {
 
-    /* There is no way to rename a root */
+    /* There is no way to rename a root, or an attached database */
     mdbfs_warning("sqlite: rename: cannot rename the root");
     ret = -EROFS;
     goto quit;
@@ -287,8 +996,11 @@ static int _rename(const char *path1, const char *path2, unsigned int flags)
 
   } else if (sqlite_path_old->type == MDBFS_SQLITE_PATH_TYPE_ROW) {
 
-    /* Renaming a row */
-    r = mdbfs_backend_sqlite_rename_row(sqlite_path_old->table, sqlite_path_old->row, sqlite_path_new->row);
+    /* Renaming a row, or moving it into another table */
+    if (strcmp(sqlite_path_old->table, sqlite_path_new->table) == 0)
+      r = mdbfs_backend_sqlite_rename_row(sqlite_path_old->table, sqlite_path_old->row, sqlite_path_new->row);
+    else
+      r = mdbfs_backend_sqlite_move_row(sqlite_path_old->table, sqlite_path_old->row, sqlite_path_new->table, sqlite_path_new->row);
     if (!r) {
       ret = -ENOSPC;
       goto quit;
@@ -303,6 +1015,23 @@ static int _rename(const char *path1, const char *path2, unsigned int flags)
       goto quit;
     }
 
+  } else if (sqlite_path_old->type == MDBFS_SQLITE_PATH_TYPE_INDEX_ROOT ||
+             sqlite_path_old->type == MDBFS_SQLITE_PATH_TYPE_INDEX_COLUMN ||
+             sqlite_path_old->type == MDBFS_SQLITE_PATH_TYPE_INDEX_VALUE ||
+             sqlite_path_old->type == MDBFS_SQLITE_PATH_TYPE_INDEX_ENTRY ||
+             sqlite_path_old->type == MDBFS_SQLITE_PATH_TYPE_QUERY_ROOT ||
+             sqlite_path_old->type == MDBFS_SQLITE_PATH_TYPE_QUERY_FILE ||
+             sqlite_path_old->type == MDBFS_SQLITE_PATH_TYPE_IMPORT ||
+             sqlite_path_old->type == MDBFS_SQLITE_PATH_TYPE_METRICS ||
+             sqlite_path_old->type == MDBFS_SQLITE_PATH_TYPE_BUCKET ||
+             mdbfs_sqlite_path_is_export(sqlite_path_old)) {
+
+    /* Index lookups, queries, imports, serialized files and buckets are views
+     * of tables, not something to rename
+     */
+    ret = -EROFS;
+    goto quit;
+
   } else {
 
     /* Something happened */
@@ -322,31 +1051,64 @@ quit:
 /**
  * Remove a file at path.
  *
- * This always fails, as SQLite does not support dropping columns (which are
- * mapped by files in this driver).
+ * Removing a query file removes the query. Removing a cell drops its column
+ * (from every row) in the table, see mdbfs_backend_sqlite_remove_column: with
+ * `ALTER TABLE DROP COLUMN` where SQLite supports it, or by rebuilding the
+ * table otherwise, which is refused where the column or the table is depended
+ * on, and watched in `/.metrics`. Tables of attached databases are not rebuilt.
  *
  * @param path [in] The file to be removed.
- * @return -EROFS.
+ * @return 0 on success, any negative error code on failure.
  */
 static int _unlink(const char *path)
 {
-  (void)path;
+  struct mdbfs_sqlite_path *sqlite_path = NULL;
+  int ret = 0; /* Value to be returned by the function */
+  int r = 0;   /* Value returned by other functions */
+
+  sqlite_path = mdbfs_sqlite_path_from_string(path);
+  if (!sqlite_path) {
+    ret = -ENOENT;
+    goto quit;
+  }
+
+  if (sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_QUERY_FILE) {
+    r = mdbfs_backend_sqlite_remove_query(sqlite_path->table);
+    if (!r)
+      ret = -ENOENT;
+    goto quit;
+  }
+
+  /* Columns of views and queries are defined by their SELECT */
+  if (sqlite_path->type != MDBFS_SQLITE_PATH_TYPE_COLUMN || sqlite_path->query ||
+      mdbfs_sqlite_path_table_type(sqlite_path) != MDBFS_BACKEND_SQLITE_TABLE_TYPE_TABLE) {
+    ret = -EROFS;
+    goto quit;
+  }
+
+  r = mdbfs_backend_sqlite_remove_column(sqlite_path->table, sqlite_path->column);
+  if (!r) {
+    ret = -EIO;
+    goto quit;
+  }
 
-  return -EROFS;
+quit:
+  mdbfs_sqlite_path_free(sqlite_path);
+  mdbfs_free(sqlite_path);
+  return ret;
 }
 
 /**
  * Create a directory at path.
  *
- * This always fails, since in this backend we do not allow directory creation:
- *
- * - Creating a directory mapping to a table creates a table without any column,
- *   which is illegal.
- * - Creating a directory mapping to a row creates a row, but the name of the
- *   directory is hard to validate.
+ * Creating a directory in a table creates a row, whose name is its ROWID, with
+ * every other column set to its default. Rows created in quick succession are
+ * committed together (see mdbfs_backend_sqlite_create_row). As those rows have
+ * been reported created, the batch is never rolled back: while the database is
+ * locked by someone else, it stays open and is committed later.
  *
- * Thus, this function always return -EROFS (read-only file system), although in
- * the future this may be implemented in an acceptable way.
+ * Creating a directory at the root creates a table, whose columns are given by
+ * the `--table-template` option, since a table without any column is illegal.
  *
  * @param path [in] The path to create.
  * @param mode [in] The file mode to be applied to the new directory.
@@ -354,10 +1116,56 @@ static int _unlink(const char *path)
  */
 static int _mkdir(const char *path, mode_t mode)
 {
-  (void)path;
+  struct mdbfs_sqlite_path *sqlite_path = NULL;
+  int ret = 0; /* Value to be returned by the function */
+  int r = 0;   /* Value returned by other functions */
+
+  /* XXX: Mode is fixed, see getattr. */
   (void)mode;
 
-  return -EROFS;
+  sqlite_path = mdbfs_sqlite_path_from_string(path);
+  if (!sqlite_path) {
+    ret = -EINTR;
+    goto quit;
+  }
+
+  if (sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_TABLE && !sqlite_path->query) {
+    /* Names starting with a dot are left for virtual files and directories */
+    const char *table_name = sqlite_path->database ? sqlite_path->table + strlen(sqlite_path->database) + 1 : sqlite_path->table;
+    if (table_name[0] == '.') {
+      ret = -EINVAL;
+      goto quit;
+    }
+
+    r = mdbfs_backend_sqlite_create_table(sqlite_path->table);
+    if (!r)
+      ret = -EIO;
+    goto quit;
+  }
+
+  /* Buckets of rows fanned out are always there */
+  if (sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_BUCKET) {
+    ret = -EEXIST;
+    goto quit;
+  }
+
+  /* Only rows of tables can be created; views and queries have no storage */
+  if (sqlite_path->type != MDBFS_SQLITE_PATH_TYPE_ROW || sqlite_path->query ||
+      mdbfs_sqlite_path_table_type(sqlite_path) != MDBFS_BACKEND_SQLITE_TABLE_TYPE_TABLE) {
+    ret = -EROFS;
+    goto quit;
+  }
+
+  r = mdbfs_backend_sqlite_create_row(sqlite_path->table, sqlite_path->row);
+  if (!r) {
+    ret = -EINVAL;
+    goto quit;
+  }
+
+quit:
+  mdbfs_sqlite_path_free(sqlite_path);
+  mdbfs_free(sqlite_path);
+  return ret;
 }
 
 /**
@@ -378,13 +1186,51 @@ static int _rmdir(const char *path)
     goto quit;
   }
 
+  /* Index lookups and queries are views of tables, not something to remove */
+  if (sqlite_path->query ||
+      sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_QUERY_ROOT ||
+      sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_QUERY_FILE ||
+      sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_INDEX_ROOT ||
+      sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_INDEX_COLUMN ||
+      sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_INDEX_VALUE ||
+      sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_INDEX_ENTRY) {
+    ret = -EROFS;
+    goto quit;
+  }
+
+  /* Serialized files and imports are files */
+  if (mdbfs_sqlite_path_is_export(sqlite_path) ||
+      sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_IMPORT ||
+      sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_METRICS) {
+    ret = -ENOTDIR;
+    goto quit;
+  }
+
+  /* Buckets of rows fanned out are always there; they go away from listings
+   * once their rows are removed
+   */
+  if (sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_BUCKET) {
+    int64_t first = 0;
+    int64_t last  = 0;
+    int empty = 1;
+
+    mdbfs_sqlite_path_bucket_range(sqlite_path, &first, &last);
+    r = mdbfs_backend_sqlite_walk_rowid_buckets(sqlite_path->table, first, last, g_fanout, mdbfs_sqlite_bucket_found, &empty);
+    if (!r)
+      ret = -EIO;
+    else if (!empty)
+      ret = -ENOTEMPTY;
+    goto quit;
+  }
+
   /* There should not be any directory in the file level (column) */
   if (sqlite_path->column) {
     ret = -EINTR;
     goto quit;
   }
 
-  if (sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_DATABASE) {
+  if (sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_DATABASES ||
+      sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_DATABASE) {
 
     /* Removing (dropping) the database */
     ret = -EACCES;
@@ -426,6 +1272,10 @@ quit:
 /**
  * Read content of a file.
  *
+ * Cells are rendered by their storage class (see _getxattr): integers in
+ * decimal, reals in the shortest form that reads back exactly, and text and
+ * BLOBs byte by byte.
+ *
  * @param path     [in]  Path to the file to be read.
  * @param buf      [out] The buffer to put file content in.
  * @param bufsize  [in]  Size of the provided buffer.
@@ -436,12 +1286,24 @@ quit:
 static int _read(const char *path, char *buf, size_t bufsize, off_t offset, struct fuse_file_info *fileinfo)
 {
   struct mdbfs_sqlite_path *sqlite_path = NULL;
+  struct mdbfs_backend_sqlite_export *export = NULL;
   uint8_t *cell = NULL;
   size_t cell_size = 0;
   int ret = 0; /* Value to be returned by the function */
+  int cancelled = 0;
 
-  /* XXX: Ignoring fileinfo from FUSE */
-  (void)fileinfo;
+  /* Scans of large cells and serialized files are given up with the request */
+  mdbfs_cancel_begin(fuse_interrupted);
+
+  /* Serialized files continue the scan started on open (see _open), told by
+   * what is open, whatever has become of the path
+   */
+  struct mdbfs_backend_sqlite_export *opened = mdbfs_sqlite_file_handle(fileinfo, MDBFS_SQLITE_FILE_TYPE_EXPORT);
+  if (opened) {
+    int64_t r = mdbfs_backend_sqlite_export_read(opened, buf, bufsize, offset);
+    ret = r < 0 ? -EIO : r;
+    goto quit;
+  }
 
   sqlite_path = mdbfs_sqlite_path_from_string(path);
   if (!sqlite_path) {
@@ -449,13 +1311,36 @@ static int _read(const char *path, char *buf, size_t bufsize, off_t offset, stru
     goto quit;
   }
 
-  if (sqlite_path->type != MDBFS_SQLITE_PATH_TYPE_COLUMN) {
+  /* Serialized files read without being opened are scanned from the start */
+  if (mdbfs_sqlite_path_is_export(sqlite_path)) {
+    export = mdbfs_backend_sqlite_export_open(sqlite_path->format, sqlite_path->table, sqlite_path->row);
+
+    int64_t r = mdbfs_backend_sqlite_export_read(export, buf, bufsize, offset);
+    ret = r < 0 ? -EIO : r;
+    goto quit;
+  }
+
+  if (sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_QUERY_FILE) {
+    /* Query files read back the SQL as written */
+    cell = (uint8_t *)mdbfs_backend_sqlite_get_query(&cell_size, sqlite_path->table);
+  } else if (sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_METRICS) {
+    cell = (uint8_t *)mdbfs_metrics_dump(&cell_size);
+  } else if (sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_IMPORT) {
+    /* Import files read back how the last import went, or nothing */
+    cell = (uint8_t *)mdbfs_backend_sqlite_import_get_report(&cell_size, sqlite_path->table);
+    if (!cell)
+      goto quit;
+  } else if (sqlite_path->type != MDBFS_SQLITE_PATH_TYPE_COLUMN) {
     /* read(3p) is for files (columns), not directories */
     ret = -EISDIR;
     goto quit;
+  } else {
+    /* Cells are rendered by their storage class right into the buffer */
+    int64_t r = mdbfs_backend_sqlite_read_cell(NULL, NULL, buf, bufsize, offset, sqlite_path->table, sqlite_path->row, sqlite_path->column);
+    ret = r < 0 ? -ENOENT : r;
+    goto quit;
   }
 
-  cell = mdbfs_backend_sqlite_get_cell(&cell_size, sqlite_path->table, sqlite_path->row, sqlite_path->column);
   if (!cell) {
     ret = -ENOENT;
     goto quit;
@@ -471,13 +1356,18 @@ static int _read(const char *path, char *buf, size_t bufsize, off_t offset, stru
   /* If offset is given, read from there */
   const uint8_t *p_cell = cell + offset;
 
-  /* Either copy all the content from database or occupy all the buffer */
-  size_t copy_size = cell_size <= bufsize ? cell_size : bufsize;
+  /* Either copy the rest of the content from database or occupy all the buffer */
+  size_t copy_size = cell_size - offset <= bufsize ? cell_size - offset : bufsize;
 
   memcpy(buf, p_cell, copy_size);
   ret = copy_size;
 
 quit:
+  cancelled = mdbfs_cancel_end();
+  if (cancelled)
+    ret = -cancelled;
+
+  mdbfs_backend_sqlite_export_close(export);
   mdbfs_free(cell);
   mdbfs_sqlite_path_free(sqlite_path);
   mdbfs_free(sqlite_path);
@@ -487,10 +1377,15 @@ quit:
 /**
  * Write content to a file.
  *
+ * Writes within a cell as large as it is (e.g. after _fallocate) go in place
+ * with incremental BLOB I/O; others rewrite the value around them. TEXT cells
+ * stay TEXT; numbers written become TEXT, subject to the affinity of the
+ * column.
+ *
  * @param path     [in] Path to the file.
  * @param buf      [in] A buffer containing data to be written.
  * @param bufsize  [in] Size of the buffer `buf`.
- * @param offset   [in] Offset to the file. This is ignored.
+ * @param offset   [in] Offset to the file.
  * @param fileinfo [in] Information about the file.
  */
 static int _write(const char *path, const char *buf, size_t bufsize, off_t offset, struct fuse_file_info *fileinfo)
@@ -499,12 +1394,15 @@ static int _write(const char *path, const char *buf, size_t bufsize, off_t offse
   int ret = 0; /* Value to be returned by the function */
   int r = 0;   /* Value returned by other functions */
 
-  /* XXX: No offset support */
-  if (offset > 0)
-    return 0;
-
-  /* XXX: Ignoring fileinfo from FUSE */
-  (void)fileinfo;
+  /* Import files feed the import started on open (see _open), told by what is
+   * open, whatever has become of the path
+   */
+  struct mdbfs_backend_sqlite_import *import = mdbfs_sqlite_file_handle(fileinfo, MDBFS_SQLITE_FILE_TYPE_IMPORT);
+  if (import) {
+    r = mdbfs_backend_sqlite_import_write(import, buf, bufsize, offset);
+    ret = r ? bufsize : -EIO;
+    goto quit;
+  }
 
   sqlite_path = mdbfs_sqlite_path_from_string(path);
   if (!sqlite_path) {
@@ -512,7 +1410,33 @@ static int _write(const char *path, const char *buf, size_t bufsize, off_t offse
     goto quit;
   }
 
-  r = mdbfs_backend_sqlite_set_cell(buf, bufsize, sqlite_path->table, sqlite_path->row, sqlite_path->column);
+  /* Query files collect SQL until they are flushed (see _flush) */
+  if (sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_QUERY_FILE) {
+    r = mdbfs_backend_sqlite_set_query(sqlite_path->table, buf, bufsize, offset);
+    ret = r ? bufsize : -ENOENT;
+    goto quit;
+  }
+
+  /* Serialized files are generated from the database, not written */
+  if (mdbfs_sqlite_path_is_export(sqlite_path) ||
+      sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_METRICS) {
+    ret = -EROFS;
+    goto quit;
+  }
+
+  /* Import files are only written through an import opened for them */
+  if (sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_IMPORT) {
+    ret = -EBADF;
+    goto quit;
+  }
+
+  /* Only cells (columns) can be written */
+  if (sqlite_path->type != MDBFS_SQLITE_PATH_TYPE_COLUMN) {
+    ret = -EISDIR;
+    goto quit;
+  }
+
+  r = mdbfs_backend_sqlite_set_cell((const uint8_t *)buf, bufsize, offset, sqlite_path->table, sqlite_path->row, sqlite_path->column);
   if (!r) {
     ret = -EINTR;
     goto quit;
@@ -527,6 +1451,83 @@ quit:
   return ret;
 }
 
+/**
+ * Copy a range of a file into another, without the data going through the
+ * kernel and back.
+ *
+ * A whole cell copied over another cell no longer than it is copied inside the
+ * database and keeps its storage class. Anything else (a part of a cell, or
+ * into the middle or over a longer cell) is a splice, left to the kernel, which
+ * falls back to reading and writing.
+ *
+ * @param path_in      [in] Path to the file copied from.
+ * @param fileinfo_in  [in] Information about the file copied from.
+ * @param offset_in    [in] Offset to the file copied from.
+ * @param path_out     [in] Path to the file copied to.
+ * @param fileinfo_out [in] Information about the file copied to.
+ * @param offset_out   [in] Offset to the file copied to.
+ * @param size         [in] Bytes to copy.
+ * @param flags        [in] Flags given to copy_file_range(2). Always 0.
+ * @return Bytes copied, or -errno on failure.
+ */
+static ssize_t _copy_file_range(const char *path_in, struct fuse_file_info *fileinfo_in, off_t offset_in, const char *path_out, struct fuse_file_info *fileinfo_out, off_t offset_out, size_t size, int flags)
+{
+  struct mdbfs_sqlite_path *sqlite_path_in = NULL;
+  struct mdbfs_sqlite_path *sqlite_path_out = NULL;
+  size_t cell_length = 0;
+  size_t cell_length_out = 0;
+  ssize_t ret = 0;
+  int r = 0;
+
+  (void)fileinfo_in;
+  (void)fileinfo_out;
+  (void)flags;
+
+  sqlite_path_in = mdbfs_sqlite_path_from_string(path_in);
+  sqlite_path_out = mdbfs_sqlite_path_from_string(path_out);
+  if (!sqlite_path_in || !sqlite_path_out) {
+    ret = -EINTR;
+    goto quit;
+  }
+
+  /* Only whole cells of tables are copied here */
+  if (sqlite_path_in->type != MDBFS_SQLITE_PATH_TYPE_COLUMN ||
+      sqlite_path_out->type != MDBFS_SQLITE_PATH_TYPE_COLUMN ||
+      sqlite_path_in->query || sqlite_path_out->query ||
+      offset_in > 0 || offset_out > 0 ||
+      mdbfs_sqlite_path_table_type(sqlite_path_in) != MDBFS_BACKEND_SQLITE_TABLE_TYPE_TABLE) {
+    ret = -EOPNOTSUPP;
+    goto quit;
+  }
+
+  if (mdbfs_backend_sqlite_read_cell(NULL, &cell_length, NULL, 0, 0, sqlite_path_in->table, sqlite_path_in->row, sqlite_path_in->column) < 0 ||
+      mdbfs_backend_sqlite_read_cell(NULL, &cell_length_out, NULL, 0, 0, sqlite_path_out->table, sqlite_path_out->row, sqlite_path_out->column) < 0) {
+    ret = -ENOENT;
+    goto quit;
+  }
+
+  /* Replacing the cell copied to is only a copy if all of it is replaced */
+  if (size < cell_length || cell_length_out > cell_length) {
+    ret = -EOPNOTSUPP;
+    goto quit;
+  }
+
+  r = mdbfs_backend_sqlite_copy_cell(sqlite_path_in->table, sqlite_path_in->row, sqlite_path_in->column, sqlite_path_out->table, sqlite_path_out->row, sqlite_path_out->column);
+  if (!r) {
+    ret = -EIO;
+    goto quit;
+  }
+
+  ret = cell_length;
+
+quit:
+  mdbfs_sqlite_path_free(sqlite_path_in);
+  mdbfs_sqlite_path_free(sqlite_path_out);
+  mdbfs_free(sqlite_path_in);
+  mdbfs_free(sqlite_path_out);
+  return ret;
+}
+
 /**
  * Get file attributes.
  *
@@ -550,16 +1551,22 @@ static int _getattr(const char *path, struct stat *stat, struct fuse_file_info *
   struct mdbfs_sqlite_path *sqlite_path = NULL;
   size_t file_size = 0;
   int ret = 0; /* Value to be returned by the function */
+  int cancelled = 0;
   int r = 0;   /* Value returned by other functions */
 
+  /* Lookups are given up with the request (see utils/cancel.h) */
+  mdbfs_cancel_begin(fuse_interrupted);
+
   sqlite_path = mdbfs_sqlite_path_from_string(path);
   if (!sqlite_path) {
     ret = -ENOENT;
     goto quit;
   }
 
-  /* We have to get data from the database because we don't know if it exists */
-  if (sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_DATABASE){
+  /* We have to get data from the database because we don't know if it exists;
+   * databases above their tables have been found while parsing the path
+   */
+  if (sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_DATABASE && !sqlite_path->database) {
 
     char **tables = mdbfs_backend_sqlite_get_table_names();
 
@@ -574,18 +1581,54 @@ static int _getattr(const char *path, struct stat *stat, struct fuse_file_info *
 
   } else if (sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_TABLE) {
 
-    char **rows = mdbfs_backend_sqlite_get_row_names(sqlite_path->table);
+    /* Asking the schema is enough; views are not run just to be stat'ed */
+    if (mdbfs_sqlite_path_table_type(sqlite_path) == MDBFS_BACKEND_SQLITE_TABLE_TYPE_NONE) {
+      ret = -ENOENT;
+      goto quit;
+    }
+
+  } else if (sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_QUERY_FILE) {
 
-    if (!rows) {
+    char *sql = mdbfs_backend_sqlite_get_query(&file_size, sqlite_path->table);
+
+    if (!sql) {
       ret = -ENOENT;
       goto quit;
     }
 
-    for (int i = 0; rows[i]; i++)
-      mdbfs_free(rows[i]);
-    mdbfs_free(rows);
+    mdbfs_free(sql);
 
-  } else if (sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_ROW) {
+  } else if (sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_METRICS) {
+
+    char *metrics = mdbfs_metrics_dump(&file_size);
+    mdbfs_free(metrics);
+
+  } else if (sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_IMPORT) {
+
+    /* Rows can only be inserted into tables */
+    if (sqlite_path->query ||
+        mdbfs_sqlite_path_table_type(sqlite_path) != MDBFS_BACKEND_SQLITE_TABLE_TYPE_TABLE) {
+      ret = -ENOENT;
+      goto quit;
+    }
+
+    char *report = mdbfs_backend_sqlite_import_get_report(&file_size, sqlite_path->table);
+    mdbfs_free(report);
+
+  } else if (sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_EXPORT_TABLE) {
+
+    if (mdbfs_sqlite_path_table_type(sqlite_path) == MDBFS_BACKEND_SQLITE_TABLE_TYPE_NONE) {
+      ret = -ENOENT;
+      goto quit;
+    }
+
+  } else if (sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_ROW &&
+             mdbfs_backend_sqlite_row_is_cached(sqlite_path->table, sqlite_path->row)) {
+
+    /* Rows just listed (or read) are known to exist */
+
+  } else if (sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_ROW ||
+             sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_EXPORT_ROW) {
 
     char **columns = mdbfs_backend_sqlite_get_column_names(sqlite_path->table, sqlite_path->row);
 
@@ -600,18 +1643,83 @@ static int _getattr(const char *path, struct stat *stat, struct fuse_file_info *
 
   } else if (sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_COLUMN) {
 
-    char *cell = mdbfs_backend_sqlite_get_cell(&file_size, sqlite_path->table, sqlite_path->row, sqlite_path->column);
+    if (mdbfs_backend_sqlite_read_cell(NULL, &file_size, NULL, 0, 0, sqlite_path->table, sqlite_path->row, sqlite_path->column) < 0) {
+      ret = -ENOENT;
+      goto quit;
+    }
+
+  } else if (sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_INDEX_ROOT ||
+             sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_INDEX_COLUMN) {
+
+    /* The table exists and (for a column) the column leads some index */
+    char **indexed_columns = mdbfs_backend_sqlite_get_indexed_column_names(sqlite_path->table);
 
-    if (!cell) {
+    if (!indexed_columns) {
       ret = -ENOENT;
       goto quit;
     }
 
-    mdbfs_free(cell);
+    if (sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_INDEX_COLUMN &&
+        !mdbfs_sqlite_list_contains(indexed_columns, sqlite_path->column))
+      ret = -ENOENT;
+
+    mdbfs_sqlite_list_free(indexed_columns);
+    if (ret < 0)
+      goto quit;
+
+  } else if (sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_INDEX_VALUE ||
+             sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_INDEX_ENTRY) {
+
+    /* A value exists if the index yields at least one row for it */
+    char **indexed_columns = mdbfs_backend_sqlite_get_indexed_column_names(sqlite_path->table);
+    int indexed = mdbfs_sqlite_list_contains(indexed_columns, sqlite_path->column);
+
+    mdbfs_sqlite_list_free(indexed_columns);
+    if (!indexed) {
+      ret = -ENOENT;
+      goto quit;
+    }
+
+    char **rows = mdbfs_backend_sqlite_get_row_names_by_value(sqlite_path->table, sqlite_path->column, sqlite_path->value);
+
+    if (!rows || !rows[0] ||
+        (sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_INDEX_ENTRY && !mdbfs_sqlite_list_contains(rows, sqlite_path->row)))
+      ret = -ENOENT;
+
+    mdbfs_sqlite_list_free(rows);
+    if (ret < 0)
+      goto quit;
 
   }
 
-  if (sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_COLUMN) {
+  if (sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_INDEX_ENTRY) {
+
+    /* Symbolic link to the row directory, 0777 */
+    stat->st_mode = S_IFLNK |
+                    S_IRWXU |
+                    S_IRWXG |
+                    S_IRWXO;
+
+    /* The size of a link is the length of its target, see _readlink */
+    stat->st_size = mdbfs_sqlite_row_link(NULL, 0, sqlite_path->row);
+
+  } else if (mdbfs_sqlite_path_is_export(sqlite_path) ||
+             sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_METRICS) {
+
+    /* Read-only regular file, 0444 */
+    stat->st_mode = S_IFREG |
+                    S_IRUSR |
+                    S_IRGRP |
+                    S_IROTH;
+
+    /* The size of a serialized file is unknown until the file is generated;
+     * with direct I/O (see _init) readers read until the end of file regardless
+     */
+    stat->st_size = file_size;
+
+  } else if (sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_COLUMN ||
+             sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_QUERY_FILE ||
+             sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_IMPORT) {
 
     /* Regular file, 0644 */
     stat->st_mode = S_IFREG |
@@ -622,9 +1730,7 @@ static int _getattr(const char *path, struct stat *stat, struct fuse_file_info *
     /* Size to return to the caller */
     stat->st_size = file_size;
 
-  } else if (sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_DATABASE ||
-             sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_TABLE ||
-             sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_ROW) {
+  } else {
 
     /* Directory file, 0755 */
     stat->st_mode = S_IFDIR |
@@ -638,6 +1744,10 @@ static int _getattr(const char *path, struct stat *stat, struct fuse_file_info *
   }
 
 quit:
+  cancelled = mdbfs_cancel_end();
+  if (cancelled)
+    ret = -cancelled;
+
   mdbfs_sqlite_path_free(sqlite_path);
   mdbfs_free(sqlite_path);
   return ret;
@@ -646,6 +1756,16 @@ quit:
 /**
  * List content of a directory.
  *
+ * Views are listed beside tables. Since they do not have ROWIDs, their rows
+ * are named by positions in the result, starting from 0, and computed page by
+ * page as they are listed, as are queries under `/.query`.
+ *
+ * `/T/.by` lists the columns leading an index of the table (as reported by
+ * `PRAGMA index_list`), and `/T/.by/C/V` links to every row holding `V` in `C`
+ * (see _readlink), found by one probe into the index instead of a scan of the
+ * table. Values that cannot be file names (empty, or containing `/`) are not
+ * reachable.
+ *
  * @param path [in] Path to the directory.
  * @param buf  [out] The buffer to receive directory information.
  * @param filler [in] A function provided by FUSE to add entries to buf.
@@ -658,15 +1778,18 @@ static int _readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t o
 {
   struct mdbfs_sqlite_path *sqlite_path = NULL;
   int ret = 0; /* Value to be returned by the function */
+  int cancelled = 0;
   int r = 0;   /* Value returned by other functions */
 
-  /* XXX: No offset support */
-  if (offset > 0)
-    return 0;
+  /* Entries come with full attributes when the kernel asks for them */
+  enum fuse_fill_dir_flags fill_flags = flags & FUSE_READDIR_PLUS ? FUSE_FILL_DIR_PLUS : 0;
 
-  /* FIXME: These should be useful */
-  (void)fileinfo;
-  (void)flags;
+  /* Tables and rows are directories, of which nothing else is to be told */
+  struct stat dir_attr = {0};
+  dir_attr.st_mode = S_IFDIR | S_IRUSR | S_IWUSR | S_IXUSR | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH;
+
+  /* Listings of large tables are given up with the request */
+  mdbfs_cancel_begin(fuse_interrupted);
 
   sqlite_path = mdbfs_sqlite_path_from_string(path);
   if (!sqlite_path) {
@@ -674,28 +1797,140 @@ static int _readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t o
     goto quit;
   }
 
+  if (sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_TABLE) {
+    struct mdbfs_sqlite_readdir_page page = {
+      .buf    = buf,
+      .filler = filler,
+      .flags  = fill_flags,
+    };
+
+    switch (mdbfs_sqlite_path_table_type(sqlite_path)) {
+      case MDBFS_BACKEND_SQLITE_TABLE_TYPE_VIEW:
+        /* Rows of views are listed page by page: each call runs the view from
+         * the given offset for as many rows as the buffer of FUSE takes, so a
+         * large result is never held in memory at once.
+         */
+        r = mdbfs_backend_sqlite_walk_view_row_names(sqlite_path->table, offset, mdbfs_sqlite_readdir_page_fill, &page);
+        if (!r)
+          ret = -EIO;
+        break;
+
+      case MDBFS_BACKEND_SQLITE_TABLE_TYPE_TABLE:
+        /* Rows of tables are listed page by page as well, named on the fly
+         * from their ROWIDs, which are kept with the open directory as runs of
+         * consecutive ones. Listing a table of any size thus takes a few bytes
+         * rather than a string per row.
+         */
+        ret = mdbfs_sqlite_readdir_table(sqlite_path->table, offset, fileinfo ? (struct mdbfs_sqlite_dir *)(uintptr_t)fileinfo->fh : NULL, &page);
+        break;
+
+      default:
+        ret = -ENOENT;
+        break;
+    }
+
+    goto quit;
+  }
+
+  if (sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_BUCKET) {
+    struct mdbfs_sqlite_readdir_page page = {
+      .buf    = buf,
+      .filler = filler,
+      .flags  = fill_flags,
+    };
+    int64_t first = 0;
+    int64_t last  = 0;
+
+    /* Buckets of rows fanned out hold buckets, then rows, both listed page by
+     * page from ranges of ROWIDs (see mdbfs_backend_sqlite_set_fanout)
+     */
+    mdbfs_sqlite_path_bucket_range(sqlite_path, &first, &last);
+    if (sqlite_path->nbuckets == 1)
+      r = mdbfs_sqlite_readdir_buckets(sqlite_path->table, first, last, g_fanout, sqlite_path->buckets[0] * g_fanout, offset, &page);
+    else
+      r = mdbfs_sqlite_readdir_rows(sqlite_path->table, first, last, offset, fileinfo ? (struct mdbfs_sqlite_dir *)(uintptr_t)fileinfo->fh : NULL, &page);
+
+    if (r < 0)
+      ret = r;
+    goto quit;
+  }
+
+  /* XXX: No offset support for anything else */
+  if (offset > 0)
+    goto quit;
+
   /* File access? How can this happen? */
-  if (sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_COLUMN) {
+  if (sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_COLUMN ||
+      sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_INDEX_ENTRY ||
+      sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_QUERY_FILE ||
+      sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_IMPORT ||
+      sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_METRICS ||
+      mdbfs_sqlite_path_is_export(sqlite_path)) {
     ret = -ENOENT;
     goto quit;
   }
 
-  if (sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_DATABASE) {
+  if (sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_DATABASES) {
+
+    /* Listing root above attached databases; show database names */
+    char **databases = mdbfs_backend_sqlite_get_database_names();
+
+    for (int i = 0; databases && databases[i]; i++)
+      filler(buf, databases[i], &dir_attr, 0, fill_flags);
+
+    mdbfs_sqlite_list_free(databases);
+
+  } else if (sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_DATABASE) {
+
+    /* Listing root (or an attached database); show table names */
+    if (sqlite_path->database && !mdbfs_backend_sqlite_use_database(sqlite_path->database)) {
+      ret = -ENOENT;
+      goto quit;
+    }
 
-    /* Listing root; show table names */
     char **table_names = mdbfs_backend_sqlite_get_table_names();
     if (!table_names) {
+      mdbfs_backend_sqlite_release_database(sqlite_path->database);
       ret = -ENOENT;
       goto quit;
     }
 
+    /* Tables of attached databases are named D/T, and listed in D only */
+    size_t database_length = sqlite_path->database ? strlen(sqlite_path->database) : 0;
+
     for (int i = 0; table_names[i]; i++) {
-      /* Attribution information is required */
-      struct stat attr = {0};
-      _getattr(path, &attr, fileinfo);
+      const char *table_name = table_names[i];
+
+      if (sqlite_path->database) {
+        if (strncmp(table_name, sqlite_path->database, database_length) != 0 || table_name[database_length] != '/')
+          continue;
+        table_name += database_length + 1;
+      }
+
+      /* Such a table would be listed, but never reached */
+      const char *hidden_by = mdbfs_sqlite_table_hidden_by(table_name, !sqlite_path->database);
+      if (hidden_by) {
+        mdbfs_warning("sqlite: table \"%s\" is hidden by %s of the same name, skipping", table_name, hidden_by);
+        continue;
+      }
 
       /* Send elements back to FUSE */
-      filler(buf, table_names[i], &attr, 0, 0);
+      filler(buf, table_name, &dir_attr, 0, fill_flags);
+
+      /* Each table can also be read as a whole in one of these formats */
+      static const char *const suffixes[] = {".csv", ".tsv", ".jsonl", NULL};
+      struct stat export_attr = {0};
+      export_attr.st_mode = S_IFREG | S_IRUSR | S_IRGRP | S_IROTH;
+
+      for (int j = 0; suffixes[j]; j++) {
+        char *file_name = mdbfs_malloc0(strlen(table_name) + strlen(suffixes[j]) + 1);
+        strcat(file_name, table_name);
+        strcat(file_name, suffixes[j]);
+
+        filler(buf, file_name, &export_attr, 0, fill_flags);
+
+        mdbfs_free(file_name);
+      }
     }
 
     /* Free unused memory */
@@ -703,32 +1938,50 @@ static int _readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t o
       mdbfs_free(table_names[i]);
     mdbfs_free(table_names);
 
-  } else if (sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_TABLE) {
+    mdbfs_backend_sqlite_release_database(sqlite_path->database);
+  }
 
-    /* Listing table; show all rows */
-    char **row_names = mdbfs_backend_sqlite_get_row_names(sqlite_path->table);
-    if (!row_names) {
-      ret = -ENOENT;
-      goto quit;
-    }
+  if (sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_DATABASES ||
+      (sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_DATABASE && !sqlite_path->database)) {
+
+    /* Ad-hoc queries live beside tables, or databases */
+    struct stat attr = {0};
+    attr.st_mode = S_IFDIR | S_IRUSR | S_IWUSR | S_IXUSR | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH;
+
+    filler(buf, MDBFS_SQLITE_QUERY_DIR, &attr, 0, fill_flags);
+
+    attr.st_mode = S_IFREG | S_IRUSR | S_IRGRP | S_IROTH;
+    filler(buf, MDBFS_SQLITE_METRICS_FILE, &attr, 0, fill_flags);
+
+  } else if (sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_QUERY_ROOT) {
+
+    /* Listing queries; show the SQL files, and results of those defined */
+    char **query_names = mdbfs_backend_sqlite_get_query_names();
+
+    for (int i = 0; query_names[i]; i++) {
+      char *file_name = mdbfs_malloc0(strlen(query_names[i]) + strlen(MDBFS_SQLITE_QUERY_SUFFIX) + 1);
+      strcat(file_name, query_names[i]);
+      strcat(file_name, MDBFS_SQLITE_QUERY_SUFFIX);
 
-    for (int i = 0; row_names[i]; i++) {
-      /* Attribution information is required */
       struct stat attr = {0};
-      r = _getattr(path, &attr, fileinfo);
-      if (r < 0) {
-        ret = r;
-        goto quit;
+      size_t sql_length = 0;
+      char *sql = mdbfs_backend_sqlite_get_query(&sql_length, query_names[i]);
+
+      attr.st_mode = S_IFREG | S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH;
+      attr.st_size = sql_length;
+      filler(buf, file_name, &attr, 0, fill_flags);
+
+      if (mdbfs_backend_sqlite_query_is_defined(query_names[i])) {
+        attr.st_mode = S_IFDIR | S_IRUSR | S_IWUSR | S_IXUSR | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH;
+        attr.st_size = 0;
+        filler(buf, query_names[i], &attr, 0, fill_flags);
       }
 
-      /* Send elements back to FUSE */
-      filler(buf, row_names[i], &attr, 0, 0);
+      mdbfs_free(sql);
+      mdbfs_free(file_name);
     }
 
-    /* Free unused memory */
-    for (int i = 0; row_names[i]; i++)
-      mdbfs_free(row_names[i]);
-    mdbfs_free(row_names);
+    mdbfs_sqlite_list_free(query_names);
 
   } else if (sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_ROW) {
 
@@ -740,16 +1993,25 @@ static int _readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t o
     }
 
     for (int i = 0; column_names[i]; i++) {
-      /* Attribution information is required */
+      /* Attribution information is required; the row cache serves all cells
+       * of the row from one query
+       */
       struct stat attr = {0};
-      r = _getattr(path, &attr, fileinfo);
+      char *column_path = mdbfs_malloc0(strlen(path) + 1 + strlen(column_names[i]) + 1);
+      strcat(column_path, path);
+      strcat(column_path, "/");
+      strcat(column_path, column_names[i]);
+
+      r = _getattr(column_path, &attr, fileinfo);
+      mdbfs_free(column_path);
       if (r < 0) {
+        mdbfs_sqlite_list_free(column_names);
         ret = r;
         goto quit;
       }
 
       /* Send elements back to FUSE */
-      filler(buf, column_names[i], &attr, 0, 0);
+      filler(buf, column_names[i], &attr, 0, fill_flags);
     }
 
     /* Free unused memory */
@@ -757,16 +2019,649 @@ static int _readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t o
       mdbfs_free(column_names[i]);
     mdbfs_free(column_names);
 
+  } else if (sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_INDEX_ROOT ||
+             sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_INDEX_COLUMN ||
+             sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_INDEX_VALUE) {
+
+    /* Listing index lookups: indexed columns, their values, then the rows
+     * holding a value
+     */
+    char **names = NULL;
+    char **indexed_columns = mdbfs_backend_sqlite_get_indexed_column_names(sqlite_path->table);
+
+    if (sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_INDEX_ROOT) {
+      names = indexed_columns;
+      indexed_columns = NULL;
+    } else if (mdbfs_sqlite_list_contains(indexed_columns, sqlite_path->column)) {
+      if (sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_INDEX_COLUMN)
+        names = mdbfs_backend_sqlite_get_indexed_values(sqlite_path->table, sqlite_path->column);
+      else
+        names = mdbfs_backend_sqlite_get_row_names_by_value(sqlite_path->table, sqlite_path->column, sqlite_path->value);
+    }
+
+    mdbfs_sqlite_list_free(indexed_columns);
+    if (!names) {
+      ret = -ENOENT;
+      goto quit;
+    }
+
+    for (int i = 0; names[i]; i++) {
+      /* Values and indexed columns are directories; rows are links */
+      struct stat attr = {0};
+      if (sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_INDEX_VALUE)
+        attr.st_mode = S_IFLNK | S_IRWXU | S_IRWXG | S_IRWXO;
+      else
+        attr.st_mode = S_IFDIR | S_IRUSR | S_IXUSR | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH;
+
+      /* Send elements back to FUSE */
+      filler(buf, names[i], &attr, 0, 0);
+    }
+
+    mdbfs_sqlite_list_free(names);
+
+  }
+
+quit:
+  cancelled = mdbfs_cancel_end();
+  if (cancelled)
+    ret = -cancelled;
+
+  mdbfs_sqlite_path_free(sqlite_path);
+  mdbfs_free(sqlite_path);
+  return ret;
+}
+
+/**
+ * Open a file.
+ *
+ * Opening a serialized file starts its export, which is kept in `fileinfo->fh`
+ * so that subsequent reads continue the same scan instead of starting over.
+ * These are `/T.csv`, `/T.tsv` and `/T.jsonl` for tables (and likewise for
+ * queries), and `/T/R.json` for rows; CSV and TSV files start with a header of
+ * column names, and BLOBs are written in hexadecimal.
+ *
+ * Likewise, opening an import file for writing starts an import: a CSV (with a
+ * header) or JSON Lines stream written into `/T/.import` is inserted into `T`
+ * as it arrives, e.g. `cat rows.csv > /T/.import`, and unquoted empty CSV
+ * fields are NULL. Reading the file tells how the last import went. Nothing
+ * needs to be done for other files.
+ *
+ * @param path     [in]     Path to the file.
+ * @param fileinfo [in,out] FUSE file information structure.
+ * @return 0 if succeeded, negated error codes otherwise.
+ */
+static int _open(const char *path, struct fuse_file_info *fileinfo)
+{
+  struct mdbfs_sqlite_path *sqlite_path = NULL;
+  struct mdbfs_sqlite_file *file = NULL;
+  int ret = 0; /* Value to be returned by the function */
+
+  sqlite_path = mdbfs_sqlite_path_from_string(path);
+  if (!sqlite_path) {
+    ret = -ENOENT;
+    goto quit;
+  }
+
+  if (sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_IMPORT &&
+      (fileinfo->flags & O_ACCMODE) != O_RDONLY) {
+    void *import = mdbfs_backend_sqlite_import_open(sqlite_path->table);
+    if (!import) {
+      ret = -EBUSY;
+      goto quit;
+    }
+
+    file = mdbfs_malloc0(sizeof(struct mdbfs_sqlite_file));
+    file->type   = MDBFS_SQLITE_FILE_TYPE_IMPORT;
+    file->handle = import;
+    fileinfo->fh = (uintptr_t)file;
+    goto quit;
   }
 
+  if (!mdbfs_sqlite_path_is_export(sqlite_path))
+    goto quit;
+
+  if ((fileinfo->flags & O_ACCMODE) != O_RDONLY) {
+    ret = -EROFS;
+    goto quit;
+  }
+
+  file = mdbfs_malloc0(sizeof(struct mdbfs_sqlite_file));
+  file->type   = MDBFS_SQLITE_FILE_TYPE_EXPORT;
+  file->handle = mdbfs_backend_sqlite_export_open(sqlite_path->format, sqlite_path->table, sqlite_path->row);
+  fileinfo->fh = (uintptr_t)file;
+
 quit:
   mdbfs_sqlite_path_free(sqlite_path);
   mdbfs_free(sqlite_path);
   return ret;
 }
 
+/**
+ * Release an open file.
+ *
+ * @param path     [in] Path to the file.
+ * @param fileinfo [in] FUSE file information structure.
+ * @return 0 if succeeded, negated error codes otherwise.
+ */
+static int _release(const char *path, struct fuse_file_info *fileinfo)
+{
+  struct mdbfs_sqlite_file *file = (struct mdbfs_sqlite_file *)(uintptr_t)fileinfo->fh;
+
+  (void)path;
+
+  /* Only serialized and import files have anything kept open, see _open */
+  if (!file)
+    return 0;
+
+  if (file->type == MDBFS_SQLITE_FILE_TYPE_IMPORT)
+    mdbfs_backend_sqlite_import_close(file->handle);
+  else
+    mdbfs_backend_sqlite_export_close(file->handle);
+
+  mdbfs_free(file);
+  fileinfo->fh = 0;
+  return 0;
+}
+
+/**
+ * Open a directory.
+ *
+ * @param path     [in]     Path to the directory.
+ * @param fileinfo [in,out] FUSE file information structure.
+ * @return 0 if succeeded, negated error codes otherwise.
+ */
+static int _opendir(const char *path, struct fuse_file_info *fileinfo)
+{
+  struct mdbfs_sqlite_path *sqlite_path = NULL;
+
+  sqlite_path = mdbfs_sqlite_path_from_string(path);
+  if (!sqlite_path)
+    return -EINTR;
+
+  /* Tables (or buckets of their rows) keep what is being listed, see _readdir */
+  if ((sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_TABLE && !sqlite_path->query) ||
+      (sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_BUCKET && sqlite_path->nbuckets == 2))
+    fileinfo->fh = (uintptr_t)mdbfs_malloc0(sizeof(struct mdbfs_sqlite_dir));
+
+  mdbfs_sqlite_path_free(sqlite_path);
+  mdbfs_free(sqlite_path);
+  return 0;
+}
+
+/**
+ * Release an open directory.
+ *
+ * @param path     [in] Path to the directory.
+ * @param fileinfo [in] FUSE file information structure.
+ * @return 0 if succeeded, negated error codes otherwise.
+ */
+static int _releasedir(const char *path, struct fuse_file_info *fileinfo)
+{
+  struct mdbfs_sqlite_dir *dir = (struct mdbfs_sqlite_dir *)(uintptr_t)fileinfo->fh;
+
+  (void)path;
+
+  /* Only tables have anything kept open, see _opendir */
+  if (!dir)
+    return 0;
+
+  mdbfs_backend_sqlite_free_rowids(dir->rowids);
+  mdbfs_free(dir);
+  fileinfo->fh = 0;
+  return 0;
+}
+
+/**
+ * Flush cached data of an open file.
+ *
+ * This is called on every close(2). For query files, it is when the SQL that
+ * has been written gets defined as a (temporary) view, which lasts as long as
+ * the mount; an invalid query, or anything but one statement that only reads
+ * the database, fails here, so that the writer sees the error when closing the
+ * file. Likewise, imports are finished (their last rows inserted and
+ * committed) here, failing if any record has failed.
+ *
+ * @param path     [in] Path to the file.
+ * @param fileinfo [in] FUSE file information structure.
+ * @return 0 if succeeded, negated error codes otherwise.
+ */
+static int _flush(const char *path, struct fuse_file_info *fileinfo)
+{
+  struct mdbfs_sqlite_path *sqlite_path = NULL;
+  int ret = 0; /* Value to be returned by the function */
+  int r = 0;   /* Value returned by other functions */
+
+  /* Imports are told by what is open, whatever has become of the path */
+  struct mdbfs_backend_sqlite_import *import = mdbfs_sqlite_file_handle(fileinfo, MDBFS_SQLITE_FILE_TYPE_IMPORT);
+  if (import) {
+    r = mdbfs_backend_sqlite_import_finish(import);
+    if (!r)
+      ret = -EIO;
+    goto quit;
+  }
+
+  sqlite_path = mdbfs_sqlite_path_from_string(path);
+  if (!sqlite_path)
+    goto quit;
+
+  if (sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_QUERY_FILE) {
+    r = mdbfs_backend_sqlite_commit_query(sqlite_path->table);
+    if (!r)
+      ret = -EINVAL;
+  }
+
+quit:
+  mdbfs_sqlite_path_free(sqlite_path);
+  mdbfs_free(sqlite_path);
+  return ret;
+}
+
+/**
+ * Change the size of a file.
+ *
+ * Query files are truncated so that they can be rewritten in place. Cells are
+ * cut, or filled with zeros with `zeroblob()`, keeping TEXT cells TEXT; an
+ * empty cell made larger becomes a BLOB. Truncating an import file does
+ * nothing, so that it can be opened with `O_TRUNC` (as shells do).
+ *
+ * @param path     [in] Path to the file.
+ * @param size     [in] The new size of the file.
+ * @param fileinfo [in] FUSE file information structure.
+ * @return 0 if succeeded, negated error codes otherwise.
+ */
+static int _truncate(const char *path, off_t size, struct fuse_file_info *fileinfo)
+{
+  struct mdbfs_sqlite_path *sqlite_path = NULL;
+  int ret = 0; /* Value to be returned by the function */
+  int r = 0;   /* Value returned by other functions */
+
+  (void)fileinfo;
+
+  sqlite_path = mdbfs_sqlite_path_from_string(path);
+  if (!sqlite_path) {
+    ret = -ENOENT;
+    goto quit;
+  }
+
+  if (sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_IMPORT)
+    goto quit;
+
+  if (sqlite_path->type == MDBFS_SQLITE_PATH_TYPE_COLUMN && !sqlite_path->query) {
+    r = mdbfs_backend_sqlite_resize_cell(size, sqlite_path->table, sqlite_path->row, sqlite_path->column);
+    ret = r ? 0 : -EIO;
+    goto quit;
+  }
+
+  if (sqlite_path->type != MDBFS_SQLITE_PATH_TYPE_QUERY_FILE) {
+    ret = -ENOSYS;
+    goto quit;
+  }
+
+  r = mdbfs_backend_sqlite_truncate_query(sqlite_path->table, size);
+  if (!r) {
+    ret = -ENOENT;
+    goto quit;
+  }
+
+quit:
+  mdbfs_sqlite_path_free(sqlite_path);
+  mdbfs_free(sqlite_path);
+  return ret;
+}
+
+/**
+ * Allocate space for a file.
+ *
+ * A cell is made as large as the range asks for at once with `zeroblob()` (see
+ * _truncate), so that it can then be filled in place chunk by chunk (see
+ * _write). Space is not reserved otherwise, so `FALLOC_FL_KEEP_SIZE` does
+ * nothing; other modes are not supported.
+ *
+ * @param path     [in] Path to the file.
+ * @param mode     [in] Mode given to fallocate(2).
+ * @param offset   [in] Start of the range to allocate.
+ * @param length   [in] Length of the range to allocate.
+ * @param fileinfo [in] FUSE file information structure.
+ * @return 0 if succeeded, negated error codes otherwise.
+ */
+static int _fallocate(const char *path, int mode, off_t offset, off_t length, struct fuse_file_info *fileinfo)
+{
+  struct mdbfs_sqlite_path *sqlite_path = NULL;
+  size_t cell_length = 0;
+  int ret = 0; /* Value to be returned by the function */
+  int r = 0;   /* Value returned by other functions */
+
+  (void)fileinfo;
+
+  if (mode & ~FALLOC_FL_KEEP_SIZE)
+    return -EOPNOTSUPP;
+
+  if (offset < 0 || length <= 0)
+    return -EINVAL;
+
+  /* The end of the range must be a size a cell can have */
+  if (length > INT64_MAX - offset)
+    return -EFBIG;
+
+  sqlite_path = mdbfs_sqlite_path_from_string(path);
+  if (!sqlite_path) {
+    ret = -ENOENT;
+    goto quit;
+  }
+
+  if (sqlite_path->type != MDBFS_SQLITE_PATH_TYPE_COLUMN || sqlite_path->query) {
+    ret = -EOPNOTSUPP;
+    goto quit;
+  }
+
+  if (mdbfs_backend_sqlite_read_cell(NULL, &cell_length, NULL, 0, 0, sqlite_path->table, sqlite_path->row, sqlite_path->column) < 0) {
+    ret = -ENOENT;
+    goto quit;
+  }
+
+  if ((mode & FALLOC_FL_KEEP_SIZE) || offset + length <= (off_t)cell_length)
+    goto quit;
+
+  r = mdbfs_backend_sqlite_resize_cell(offset + length, sqlite_path->table, sqlite_path->row, sqlite_path->column);
+  if (!r) {
+    ret = -EIO;
+    goto quit;
+  }
+
+quit:
+  mdbfs_sqlite_path_free(sqlite_path);
+  mdbfs_free(sqlite_path);
+  return ret;
+}
+
+/**
+ * Read the target of a symbolic link.
+ *
+ * Only entries in index lookups (`/T/.by/C/V/R`) are links. They point back to
+ * the row directory `/T/R`, so that following one lands on the row found by
+ * the index.
+ *
+ * @param path    [in]  Path to the link.
+ * @param buf     [out] The buffer to put the NUL-terminated target in.
+ * @param bufsize [in]  Size of the provided buffer.
+ * @return 0 if succeeded, negated error codes otherwise.
+ */
+static int _readlink(const char *path, char *buf, size_t bufsize)
+{
+  struct stat attr = {0};
+  struct mdbfs_sqlite_path *sqlite_path = NULL;
+  int ret = 0; /* Value to be returned by the function */
+  int r = 0;   /* Value returned by other functions */
+
+  sqlite_path = mdbfs_sqlite_path_from_string(path);
+  if (!sqlite_path) {
+    ret = -ENOENT;
+    goto quit;
+  }
+
+  if (sqlite_path->type != MDBFS_SQLITE_PATH_TYPE_INDEX_ENTRY) {
+    ret = -EINVAL;
+    goto quit;
+  }
+
+  /* Make sure the row is really found through the index */
+  r = _getattr(path, &attr, NULL);
+  if (r < 0) {
+    ret = r;
+    goto quit;
+  }
+
+  /* "If the linkname is too long to fit in the buffer, it should be
+   * truncated."
+   * -- https://libfuse.github.io/doxygen/structfuse__operations.html
+   */
+  mdbfs_sqlite_row_link(buf, bufsize, sqlite_path->row);
+
+quit:
+  mdbfs_sqlite_path_free(sqlite_path);
+  mdbfs_free(sqlite_path);
+  return ret;
+}
+
+/**
+ * Reply an extended attribute value following getxattr(2): its length when
+ * asked for the size only, the value itself when the buffer is large enough.
+ *
+ * @param value   [in]  The value.
+ * @param buf     [out] The buffer to put the value in.
+ * @param bufsize [in]  Size of the buffer, or 0 to ask for the size.
+ * @return Length of the value, or -ERANGE if the buffer is too small.
+ */
+static int mdbfs_sqlite_xattr_reply(const char *value, char *buf, size_t bufsize)
+{
+  size_t length = strlen(value);
+
+  if (!bufsize)
+    return length;
+
+  if (bufsize < length)
+    return -ERANGE;
+
+  memcpy(buf, value, length);
+  return length;
+}
+
+/**
+ * List the extended attributes a node has.
+ *
+ * Only cheap metadata is exposed: what the schema cache, the statistics, and
+ * the path itself tell, plus the storage class of cells.
+ *
+ * @param sqlite_path [in] The node.
+ * @return A NULL-terminated list of attribute names.
+ */
+static const char *const *mdbfs_sqlite_xattr_names(const struct mdbfs_sqlite_path *sqlite_path)
+{
+  static const char *const none[]        = {NULL};
+  static const char *const table[]       = {MDBFS_SQLITE_XATTR_KIND, MDBFS_SQLITE_XATTR_ROWS, NULL};
+  static const char *const view[]        = {MDBFS_SQLITE_XATTR_KIND, NULL};
+  static const char *const table_row[]   = {MDBFS_SQLITE_XATTR_ROWID, NULL};
+  static const char *const table_cell[]  = {MDBFS_SQLITE_XATTR_TYPE, MDBFS_SQLITE_XATTR_DECLTYPE, MDBFS_SQLITE_XATTR_ROWID, NULL};
+  static const char *const view_cell[]   = {MDBFS_SQLITE_XATTR_TYPE, MDBFS_SQLITE_XATTR_DECLTYPE, NULL};
+
+  if (sqlite_path->type != MDBFS_SQLITE_PATH_TYPE_TABLE &&
+      sqlite_path->type != MDBFS_SQLITE_PATH_TYPE_ROW &&
+      sqlite_path->type != MDBFS_SQLITE_PATH_TYPE_COLUMN)
+    return none;
+
+  /* Rows of views are named by positions; they have no ROWIDs */
+  enum mdbfs_backend_sqlite_table_type table_type = mdbfs_backend_sqlite_get_table_type(sqlite_path->table);
+  int is_table = table_type == MDBFS_BACKEND_SQLITE_TABLE_TYPE_TABLE;
+
+  switch (sqlite_path->type) {
+    case MDBFS_SQLITE_PATH_TYPE_TABLE:
+      if (table_type == MDBFS_BACKEND_SQLITE_TABLE_TYPE_NONE)
+        return none;
+
+      /* Without a cheap estimate (e.g. WITHOUT ROWID), there is no row count */
+      return is_table && mdbfs_backend_sqlite_get_row_estimate(sqlite_path->table) >= 0 ? table : view;
+    case MDBFS_SQLITE_PATH_TYPE_ROW:
+      return is_table ? table_row : none;
+    default:
+      return table_type == MDBFS_BACKEND_SQLITE_TABLE_TYPE_NONE ? none : is_table ? table_cell : view_cell;
+  }
+}
+
+/**
+ * Retrieve an extended attribute.
+ *
+ * - Tables and views have `user.mdbfs.kind` (`table` or `view`). Tables also
+ *   have `user.mdbfs.rows`, an estimate of the number of rows from `ANALYZE`
+ *   statistics, or from the largest ROWID without them.
+ * - Rows of tables have `user.mdbfs.rowid`.
+ * - Column files have `user.mdbfs.type`, the storage class of the cell (one of
+ *   `null`, `integer`, `real`, `text`, and `blob`), `user.mdbfs.decltype`, the
+ *   type declared in the schema (maybe empty), and in tables
+ *   `user.mdbfs.rowid`.
+ *
+ * @param path    [in]  Path to the file.
+ * @param name    [in]  Name of the attribute.
+ * @param buf     [out] The buffer to put the value in.
+ * @param bufsize [in]  Size of the buffer, or 0 to ask for the size.
+ * @return Length of the value if succeeded, negated error codes otherwise.
+ */
+static int _getxattr(const char *path, const char *name, char *buf, size_t bufsize)
+{
+  struct mdbfs_sqlite_path *sqlite_path = NULL;
+  char *value = NULL;
+  int ret = -ENODATA;
+
+  mdbfs_debug("sqlite: getxattr: %s (%s)", path, name);
+
+  sqlite_path = mdbfs_sqlite_path_from_string(path);
+  if (!sqlite_path) {
+    ret = -ENOENT;
+    goto quit;
+  }
+
+  if (!mdbfs_sqlite_list_contains((char **)mdbfs_sqlite_xattr_names(sqlite_path), name))
+    goto quit;
+
+  if (strcmp(name, MDBFS_SQLITE_XATTR_KIND) == 0) {
+
+    int is_view = mdbfs_backend_sqlite_get_table_type(sqlite_path->table) == MDBFS_BACKEND_SQLITE_TABLE_TYPE_VIEW;
+    ret = mdbfs_sqlite_xattr_reply(is_view ? "view" : "table", buf, bufsize);
+
+  } else if (strcmp(name, MDBFS_SQLITE_XATTR_ROWS) == 0) {
+
+    char number[MDBFS_FORMAT_NUMBER_MAX];
+    int64_t rows = mdbfs_backend_sqlite_get_row_estimate(sqlite_path->table);
+    if (rows < 0)
+      goto quit;
+
+    mdbfs_format_int64(number, rows);
+    ret = mdbfs_sqlite_xattr_reply(number, buf, bufsize);
+
+  } else if (strcmp(name, MDBFS_SQLITE_XATTR_ROWID) == 0) {
+
+    /* Rows of tables are named by ROWIDs; tell it in canonical form */
+    char number[MDBFS_FORMAT_NUMBER_MAX];
+    char *end = NULL;
+    long long rowid = strtoll(sqlite_path->row, &end, 10);
+
+    if (!*sqlite_path->row || *end)
+      goto quit;
+
+    mdbfs_format_int64(number, rowid);
+    ret = mdbfs_sqlite_xattr_reply(number, buf, bufsize);
+
+  } else if (strcmp(name, MDBFS_SQLITE_XATTR_TYPE) == 0) {
+
+    enum mdbfs_backend_sqlite_cell_type cell_type = MDBFS_BACKEND_SQLITE_CELL_TYPE_NONE;
+
+    if (mdbfs_backend_sqlite_read_cell(&cell_type, NULL, NULL, 0, 0, sqlite_path->table, sqlite_path->row, sqlite_path->column) < 0) {
+      ret = -ENOENT;
+      goto quit;
+    }
+
+    ret = mdbfs_sqlite_xattr_reply(mdbfs_backend_sqlite_cell_type_name(cell_type), buf, bufsize);
+
+  } else if (strcmp(name, MDBFS_SQLITE_XATTR_DECLTYPE) == 0) {
+
+    value = mdbfs_backend_sqlite_get_column_decltype(sqlite_path->table, sqlite_path->column);
+    if (!value)
+      goto quit;
+
+    ret = mdbfs_sqlite_xattr_reply(value, buf, bufsize);
+
+  }
+
+quit:
+  mdbfs_free(value);
+  mdbfs_sqlite_path_free(sqlite_path);
+  mdbfs_free(sqlite_path);
+  return ret;
+}
+
+/**
+ * List names of extended attributes, each terminated by a NUL.
+ *
+ * @param path    [in]  Path to the file.
+ * @param buf     [out] The buffer to put the names in.
+ * @param bufsize [in]  Size of the buffer, or 0 to ask for the size.
+ * @return Length of the list if succeeded, negated error codes otherwise.
+ */
+static int _listxattr(const char *path, char *buf, size_t bufsize)
+{
+  struct mdbfs_sqlite_path *sqlite_path = NULL;
+  int ret = 0;
+
+  mdbfs_debug("sqlite: listxattr: %s", path);
+
+  sqlite_path = mdbfs_sqlite_path_from_string(path);
+  if (!sqlite_path) {
+    ret = -ENOENT;
+    goto quit;
+  }
+
+  const char *const *names = mdbfs_sqlite_xattr_names(sqlite_path);
+
+  for (int i = 0; names[i]; i++) {
+    size_t length = strlen(names[i]) + 1; /* The NUL is part of the list */
+
+    if (bufsize && ret + length > bufsize) {
+      ret = -ERANGE;
+      goto quit;
+    }
+
+    if (bufsize)
+      memcpy(buf + ret, names[i], length);
+
+    ret += length;
+  }
+
+quit:
+  mdbfs_sqlite_path_free(sqlite_path);
+  mdbfs_free(sqlite_path);
+  return ret;
+}
+
+/**
+ * Retrieve file system statistics.
+ *
+ * Blocks are database pages: the total is the pages the database has, and the
+ * free ones are those on its free list plus what the file system holding the
+ * database has left. The statistics are cached for a moment, see
+ * mdbfs_backend_sqlite_get_space.
+ *
+ * @param path [in]  Path to any file in the file system.
+ * @param stat [out] File system statistics.
+ * @return 0 if succeeded, negated error codes otherwise.
+ */
+static int _statfs(const char *path, struct statvfs *stat)
+{
+  int64_t page_size   = 0;
+  int64_t total_pages = 0;
+  int64_t free_pages  = 0;
+
+  (void)path;
+
+  if (!mdbfs_backend_sqlite_get_space(&page_size, &total_pages, &free_pages))
+    return -EIO;
+
+  memset(stat, 0, sizeof(struct statvfs));
+  stat->f_bsize   = page_size;
+  stat->f_frsize  = page_size;
+  stat->f_blocks  = total_pages;
+  stat->f_bfree   = free_pages;
+  stat->f_bavail  = free_pages;
+  stat->f_namemax = 255;
+
+  return 0;
+}
+
 /********** Public APIs **********/
 
+void mdbfs_backend_sqlite_set_fanout(int64_t fanout)
+{
+  g_fanout = fanout;
+}
+
 struct mdbfs_backend_sqlite_operations mdbfs_backend_sqlite_get_operations(void)
 {
   return (struct mdbfs_backend_sqlite_operations) {
@@ -779,10 +2674,22 @@ struct mdbfs_backend_sqlite_operations mdbfs_backend_sqlite_get_operations(void)
     .mkdir    = _mkdir,
     .rmdir    = _rmdir,
 
+    .open     = _open,
+    .release  = _release,
     .read     = _read,
     .write    = _write,
+    .flush    = _flush,
+    .truncate = _truncate,
+    .fallocate = _fallocate,
+    .copy_file_range = _copy_file_range,
+    .opendir  = _opendir,
     .readdir  = _readdir,
+    .releasedir = _releasedir,
 
-    .getattr  = _getattr,
+    .getattr   = _getattr,
+    .readlink  = _readlink,
+    .getxattr  = _getxattr,
+    .listxattr = _listxattr,
+    .statfs    = _statfs,
   };
 }
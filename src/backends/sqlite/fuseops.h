@@ -21,6 +21,11 @@
  * `T` and `R` are directories, while `C` is a file. The content of `C` is the
  * value stored in the cell, which is located in <T, R, C> in the original
  * SQLite database management system.
+ *
+ * Virtual entries sit beside them: index lookups (`/T/.by`), ad-hoc queries
+ * (`/.query`), serialized files (`/T.csv`, `/T/R.json`, ...), bulk imports
+ * (`/T/.import`) and metrics (`/.metrics`). Each is described where it is
+ * handled in fuseops.c.
  */
 
 #ifndef MDBFS_BACKENDS_SQLITE_FUSEOPS_H
@@ -45,13 +50,24 @@ struct mdbfs_backend_sqlite_operations {
   int (*rmdir)  (const char *);
 
   /* I/O */
+  int (*open)    (const char *, struct fuse_file_info *);
+  int (*release) (const char *, struct fuse_file_info *);
   int (*read)    (const char *, char *, size_t, off_t, struct fuse_file_info *);
   int (*write)   (const char *, const char *, size_t, off_t, struct fuse_file_info *);
+  int (*flush)   (const char *, struct fuse_file_info *);
+  int (*truncate)(const char *, off_t, struct fuse_file_info *);
+  int (*fallocate)(const char *, int, off_t, off_t, struct fuse_file_info *);
+  ssize_t (*copy_file_range)(const char *, struct fuse_file_info *, off_t, const char *, struct fuse_file_info *, off_t, size_t, int);
   int (*opendir) (const char *, struct fuse_file_info *);
   int (*readdir) (const char *, void *, fuse_fill_dir_t, off_t, struct fuse_file_info *, enum fuse_readdir_flags);
+  int (*releasedir)(const char *, struct fuse_file_info *);
 
   /* Metadata */
-  int (*getattr) (const char *, struct stat *, struct fuse_file_info *);
+  int (*getattr)  (const char *, struct stat *, struct fuse_file_info *);
+  int (*readlink) (const char *, char *, size_t);
+  int (*getxattr) (const char *, const char *, char *, size_t);
+  int (*listxattr)(const char *, char *, size_t);
+  int (*statfs)   (const char *, struct statvfs *);
 };
 
 /**
@@ -63,4 +79,13 @@ struct mdbfs_backend_sqlite_operations {
  */
 struct mdbfs_backend_sqlite_operations mdbfs_backend_sqlite_get_operations(void);
 
+/**
+ * Fan rows of tables out into buckets, so that no directory holds much more
+ * than `fanout` entries.
+ *
+ * @param fanout [in] Rows per bucket, at least 2, or 0 to keep rows right in
+ *                    their tables.
+ */
+void mdbfs_backend_sqlite_set_fanout(int64_t fanout);
+
 #endif
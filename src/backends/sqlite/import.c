@@ -0,0 +1,896 @@
+/**
+ * @file import.c
+ *
+ * Implementation of bulk imports for the MDBFS SQLite backend.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sqlite3.h>
+#include "utils/escape.h"
+#include "utils/memory.h"
+#include "utils/print.h"
+#include "dbmgr.h"
+#include "import.h"
+
+/**
+ * Rows inserted in one transaction at most. A batch is also committed once the
+ * import has been idle for a while, see import_resume.
+ */
+#define MDBFS_SQLITE_IMPORT_BATCH_ROWS 10000
+
+/********** Private Structures **********/
+
+/**
+ * Format of an import stream, told by its first non-blank byte.
+ */
+enum import_format {
+  IMPORT_FORMAT_UNKNOWN = 0,
+  IMPORT_FORMAT_CSV,
+  IMPORT_FORMAT_JSONL,
+};
+
+/**
+ * Type of a parsed value, which decides how it is bound.
+ */
+enum field_type {
+  FIELD_TYPE_NULL = 0,
+  FIELD_TYPE_TEXT,
+  FIELD_TYPE_INTEGER,
+  FIELD_TYPE_REAL,
+};
+
+/**
+ * A value parsed from a record. Contents live in `values` of the import,
+ * referred to by offsets since the buffer moves as it grows.
+ */
+struct field {
+  enum field_type type;
+  size_t offset; ///< Offset of the NUL-terminated value
+  size_t length; ///< Length of the value
+  size_t key;    ///< Offset of the NUL-terminated key (JSON Lines only)
+};
+
+struct mdbfs_backend_sqlite_import {
+  char *table_name;
+  enum import_format format;
+
+  char   *pending;          ///< Received bytes not yet parsed into records
+  size_t  pending_length;
+  size_t  pending_capacity;
+  int64_t received;         ///< Bytes received, i.e. the next expected offset
+
+  char   *values;           ///< Decoded keys and values of the current record
+  size_t  values_length;
+  size_t  values_capacity;
+  struct field *fields;     ///< Fields of the current record
+  size_t  nfields;
+  size_t  fields_capacity;
+
+  char  **columns;          ///< Columns `stmt` inserts into, NULL-terminated
+  size_t  ncolumns;
+  sqlite3_stmt *stmt;       ///< The reused INSERT
+
+  int     in_transaction;   ///< Whether a batch is open
+  int64_t batch_rows;       ///< Rows inserted in the open batch
+  int64_t rows;             ///< Rows inserted in total
+
+  int failed;
+  int finished;
+  struct timespec start;
+
+  pthread_mutex_t lock;
+};
+
+/**
+ * Report of the last finished import into a table.
+ */
+struct report {
+  char *table_name;
+  char *text;
+  struct report *next;
+};
+
+/********** Private States **********/
+
+static int             g_import_running = 0;
+static struct report  *g_reports = NULL;
+static pthread_mutex_t g_import_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/********** Private APIs **********/
+
+static void buffer_reserve(char **data, size_t *capacity, size_t length, size_t more)
+{
+  if (length + more <= *capacity)
+    return;
+
+  size_t new_capacity = *capacity ? *capacity : 4096;
+  while (new_capacity < length + more)
+    new_capacity *= 2;
+
+  *data = mdbfs_realloc(*data, new_capacity);
+  *capacity = new_capacity;
+}
+
+/**
+ * Append bytes to the value being decoded.
+ */
+static void value_append(struct mdbfs_backend_sqlite_import *import, const char *data, size_t length)
+{
+  buffer_reserve(&import->values, &import->values_capacity, import->values_length, length);
+  memcpy(import->values + import->values_length, data, length);
+  import->values_length += length;
+}
+
+static void value_append_char(struct mdbfs_backend_sqlite_import *import, char c)
+{
+  value_append(import, &c, 1);
+}
+
+/**
+ * Start a new field, whose value is appended next.
+ */
+static struct field *field_begin(struct mdbfs_backend_sqlite_import *import)
+{
+  if (import->nfields == import->fields_capacity) {
+    import->fields_capacity = import->fields_capacity ? import->fields_capacity * 2 : 16;
+    import->fields = mdbfs_realloc(import->fields, import->fields_capacity * sizeof(struct field));
+  }
+
+  struct field *field = &import->fields[import->nfields++];
+  field->type   = FIELD_TYPE_TEXT;
+  field->offset = import->values_length;
+  field->length = 0;
+  field->key    = 0;
+
+  return field;
+}
+
+/**
+ * End the field being decoded, terminating its value.
+ */
+static void field_end(struct mdbfs_backend_sqlite_import *import)
+{
+  struct field *field = &import->fields[import->nfields - 1];
+
+  field->length = import->values_length - field->offset;
+  value_append_char(import, '\0');
+}
+
+static void record_reset(struct mdbfs_backend_sqlite_import *import)
+{
+  import->nfields = 0;
+  import->values_length = 0;
+}
+
+/**
+ * Mark an import failed, rolling back the open batch so that the connection is
+ * not left in a transaction.
+ */
+static void import_fail(struct mdbfs_backend_sqlite_import *import)
+{
+  if (import->in_transaction)
+    mdbfs_backend_sqlite_rollback();
+
+  import->in_transaction = 0;
+  import->failed = 1;
+}
+
+/**
+ * Take the open batch back before working on it. Between writes, the batch is
+ * paused (see mdbfs_backend_sqlite_pause), so that it is committed in the
+ * background if no write follows soon, keeping other writes from waiting on it.
+ *
+ * @return 1 on success, 0 if the batch could not be committed while paused.
+ */
+static int import_resume(struct mdbfs_backend_sqlite_import *import)
+{
+  if (!import->in_transaction)
+    return 1;
+
+  int r = mdbfs_backend_sqlite_resume();
+  if (r > 0)
+    return 1;
+
+  import->in_transaction = 0;
+  import->batch_rows = 0;
+  return r == 0;
+}
+
+static void columns_free(struct mdbfs_backend_sqlite_import *import)
+{
+  if (import->columns) {
+    for (size_t i = 0; import->columns[i]; i++)
+      mdbfs_free(import->columns[i]);
+    mdbfs_free(import->columns);
+  }
+
+  import->ncolumns = 0;
+  sqlite3_finalize(import->stmt);
+  import->stmt = NULL;
+}
+
+/**
+ * Make the INSERT match the given columns, reusing it if it already does.
+ *
+ * @param import [in] The import.
+ * @param keys   [in] Whether the columns are the keys of the fields (JSON
+ *                    Lines), or the values of them (a CSV header).
+ * @return 1 on success, 0 on failure.
+ */
+static int import_use_columns(struct mdbfs_backend_sqlite_import *import, int keys)
+{
+  if (import->stmt && import->ncolumns == import->nfields) {
+    size_t i = 0;
+
+    for (; i < import->nfields; i++) {
+      size_t offset = keys ? import->fields[i].key : import->fields[i].offset;
+      if (strcmp(import->columns[i], import->values + offset) != 0)
+        break;
+    }
+
+    if (i == import->nfields)
+      return 1;
+  }
+
+  columns_free(import);
+
+  if (import->nfields == 0) {
+    mdbfs_warning("sqlite: import: a record without any column cannot be inserted into \"%s\"", import->table_name);
+    return 0;
+  }
+
+  import->columns = mdbfs_malloc0((import->nfields + 1) * sizeof(char *));
+  for (size_t i = 0; i < import->nfields; i++) {
+    const char *name = import->values + (keys ? import->fields[i].key : import->fields[i].offset);
+
+    import->columns[i] = mdbfs_malloc0(strlen(name) + 1);
+    strcpy(import->columns[i], name);
+  }
+  import->ncolumns = import->nfields;
+
+  import->stmt = mdbfs_backend_sqlite_prepare_insert(import->table_name, import->columns);
+
+  return import->stmt ? 1 : 0;
+}
+
+/**
+ * Insert the current record as a row.
+ *
+ * @return 1 on success, 0 on failure.
+ */
+static int import_insert(struct mdbfs_backend_sqlite_import *import)
+{
+  int r = 0;
+
+  if (import->nfields != import->ncolumns) {
+    mdbfs_warning("sqlite: import: record %lld has %zu fields, but %zu columns are expected", (long long)import->rows + 1, import->nfields, import->ncolumns);
+    return 0;
+  }
+
+  if (!import->in_transaction) {
+    if (!mdbfs_backend_sqlite_begin())
+      return 0;
+    import->in_transaction = 1;
+  }
+
+  for (size_t i = 0; i < import->nfields; i++) {
+    const struct field *field = &import->fields[i];
+    const char *value = import->values + field->offset;
+
+    switch (field->type) {
+      case FIELD_TYPE_NULL:
+        sqlite3_bind_null(import->stmt, i + 1);
+        break;
+      case FIELD_TYPE_INTEGER:
+        sqlite3_bind_int64(import->stmt, i + 1, strtoll(value, NULL, 10));
+        break;
+      case FIELD_TYPE_REAL:
+        sqlite3_bind_double(import->stmt, i + 1, strtod(value, NULL));
+        break;
+      case FIELD_TYPE_TEXT:
+      default:
+        sqlite3_bind_text(import->stmt, i + 1, value, field->length, SQLITE_STATIC);
+        break;
+    }
+  }
+
+  r = sqlite3_step(import->stmt);
+  sqlite3_reset(import->stmt);
+  sqlite3_clear_bindings(import->stmt);
+
+  if (r != SQLITE_DONE) {
+    mdbfs_warning("sqlite: import: cannot insert record %lld into \"%s\": %s", (long long)import->rows + 1, import->table_name, sqlite3_errstr(r));
+    return 0;
+  }
+
+  import->rows += 1;
+  import->batch_rows += 1;
+
+  if (import->batch_rows >= MDBFS_SQLITE_IMPORT_BATCH_ROWS) {
+    import->in_transaction = 0;
+    import->batch_rows = 0;
+
+    if (!mdbfs_backend_sqlite_commit())
+      return 0;
+  }
+
+  return 1;
+}
+
+/**
+ * Parse one CSV record (RFC 4180) from the start of the data.
+ *
+ * Unquoted empty fields are NULL, while quoted ones are empty strings, which is
+ * how exported CSV files tell them apart.
+ *
+ * @param final    [in]  Whether no more data will follow.
+ * @param consumed [out] Bytes taken by the record.
+ * @return 1 if a record is parsed, 0 if more data is needed, -1 on malformed
+ *         data.
+ */
+static int csv_parse(struct mdbfs_backend_sqlite_import *import, const char *data, size_t length, int final, size_t *consumed)
+{
+  size_t i = 0;
+
+  record_reset(import);
+
+  for (;;) {
+    struct field *field = field_begin(import);
+
+    if (i < length && data[i] == '"') {
+
+      /* Quoted; quotes inside are doubled */
+      i += 1;
+      for (;;) {
+        const char *quote = memchr(data + i, '"', length - i);
+        if (!quote)
+          return final ? -1 : 0;
+
+        value_append(import, data + i, quote - data - i);
+        i = quote - data + 1;
+
+        /* A quote at the end could be the first of a doubled one */
+        if (i == length && !final)
+          return 0;
+
+        if (i < length && data[i] == '"') {
+          value_append_char(import, '"');
+          i += 1;
+          continue;
+        }
+
+        break;
+      }
+
+    } else {
+
+      size_t span = mdbfs_escape_span(MDBFS_ESCAPE_SET_CSV, data + i, length - i);
+
+      if (i + span == length && !final)
+        return 0;
+
+      if (span == 0)
+        field->type = FIELD_TYPE_NULL;
+
+      value_append(import, data + i, span);
+      i += span;
+
+    }
+
+    field_end(import);
+
+    if (i == length) {
+      *consumed = i;
+      return 1;
+    }
+
+    switch (data[i]) {
+      case ',':
+        i += 1;
+        continue;
+
+      case '\r':
+        if (i + 1 == length && !final)
+          return 0;
+        i += 1;
+        if (i < length && data[i] == '\n')
+          i += 1;
+        *consumed = i;
+        return 1;
+
+      case '\n':
+        *consumed = i + 1;
+        return 1;
+
+      default:
+        /* A quote in the middle of an unquoted field, or after a quoted one */
+        return -1;
+    }
+  }
+}
+
+static const char *json_skip_blank(const char *p, const char *end)
+{
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+    p++;
+  return p;
+}
+
+/**
+ * Decode a JSON string at `p` (at the opening quote) into the value buffer.
+ *
+ * @return Where the string ends (after the closing quote), or NULL if it is
+ *         malformed.
+ */
+static const char *json_parse_string(struct mdbfs_backend_sqlite_import *import, const char *p, const char *end)
+{
+  p += 1;
+
+  for (;;) {
+    size_t span = mdbfs_escape_span(MDBFS_ESCAPE_SET_JSON, p, end - p);
+
+    value_append(import, p, span);
+    p += span;
+
+    if (p == end)
+      return NULL;
+
+    if (*p == '"')
+      return p + 1;
+
+    /* Control characters must have been escaped */
+    if (*p != '\\' || p + 1 == end)
+      return NULL;
+
+    p += 1;
+    switch (*p++) {
+      case '"':  value_append_char(import, '"');  break;
+      case '\\': value_append_char(import, '\\'); break;
+      case '/':  value_append_char(import, '/');  break;
+      case 'b':  value_append_char(import, '\b'); break;
+      case 'f':  value_append_char(import, '\f'); break;
+      case 'n':  value_append_char(import, '\n'); break;
+      case 'r':  value_append_char(import, '\r'); break;
+      case 't':  value_append_char(import, '\t'); break;
+      case 'u': {
+        char hex[5] = {0};
+        char utf8[4];
+        size_t utf8_length = 0;
+
+        if (end - p < 4)
+          return NULL;
+        memcpy(hex, p, 4);
+        p += 4;
+
+        char *hex_end = NULL;
+        unsigned long code = strtoul(hex, &hex_end, 16);
+        if (hex_end != hex + 4)
+          return NULL;
+
+        /* A high surrogate is followed by a low one */
+        if (code >= 0xd800 && code <= 0xdbff) {
+          if (end - p < 6 || p[0] != '\\' || p[1] != 'u')
+            return NULL;
+          memcpy(hex, p + 2, 4);
+
+          unsigned long low = strtoul(hex, &hex_end, 16);
+          if (hex_end != hex + 4 || low < 0xdc00 || low > 0xdfff)
+            return NULL;
+          p += 6;
+
+          code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+        }
+
+        if (code < 0x80) {
+          utf8[utf8_length++] = code;
+        } else if (code < 0x800) {
+          utf8[utf8_length++] = 0xc0 | (code >> 6);
+          utf8[utf8_length++] = 0x80 | (code & 0x3f);
+        } else if (code < 0x10000) {
+          utf8[utf8_length++] = 0xe0 | (code >> 12);
+          utf8[utf8_length++] = 0x80 | ((code >> 6) & 0x3f);
+          utf8[utf8_length++] = 0x80 | (code & 0x3f);
+        } else {
+          utf8[utf8_length++] = 0xf0 | (code >> 18);
+          utf8[utf8_length++] = 0x80 | ((code >> 12) & 0x3f);
+          utf8[utf8_length++] = 0x80 | ((code >> 6) & 0x3f);
+          utf8[utf8_length++] = 0x80 | (code & 0x3f);
+        }
+
+        value_append(import, utf8, utf8_length);
+        break;
+      }
+      default:
+        return NULL;
+    }
+  }
+}
+
+/**
+ * Parse a scalar JSON value (string, number, boolean or null) into a field.
+ *
+ * @return Where the value ends, or NULL if it is malformed or not a scalar.
+ */
+static const char *json_parse_value(struct mdbfs_backend_sqlite_import *import, struct field *field, const char *p, const char *end)
+{
+  if (p == end)
+    return NULL;
+
+  if (*p == '"')
+    return json_parse_string(import, p, end);
+
+  if (end - p >= 4 && memcmp(p, "null", 4) == 0) {
+    field->type = FIELD_TYPE_NULL;
+    return p + 4;
+  }
+
+  if (end - p >= 4 && memcmp(p, "true", 4) == 0) {
+    field->type = FIELD_TYPE_INTEGER;
+    value_append_char(import, '1');
+    return p + 4;
+  }
+
+  if (end - p >= 5 && memcmp(p, "false", 5) == 0) {
+    field->type = FIELD_TYPE_INTEGER;
+    value_append_char(import, '0');
+    return p + 5;
+  }
+
+  /* Numbers */
+  const char *start = p;
+  int real = 0;
+
+  while (p < end && strchr("+-0123456789.eE", *p)) {
+    if (*p == '.' || *p == 'e' || *p == 'E')
+      real = 1;
+    p++;
+  }
+
+  if (p == start)
+    return NULL;
+
+  value_append(import, start, p - start);
+
+  /* Integers too large for 64 bits are stored as reals, as SQLite does */
+  if (!real) {
+    char number[32] = {0};
+    if ((size_t)(p - start) >= sizeof(number))
+      real = 1;
+    else {
+      memcpy(number, start, p - start);
+      errno = 0;
+      strtoll(number, NULL, 10);
+      if (errno == ERANGE)
+        real = 1;
+    }
+  }
+
+  field->type = real ? FIELD_TYPE_REAL : FIELD_TYPE_INTEGER;
+  return p;
+}
+
+/**
+ * Parse one JSON Lines record, a flat object, from the start of the data.
+ *
+ * Parameters and return values are the same as csv_parse. Blank lines are
+ * parsed as records without fields.
+ */
+static int jsonl_parse(struct mdbfs_backend_sqlite_import *import, const char *data, size_t length, int final, size_t *consumed)
+{
+  const char *newline = memchr(data, '\n', length);
+  const char *end = newline ? newline : data + length;
+  const char *p = data;
+
+  if (!newline && !final)
+    return 0;
+
+  record_reset(import);
+  *consumed = newline ? (size_t)(newline - data) + 1 : length;
+
+  p = json_skip_blank(p, end);
+  if (p == end)
+    return 1;
+
+  if (*p != '{')
+    return -1;
+  p = json_skip_blank(p + 1, end);
+
+  if (p < end && *p == '}')
+    goto close;
+
+  for (;;) {
+    /* "key" */
+    if (p == end || *p != '"')
+      return -1;
+
+    size_t key = import->values_length;
+    p = json_parse_string(import, p, end);
+    if (!p)
+      return -1;
+    value_append_char(import, '\0');
+
+    /* : */
+    p = json_skip_blank(p, end);
+    if (p == end || *p != ':')
+      return -1;
+    p = json_skip_blank(p + 1, end);
+
+    /* value */
+    struct field *field = field_begin(import);
+    field->key = key;
+
+    p = json_parse_value(import, field, p, end);
+    if (!p)
+      return -1;
+    field_end(import);
+
+    /* , or } */
+    p = json_skip_blank(p, end);
+    if (p == end)
+      return -1;
+    if (*p == '}')
+      break;
+    if (*p != ',')
+      return -1;
+    p = json_skip_blank(p + 1, end);
+  }
+
+close:
+  p = json_skip_blank(p + 1, end);
+  return p == end ? 1 : -1;
+}
+
+/**
+ * Parse and insert every complete record in the pending data.
+ *
+ * @param final [in] Whether no more data will follow.
+ * @return 1 on success, 0 on failure.
+ */
+static int import_process(struct mdbfs_backend_sqlite_import *import, int final)
+{
+  size_t start = 0;
+  int ret = 1;
+
+  /* Tell the format by the first non-blank byte */
+  if (import->format == IMPORT_FORMAT_UNKNOWN) {
+    for (size_t i = 0; i < import->pending_length; i++) {
+      char c = import->pending[i];
+
+      if (c == ' ' || c == '\t' || c == '\r' || c == '\n')
+        continue;
+
+      import->format = c == '{' ? IMPORT_FORMAT_JSONL : IMPORT_FORMAT_CSV;
+      mdbfs_debug("sqlite: import: importing %s into \"%s\"", c == '{' ? "JSON Lines" : "CSV", import->table_name);
+      break;
+    }
+
+    if (import->format == IMPORT_FORMAT_UNKNOWN)
+      return 1;
+  }
+
+  while (start < import->pending_length) {
+    const char *data = import->pending + start;
+    size_t length = import->pending_length - start;
+    size_t consumed = 0;
+    int r = 0;
+
+    /* Blank lines separate nothing */
+    if (data[0] == '\n' || (data[0] == '\r' && length > 1 && data[1] == '\n')) {
+      start += data[0] == '\n' ? 1 : 2;
+      continue;
+    }
+
+    if (import->format == IMPORT_FORMAT_CSV)
+      r = csv_parse(import, data, length, final, &consumed);
+    else
+      r = jsonl_parse(import, data, length, final, &consumed);
+
+    if (r == 0)
+      break;
+
+    if (r < 0) {
+      mdbfs_warning("sqlite: import: malformed record %lld for \"%s\"", (long long)import->rows + 1, import->table_name);
+      ret = 0;
+      break;
+    }
+
+    start += consumed;
+
+    if (import->format == IMPORT_FORMAT_CSV && !import->columns) {
+      /* The first CSV record is the header */
+      if (!import_use_columns(import, 0)) {
+        ret = 0;
+        break;
+      }
+      continue;
+    }
+
+    if (import->nfields == 0)
+      continue;
+
+    if ((import->format == IMPORT_FORMAT_JSONL && !import_use_columns(import, 1)) ||
+        !import_insert(import)) {
+      ret = 0;
+      break;
+    }
+  }
+
+  /* Keep the incomplete record for the next piece */
+  memmove(import->pending, import->pending + start, import->pending_length - start);
+  import->pending_length -= start;
+
+  return ret;
+}
+
+/********** Public APIs **********/
+
+struct mdbfs_backend_sqlite_import *mdbfs_backend_sqlite_import_open(const char *table_name)
+{
+  struct mdbfs_backend_sqlite_import *ret = NULL;
+
+  pthread_mutex_lock(&g_import_lock);
+
+  if (g_import_running) {
+    mdbfs_warning("sqlite: import: another import is running; refusing to import into \"%s\"", table_name);
+    goto quit;
+  }
+
+  g_import_running = 1;
+
+  ret = mdbfs_malloc0(sizeof(struct mdbfs_backend_sqlite_import));
+  ret->table_name = mdbfs_malloc0(strlen(table_name) + 1);
+  strcpy(ret->table_name, table_name);
+
+  clock_gettime(CLOCK_MONOTONIC, &ret->start);
+  pthread_mutex_init(&ret->lock, NULL);
+
+quit:
+  pthread_mutex_unlock(&g_import_lock);
+  return ret;
+}
+
+int mdbfs_backend_sqlite_import_write(struct mdbfs_backend_sqlite_import *import, const char *buf, size_t size, int64_t offset)
+{
+  int ret = 0;
+
+  pthread_mutex_lock(&import->lock);
+
+  if (import->failed || import->finished)
+    goto quit;
+
+  if (!import_resume(import)) {
+    mdbfs_warning("sqlite: import: rows imported into \"%s\" are lost", import->table_name);
+    import_fail(import);
+    goto quit;
+  }
+
+  if (offset != import->received) {
+    mdbfs_warning("sqlite: import: \"%s\" must be written sequentially (expected offset %lld, got %lld)", import->table_name, (long long)import->received, (long long)offset);
+    import_fail(import);
+    goto quit;
+  }
+
+  buffer_reserve(&import->pending, &import->pending_capacity, import->pending_length, size);
+  memcpy(import->pending + import->pending_length, buf, size);
+  import->pending_length += size;
+  import->received += size;
+
+  ret = import_process(import, 0);
+
+  if (!ret)
+    import_fail(import);
+  else if (import->in_transaction)
+    mdbfs_backend_sqlite_pause();
+
+quit:
+  pthread_mutex_unlock(&import->lock);
+  return ret;
+}
+
+int mdbfs_backend_sqlite_import_finish(struct mdbfs_backend_sqlite_import *import)
+{
+  struct timespec now;
+  int ret = 0;
+
+  pthread_mutex_lock(&import->lock);
+
+  if (import->finished)
+    goto quit;
+  import->finished = 1;
+
+  if (!import->failed && !import_resume(import))
+    import_fail(import);
+
+  if (!import->failed && !import_process(import, 1))
+    import_fail(import);
+
+  if (!import->failed && import->in_transaction) {
+    import->in_transaction = 0;
+    if (!mdbfs_backend_sqlite_commit())
+      import_fail(import);
+  }
+
+  /* Report */
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  double seconds = (now.tv_sec - import->start.tv_sec) + (now.tv_nsec - import->start.tv_nsec) / 1e9;
+  double rate = seconds > 0 ? import->rows / seconds : 0;
+
+  struct report *report = mdbfs_malloc0(sizeof(struct report));
+  report->table_name = mdbfs_malloc0(strlen(import->table_name) + 1);
+  strcpy(report->table_name, import->table_name);
+
+  const char *fmt = "status: %s\nrows: %lld\nseconds: %.3f\nrows_per_second: %.0f\n";
+  const char *status = import->failed ? "failed" : "ok";
+  int report_length = snprintf(NULL, 0, fmt, status, (long long)import->rows, seconds, rate);
+  report->text = mdbfs_malloc0(report_length + 1);
+  snprintf(report->text, report_length + 1, fmt, status, (long long)import->rows, seconds, rate);
+
+  mdbfs_info("sqlite: import: %s: %lld rows into \"%s\" in %.3f s (%.0f rows/s)", status, (long long)import->rows, import->table_name, seconds, rate);
+
+  /* Replace the last report of the table */
+  pthread_mutex_lock(&g_import_lock);
+  for (struct report **p = &g_reports; *p; p = &(*p)->next) {
+    if (strcmp((*p)->table_name, report->table_name) == 0) {
+      struct report *old = *p;
+      *p = old->next;
+      mdbfs_free(old->table_name);
+      mdbfs_free(old->text);
+      mdbfs_free(old);
+      break;
+    }
+  }
+  report->next = g_reports;
+  g_reports = report;
+  pthread_mutex_unlock(&g_import_lock);
+
+quit:
+  ret = !import->failed;
+  pthread_mutex_unlock(&import->lock);
+  return ret;
+}
+
+void mdbfs_backend_sqlite_import_close(struct mdbfs_backend_sqlite_import *import)
+{
+  if (!import)
+    return;
+
+  mdbfs_backend_sqlite_import_finish(import);
+
+  columns_free(import);
+  pthread_mutex_destroy(&import->lock);
+
+  mdbfs_free(import->table_name);
+  mdbfs_free(import->pending);
+  mdbfs_free(import->values);
+  mdbfs_free(import->fields);
+  mdbfs_free(import);
+
+  pthread_mutex_lock(&g_import_lock);
+  g_import_running = 0;
+  pthread_mutex_unlock(&g_import_lock);
+}
+
+char *mdbfs_backend_sqlite_import_get_report(size_t *report_length, const char *table_name)
+{
+  char *ret = NULL;
+
+  pthread_mutex_lock(&g_import_lock);
+
+  for (struct report *report = g_reports; report; report = report->next) {
+    if (strcmp(report->table_name, table_name) == 0) {
+      *report_length = strlen(report->text);
+      ret = mdbfs_malloc0(*report_length + 1);
+      memcpy(ret, report->text, *report_length);
+      break;
+    }
+  }
+
+  pthread_mutex_unlock(&g_import_lock);
+  return ret;
+}
@@ -0,0 +1,78 @@
+/**
+ * @file import.h
+ *
+ * Definition of bulk imports for the MDBFS SQLite backend.
+ *
+ * An import receives a CSV (with a header of column names) or JSON Lines
+ * stream as it is written, parsing and inserting every complete record right
+ * away, so that the stream is never buffered as a whole. Rows are inserted
+ * with one reused prepared INSERT, in transactions of many rows each.
+ *
+ * Only one import runs at a time, since its transactions span the connection.
+ */
+
+#ifndef MDBFS_BACKENDS_SQLITE_IMPORT_H
+#define MDBFS_BACKENDS_SQLITE_IMPORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * An ongoing import.
+ */
+struct mdbfs_backend_sqlite_import;
+
+/**
+ * Start importing into a table.
+ *
+ * @param table_name [in] Name of the table.
+ * @return The import, or NULL if another import is running. The caller is
+ *         responsible for closing it with mdbfs_backend_sqlite_import_close.
+ */
+struct mdbfs_backend_sqlite_import *mdbfs_backend_sqlite_import_open(const char *table_name);
+
+/**
+ * Feed a piece of the stream to an import.
+ *
+ * The stream must be written sequentially. Whether it is CSV or JSON Lines is
+ * told by its first non-blank byte: `{` for JSON Lines, anything else for CSV.
+ *
+ * @param import [in] The import.
+ * @param buf    [in] The piece of stream.
+ * @param size   [in] Size of the piece.
+ * @param offset [in] Offset of the piece in the stream.
+ * @return 1 on success, 0 if the stream is malformed, written out of order, or
+ *         rejected by the database. The import fails as a whole from then on.
+ */
+int mdbfs_backend_sqlite_import_write(struct mdbfs_backend_sqlite_import *import, const char *buf, size_t size, int64_t offset);
+
+/**
+ * Finish an import: insert the last record and commit.
+ *
+ * This can be called more than once; later calls only report the result.
+ *
+ * @param import [in] The import.
+ * @return 1 if every record has been inserted, 0 otherwise. Rows committed in
+ *         previous transactions stay in the table on failure.
+ */
+int mdbfs_backend_sqlite_import_finish(struct mdbfs_backend_sqlite_import *import);
+
+/**
+ * Close an import, finishing it if it has not been finished.
+ *
+ * @param import [in] The import. May be NULL.
+ */
+void mdbfs_backend_sqlite_import_close(struct mdbfs_backend_sqlite_import *import);
+
+/**
+ * Retrieve the report of the last finished import into a table: rows, seconds
+ * taken, and rows per second.
+ *
+ * @param report_length [out] Length of the report.
+ * @param table_name    [in]  Name of the table.
+ * @return The report (NUL-terminated), which the caller is responsible for
+ *         freeing, or NULL if nothing has been imported into the table.
+ */
+char *mdbfs_backend_sqlite_import_get_report(size_t *report_length, const char *table_name);
+
+#endif
@@ -4,8 +4,13 @@
  * Implementation of public interfaces exposed by the SQLite backend for MDBFS.
  */
 
+#include <glob.h>
+#include <string.h>
+#include <sys/stat.h>
 #include <sqlite3.h>
+#include "utils/cancel.h"
 #include "utils/memory.h"
+#include "utils/options.h"
 #include "utils/print.h"
 #include "backend.h"
 #include "dbmgr.h"
@@ -15,7 +20,32 @@
 
 static const char const *mdbfs_backend_name = "sqlite";
 static const char const *mdbfs_backend_description = "backend for reading SQLite files";
-static const char const *mdbfs_backend_help = NULL;
+static const char const *mdbfs_backend_help =
+  "    --db=<s>              May be given more than once, or as a quoted glob\n"
+  "                          (e.g. --db='shards/*.db'), to attach the files\n"
+  "                          as /D/T/R/C, D being the file name up to its\n"
+  "                          last dot (at most 10 files). Given a directory,\n"
+  "                          its files are attached as /F/T/R/C as they are\n"
+  "                          used, F being the file name.\n"
+  "    --open-databases=<n>  Files of a --db directory attached at once, the\n"
+  "                          least recently used being detached (default: 8,\n"
+  "                          at most 10).\n"
+  "    --table-template=<s>  Columns of tables created with mkdir, as in\n"
+  "                          CREATE TABLE (default: \"id INTEGER PRIMARY KEY\").\n"
+  "    --op-timeout=<ms>     Give up lookups, listings and reads running for\n"
+  "                          longer, with ETIMEDOUT (default: 0, no limit).\n"
+  "    --bloom-memory=<MiB>  Memory for Bloom filters telling rows that do not\n"
+  "                          exist without a lookup (default: 0, none).\n"
+  "    --fanout=<n>          Put rows of tables in two levels of buckets of n\n"
+  "                          by ROWID, as /T/B1/B2/R (default: 0, none).\n"
+  "    --prewarm=<s>         Tables to load the schemas and row estimates of\n"
+  "                          once mounted, separated by commas, or * for all.\n"
+  "    --prewarm-bytes=<MiB> Content of those tables to read as well, to have\n"
+  "                          it cached by the OS (default: 0, none).\n"
+  "    --prewarm-threads=<n> Threads reading the content (default: 4).\n"
+  "    --metadata-cache=<s>  File to keep schemas and ROWIDs of tables in\n"
+  "                          across mounts, e.g. next to the database as\n"
+  "                          data.db.mdbfs (default: none).";
 static const char const *mdbfs_backend_version = "0.1.0\n  with SQLite " SQLITE_VERSION;
 
 static const char *mdbfs_backend_sqlite_get_name(void)
@@ -38,14 +68,97 @@ static const char *mdbfs_backend_sqlite_get_version(void)
   return mdbfs_backend_version;
 }
 
-static int mdbfs_backend_sqlite_init(int argc, char **argv)
+/**
+ * Tell the database manager the databases to attach, if `--db` is given more
+ * than once or as a glob, or the directory of databases, if it is given as
+ * one; a single database is opened on its own.
+ *
+ * @param argc [in] Argument count from command line.
+ * @param argv [in] Argument vector from command line.
+ * @return 1 on success, 0 on failure.
+ */
+static int mdbfs_backend_sqlite_init_databases(int argc, char **argv)
 {
-  (void)argc;
-  (void)argv;
-
-  /* No-op */
+  const char **paths = mdbfs_option_get_all(argc, argv, "db");
+  glob_t matches = {0};
+  int attached = 0;
+  int ret = 0;
+
+  for (size_t i = 0; paths[i]; i++)
+    if (i > 0 || strpbrk(paths[i], "*?["))
+      attached = 1;
+
+  /* Files in a directory are not looked at until they are used */
+  struct stat st;
+  if (!attached && paths[0] && stat(paths[0], &st) == 0 && S_ISDIR(st.st_mode)) {
+    int64_t open_databases = mdbfs_option_get_int(argc, argv, "open-databases", 0);
+    if (open_databases < 0) {
+      mdbfs_error("sqlite: --open-databases takes a number of databases");
+      goto quit;
+    }
+
+    ret = mdbfs_backend_sqlite_set_database_dir(paths[0], open_databases);
+    goto quit;
+  }
+
+  if (!attached) {
+    ret = 1;
+    goto quit;
+  }
+
+  for (size_t i = 0; paths[i]; i++) {
+    int r = glob(paths[i], i ? GLOB_APPEND : 0, NULL, &matches);
+    if (r != 0) {
+      mdbfs_error("sqlite: --db=%s %s", paths[i], r == GLOB_NOMATCH ? "matches no file" : "cannot be expanded");
+      goto quit;
+    }
+  }
+
+  ret = mdbfs_backend_sqlite_set_databases((const char *const *)matches.gl_pathv);
+
+quit:
+  if (attached)
+    globfree(&matches);
+  mdbfs_free(paths);
+  return ret;
+}
 
-  return 1;
+static int mdbfs_backend_sqlite_init(int argc, char **argv)
+{
+  mdbfs_backend_sqlite_set_table_template(mdbfs_option_get(argc, argv, "table-template"));
+
+  int64_t op_timeout = mdbfs_option_get_int(argc, argv, "op-timeout", 0);
+  if (op_timeout < 0) {
+    mdbfs_error("sqlite: --op-timeout takes a number of milliseconds");
+    return 0;
+  }
+  mdbfs_cancel_set_timeout(op_timeout);
+
+  int64_t bloom_memory = mdbfs_option_get_int(argc, argv, "bloom-memory", 0);
+  if (bloom_memory < 0) {
+    mdbfs_error("sqlite: --bloom-memory takes a number of MiB");
+    return 0;
+  }
+  mdbfs_backend_sqlite_set_bloom_memory(bloom_memory * 1024 * 1024);
+
+  /* Beyond this, the square of the fan-out does not fit in a ROWID */
+  int64_t fanout = mdbfs_option_get_int(argc, argv, "fanout", 0);
+  if (fanout < 0 || fanout == 1 || fanout > INT32_MAX) {
+    mdbfs_error("sqlite: --fanout takes a number of rows per bucket, from 2 to %d", INT32_MAX);
+    return 0;
+  }
+  mdbfs_backend_sqlite_set_fanout(fanout);
+
+  int64_t prewarm_bytes = mdbfs_option_get_int(argc, argv, "prewarm-bytes", 0);
+  int64_t prewarm_threads = mdbfs_option_get_int(argc, argv, "prewarm-threads", 0);
+  if (prewarm_bytes < 0 || prewarm_threads < 0 || prewarm_threads > 64) {
+    mdbfs_error("sqlite: --prewarm-bytes takes a number of MiB, and --prewarm-threads a number of threads up to 64");
+    return 0;
+  }
+  mdbfs_backend_sqlite_set_prewarm(mdbfs_option_get(argc, argv, "prewarm"), prewarm_bytes * 1024 * 1024, prewarm_threads);
+  mdbfs_backend_sqlite_set_metadata_cache(mdbfs_option_get(argc, argv, "metadata-cache"));
+
+  return mdbfs_backend_sqlite_init_databases(argc, argv);
 }
 
 static void mdbfs_backend_sqlite_deinit(void)
@@ -59,7 +172,7 @@ static struct fuse_operations mdbfs_backend_sqlite_get_fuse_operations(void)
 
   return (struct fuse_operations) {
     .getattr         = ops.getattr,
-    .readlink        = NULL,
+    .readlink        = ops.readlink,
     .mknod           = ops.mknod,
     .mkdir           = ops.mkdir,
     .unlink          = ops.unlink,
@@ -69,21 +182,21 @@ static struct fuse_operations mdbfs_backend_sqlite_get_fuse_operations(void)
     .link            = NULL,
     .chmod           = NULL,
     .chown           = NULL,
-    .truncate        = NULL,
-    .open            = NULL,
+    .truncate        = ops.truncate,
+    .open            = ops.open,
     .read            = ops.read,
     .write           = ops.write,
-    .statfs          = NULL,
-    .flush           = NULL,
-    .release         = NULL,
+    .statfs          = ops.statfs,
+    .flush           = ops.flush,
+    .release         = ops.release,
     .fsync           = NULL,
     .setxattr        = NULL,
-    .getxattr        = NULL,
-    .listxattr       = NULL,
+    .getxattr        = ops.getxattr,
+    .listxattr       = ops.listxattr,
     .removexattr     = NULL,
     .opendir         = ops.opendir,
     .readdir         = ops.readdir,
-    .releasedir      = NULL,
+    .releasedir      = ops.releasedir,
     .fsyncdir        = NULL,
     .init            = ops.init,
     .destroy         = ops.destroy,
@@ -97,8 +210,8 @@ static struct fuse_operations mdbfs_backend_sqlite_get_fuse_operations(void)
     .write_buf       = NULL,
     .read_buf        = NULL,
     .flock           = NULL,
-    .fallocate       = NULL,
-    .copy_file_range = NULL,
+    .fallocate       = ops.fallocate,
+    .copy_file_range = ops.copy_file_range,
   };
 }
 
@@ -0,0 +1,281 @@
+/**
+ * @file lazy.c
+ *
+ * Implementation of opening databases of backends in the background once
+ * mounted.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "utils/print.h"
+#include "lazy.h"
+
+/**
+ * The backend whose database is opened, and its operations being wrapped.
+ */
+static struct mdbfs_backend  *g_backend = NULL;
+static const char            *g_path = NULL;
+static struct fuse_operations g_ops;
+
+/**
+ * State of the thread opening the database.
+ */
+static pthread_t       g_opener;
+static int             g_opener_started = 0;
+static int             g_opened = 0; ///< Whether opening has finished, one way or the other
+static int             g_result = 0; ///< What mdbfs_backend.open has returned
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  g_cond = PTHREAD_COND_INITIALIZER;
+
+/**
+ * Body of the thread opening the database.
+ */
+static void *opener(void *data)
+{
+  struct timespec started;
+  struct timespec finished;
+
+  (void)data;
+
+  clock_gettime(CLOCK_MONOTONIC, &started);
+  int r = g_backend->open(g_path);
+  clock_gettime(CLOCK_MONOTONIC, &finished);
+
+  if (r > 0) {
+    mdbfs_info(
+      "database opened in %lld ms",
+      (long long)(finished.tv_sec - started.tv_sec) * 1000 + (finished.tv_nsec - started.tv_nsec) / 1000000
+    );
+  } else {
+    mdbfs_error("backend cannot open the database: %s", r == 0 ? "internal error" : strerror(-r));
+  }
+
+  pthread_mutex_lock(&g_lock);
+  g_result = r;
+  __atomic_store_n(&g_opened, 1, __ATOMIC_RELEASE);
+  pthread_cond_broadcast(&g_cond);
+  pthread_mutex_unlock(&g_lock);
+
+  return NULL;
+}
+
+/**
+ * Wait until the database is open.
+ *
+ * @return 0 if it is open, or the error opening it has failed with, negated.
+ */
+static int wait_opened(void)
+{
+  /* Once open, it stays so until unmounted */
+  if (__atomic_load_n(&g_opened, __ATOMIC_ACQUIRE))
+    return g_result > 0 ? 0 : g_result < 0 ? g_result : -EIO;
+
+  pthread_mutex_lock(&g_lock);
+  while (!g_opened)
+    pthread_cond_wait(&g_cond, &g_lock);
+  pthread_mutex_unlock(&g_lock);
+
+  return g_result > 0 ? 0 : g_result < 0 ? g_result : -EIO;
+}
+
+/**
+ * Start opening the database, then initialize the file system as the backend
+ * does.
+ */
+static void *lazy_init(struct fuse_conn_info *conn, struct fuse_config *cfg)
+{
+  /* This runs once mounted (and daemonized), so the thread stays with us */
+  if (pthread_create(&g_opener, NULL, opener, NULL) == 0) {
+    g_opener_started = 1;
+  } else {
+    mdbfs_warning("cannot open the database in the background; opening it now");
+    opener(NULL);
+  }
+
+  return g_ops.init ? g_ops.init(conn, cfg) : NULL;
+}
+
+/**
+ * Close the database, if it has been opened, once opening has finished.
+ */
+static void lazy_destroy(void *private_data)
+{
+  if (g_opener_started)
+    pthread_join(g_opener, NULL);
+
+  if (wait_opened() == 0 && g_ops.destroy)
+    g_ops.destroy(private_data);
+}
+
+/* The rest wait for the database, then do as the backend does */
+
+static int lazy_getattr(const char *path, struct stat *st, struct fuse_file_info *fi)
+{
+  int r = wait_opened();
+  return r ? r : g_ops.getattr(path, st, fi);
+}
+
+static int lazy_readlink(const char *path, char *buf, size_t size)
+{
+  int r = wait_opened();
+  return r ? r : g_ops.readlink(path, buf, size);
+}
+
+static int lazy_mknod(const char *path, mode_t mode, dev_t device)
+{
+  int r = wait_opened();
+  return r ? r : g_ops.mknod(path, mode, device);
+}
+
+static int lazy_mkdir(const char *path, mode_t mode)
+{
+  int r = wait_opened();
+  return r ? r : g_ops.mkdir(path, mode);
+}
+
+static int lazy_unlink(const char *path)
+{
+  int r = wait_opened();
+  return r ? r : g_ops.unlink(path);
+}
+
+static int lazy_rmdir(const char *path)
+{
+  int r = wait_opened();
+  return r ? r : g_ops.rmdir(path);
+}
+
+static int lazy_rename(const char *path_old, const char *path_new, unsigned int flags)
+{
+  int r = wait_opened();
+  return r ? r : g_ops.rename(path_old, path_new, flags);
+}
+
+static int lazy_truncate(const char *path, off_t size, struct fuse_file_info *fi)
+{
+  int r = wait_opened();
+  return r ? r : g_ops.truncate(path, size, fi);
+}
+
+static int lazy_open(const char *path, struct fuse_file_info *fi)
+{
+  int r = wait_opened();
+  return r ? r : g_ops.open(path, fi);
+}
+
+static int lazy_read(const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *fi)
+{
+  int r = wait_opened();
+  return r ? r : g_ops.read(path, buf, size, offset, fi);
+}
+
+static int lazy_write(const char *path, const char *buf, size_t size, off_t offset, struct fuse_file_info *fi)
+{
+  int r = wait_opened();
+  return r ? r : g_ops.write(path, buf, size, offset, fi);
+}
+
+static int lazy_statfs(const char *path, struct statvfs *st)
+{
+  int r = wait_opened();
+  return r ? r : g_ops.statfs(path, st);
+}
+
+static int lazy_flush(const char *path, struct fuse_file_info *fi)
+{
+  int r = wait_opened();
+  return r ? r : g_ops.flush(path, fi);
+}
+
+static int lazy_release(const char *path, struct fuse_file_info *fi)
+{
+  int r = wait_opened();
+  return r ? r : g_ops.release(path, fi);
+}
+
+static int lazy_getxattr(const char *path, const char *name, char *value, size_t size)
+{
+  int r = wait_opened();
+  return r ? r : g_ops.getxattr(path, name, value, size);
+}
+
+static int lazy_listxattr(const char *path, char *list, size_t size)
+{
+  int r = wait_opened();
+  return r ? r : g_ops.listxattr(path, list, size);
+}
+
+static int lazy_opendir(const char *path, struct fuse_file_info *fi)
+{
+  int r = wait_opened();
+  return r ? r : g_ops.opendir(path, fi);
+}
+
+static int lazy_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi, enum fuse_readdir_flags flags)
+{
+  int r = wait_opened();
+  return r ? r : g_ops.readdir(path, buf, filler, offset, fi, flags);
+}
+
+static int lazy_releasedir(const char *path, struct fuse_file_info *fi)
+{
+  int r = wait_opened();
+  return r ? r : g_ops.releasedir(path, fi);
+}
+
+static int lazy_fallocate(const char *path, int mode, off_t offset, off_t length, struct fuse_file_info *fi)
+{
+  int r = wait_opened();
+  return r ? r : g_ops.fallocate(path, mode, offset, length, fi);
+}
+
+static ssize_t lazy_copy_file_range(const char *path_in, struct fuse_file_info *fi_in, off_t offset_in, const char *path_out, struct fuse_file_info *fi_out, off_t offset_out, size_t size, int flags)
+{
+  int r = wait_opened();
+  return r ? r : g_ops.copy_file_range(path_in, fi_in, offset_in, path_out, fi_out, offset_out, size, flags);
+}
+
+/********** Public APIs **********/
+
+struct fuse_operations mdbfs_lazy_get_fuse_operations(struct mdbfs_backend *backend, const char *path)
+{
+  g_backend = backend;
+  g_path    = path;
+  g_ops     = backend->get_fuse_operations();
+
+  /* Operations the backend does not implement stay so */
+  struct fuse_operations ret = g_ops;
+
+  ret.init    = lazy_init;
+  ret.destroy = lazy_destroy;
+
+#define WRAP(op) if (g_ops.op) ret.op = lazy_##op
+
+  WRAP(getattr);
+  WRAP(readlink);
+  WRAP(mknod);
+  WRAP(mkdir);
+  WRAP(unlink);
+  WRAP(rmdir);
+  WRAP(rename);
+  WRAP(truncate);
+  WRAP(open);
+  WRAP(read);
+  WRAP(write);
+  WRAP(statfs);
+  WRAP(flush);
+  WRAP(release);
+  WRAP(getxattr);
+  WRAP(listxattr);
+  WRAP(opendir);
+  WRAP(readdir);
+  WRAP(releasedir);
+  WRAP(fallocate);
+  WRAP(copy_file_range);
+
+#undef WRAP
+
+  return ret;
+}
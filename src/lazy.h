@@ -0,0 +1,30 @@
+/**
+ * @file lazy.h
+ *
+ * Opening databases of backends in the background once mounted.
+ */
+
+#ifndef MDBFS_LAZY_H
+#define MDBFS_LAZY_H
+
+#include "mdbfs-config.h"
+#include <fuse.h>
+#include "backend.h"
+
+/**
+ * Get the FUSE operations of a backend, wrapped so that the database is opened
+ * once the file system is mounted, rather than before mounting.
+ *
+ * The database is opened by a thread started from FUSE `init`, so that the
+ * mount is ready at once however long opening takes. Requests arriving
+ * meanwhile wait until it is open; if it cannot be opened, they fail with the
+ * error opening it has failed with (`EIO` if it tells none).
+ *
+ * @param backend [in] The backend. It must be kept until unmounted.
+ * @param path    [in] Path to the database, as given to mdbfs_backend.open. It
+ *                     must be kept likewise.
+ * @return A `struct fuse_operations` for FUSE use.
+ */
+struct fuse_operations mdbfs_lazy_get_fuse_operations(struct mdbfs_backend *backend, const char *path);
+
+#endif
@@ -11,6 +11,7 @@
 #include <stddef.h>
 #include <fuse.h>
 #include "backend.h"
+#include "lazy.h"
 #include "utils/memory.h"
 #include "utils/print.h"
 
@@ -23,6 +24,7 @@ static struct _cmdline_options {
   char *path;      /**< Path to the database file */
   int   show_help; /**< Whether help message should be shown */
   int   show_version; /**< Whether version information should be shown */
+  int   lazy_open; /**< Whether the database should be opened once mounted */
 } cmdline_options;
 
 /**
@@ -44,9 +46,29 @@ static const struct fuse_opt cmdline_option_spec[] = {
   CMDLINE_OPTION("-h", show_help),
   CMDLINE_OPTION("--version", show_version),
   CMDLINE_OPTION("-v", show_version),
+  CMDLINE_OPTION("--lazy-open", lazy_open),
   FUSE_OPT_END,
 };
 
+/**
+ * Process command line options not in cmdline_option_spec.
+ *
+ * Long options (`--name=value`) which are not ours belong to backends, which
+ * take them from the command line themselves (see mdbfs_backend.init); they
+ * are dropped here so that FUSE does not reject them. Everything else is kept
+ * for FUSE.
+ */
+static int cmdline_option_proc(void *data, const char *arg, int key, struct fuse_args *outargs)
+{
+  (void)data;
+  (void)outargs;
+
+  if (key == FUSE_OPT_KEY_OPT && strncmp(arg, "--", 2) == 0)
+    return 0;
+
+  return 1;
+}
+
 /**
  * Print MDBFS-specific help message to stdout.
  */
@@ -61,6 +83,8 @@ void show_help(const char const *progname) {
     "    --db=<s>      Path to the database to mount.\n"
     "                  Depending on the database backend type, this may vary.\n"
     "    --type=<s>    Specify the type of database (backend).\n"
+    "    --lazy-open   Mount at once, and open the database in the background;\n"
+    "                  requests wait until it is open.\n"
     "\n"
     "Help messages from backends:\n"
     "\n"
@@ -102,7 +126,7 @@ int main(int argc, char **argv)
   int r = 0;   /* Value returned by other functions */
 
   /* Deal with command line arguments first */
-  r = fuse_opt_parse(&args, &cmdline_options, cmdline_option_spec, NULL);
+  r = fuse_opt_parse(&args, &cmdline_options, cmdline_option_spec, cmdline_option_proc);
   if (r != 0) {
     ret = 1;
     goto quit;
@@ -152,6 +176,10 @@ int main(int argc, char **argv)
     goto quit;
   }
 
+  /* The database is opened once mounted instead, see lazy.h */
+  if (cmdline_options.lazy_open)
+    goto fusemain;
+
   /* System errors are returned in a negative form */
   r = backend->open(cmdline_options.path);
   if (r <= 0) {
@@ -163,7 +191,9 @@ int main(int argc, char **argv)
 
 fusemain:
   if (backend) {
-    struct fuse_operations fuse_ops = backend->get_fuse_operations();
+    struct fuse_operations fuse_ops = cmdline_options.lazy_open ?
+      mdbfs_lazy_get_fuse_operations(backend, cmdline_options.path) :
+      backend->get_fuse_operations();
     r = fuse_main(args.argc, args.argv, &fuse_ops, NULL);
   } else {
     r = fuse_main(args.argc, args.argv, NULL, NULL);
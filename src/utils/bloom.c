@@ -0,0 +1,132 @@
+/**
+ * @file bloom.c
+ *
+ * Implementation of Bloom filter utilities.
+ */
+
+#include <stdint.h>
+#include "memory.h"
+#include "bloom.h"
+
+/**
+ * Bits probed per key, at most; more would only slow lookups down.
+ */
+#define MDBFS_BLOOM_MAX_HASHES 16
+
+/**
+ * Removals below this many never make a filter stale, so that small tables
+ * are not scanned again and again.
+ */
+#define MDBFS_BLOOM_MIN_STALE_KEYS 1024
+
+struct mdbfs_bloom {
+  uint64_t *words;
+  uint64_t  nbits;    ///< A multiple of 64
+  int       nhashes;  ///< Bits probed per key
+  int64_t   nadded;   ///< Keys added, updated atomically
+  int64_t   nremoved; ///< Keys removed, updated atomically
+};
+
+/**
+ * Hash a key: 64-bit FNV-1a, with the finalizer of MurmurHash3 to spread the
+ * low bits, which FNV leaves poorly mixed for short keys such as integers.
+ */
+static uint64_t bloom_hash(const void *key, size_t key_length)
+{
+  const uint8_t *p = key;
+  uint64_t h = 0xcbf29ce484222325ULL;
+
+  for (size_t i = 0; i < key_length; i++) {
+    h ^= p[i];
+    h *= 0x100000001b3ULL;
+  }
+
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+
+  return h;
+}
+
+struct mdbfs_bloom *mdbfs_bloom_new(size_t size, int64_t expected_keys)
+{
+  struct mdbfs_bloom *ret = mdbfs_malloc0(sizeof(struct mdbfs_bloom));
+  size_t nwords = size / sizeof(uint64_t);
+
+  if (!nwords)
+    nwords = 1;
+
+  ret->words = mdbfs_malloc0(nwords * sizeof(uint64_t));
+  ret->nbits = (uint64_t)nwords * 64;
+
+  /* The false positive rate is lowest with (bits per key) * ln 2 probes; with
+   * no idea of the keys, assume 10 bits per key
+   */
+  if (expected_keys <= 0)
+    expected_keys = ret->nbits / 10 ? ret->nbits / 10 : 1;
+
+  ret->nhashes = (int)((double)ret->nbits / expected_keys * 0.693 + 0.5);
+  if (ret->nhashes < 1)
+    ret->nhashes = 1;
+  if (ret->nhashes > MDBFS_BLOOM_MAX_HASHES)
+    ret->nhashes = MDBFS_BLOOM_MAX_HASHES;
+
+  return ret;
+}
+
+void mdbfs_bloom_free(struct mdbfs_bloom *bloom)
+{
+  if (!bloom)
+    return;
+
+  mdbfs_free(bloom->words);
+  mdbfs_free(bloom);
+}
+
+void mdbfs_bloom_add(struct mdbfs_bloom *bloom, const void *key, size_t key_length)
+{
+  uint64_t h1 = bloom_hash(key, key_length);
+  uint64_t h2 = (h1 >> 32 | h1 << 32) | 1;
+
+  /* Probes are derived from two hashes (Kirsch and Mitzenmacher) */
+  for (int i = 0; i < bloom->nhashes; i++) {
+    uint64_t bit = (h1 + i * h2) % bloom->nbits;
+    __atomic_fetch_or(&bloom->words[bit / 64], (uint64_t)1 << (bit % 64), __ATOMIC_RELAXED);
+  }
+
+  __atomic_add_fetch(&bloom->nadded, 1, __ATOMIC_RELAXED);
+}
+
+void mdbfs_bloom_remove(struct mdbfs_bloom *bloom)
+{
+  __atomic_add_fetch(&bloom->nremoved, 1, __ATOMIC_RELAXED);
+}
+
+int mdbfs_bloom_may_contain(const struct mdbfs_bloom *bloom, const void *key, size_t key_length)
+{
+  uint64_t h1 = bloom_hash(key, key_length);
+  uint64_t h2 = (h1 >> 32 | h1 << 32) | 1;
+
+  for (int i = 0; i < bloom->nhashes; i++) {
+    uint64_t bit = (h1 + i * h2) % bloom->nbits;
+    if (!(__atomic_load_n(&bloom->words[bit / 64], __ATOMIC_RELAXED) & (uint64_t)1 << (bit % 64)))
+      return 0;
+  }
+
+  return 1;
+}
+
+int mdbfs_bloom_is_stale(const struct mdbfs_bloom *bloom)
+{
+  int64_t nadded   = __atomic_load_n(&bloom->nadded, __ATOMIC_RELAXED);
+  int64_t nremoved = __atomic_load_n(&bloom->nremoved, __ATOMIC_RELAXED);
+
+  return nremoved >= MDBFS_BLOOM_MIN_STALE_KEYS && nremoved * 2 > nadded;
+}
+
+size_t mdbfs_bloom_size(const struct mdbfs_bloom *bloom)
+{
+  return bloom->nbits / 8;
+}
@@ -0,0 +1,86 @@
+/**
+ * @file bloom.h
+ *
+ * Public interface of Bloom filter utilities.
+ *
+ * A Bloom filter tells, in a few bits per key, that a key has surely never
+ * been added, so that lookups of keys that do not exist can be answered
+ * without probing the database. Keys that have been added are told as maybe
+ * present, as are a few that have not (false positives). Keys cannot be taken
+ * out; a filter whose keys have mostly been removed is to be built again.
+ *
+ * Adding and testing keys are lock-free and may happen from any thread.
+ */
+
+#ifndef MDBFS_UTIL_BLOOM_H
+#define MDBFS_UTIL_BLOOM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * A Bloom filter.
+ */
+struct mdbfs_bloom;
+
+/**
+ * Create an empty Bloom filter.
+ *
+ * @param size          [in] Memory for the filter, in bytes.
+ * @param expected_keys [in] Number of keys expected to be added, to tune the
+ *                           filter for, or 0 if unknown.
+ * @return The filter, to be freed with mdbfs_bloom_free.
+ */
+struct mdbfs_bloom *mdbfs_bloom_new(size_t size, int64_t expected_keys);
+
+/**
+ * Free a Bloom filter.
+ *
+ * @param bloom [in] The filter. May be NULL.
+ */
+void mdbfs_bloom_free(struct mdbfs_bloom *bloom);
+
+/**
+ * Add a key.
+ *
+ * @param bloom      [in] The filter.
+ * @param key        [in] The key.
+ * @param key_length [in] Length of the key, in bytes.
+ */
+void mdbfs_bloom_add(struct mdbfs_bloom *bloom, const void *key, size_t key_length);
+
+/**
+ * Record that a key has been removed. The key stays in the filter.
+ *
+ * @param bloom [in] The filter.
+ */
+void mdbfs_bloom_remove(struct mdbfs_bloom *bloom);
+
+/**
+ * Tell whether a key may have been added.
+ *
+ * @param bloom      [in] The filter.
+ * @param key        [in] The key.
+ * @param key_length [in] Length of the key, in bytes.
+ * @return 0 if the key has surely not been added, non-zero otherwise.
+ */
+int mdbfs_bloom_may_contain(const struct mdbfs_bloom *bloom, const void *key, size_t key_length);
+
+/**
+ * Tell whether most keys added have since been removed, so that the filter is
+ * better built again.
+ *
+ * @param bloom [in] The filter.
+ * @return Non-zero if so, 0 otherwise.
+ */
+int mdbfs_bloom_is_stale(const struct mdbfs_bloom *bloom);
+
+/**
+ * Get the memory taken by a Bloom filter.
+ *
+ * @param bloom [in] The filter.
+ * @return Size of the filter, in bytes.
+ */
+size_t mdbfs_bloom_size(const struct mdbfs_bloom *bloom);
+
+#endif
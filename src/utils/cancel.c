@@ -0,0 +1,74 @@
+/**
+ * @file cancel.c
+ *
+ * Implementation of cancellation utilities.
+ */
+
+#include <errno.h>
+#include <time.h>
+#include "cancel.h"
+
+static int64_t g_timeout_ms = 0;
+
+/**
+ * The scope open on each thread.
+ */
+static __thread int             t_depth = 0;
+static __thread int           (*t_interrupted)(void) = NULL;
+static __thread struct timespec t_deadline;
+static __thread int             t_cancelled = 0; ///< Why the work is given up, if it is
+
+void mdbfs_cancel_set_timeout(int64_t timeout_ms)
+{
+  g_timeout_ms = timeout_ms > 0 ? timeout_ms : 0;
+}
+
+void mdbfs_cancel_begin(int (*interrupted)(void))
+{
+  if (t_depth++)
+    return;
+
+  t_interrupted = interrupted;
+  t_cancelled = 0;
+
+  if (g_timeout_ms) {
+    clock_gettime(CLOCK_MONOTONIC, &t_deadline);
+    t_deadline.tv_sec  += g_timeout_ms / 1000;
+    t_deadline.tv_nsec += (g_timeout_ms % 1000) * 1000000;
+    if (t_deadline.tv_nsec >= 1000000000) {
+      t_deadline.tv_sec  += 1;
+      t_deadline.tv_nsec -= 1000000000;
+    }
+  }
+}
+
+int mdbfs_cancel_check(void)
+{
+  if (!t_depth || t_cancelled)
+    return t_cancelled;
+
+  if (t_interrupted && t_interrupted()) {
+    t_cancelled = EINTR;
+  } else if (g_timeout_ms) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    if (now.tv_sec > t_deadline.tv_sec ||
+        (now.tv_sec == t_deadline.tv_sec && now.tv_nsec >= t_deadline.tv_nsec))
+      t_cancelled = ETIMEDOUT;
+  }
+
+  return t_cancelled;
+}
+
+int mdbfs_cancel_end(void)
+{
+  int ret = t_cancelled;
+
+  if (t_depth && !--t_depth) {
+    t_interrupted = NULL;
+    t_cancelled = 0;
+  }
+
+  return ret;
+}
@@ -0,0 +1,54 @@
+/**
+ * @file cancel.h
+ *
+ * Public interface of cancellation utilities.
+ *
+ * Backend work done for a FUSE request can be given up once the request is
+ * interrupted (e.g. by Ctrl-C on `ls`) or once it has run for longer than
+ * allowed, so that a worker is not pinned by a caller who has gone. A request
+ * opens a scope with mdbfs_cancel_begin on its thread, and long-running work
+ * polls mdbfs_cancel_check within it.
+ */
+
+#ifndef MDBFS_UTIL_CANCEL_H
+#define MDBFS_UTIL_CANCEL_H
+
+#include <stdint.h>
+
+/**
+ * Set how long a request may run before it is given up.
+ *
+ * @param timeout_ms [in] Milliseconds, or 0 for no limit.
+ */
+void mdbfs_cancel_set_timeout(int64_t timeout_ms);
+
+/**
+ * Open a cancellable scope on the calling thread. Scopes may nest, in which
+ * case the outermost one counts.
+ *
+ * @param interrupted [in] Function telling whether the request has been
+ *                         interrupted, e.g. fuse_interrupted. May be NULL.
+ */
+void mdbfs_cancel_begin(int (*interrupted)(void));
+
+/**
+ * Tell whether the work on the calling thread is to be given up. Once it is,
+ * it stays so until the scope is closed.
+ *
+ * @return 0 outside of a scope or if the work may go on, EINTR if the request
+ *         has been interrupted, or ETIMEDOUT if it has run out of time.
+ */
+int mdbfs_cancel_check(void);
+
+/**
+ * Close a cancellable scope on the calling thread.
+ *
+ * Work that has finished before being given up is not given up here, however
+ * late it has finished.
+ *
+ * @return Why the work has been given up (see mdbfs_cancel_check), or 0 if it
+ *         has not.
+ */
+int mdbfs_cancel_end(void);
+
+#endif
@@ -0,0 +1,148 @@
+/**
+ * @file escape.c
+ *
+ * Implementation of text escaping utilities.
+ *
+ * Three implementations of mdbfs_escape_span are provided: a scalar one which
+ * works everywhere, and SSE2 and AVX2 ones on x86. The fastest one the CPU
+ * supports is picked when the program is loaded.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include "escape.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define MDBFS_ESCAPE_X86 1
+#include <immintrin.h>
+#endif
+
+/**
+ * Bytes of a set. Each set has up to 4 bytes (repeated to fill the slots), and
+ * optionally all control characters.
+ */
+static const struct {
+  unsigned char bytes[4];
+  int control;
+} escape_sets[] = {
+  [MDBFS_ESCAPE_SET_CSV]  = {{',',  '"',  '\r', '\n'}, 0},
+  [MDBFS_ESCAPE_SET_TSV]  = {{'\t', '\n', '\r', '\\'}, 0},
+  [MDBFS_ESCAPE_SET_JSON] = {{'"',  '\\', '"',  '\\'}, 1},
+};
+
+/********** Private APIs **********/
+
+static size_t escape_span_scalar(enum mdbfs_escape_set set, const char *data, size_t length, size_t start)
+{
+  const unsigned char *bytes = escape_sets[set].bytes;
+  int control = escape_sets[set].control;
+
+  for (size_t i = start; i < length; i++) {
+    unsigned char c = data[i];
+
+    if (c == bytes[0] || c == bytes[1] || c == bytes[2] || c == bytes[3] || (control && c < 0x20))
+      return i;
+  }
+
+  return length;
+}
+
+static size_t escape_span_generic(enum mdbfs_escape_set set, const char *data, size_t length)
+{
+  return escape_span_scalar(set, data, length, 0);
+}
+
+#ifdef MDBFS_ESCAPE_X86
+
+__attribute__((target("sse2")))
+static size_t escape_span_sse2(enum mdbfs_escape_set set, const char *data, size_t length)
+{
+  const unsigned char *bytes = escape_sets[set].bytes;
+  const __m128i b0 = _mm_set1_epi8(bytes[0]);
+  const __m128i b1 = _mm_set1_epi8(bytes[1]);
+  const __m128i b2 = _mm_set1_epi8(bytes[2]);
+  const __m128i b3 = _mm_set1_epi8(bytes[3]);
+  const __m128i limit = _mm_set1_epi8(0x1f);
+  const __m128i control = _mm_set1_epi8(escape_sets[set].control ? -1 : 0);
+  size_t i = 0;
+
+  for (; i + 16 <= length; i += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i *)(data + i));
+
+    /* x <= 0x1f iff max(x, 0x1f) == 0x1f, compared unsigned */
+    __m128i hit = _mm_and_si128(_mm_cmpeq_epi8(_mm_max_epu8(x, limit), limit), control);
+    hit = _mm_or_si128(hit, _mm_cmpeq_epi8(x, b0));
+    hit = _mm_or_si128(hit, _mm_cmpeq_epi8(x, b1));
+    hit = _mm_or_si128(hit, _mm_cmpeq_epi8(x, b2));
+    hit = _mm_or_si128(hit, _mm_cmpeq_epi8(x, b3));
+
+    unsigned mask = _mm_movemask_epi8(hit);
+    if (mask)
+      return i + __builtin_ctz(mask);
+  }
+
+  return escape_span_scalar(set, data, length, i);
+}
+
+__attribute__((target("avx2")))
+static size_t escape_span_avx2(enum mdbfs_escape_set set, const char *data, size_t length)
+{
+  const unsigned char *bytes = escape_sets[set].bytes;
+  const __m256i b0 = _mm256_set1_epi8(bytes[0]);
+  const __m256i b1 = _mm256_set1_epi8(bytes[1]);
+  const __m256i b2 = _mm256_set1_epi8(bytes[2]);
+  const __m256i b3 = _mm256_set1_epi8(bytes[3]);
+  const __m256i limit = _mm256_set1_epi8(0x1f);
+  const __m256i control = _mm256_set1_epi8(escape_sets[set].control ? -1 : 0);
+  size_t i = 0;
+
+  for (; i + 32 <= length; i += 32) {
+    __m256i x = _mm256_loadu_si256((const __m256i *)(data + i));
+
+    /* x <= 0x1f iff max(x, 0x1f) == 0x1f, compared unsigned */
+    __m256i hit = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(x, limit), limit), control);
+    hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(x, b0));
+    hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(x, b1));
+    hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(x, b2));
+    hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(x, b3));
+
+    unsigned mask = (unsigned)_mm256_movemask_epi8(hit);
+    if (mask)
+      return i + __builtin_ctz(mask);
+  }
+
+  /* The tail is short; let SSE2 (and then the scalar loop) finish it */
+  return i + escape_span_sse2(set, data + i, length - i);
+}
+
+#endif
+
+/**
+ * The implementation in use, see escape_select.
+ */
+static size_t (*escape_span_impl)(enum mdbfs_escape_set, const char *, size_t) = escape_span_generic;
+
+#ifdef MDBFS_ESCAPE_X86
+
+/**
+ * Pick the fastest implementation the CPU supports, once, before main.
+ */
+__attribute__((constructor))
+static void escape_select(void)
+{
+  __builtin_cpu_init();
+
+  if (__builtin_cpu_supports("avx2"))
+    escape_span_impl = escape_span_avx2;
+  else if (__builtin_cpu_supports("sse2"))
+    escape_span_impl = escape_span_sse2;
+}
+
+#endif
+
+/********** Public APIs **********/
+
+size_t mdbfs_escape_span(enum mdbfs_escape_set set, const char *data, size_t length)
+{
+  return escape_span_impl(set, data, length);
+}
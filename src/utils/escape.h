@@ -0,0 +1,35 @@
+/**
+ * @file escape.h
+ *
+ * Public interface of text escaping utilities.
+ *
+ * Escaping text is done by finding runs of bytes that can be copied as-is, and
+ * escaping the byte ending each run. Finding runs is vectorized where the CPU
+ * allows, which is chosen once at run time.
+ */
+
+#ifndef MDBFS_UTIL_ESCAPE_H
+#define MDBFS_UTIL_ESCAPE_H
+
+#include <stddef.h>
+
+/**
+ * Sets of bytes which must be escaped in a format.
+ */
+enum mdbfs_escape_set {
+  MDBFS_ESCAPE_SET_CSV,  ///< `,` `"` CR LF, which require a field to be quoted
+  MDBFS_ESCAPE_SET_TSV,  ///< TAB LF CR `\`
+  MDBFS_ESCAPE_SET_JSON, ///< `"` `\` and control characters (< 0x20)
+};
+
+/**
+ * Find the length of the longest prefix of data that needs no escaping.
+ *
+ * @param set    [in] The set of bytes to be escaped.
+ * @param data   [in] The data to scan.
+ * @param length [in] Length of the data.
+ * @return Offset of the first byte in the set, or `length` if there is none.
+ */
+size_t mdbfs_escape_span(enum mdbfs_escape_set set, const char *data, size_t length);
+
+#endif
@@ -0,0 +1,100 @@
+/**
+ * @file format.c
+ *
+ * Implementation of number formatting utilities.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "format.h"
+
+/**
+ * "00" to "99", so that integers are written two digits at a time.
+ */
+static const char digit_pairs[201] =
+  "00010203040506070809"
+  "10111213141516171819"
+  "20212223242526272829"
+  "30313233343536373839"
+  "40414243444546474849"
+  "50515253545556575859"
+  "60616263646566676869"
+  "70717273747576777879"
+  "80818283848586878889"
+  "90919293949596979899";
+
+size_t mdbfs_format_int64(char *buf, int64_t value)
+{
+  char digits[20];
+  char *p = digits + sizeof(digits);
+  size_t length = 0;
+
+  /* Work on the magnitude unsigned, so that INT64_MIN does not overflow */
+  uint64_t magnitude = value < 0 ? -(uint64_t)value : (uint64_t)value;
+
+  while (magnitude >= 100) {
+    unsigned pair = magnitude % 100;
+    magnitude /= 100;
+    p -= 2;
+    memcpy(p, digit_pairs + pair * 2, 2);
+  }
+
+  if (magnitude >= 10) {
+    p -= 2;
+    memcpy(p, digit_pairs + magnitude * 2, 2);
+  } else {
+    *--p = '0' + magnitude;
+  }
+
+  if (value < 0)
+    buf[length++] = '-';
+
+  size_t ndigits = digits + sizeof(digits) - p;
+  memcpy(buf + length, p, ndigits);
+  length += ndigits;
+
+  buf[length] = '\0';
+  return length;
+}
+
+size_t mdbfs_format_double(char *buf, double value)
+{
+  if (isnan(value)) {
+    strcpy(buf, "NaN");
+    return 3;
+  }
+
+  if (isinf(value)) {
+    strcpy(buf, value < 0 ? "-Inf" : "Inf");
+    return value < 0 ? 4 : 3;
+  }
+
+  /* Integral values which a 64-bit integer holds exactly are the common case
+   * (counts, prices in cents, timestamps); write them as integers
+   */
+  if (value == trunc(value) && fabs(value) < 1e15) {
+    size_t length = 0;
+
+    if (value == 0 && signbit(value))
+      buf[length++] = '-';
+
+    length += mdbfs_format_int64(buf + length, (int64_t)value);
+    memcpy(buf + length, ".0", 3);
+    return length + 2;
+  }
+
+  /* Otherwise find the fewest significant digits that read back exactly; 17
+   * always do
+   */
+  int length = 0;
+
+  for (int precision = 15; precision <= 17; precision++) {
+    length = snprintf(buf, MDBFS_FORMAT_NUMBER_MAX, "%.*g", precision, value);
+    if (strtod(buf, NULL) == value)
+      break;
+  }
+
+  return length;
+}
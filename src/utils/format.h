@@ -0,0 +1,44 @@
+/**
+ * @file format.h
+ *
+ * Public interface of number formatting utilities.
+ *
+ * These write numbers as text straight into a caller's buffer, without going
+ * through the locale machinery of printf for the common cases.
+ */
+
+#ifndef MDBFS_UTIL_FORMAT_H
+#define MDBFS_UTIL_FORMAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Size of a buffer large enough for any number formatted by these functions,
+ * including a terminating NUL.
+ */
+#define MDBFS_FORMAT_NUMBER_MAX 32
+
+/**
+ * Write a 64-bit integer in decimal.
+ *
+ * @param buf   [out] Buffer of at least `MDBFS_FORMAT_NUMBER_MAX` bytes.
+ * @param value [in]  The integer.
+ * @return Length of the text, without the terminating NUL.
+ */
+size_t mdbfs_format_int64(char *buf, int64_t value);
+
+/**
+ * Write a double in the shortest form that reads back as the same double.
+ *
+ * Integral values are written with a trailing `.0` (as SQLite does), so that
+ * they are not mistaken for integers. Infinities are written as `Inf` and
+ * `-Inf`, and NaN as `NaN`.
+ *
+ * @param buf   [out] Buffer of at least `MDBFS_FORMAT_NUMBER_MAX` bytes.
+ * @param value [in]  The double.
+ * @return Length of the text, without the terminating NUL.
+ */
+size_t mdbfs_format_double(char *buf, double value);
+
+#endif
@@ -43,4 +43,6 @@ void *mdbfs_realloc(void *ptr, size_t size)
 
     abort();
   }
+
+  return ret;
 }
@@ -0,0 +1,90 @@
+/**
+ * @file metrics.c
+ *
+ * Implementation of metrics utilities.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include "memory.h"
+#include "metrics.h"
+
+struct mdbfs_metric {
+  const char *name;
+  int64_t value;
+  struct mdbfs_metric *next;
+};
+
+/**
+ * Registered metrics, newest first. Entries are never removed, so the list can
+ * be walked without the lock once a pointer to an entry is taken.
+ */
+static struct mdbfs_metric *g_metrics = NULL;
+static pthread_mutex_t      g_metrics_lock = PTHREAD_MUTEX_INITIALIZER;
+
+struct mdbfs_metric *mdbfs_metric_get(const char *name)
+{
+  struct mdbfs_metric *ret = NULL;
+
+  pthread_mutex_lock(&g_metrics_lock);
+
+  for (ret = g_metrics; ret; ret = ret->next)
+    if (strcmp(ret->name, name) == 0)
+      goto quit;
+
+  ret = mdbfs_malloc0(sizeof(struct mdbfs_metric));
+  ret->name = name;
+  ret->next = g_metrics;
+  g_metrics = ret;
+
+quit:
+  pthread_mutex_unlock(&g_metrics_lock);
+  return ret;
+}
+
+void mdbfs_metric_add(struct mdbfs_metric *metric, int64_t delta)
+{
+  __atomic_add_fetch(&metric->value, delta, __ATOMIC_RELAXED);
+}
+
+void mdbfs_metric_set(struct mdbfs_metric *metric, int64_t value)
+{
+  __atomic_store_n(&metric->value, value, __ATOMIC_RELAXED);
+}
+
+int64_t mdbfs_metric_value(struct mdbfs_metric *metric)
+{
+  return __atomic_load_n(&metric->value, __ATOMIC_RELAXED);
+}
+
+char *mdbfs_metrics_dump(size_t *length)
+{
+  char *ret = NULL;
+  size_t ret_length = 0;
+  size_t nmetrics = 0;
+
+  pthread_mutex_lock(&g_metrics_lock);
+
+  for (struct mdbfs_metric *metric = g_metrics; metric; metric = metric->next) {
+    ret_length += strlen(metric->name) + 1 + 20 + 1; /* name, space, value, LF */
+    nmetrics += 1;
+  }
+
+  /* Print the oldest first, so that the order is stable as metrics appear */
+  struct mdbfs_metric **metrics = mdbfs_malloc0((nmetrics + 1) * sizeof(struct mdbfs_metric *));
+  size_t i = nmetrics;
+  for (struct mdbfs_metric *metric = g_metrics; metric; metric = metric->next)
+    metrics[--i] = metric;
+
+  pthread_mutex_unlock(&g_metrics_lock);
+
+  ret = mdbfs_malloc0(ret_length + 1);
+  *length = 0;
+
+  for (i = 0; i < nmetrics; i++)
+    *length += sprintf(ret + *length, "%s %lld\n", metrics[i]->name, (long long)mdbfs_metric_value(metrics[i]));
+
+  mdbfs_free(metrics);
+  return ret;
+}
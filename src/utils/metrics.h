@@ -0,0 +1,68 @@
+/**
+ * @file metrics.h
+ *
+ * Public interface of metrics utilities.
+ *
+ * A metric is a named 64-bit value, either a counter that only goes up or a
+ * gauge that is set. Metrics are registered on first use and live as long as
+ * the program; updating one is a single atomic operation, so that they can be
+ * updated from hot paths and any thread.
+ */
+
+#ifndef MDBFS_UTIL_METRICS_H
+#define MDBFS_UTIL_METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * A metric.
+ */
+struct mdbfs_metric;
+
+/**
+ * Get the metric with the given name, registering it if it does not exist.
+ *
+ * Callers on hot paths should keep the returned pointer instead of looking it
+ * up every time.
+ *
+ * @param name [in] Name of the metric, e.g. `sqlite_rows_imported`. The string
+ *                  must live as long as the program (e.g. a literal).
+ * @return The metric, which is never freed.
+ */
+struct mdbfs_metric *mdbfs_metric_get(const char *name);
+
+/**
+ * Add to a metric.
+ *
+ * @param metric [in] The metric.
+ * @param delta  [in] The value to add.
+ */
+void mdbfs_metric_add(struct mdbfs_metric *metric, int64_t delta);
+
+/**
+ * Set a metric.
+ *
+ * @param metric [in] The metric.
+ * @param value  [in] The new value.
+ */
+void mdbfs_metric_set(struct mdbfs_metric *metric, int64_t value);
+
+/**
+ * Read a metric.
+ *
+ * @param metric [in] The metric.
+ * @return The current value.
+ */
+int64_t mdbfs_metric_value(struct mdbfs_metric *metric);
+
+/**
+ * Print all metrics, one `name value` per line, in the order they are
+ * registered.
+ *
+ * @param length [out] Length of the returned text.
+ * @return The text, which the caller is responsible for freeing.
+ */
+char *mdbfs_metrics_dump(size_t *length);
+
+#endif
@@ -0,0 +1,61 @@
+/**
+ * @file options.c
+ *
+ * Implementation of backend option utilities.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "memory.h"
+#include "options.h"
+
+const char *mdbfs_option_get(int argc, char **argv, const char *name)
+{
+  const char *ret = NULL;
+  size_t name_length = strlen(name);
+
+  for (int i = 1; i < argc && argv[i]; i++) {
+    const char *arg = argv[i];
+
+    if (strncmp(arg, "--", 2) == 0 && strncmp(arg + 2, name, name_length) == 0 && arg[2 + name_length] == '=')
+      ret = arg + 2 + name_length + 1;
+  }
+
+  return ret;
+}
+
+int64_t mdbfs_option_get_int(int argc, char **argv, const char *name, int64_t fallback)
+{
+  const char *value = mdbfs_option_get(argc, argv, name);
+  char *value_end = NULL;
+
+  if (!value)
+    return fallback;
+
+  errno = 0;
+  long long ret = strtoll(value, &value_end, 10);
+  if (!*value || *value_end || errno == ERANGE || ret < 0)
+    return -1;
+
+  return ret;
+}
+
+const char **mdbfs_option_get_all(int argc, char **argv, const char *name)
+{
+  const char **ret = mdbfs_malloc0(sizeof(const char *));
+  size_t ret_length = 0;
+  size_t name_length = strlen(name);
+
+  for (int i = 1; i < argc && argv[i]; i++) {
+    const char *arg = argv[i];
+
+    if (strncmp(arg, "--", 2) == 0 && strncmp(arg + 2, name, name_length) == 0 && arg[2 + name_length] == '=') {
+      ret = mdbfs_realloc(ret, (ret_length + 2) * sizeof(const char *));
+      ret[ret_length++] = arg + 2 + name_length + 1;
+      ret[ret_length] = NULL;
+    }
+  }
+
+  return ret;
+}
@@ -0,0 +1,51 @@
+/**
+ * @file options.h
+ *
+ * Public interface of backend option utilities.
+ *
+ * Backends take their own command line options in the form of `--name=value`,
+ * which the main program leaves to them (see mdbfs_backend.init).
+ */
+
+#ifndef MDBFS_UTIL_OPTIONS_H
+#define MDBFS_UTIL_OPTIONS_H
+
+#include <stdint.h>
+
+/**
+ * Find the value of an option `--name=value` in the command line.
+ *
+ * If the option is given more than once, the last one wins.
+ *
+ * @param argc [in] Argument count from command line.
+ * @param argv [in] Argument vector from command line.
+ * @param name [in] Name of the option, without the leading dashes.
+ * @return The value, pointing into argv, or NULL if the option is not given.
+ */
+const char *mdbfs_option_get(int argc, char **argv, const char *name);
+
+/**
+ * Same as mdbfs_option_get, for options taking a non-negative integer.
+ *
+ * @param argc     [in] Argument count from command line.
+ * @param argv     [in] Argument vector from command line.
+ * @param name     [in] Name of the option, without the leading dashes.
+ * @param fallback [in] Value to return if the option is not given.
+ * @return The value, or -1 if the option is given but is not a non-negative
+ *         integer.
+ */
+int64_t mdbfs_option_get_int(int argc, char **argv, const char *name, int64_t fallback);
+
+/**
+ * Same as mdbfs_option_get, for options which may be given more than once.
+ *
+ * @param argc [in] Argument count from command line.
+ * @param argv [in] Argument vector from command line.
+ * @param name [in] Name of the option, without the leading dashes.
+ * @return NULL-terminated list of the values in the order they are given,
+ *         pointing into argv. The caller is responsible for freeing the list
+ *         (but not the values) with mdbfs_free.
+ */
+const char **mdbfs_option_get_all(int argc, char **argv, const char *name);
+
+#endif
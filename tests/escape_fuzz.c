@@ -0,0 +1,198 @@
+/**
+ * @file escape_fuzz.c
+ *
+ * Fuzz test and microbenchmark of text escaping utilities.
+ *
+ * The vectorized implementations of mdbfs_escape_span must agree with the
+ * scalar one on every input. They are compared on random buffers of every
+ * length up to a few vectors, at every misalignment, and then timed against
+ * the scalar loop on a long buffer. The implementations are static, so the
+ * source is included here directly.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "escape.c"
+
+/**
+ * Lengths are tried from 0 to this, which covers every tail of both vectors.
+ */
+#define ESCAPE_FUZZ_MAX_LENGTH 80
+
+/**
+ * Misalignments are tried from 0 to this (exclusive), the width of AVX2.
+ */
+#define ESCAPE_FUZZ_MAX_OFFSET 32
+
+/**
+ * Random buffers tried for each set, length and misalignment.
+ */
+#define ESCAPE_FUZZ_ROUNDS 16
+
+/**
+ * Size of the buffer timed, and times it is scanned.
+ */
+#define ESCAPE_BENCH_LENGTH (1 << 20)
+#define ESCAPE_BENCH_ROUNDS 256
+
+typedef size_t (*escape_span_fn)(enum mdbfs_escape_set, const char *, size_t);
+
+static const struct {
+  const char     *name;
+  escape_span_fn  fn;
+  const char     *feature; ///< CPU feature required, or NULL
+} impls[] = {
+  {"scalar", escape_span_generic, NULL},
+#ifdef MDBFS_ESCAPE_X86
+  {"sse2",   escape_span_sse2,    "sse2"},
+  {"avx2",   escape_span_avx2,    "avx2"},
+#endif
+};
+
+static const char *set_names[] = {
+  [MDBFS_ESCAPE_SET_CSV]  = "csv",
+  [MDBFS_ESCAPE_SET_TSV]  = "tsv",
+  [MDBFS_ESCAPE_SET_JSON] = "json",
+};
+
+static int impl_supported(size_t i)
+{
+  if (!impls[i].feature)
+    return 1;
+
+#ifdef MDBFS_ESCAPE_X86
+  /* __builtin_cpu_supports only takes literals */
+  if (strcmp(impls[i].feature, "avx2") == 0)
+    return __builtin_cpu_supports("avx2");
+  if (strcmp(impls[i].feature, "sse2") == 0)
+    return __builtin_cpu_supports("sse2");
+#endif
+
+  return 0;
+}
+
+/**
+ * Fill a buffer with random bytes, hitting a set rarely enough that runs of
+ * every length occur. Bytes with the high bit set are included, so that
+ * signed and unsigned comparisons are told apart.
+ */
+static void fill_random(char *data, size_t length)
+{
+  for (size_t i = 0; i < length; i++) {
+    if (rand() % 4 == 0)
+      data[i] = (char)(rand() % 256);
+    else
+      data[i] = (char)(0x20 + rand() % 0x5f);
+
+    /* Keep most bytes out of every set, or matches would be found too early */
+    if (rand() % 8 != 0 && data[i] != '\0' && strchr(",\"\r\n\t\\", data[i]))
+      data[i] = 'a';
+    if (rand() % 8 != 0 && (unsigned char)data[i] < 0x20)
+      data[i] = 'b';
+  }
+}
+
+static int fuzz(void)
+{
+  static char buffer[ESCAPE_FUZZ_MAX_OFFSET + ESCAPE_FUZZ_MAX_LENGTH + 1];
+  int failures = 0;
+
+  for (int set = 0; set <= MDBFS_ESCAPE_SET_JSON; set++) {
+    for (size_t length = 0; length <= ESCAPE_FUZZ_MAX_LENGTH; length++) {
+      for (size_t offset = 0; offset < ESCAPE_FUZZ_MAX_OFFSET; offset++) {
+        for (int round = 0; round < ESCAPE_FUZZ_ROUNDS; round++) {
+          char *data = buffer + offset;
+
+          /* Bytes past the end may match; they must never be reported */
+          fill_random(buffer, sizeof(buffer));
+          data[length] = '"';
+
+          size_t expected = escape_span_scalar(set, data, length, 0);
+          size_t got_public = mdbfs_escape_span(set, data, length);
+
+          if (got_public != expected) {
+            fprintf(stderr, "FAIL dispatch %s length %zu offset %zu: %zu != %zu\n",
+                    set_names[set], length, offset, got_public, expected);
+            failures++;
+          }
+
+          for (size_t i = 0; i < sizeof(impls) / sizeof(impls[0]); i++) {
+            if (!impl_supported(i))
+              continue;
+
+            size_t got = impls[i].fn(set, data, length);
+            if (got != expected) {
+              fprintf(stderr, "FAIL %s %s length %zu offset %zu: %zu != %zu\n",
+                      impls[i].name, set_names[set], length, offset, got, expected);
+              failures++;
+            }
+          }
+        }
+      }
+    }
+  }
+
+  return failures;
+}
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void bench(void)
+{
+  char *data = malloc(ESCAPE_BENCH_LENGTH);
+  if (!data)
+    return;
+
+  /* A long run of plain text, the common case of exported cells */
+  for (size_t i = 0; i < ESCAPE_BENCH_LENGTH; i++)
+    data[i] = (char)('a' + i % 26);
+
+  for (int set = 0; set <= MDBFS_ESCAPE_SET_JSON; set++) {
+    double scalar = 0;
+
+    for (size_t i = 0; i < sizeof(impls) / sizeof(impls[0]); i++) {
+      if (!impl_supported(i)) {
+        printf("%-4s %-6s unsupported by this CPU\n", set_names[set], impls[i].name);
+        continue;
+      }
+
+      volatile size_t sink = 0;
+      double start = now();
+      for (int round = 0; round < ESCAPE_BENCH_ROUNDS; round++)
+        sink += impls[i].fn(set, data, ESCAPE_BENCH_LENGTH);
+      double elapsed = now() - start;
+      (void)sink;
+
+      if (i == 0)
+        scalar = elapsed;
+
+      double mbps = (double)ESCAPE_BENCH_LENGTH * ESCAPE_BENCH_ROUNDS / elapsed / 1e6;
+      printf("%-4s %-6s %10.1f MB/s  %5.2fx scalar\n",
+             set_names[set], impls[i].name, mbps, elapsed > 0 ? scalar / elapsed : 0);
+    }
+  }
+
+  free(data);
+}
+
+int main(void)
+{
+  srand(0x6d646266);
+
+  int failures = fuzz();
+  if (failures) {
+    fprintf(stderr, "%d mismatches against the scalar implementation\n", failures);
+    return 1;
+  }
+
+  printf("All implementations agree with the scalar one\n");
+  bench();
+  return 0;
+}